@@ -0,0 +1,127 @@
+// Measures the heap allocations and time spent per MiB downloaded, as 256
+// MiB of 256 KiB pieces arrive in 16 KiB blocks. The former path zeroed a
+// fresh vector per piece, built every request in a vector and parsed each
+// block message into two more copies; the pooled path takes the piece and
+// the requests from the BufferPool and reads blocks straight into place.
+// Hashing and disk writes are the same for both and left out.
+#include "BufferPool/BufferPool.h"
+#include "Logger/Logger.h"
+#include "Message/Message.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <vector>
+
+std::ostringstream Logger::null_stream_;
+
+namespace {
+
+size_t heap_allocations = 0;
+
+const uint32_t PIECE_SIZE = 256 * 1024;
+const uint32_t BLOCK = 16 * 1024;
+const uint32_t PIECES = 1024;
+const double MEBIBYTES = double(PIECE_SIZE) * PIECES / (1024 * 1024);
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+void put_uint32(std::byte *out, uint32_t value) {
+  for (int i = 0; i < 4; ++i) {
+    out[i] = static_cast<std::byte>(value >> (24 - 8 * i));
+  }
+}
+
+/**
+ * @brief Downloads through vectors, as connections did before the pool.
+ */
+double download_with_vectors(const std::vector<std::byte> &wire,
+                             size_t &checksum) {
+  std::vector<std::byte> read_buffer;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t piece = 0; piece < PIECES; ++piece) {
+    std::vector<std::byte> piece_data(PIECE_SIZE);
+    for (uint32_t begin = 0; begin < PIECE_SIZE; begin += BLOCK) {
+      std::vector<std::byte> request(17, std::byte{0});
+      put_uint32(&request[5], piece);
+      checksum += std::to_integer<size_t>(request[5]);
+
+      // The whole message is read, then parsed into a payload and a block
+      read_buffer.resize(4);
+      read_buffer.resize(wire.size());
+      std::memcpy(read_buffer.data(), wire.data(), wire.size());
+      Message message = Message::parseMessage(read_buffer);
+      const auto &block = std::get<PieceData>(message.payload).block;
+      std::copy(block.begin(), block.end(), piece_data.begin() + begin);
+      read_buffer.clear();
+    }
+    checksum += std::to_integer<size_t>(piece_data[piece % PIECE_SIZE]);
+  }
+  return elapsed_ms(start);
+}
+
+/**
+ * @brief Downloads through pooled buffers.
+ */
+double download_with_pool(const std::vector<std::byte> &wire,
+                          size_t &checksum) {
+  BufferPool &pool = BufferPool::instance();
+  std::vector<std::byte> header(13);
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t piece = 0; piece < PIECES; ++piece) {
+    Buffer piece_data = pool.acquire(PIECE_SIZE);
+    for (uint32_t begin = 0; begin < PIECE_SIZE; begin += BLOCK) {
+      Buffer request = pool.acquire(17);
+      put_uint32(&request[5], piece);
+      checksum += std::to_integer<size_t>(request[5]);
+
+      // The header is read on its own, the block lands in the piece
+      std::memcpy(header.data(), wire.data(), header.size());
+      std::memcpy(piece_data.data() + begin, wire.data() + header.size(),
+                  BLOCK);
+    }
+    checksum += std::to_integer<size_t>(piece_data[piece % PIECE_SIZE]);
+  }
+  return elapsed_ms(start);
+}
+
+} // namespace
+
+void *operator new(size_t size) {
+  ++heap_allocations;
+  if (void *memory = std::malloc(size == 0 ? 1 : size)) {
+    return memory;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *memory) noexcept { std::free(memory); }
+void operator delete(void *memory, size_t) noexcept { std::free(memory); }
+
+int main() {
+  std::vector<std::byte> wire(13 + BLOCK, std::byte{0x5a});
+  put_uint32(wire.data(), 9 + BLOCK);
+  wire[4] = std::byte{7};
+
+  size_t checksum = 0;
+  size_t before = heap_allocations;
+  double vector_ms = download_with_vectors(wire, checksum);
+  size_t vector_allocations = heap_allocations - before;
+
+  before = heap_allocations;
+  double pool_ms = download_with_pool(wire, checksum);
+  size_t pool_allocations = heap_allocations - before;
+
+  std::cout << MEBIBYTES << " MiB in " << BLOCK / 1024 << " KiB blocks\n"
+            << "vectors:     " << vector_allocations / MEBIBYTES
+            << " allocations per MiB, " << vector_ms << " ms\n"
+            << "buffer pool: " << pool_allocations / MEBIBYTES
+            << " allocations per MiB, " << pool_ms << " ms\n"
+            << "(checksum " << checksum << ")" << std::endl;
+  return 0;
+}
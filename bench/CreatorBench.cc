@@ -0,0 +1,102 @@
+// Measures .torrent creation throughput on a 10 GiB tree (override the size
+// with YATC_BENCH_GIB, or pass an existing directory as the first argument).
+// The page cache is dropped for every file before each run, so the numbers
+// include reading from disk.
+#include "Logger/Logger.h"
+#include "TorrentCreator/TorrentCreator.h"
+#include <chrono>
+#include <cstdlib>
+#include <fcntl.h>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <unistd.h>
+
+std::ostringstream Logger::null_stream_;
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const uint64_t BENCH_FILE_SIZE = 256ull * 1024 * 1024;
+
+void generate_tree(const std::string &root, uint64_t total_size) {
+  std::mt19937_64 random(42);
+  std::vector<uint64_t> block(1024 * 1024 / sizeof(uint64_t));
+
+  for (uint64_t written = 0, index = 0; written < total_size; ++index) {
+    fs::path path = fs::path(root) / ("dir" + std::to_string(index % 8)) /
+                    ("file" + std::to_string(index) + ".bin");
+    fs::create_directories(path.parent_path());
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    uint64_t size = std::min(BENCH_FILE_SIZE, total_size - written);
+    for (uint64_t done = 0; done < size;) {
+      for (auto &word : block) {
+        word = random();
+      }
+      uint64_t length = std::min<uint64_t>(block.size() * 8, size - done);
+      if (write(fd, block.data(), length) != static_cast<ssize_t>(length)) {
+        std::cerr << "Failed to generate " << path << std::endl;
+        std::exit(1);
+      }
+      done += length;
+    }
+    fsync(fd);
+    close(fd);
+    written += size;
+  }
+}
+
+void drop_cache(const std::string &root) {
+  for (const auto &entry : fs::recursive_directory_iterator(root)) {
+    if (entry.is_regular_file()) {
+      int fd = open(entry.path().c_str(), O_RDONLY);
+      posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+      close(fd);
+    }
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::string root = argc > 1 ? argv[1] : "creator_bench_data";
+  bool generated = argc <= 1;
+  if (generated) {
+    const char *gib = std::getenv("YATC_BENCH_GIB");
+    uint64_t total_size = (gib ? std::strtoull(gib, nullptr, 10) : 10) << 30;
+    std::cout << "generating " << (total_size >> 30) << " GiB in " << root
+              << "..." << std::endl;
+    generate_tree(root, total_size);
+  }
+
+  unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+  for (unsigned threads : {1u, cores}) {
+    drop_cache(root);
+    TorrentCreator creator(root, "http://localhost/announce");
+
+    auto start = std::chrono::steady_clock::now();
+    creator.create(threads);
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+
+    const Torrent &torrent = creator.torrent();
+    std::cout << "files: " << torrent.files.size()
+              << ", piece length: " << torrent.piece_length
+              << ", pieces: " << torrent.total_pieces()
+              << ", hashing threads: " << threads << "\n"
+              << "created in " << seconds << " s ("
+              << torrent.size() / seconds / (1024 * 1024) << " MiB/s)"
+              << std::endl;
+    if (cores == 1) {
+      break;
+    }
+  }
+
+  if (generated) {
+    fs::remove_all(root);
+  }
+  return 0;
+}
@@ -0,0 +1,80 @@
+// Measures decoding a tracker response with 10k compact IPv4 peers into
+// endpoints, against the former decoding into address strings that each
+// had to be resolved again before connecting.
+#include "Logger/Logger.h"
+#include "TrackerClient/TrackerClient.h"
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+std::ostringstream Logger::null_stream_;
+
+namespace {
+
+const int PEER_COUNT = 10000;
+const int ROUNDS = 50;
+
+std::string build_response() {
+  std::string peers;
+  for (int i = 0; i < PEER_COUNT; ++i) {
+    uint32_t address = 0x0a000000 + static_cast<uint32_t>(i);
+    uint16_t port = static_cast<uint16_t>(6881 + i % 100);
+    for (int shift = 24; shift >= 0; shift -= 8) {
+      peers.push_back(static_cast<char>(address >> shift));
+    }
+    peers.push_back(static_cast<char>(port >> 8));
+    peers.push_back(static_cast<char>(port));
+  }
+  return "d8:intervali1800e5:peers" + std::to_string(peers.size()) + ":" +
+         peers + "e";
+}
+
+/**
+ * @brief The string-based decoding and resolution peers used to go through.
+ */
+size_t decode_to_strings(const std::string &peers) {
+  boost::asio::io_context io_context;
+  tcp::resolver resolver(io_context);
+  size_t resolved = 0;
+  for (size_t i = 0; i + 6 <= peers.size(); i += 6) {
+    struct in_addr ip_addr;
+    std::memcpy(&ip_addr, peers.data() + i, 4);
+    std::string ip = inet_ntoa(ip_addr);
+    uint16_t port;
+    std::memcpy(&port, peers.data() + i + 4, 2);
+    resolved += resolver.resolve(ip, std::to_string(ntohs(port))).size();
+  }
+  return resolved;
+}
+
+template <typename Function> double milliseconds_per_round(Function run) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < ROUNDS; ++i) {
+    run();
+  }
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() / ROUNDS;
+}
+
+} // namespace
+
+int main() {
+  const std::string body = build_response();
+  const std::string peers = body.substr(body.find(':', 24) + 1,
+                                        static_cast<size_t>(PEER_COUNT) * 6);
+
+  size_t decoded = 0;
+  double endpoints = milliseconds_per_round(
+      [&]() { decoded += parse_tracker_response(body).peers.size(); });
+  double strings =
+      milliseconds_per_round([&]() { decoded += decode_to_strings(peers); });
+
+  std::cout << PEER_COUNT << " compact peers (" << body.size() / 1024
+            << " KiB response)\n"
+            << "parse to endpoints:            " << endpoints << " ms\n"
+            << "decode to strings and resolve: " << strings << " ms\n"
+            << "(" << decoded << " peers decoded)" << std::endl;
+  return 0;
+}
@@ -0,0 +1,68 @@
+// Measures the latency from the last block of a piece arriving to the piece
+// being verified, for common piece sizes with blocks arriving in order.
+// Hashing the whole piece once complete, as before, against a running
+// SHA-1 that each block is fed into as it arrives, which leaves only the
+// last block and the final padding for the moment the piece completes.
+#include "Logger/Logger.h"
+#include "Utils/utils.h"
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+std::ostringstream Logger::null_stream_;
+
+namespace {
+
+const size_t BLOCK = 16 * 1024;
+const int ROUNDS = 20;
+
+double elapsed_us(std::chrono::steady_clock::time_point start) {
+  std::chrono::duration<double, std::micro> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+/**
+ * @brief Hashes the whole piece once its last block is in.
+ */
+double final_hash(const std::vector<std::byte> &piece, size_t &checksum) {
+  auto start = std::chrono::steady_clock::now();
+  checksum += std::to_integer<size_t>(
+      sha1_digest(piece.data(), piece.size())[0]);
+  return elapsed_us(start);
+}
+
+/**
+ * @brief Feeds every block in as it arrives, timing only the last one.
+ */
+double running_hash(const std::vector<std::byte> &piece, size_t &checksum) {
+  Sha1 hash;
+  for (size_t begin = 0; begin + BLOCK < piece.size(); begin += BLOCK) {
+    hash.update(piece.data() + begin, BLOCK);
+  }
+  auto start = std::chrono::steady_clock::now();
+  hash.update(piece.data() + piece.size() - BLOCK, BLOCK);
+  checksum += std::to_integer<size_t>(hash.finish()[0]);
+  return elapsed_us(start);
+}
+
+} // namespace
+
+int main() {
+  size_t checksum = 0;
+  std::cout << "piece size   final hash   running hash (us to verify)\n";
+  for (size_t piece_size : {256 * 1024, 1024 * 1024, 4 * 1024 * 1024,
+                            16 * 1024 * 1024}) {
+    std::vector<std::byte> piece(piece_size, std::byte{0x5a});
+    double final_us = 0;
+    double running_us = 0;
+    for (int round = 0; round < ROUNDS; ++round) {
+      final_us += final_hash(piece, checksum);
+      running_us += running_hash(piece, checksum);
+    }
+    std::cout << piece_size / 1024 << " KiB\t" << final_us / ROUNDS << "\t"
+              << running_us / ROUNDS << "\n";
+  }
+  std::cout << "(checksum " << checksum << ")" << std::endl;
+  return 0;
+}
@@ -0,0 +1,79 @@
+// Measures time-to-first-request when restarting a 100k-piece torrent from
+// resume data: load, validate file stamps, restore the PieceManager and pick
+// the first piece to request from a seed.
+#include "Logger/Logger.h"
+#include "PieceManager/PieceManager.h"
+#include "ResumeData/ResumeData.h"
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <iostream>
+#include <unistd.h>
+
+std::ostringstream Logger::null_stream_;
+
+int main() {
+  const uint32_t total_pieces = 100000;
+  const uint32_t piece_length = 256 * 1024;
+  const uint32_t file_count = 100;
+  const uint64_t total_size =
+      static_cast<uint64_t>(total_pieces) * piece_length;
+  const uint64_t file_length = total_size / file_count;
+
+  // Sparse files, so the benchmark needs no real disk space
+  std::vector<FileInfo> files;
+  for (uint32_t i = 0; i < file_count; ++i) {
+    std::string path = "resume_bench_" + std::to_string(i) + ".bin";
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT, 0666);
+    ftruncate(fd, file_length);
+    close(fd);
+    files.push_back(
+        {path, file_length, i * file_length, (i + 1) * file_length});
+  }
+
+  // Half-done job with a handful of pieces in flight
+  ResumeData resume;
+  resume.pieces = Bitfield(total_pieces);
+  for (uint32_t i = 0; i < total_pieces / 2; ++i) {
+    resume.pieces.set(i);
+  }
+  for (const auto &file : files) {
+    resume.files.push_back(*stat_file(file.path));
+  }
+  for (uint32_t i = 0; i < 64; ++i) {
+    Bitfield blocks(piece_length / (16 * 1024));
+    blocks.set(0);
+    resume.partial_pieces.push_back({total_pieces / 2 + i, blocks});
+  }
+  resume.save("resume_bench.resume");
+
+  auto start = std::chrono::steady_clock::now();
+
+  auto loaded = ResumeData::load("resume_bench.resume");
+  loaded->validate(files, piece_length);
+  PieceManager piece_manager(total_size, piece_length);
+  piece_manager.restore_pieces(loaded->pieces);
+  for (auto &partial : loaded->partial_pieces) {
+    piece_manager.add_partial_piece(std::move(partial));
+  }
+
+  Bitfield seed(total_pieces);
+  seed.set_all();
+  uint32_t first = piece_manager.wanted_from(seed).find_next(0);
+
+  auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start);
+
+  std::cout << "pieces: " << total_pieces << ", restored: "
+            << piece_manager.total_pieces() - piece_manager.missing_count()
+            << ", first request: piece " << first << "\n"
+            << "time to first request from resume data: " << elapsed.count()
+            << " us (versus rehashing "
+            << (total_size / 2) / (1024 * 1024 * 1024) << " GiB)" << std::endl;
+
+  for (const auto &file : files) {
+    remove(file.path.c_str());
+  }
+  remove("resume_bench.resume");
+  return 0;
+}
@@ -0,0 +1,111 @@
+// Measures what idle torrents cost a session: 1000 small seeded torrents
+// (override with YATC_BENCH_TORRENTS) are added to one session, which then
+// sits idle for 10 seconds. Reports the time to add them, peak and steady
+// resident memory, and the CPU used while idle.
+#include "Logger/Logger.h"
+#include "Session/Session.h"
+#include "TorrentCreator/TorrentCreator.h"
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sys/resource.h>
+#include <thread>
+#include <unistd.h>
+
+std::ostringstream Logger::null_stream_;
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const uint64_t BENCH_FILE_SIZE = 64 * 1024;
+const std::chrono::seconds IDLE_TIME(10);
+
+long status_kib(const std::string &field) {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, field.size(), field) == 0) {
+      return std::strtol(line.c_str() + field.size() + 1, nullptr, 10);
+    }
+  }
+  return 0;
+}
+
+double cpu_seconds() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+         (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+} // namespace
+
+int main() {
+  const char *count_env = std::getenv("YATC_BENCH_TORRENTS");
+  int count = count_env ? std::atoi(count_env) : 1000;
+
+  // Data, torrents and resume files all live in a scratch directory
+  fs::path root = fs::absolute("session_bench_data");
+  fs::create_directories(root);
+  fs::current_path(root);
+
+  std::cout << "creating " << count << " torrents..." << std::endl;
+  std::vector<std::string> torrent_files;
+  for (int i = 0; i < count; ++i) {
+    std::string name = "data" + std::to_string(i) + ".bin";
+    std::ofstream data(name, std::ios::binary);
+    data << std::string(BENCH_FILE_SIZE, static_cast<char>(i));
+    data.close();
+
+    TorrentCreator creator(name, "http://127.0.0.1:9/announce");
+    creator.create(1);
+    torrent_files.push_back("torrent" + std::to_string(i) + ".torrent");
+    creator.save(torrent_files.back());
+  }
+
+  // Every announce fails against the closed port and reports it on stderr
+  std::streambuf *stderr_buffer = std::cerr.rdbuf(nullptr);
+  long rss_before = status_kib("VmRSS:");
+  {
+    Session session(0, 0);
+    auto start = std::chrono::steady_clock::now();
+    for (const auto &torrent_file : torrent_files) {
+      session.add_torrent(torrent_file);
+    }
+    double add_seconds = seconds_since(start);
+
+    // Give the disk threads time to check and announce every torrent
+    std::this_thread::sleep_for(std::chrono::seconds(5));
+    double cpu_start = cpu_seconds();
+    start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(IDLE_TIME);
+    double idle_cpu = (cpu_seconds() - cpu_start) / seconds_since(start);
+    long rss_idle = status_kib("VmRSS:");
+
+    start = std::chrono::steady_clock::now();
+    session.stop();
+    double stop_seconds = seconds_since(start);
+
+    std::cout << "torrents: " << count << "\nadded in " << add_seconds
+              << " s (" << add_seconds / count * 1e6 << " us per torrent)"
+              << "\nresident while idle: " << rss_idle << " KiB ("
+              << (rss_idle - rss_before) / count << " KiB per torrent)"
+              << "\npeak resident: " << status_kib("VmHWM:") << " KiB"
+              << "\nCPU while idle: " << idle_cpu * 100 << "% of one core"
+              << "\nstopped in " << stop_seconds << " s" << std::endl;
+  }
+  std::cerr.rdbuf(stderr_buffer);
+
+  fs::current_path(root.parent_path());
+  fs::remove_all(root);
+  return 0;
+}
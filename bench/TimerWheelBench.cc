@@ -0,0 +1,151 @@
+// Measures the timeouts of 10k connections with 4 timers each (keep-alive,
+// request, choke rotation and connect timeout) on one TimerWheel, against a
+// steady_timer per timeout. Re-arming is what connections do most, every
+// block received pushes its request deadline back; firing is measured as
+// CPU time spent while the timers expire over one second.
+#include "Logger/Logger.h"
+#include "TimerWheel/TimerWheel.h"
+#include <chrono>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+std::ostringstream Logger::null_stream_;
+
+namespace {
+
+const int CONNECTIONS = 10000;
+const int TIMERS_PER_CONNECTION = 4;
+const int TIMERS = CONNECTIONS * TIMERS_PER_CONNECTION;
+const int REARMS = 1000000;
+
+/// The delays connections use, by kind of timer.
+const std::chrono::seconds DELAYS[TIMERS_PER_CONNECTION] = {
+    std::chrono::seconds(5), std::chrono::seconds(20),
+    std::chrono::seconds(10), std::chrono::seconds(90)};
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+double cpu_ms(std::clock_t start) {
+  return 1000.0 * (std::clock() - start) / CLOCKS_PER_SEC;
+}
+
+/**
+ * @brief Re-arms random timers, each kept as its own steady_timer.
+ */
+double rearm_steady_timers(size_t &fired) {
+  boost::asio::io_context io_context;
+  std::vector<std::unique_ptr<boost::asio::steady_timer>> timers;
+  auto on_expiry = [&fired](const boost::system::error_code &error) {
+    fired += !error;
+  };
+  for (int i = 0; i < TIMERS; ++i) {
+    timers.push_back(std::make_unique<boost::asio::steady_timer>(io_context));
+    timers.back()->expires_after(DELAYS[i % TIMERS_PER_CONNECTION]);
+    timers.back()->async_wait(on_expiry);
+  }
+
+  std::mt19937 random(42);
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < REARMS; ++i) {
+    int timer = random() % TIMERS;
+    // Moving the expiry cancels the pending wait, whose handler still runs
+    timers[timer]->expires_after(DELAYS[timer % TIMERS_PER_CONNECTION]);
+    timers[timer]->async_wait(on_expiry);
+    if (i % 1024 == 0) {
+      io_context.poll();
+    }
+  }
+  io_context.poll();
+  return elapsed_ms(start);
+}
+
+/**
+ * @brief Re-arms random timers on a TimerWheel.
+ */
+double rearm_timer_wheel(size_t &fired) {
+  boost::asio::io_context io_context;
+  auto wheel = std::make_shared<TimerWheel>(io_context.get_executor());
+  std::vector<TimerWheel::TimerId> timers;
+  for (int i = 0; i < TIMERS; ++i) {
+    timers.push_back(wheel->arm(DELAYS[i % TIMERS_PER_CONNECTION],
+                                [&fired]() { ++fired; }));
+  }
+
+  std::mt19937 random(42);
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < REARMS; ++i) {
+    int timer = random() % TIMERS;
+    wheel->cancel(timers[timer]);
+    timers[timer] = wheel->arm(DELAYS[timer % TIMERS_PER_CONNECTION],
+                               [&fired]() { ++fired; });
+    if (i % 1024 == 0) {
+      io_context.poll();
+    }
+  }
+  io_context.poll();
+  double elapsed = elapsed_ms(start);
+  wheel->stop();
+  return elapsed;
+}
+
+/**
+ * @brief Lets every timer expire, spread over one second, each kept as its
+ * own steady_timer.
+ */
+double expire_steady_timers(size_t &fired) {
+  boost::asio::io_context io_context;
+  std::vector<std::unique_ptr<boost::asio::steady_timer>> timers;
+  std::clock_t start = std::clock();
+  for (int i = 0; i < TIMERS; ++i) {
+    timers.push_back(std::make_unique<boost::asio::steady_timer>(io_context));
+    timers.back()->expires_after(std::chrono::microseconds(i * 25));
+    timers.back()->async_wait(
+        [&fired](const boost::system::error_code &error) { fired += !error; });
+  }
+  io_context.run();
+  return cpu_ms(start);
+}
+
+/**
+ * @brief Lets every timer expire, spread over one second, on a TimerWheel.
+ */
+double expire_timer_wheel(size_t &fired) {
+  boost::asio::io_context io_context;
+  auto wheel = std::make_shared<TimerWheel>(io_context.get_executor());
+  std::clock_t start = std::clock();
+  for (int i = 0; i < TIMERS; ++i) {
+    wheel->arm(std::chrono::microseconds(i * 25), [&fired]() { ++fired; });
+  }
+  io_context.run();
+  return cpu_ms(start);
+}
+
+} // namespace
+
+int main() {
+  size_t fired = 0;
+  double steady_rearm = rearm_steady_timers(fired);
+  double wheel_rearm = rearm_timer_wheel(fired);
+  double steady_expire = expire_steady_timers(fired);
+  double wheel_expire = expire_timer_wheel(fired);
+
+  std::cout << CONNECTIONS << " connections x " << TIMERS_PER_CONNECTION
+            << " timers\n"
+            << REARMS << " re-arms, steady_timer:  " << steady_rearm
+            << " ms (" << steady_rearm * 1e6 / REARMS << " ns each)\n"
+            << REARMS << " re-arms, TimerWheel:    " << wheel_rearm
+            << " ms (" << wheel_rearm * 1e6 / REARMS << " ns each)\n"
+            << TIMERS << " expiries, steady_timer: " << steady_expire
+            << " ms CPU\n"
+            << TIMERS << " expiries, TimerWheel:   " << wheel_expire
+            << " ms CPU\n"
+            << "(" << fired << " timers fired)" << std::endl;
+  return 0;
+}
@@ -0,0 +1,94 @@
+// Measures the resident memory each loaded torrent costs: the shared
+// metadata plus the tracker client referring to it. The torrent has 1000
+// files and about 42k pieces, so per-piece and per-file overheads dominate.
+#include "Logger/Logger.h"
+#include "TorrentParser/TorrentParser.h"
+#include "HttpClient/HttpClient.h"
+#include "TrackerClient/TrackerClient.h"
+#include <bencode.hpp>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <unistd.h>
+
+std::ostringstream Logger::null_stream_;
+
+namespace {
+
+const int LOADED_TORRENTS = 200;
+const int FILE_COUNT = 1000;
+const uint64_t FILE_SIZE = 11 * 1024 * 1024;
+const uint32_t PIECE_LENGTH = 256 * 1024;
+
+std::string build_torrent() {
+  uint64_t total_size = 0;
+  bencode::list files;
+  for (int i = 0; i < FILE_COUNT; ++i) {
+    bencode::dict entry;
+    entry["length"] = static_cast<bencode::integer>(FILE_SIZE);
+    entry["path"] = bencode::list{"directory" + std::to_string(i % 10),
+                                  "file" + std::to_string(i) + ".bin"};
+    files.push_back(std::move(entry));
+    total_size += FILE_SIZE;
+  }
+
+  uint64_t pieces = (total_size + PIECE_LENGTH - 1) / PIECE_LENGTH;
+  std::string hashes(pieces * sizeof(InfoHash), '\0');
+  for (size_t i = 0; i < hashes.size(); ++i) {
+    hashes[i] = static_cast<char>(i * 131 + 7);
+  }
+
+  bencode::dict info;
+  info["name"] = "memory";
+  info["piece length"] = static_cast<bencode::integer>(PIECE_LENGTH);
+  info["pieces"] = std::move(hashes);
+  info["files"] = std::move(files);
+
+  bencode::dict dict;
+  dict["announce"] = "http://localhost/announce";
+  dict["info"] = std::move(info);
+  return bencode::encode(dict);
+}
+
+long resident_kib() {
+  std::ifstream statm("/proc/self/statm");
+  long size = 0;
+  long resident = 0;
+  statm >> size >> resident;
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+} // namespace
+
+int main() {
+  const std::string path = "torrent_memory_bench.torrent";
+  std::string content = build_torrent();
+  {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(content.data(), static_cast<std::streamsize>(content.size()));
+  }
+
+  boost::asio::io_context io_context;
+  auto http_client = std::make_shared<HttpClient>(io_context);
+  std::shared_ptr<const Torrent> torrent;
+  std::vector<std::unique_ptr<TrackerClient>> loaded;
+  loaded.reserve(LOADED_TORRENTS);
+  long before = resident_kib();
+  for (int i = 0; i < LOADED_TORRENTS; ++i) {
+    torrent = std::make_shared<const Torrent>(
+        TorrentParser().parse_torrent_file(path));
+    loaded.push_back(
+        std::make_unique<TrackerClient>(torrent, http_client, nullptr));
+  }
+  long after = resident_kib();
+  std::remove(path.c_str());
+
+  std::cout << ".torrent file: " << content.size() / 1024 << " KiB, "
+            << torrent->files.size() << " files, " << torrent->total_pieces()
+            << " pieces\n"
+            << "loaded " << LOADED_TORRENTS << " torrents: "
+            << (after - before) / LOADED_TORRENTS << " KiB per torrent"
+            << std::endl;
+  return 0;
+}
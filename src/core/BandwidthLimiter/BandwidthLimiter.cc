@@ -0,0 +1,46 @@
+#include "BandwidthLimiter.h"
+#include <algorithm>
+#include <utility>
+
+BandwidthLimiter::BandwidthLimiter(uint64_t rate,
+                                   std::shared_ptr<BandwidthLimiter> parent)
+    : parent_(std::move(parent)), rate_(rate),
+      tokens_(static_cast<double>(rate)), last_refill_(Clock::now()) {}
+
+void BandwidthLimiter::set_rate(uint64_t rate) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  rate_ = rate;
+  tokens_ = static_cast<double>(rate);
+  last_refill_ = Clock::now();
+}
+
+uint64_t BandwidthLimiter::rate() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return rate_;
+}
+
+BandwidthLimiter::Clock::duration BandwidthLimiter::reserve(uint64_t bytes) {
+  bytes_transferred_.fetch_add(bytes, std::memory_order_relaxed);
+  Clock::duration parent_delay =
+      parent_ != nullptr ? parent_->reserve(bytes) : Clock::duration::zero();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (rate_ == 0) {
+    return parent_delay;
+  }
+
+  Clock::time_point now = Clock::now();
+  double elapsed = std::chrono::duration<double>(now - last_refill_).count();
+  last_refill_ = now;
+  tokens_ = std::min(tokens_ + elapsed * static_cast<double>(rate_),
+                     static_cast<double>(rate_));
+  tokens_ -= static_cast<double>(bytes);
+
+  if (tokens_ >= 0) {
+    return parent_delay;
+  }
+  return std::max(
+      parent_delay,
+      std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(
+          -tokens_ / static_cast<double>(rate_))));
+}
@@ -0,0 +1,77 @@
+#ifndef BANDWIDTHLIMITER_H
+#define BANDWIDTHLIMITER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+/**
+ * @brief Token bucket shared by every connection whose traffic it limits.
+ *
+ * Connections reserve bandwidth for data they are about to send or have just
+ * received and wait for the returned delay before going on, so together they
+ * stay under the rate. Up to one second worth of unused bandwidth is kept
+ * for bursts. A limiter may have a parent that also has to grant every
+ * transfer, so a torrent's share can be limited within a session-wide
+ * limit. Thread-safe.
+ */
+class BandwidthLimiter {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  /**
+   * @brief Constructs a BandwidthLimiter.
+   *
+   * @param rate The limit in bytes per second, 0 for unlimited.
+   * @param parent Limiter that must also grant each transfer, or null.
+   */
+  explicit BandwidthLimiter(uint64_t rate = 0,
+                            std::shared_ptr<BandwidthLimiter> parent = nullptr);
+
+  /**
+   * @brief Changes the limit.
+   *
+   * @param rate The limit in bytes per second, 0 for unlimited.
+   */
+  void set_rate(uint64_t rate);
+
+  /**
+   * @brief Gets the limit.
+   *
+   * @return The limit in bytes per second, 0 if unlimited.
+   */
+  uint64_t rate() const;
+
+  /**
+   * @brief Takes bandwidth for a transfer.
+   *
+   * The bytes are always granted; when the bucket runs dry the caller pays
+   * by waiting before its next transfer. The parent, if any, is charged
+   * as well and the longer of the two delays applies.
+   *
+   * @param bytes The size of the transfer.
+   * @return How long to wait before the next transfer, zero if not at all.
+   */
+  Clock::duration reserve(uint64_t bytes);
+
+  /**
+   * @brief Gets the number of bytes reserved so far, limited or not.
+   *
+   * @return The total number of bytes.
+   */
+  uint64_t bytes_transferred() const {
+    return bytes_transferred_.load(std::memory_order_relaxed);
+  }
+
+private:
+  std::shared_ptr<BandwidthLimiter> parent_; ///< Also charged, or null.
+  mutable std::mutex mutex_; ///< Guards the bucket.
+  uint64_t rate_;            ///< Bytes per second, 0 if unlimited.
+  double tokens_;            ///< Bytes available now, negative when owed.
+  Clock::time_point last_refill_;             ///< When tokens_ was updated.
+  std::atomic<uint64_t> bytes_transferred_{0}; ///< Total bytes reserved.
+};
+
+#endif // BANDWIDTHLIMITER_H
@@ -0,0 +1,245 @@
+#include "Bitfield.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define BITFIELD_HAVE_AVX2 1
+#endif
+
+namespace {
+
+uint64_t load_be64(const std::byte *data) {
+  uint64_t word;
+  std::memcpy(&word, data, sizeof(word));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  word = __builtin_bswap64(word);
+#endif
+  return word;
+}
+
+void store_be64(std::byte *data, uint64_t word) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  word = __builtin_bswap64(word);
+#endif
+  std::memcpy(data, &word, sizeof(word));
+}
+
+uint64_t popcount_and_not_scalar(const uint64_t *a, const uint64_t *b,
+                                 size_t n) {
+  uint64_t total = 0;
+  for (size_t i = 0; i < n; ++i) {
+    total += __builtin_popcountll(a[i] & ~b[i]);
+  }
+  return total;
+}
+
+bool any_and_not_scalar(const uint64_t *a, const uint64_t *b, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    if (a[i] & ~b[i])
+      return true;
+  }
+  return false;
+}
+
+void and_not_scalar(uint64_t *out, const uint64_t *a, const uint64_t *b,
+                    size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    out[i] = a[i] & ~b[i];
+  }
+}
+
+#ifdef BITFIELD_HAVE_AVX2
+bool cpu_has_avx2() {
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+  return has_avx2;
+}
+
+// Nibble lookup popcount (Mula et al.): AVX2 has no vector popcount, so count
+// the bits of each byte with two table shuffles and sum bytes with SAD.
+__attribute__((target("avx2,popcnt"))) uint64_t
+popcount_and_not_avx2(const uint64_t *a, const uint64_t *b, size_t n) {
+  const __m256i lookup =
+      _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1,
+                       2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_mask = _mm256_set1_epi8(0x0f);
+  __m256i acc = _mm256_setzero_si256();
+
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+    __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+    __m256i v = _mm256_andnot_si256(vb, va);
+    __m256i lo = _mm256_and_si256(v, low_mask);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+    __m256i bytes = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo),
+                                    _mm256_shuffle_epi8(lookup, hi));
+    acc = _mm256_add_epi64(acc,
+                           _mm256_sad_epu8(bytes, _mm256_setzero_si256()));
+  }
+
+  uint64_t total = static_cast<uint64_t>(_mm256_extract_epi64(acc, 0)) +
+                   static_cast<uint64_t>(_mm256_extract_epi64(acc, 1)) +
+                   static_cast<uint64_t>(_mm256_extract_epi64(acc, 2)) +
+                   static_cast<uint64_t>(_mm256_extract_epi64(acc, 3));
+  for (; i < n; ++i) {
+    total += __builtin_popcountll(a[i] & ~b[i]);
+  }
+  return total;
+}
+
+__attribute__((target("avx2"))) bool
+any_and_not_avx2(const uint64_t *a, const uint64_t *b, size_t n) {
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+    __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+    // testc returns 1 when (~vb & va) == 0
+    if (!_mm256_testc_si256(vb, va))
+      return true;
+  }
+  return any_and_not_scalar(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2"))) void
+and_not_avx2(uint64_t *out, const uint64_t *a, const uint64_t *b, size_t n) {
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+    __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i),
+                        _mm256_andnot_si256(vb, va));
+  }
+  and_not_scalar(out + i, a + i, b + i, n - i);
+}
+#endif
+
+uint64_t popcount_and_not(const uint64_t *a, const uint64_t *b, size_t n) {
+#ifdef BITFIELD_HAVE_AVX2
+  if (cpu_has_avx2())
+    return popcount_and_not_avx2(a, b, n);
+#endif
+  return popcount_and_not_scalar(a, b, n);
+}
+
+bool any_and_not(const uint64_t *a, const uint64_t *b, size_t n) {
+#ifdef BITFIELD_HAVE_AVX2
+  if (cpu_has_avx2())
+    return any_and_not_avx2(a, b, n);
+#endif
+  return any_and_not_scalar(a, b, n);
+}
+
+void and_not(uint64_t *out, const uint64_t *a, const uint64_t *b, size_t n) {
+#ifdef BITFIELD_HAVE_AVX2
+  if (cpu_has_avx2()) {
+    and_not_avx2(out, a, b, n);
+    return;
+  }
+#endif
+  and_not_scalar(out, a, b, n);
+}
+
+} // namespace
+
+Bitfield::Bitfield(uint32_t size) : words_((size + 63) / 64, 0), size_(size) {}
+
+Bitfield::Bitfield(const std::byte *data, size_t length, uint32_t size)
+    : Bitfield(size) {
+  size_t bytes = std::min(length, (static_cast<size_t>(size) + 7) / 8);
+  size_t full_words = bytes / 8;
+
+  for (size_t w = 0; w < full_words; ++w) {
+    words_[w] = load_be64(data + w * 8);
+  }
+
+  // Remaining bytes of a partial last word
+  for (size_t i = full_words * 8; i < bytes; ++i) {
+    uint64_t byte = std::to_integer<uint8_t>(data[i]);
+    words_[full_words] |= byte << (56 - 8 * (i - full_words * 8));
+  }
+
+  clear_padding();
+}
+
+std::vector<std::byte> Bitfield::to_bytes() const {
+  std::vector<std::byte> bytes(words_.size() * 8);
+  for (size_t w = 0; w < words_.size(); ++w) {
+    store_be64(bytes.data() + w * 8, words_[w]);
+  }
+  bytes.resize((static_cast<size_t>(size_) + 7) / 8);
+  return bytes;
+}
+
+void Bitfield::set_all() {
+  std::fill(words_.begin(), words_.end(), ~uint64_t{0});
+  clear_padding();
+}
+
+uint32_t Bitfield::count() const { return count_and_not(Bitfield()); }
+
+bool Bitfield::none() const { return !any_and_not(Bitfield()); }
+
+uint32_t Bitfield::count_and_not(const Bitfield &other) const {
+  size_t common = std::min(words_.size(), other.words_.size());
+  uint64_t total = popcount_and_not(words_.data(), other.words_.data(), common);
+  for (size_t w = common; w < words_.size(); ++w) {
+    total += __builtin_popcountll(words_[w]);
+  }
+  return static_cast<uint32_t>(total);
+}
+
+bool Bitfield::any_and_not(const Bitfield &other) const {
+  size_t common = std::min(words_.size(), other.words_.size());
+  if (::any_and_not(words_.data(), other.words_.data(), common))
+    return true;
+  for (size_t w = common; w < words_.size(); ++w) {
+    if (words_[w])
+      return true;
+  }
+  return false;
+}
+
+Bitfield Bitfield::and_not(const Bitfield &other) const {
+  Bitfield result(size_);
+  size_t common = std::min(words_.size(), other.words_.size());
+  ::and_not(result.words_.data(), words_.data(), other.words_.data(), common);
+  std::copy(words_.begin() + common, words_.end(),
+            result.words_.begin() + common);
+  return result;
+}
+
+uint32_t Bitfield::find_next(uint32_t from) const {
+  if (from >= size_)
+    return size_;
+
+  size_t w = from >> 6;
+  uint64_t word = words_[w] & (~uint64_t{0} >> (from & 63));
+  while (word == 0) {
+    if (++w >= words_.size())
+      return size_;
+    word = words_[w];
+  }
+  return static_cast<uint32_t>(w * 64 + __builtin_clzll(word));
+}
+
+void Bitfield::clear_padding() {
+  if (size_ % 64 != 0) {
+    words_.back() &= ~uint64_t{0} << (64 - size_ % 64);
+  }
+}
+
+AtomicBitfield::AtomicBitfield(uint32_t size)
+    : words_(new std::atomic<uint64_t>[(size + 63) / 64]), size_(size) {
+  for (size_t w = 0; w < (size_ + 63) / 64; ++w) {
+    words_[w].store(0, std::memory_order_relaxed);
+  }
+}
+
+Bitfield AtomicBitfield::snapshot() const {
+  Bitfield result(size_);
+  for (size_t w = 0; w < result.words_.size(); ++w) {
+    result.words_[w] = words_[w].load(std::memory_order_acquire);
+  }
+  return result;
+}
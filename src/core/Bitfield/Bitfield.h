@@ -0,0 +1,239 @@
+#ifndef BITFIELD_H
+#define BITFIELD_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Word-packed set of piece indices.
+ *
+ * Bits are stored 64 at a time in the same order as the BitTorrent wire
+ * format: piece 0 is the most significant bit of the first word. A bitfield
+ * message can therefore be loaded with one big-endian word load per 64
+ * pieces, and set operations between bitfields (e.g. "peer has & we lack")
+ * work a whole word at a time. Where the CPU supports it, the bulk operations
+ * use AVX2.
+ */
+class Bitfield {
+public:
+  /**
+   * @brief Constructs an empty bitfield of size zero.
+   */
+  Bitfield() = default;
+
+  /**
+   * @brief Constructs a bitfield with all bits cleared.
+   *
+   * @param size The number of bits (pieces) in the bitfield.
+   */
+  explicit Bitfield(uint32_t size);
+
+  /**
+   * @brief Constructs a bitfield from the payload of a bitfield message.
+   *
+   * Bytes beyond @p size bits are ignored and spare bits in the last byte are
+   * cleared. Missing trailing bytes are treated as zero.
+   *
+   * @param data Pointer to the wire bytes.
+   * @param length Number of bytes available at @p data.
+   * @param size The number of bits (pieces) in the bitfield.
+   */
+  Bitfield(const std::byte *data, size_t length, uint32_t size);
+
+  /**
+   * @brief Encodes the bitfield in wire format.
+   *
+   * @return The bitfield as (size + 7) / 8 bytes, spare bits zeroed.
+   */
+  std::vector<std::byte> to_bytes() const;
+
+  /**
+   * @brief Checks whether a bit is set.
+   *
+   * @param index The bit to check.
+   * @return true if the bit is set, false if it is cleared or out of range.
+   */
+  bool test(uint32_t index) const {
+    return index < size_ &&
+           (words_[index >> 6] >> (63 - (index & 63))) & uint64_t{1};
+  }
+
+  /**
+   * @brief Sets a bit. Out of range indices are ignored.
+   *
+   * @param index The bit to set.
+   */
+  void set(uint32_t index) {
+    if (index < size_)
+      words_[index >> 6] |= uint64_t{1} << (63 - (index & 63));
+  }
+
+  /**
+   * @brief Clears a bit. Out of range indices are ignored.
+   *
+   * @param index The bit to clear.
+   */
+  void reset(uint32_t index) {
+    if (index < size_)
+      words_[index >> 6] &= ~(uint64_t{1} << (63 - (index & 63)));
+  }
+
+  /**
+   * @brief Sets every bit.
+   */
+  void set_all();
+
+  /**
+   * @brief Gets the number of bits in the bitfield.
+   *
+   * @return The number of bits.
+   */
+  uint32_t size() const { return size_; }
+
+  /**
+   * @brief Counts the set bits.
+   *
+   * @return The number of set bits.
+   */
+  uint32_t count() const;
+
+  /**
+   * @brief Checks whether every bit is set.
+   *
+   * @return true if all bits are set.
+   */
+  bool all() const { return count() == size_; }
+
+  /**
+   * @brief Checks whether no bit is set.
+   *
+   * @return true if no bits are set.
+   */
+  bool none() const;
+
+  /**
+   * @brief Counts the bits set in this bitfield but not in @p other.
+   *
+   * Bits beyond the size of @p other are compared against zero.
+   *
+   * @param other The bitfield to subtract.
+   * @return The population count of (this & ~other).
+   */
+  uint32_t count_and_not(const Bitfield &other) const;
+
+  /**
+   * @brief Checks whether any bit is set in this bitfield but not in
+   * @p other.
+   *
+   * @param other The bitfield to subtract.
+   * @return true if (this & ~other) is non-empty.
+   */
+  bool any_and_not(const Bitfield &other) const;
+
+  /**
+   * @brief Computes the bits set in this bitfield but not in @p other.
+   *
+   * @param other The bitfield to subtract.
+   * @return A bitfield of the same size as this one.
+   */
+  Bitfield and_not(const Bitfield &other) const;
+
+  /**
+   * @brief Finds the next set bit at or after @p from.
+   *
+   * @param from The first bit to consider.
+   * @return The index of the next set bit, or size() if there is none.
+   */
+  uint32_t find_next(uint32_t from) const;
+
+  /**
+   * @brief Gives read access to the packed words.
+   *
+   * @return The words, most significant bit first.
+   */
+  const std::vector<uint64_t> &words() const { return words_; }
+
+  bool operator==(const Bitfield &other) const {
+    return size_ == other.size_ && words_ == other.words_;
+  }
+  bool operator!=(const Bitfield &other) const { return !(*this == other); }
+
+private:
+  friend class AtomicBitfield;
+
+  /**
+   * @brief Clears the bits of the last word that lie beyond size().
+   */
+  void clear_padding();
+
+  std::vector<uint64_t> words_; ///< Packed bits, 64 per word.
+  uint32_t size_ = 0;           ///< Number of valid bits.
+};
+
+/**
+ * @brief Bitfield whose words can be read and updated concurrently.
+ *
+ * Uses the same layout as Bitfield. Bits can only be set, never cleared, which
+ * is all completion tracking needs and keeps every operation a single atomic
+ * word access.
+ */
+class AtomicBitfield {
+public:
+  /**
+   * @brief Constructs an atomic bitfield with all bits cleared.
+   *
+   * @param size The number of bits (pieces) in the bitfield.
+   */
+  explicit AtomicBitfield(uint32_t size);
+
+  /**
+   * @brief Checks whether a bit is set.
+   *
+   * @param index The bit to check.
+   * @return true if the bit is set, false if it is cleared or out of range.
+   */
+  bool test(uint32_t index) const {
+    return index < size_ &&
+           (words_[index >> 6].load(std::memory_order_acquire) >>
+            (63 - (index & 63))) &
+               uint64_t{1};
+  }
+
+  /**
+   * @brief Atomically sets a bit.
+   *
+   * @param index The bit to set; must be less than size().
+   * @return true if this call changed the bit from cleared to set.
+   */
+  bool set(uint32_t index) {
+    uint64_t mask = uint64_t{1} << (63 - (index & 63));
+    return !(words_[index >> 6].fetch_or(mask, std::memory_order_acq_rel) &
+             mask);
+  }
+
+  /**
+   * @brief Gets the number of bits in the bitfield.
+   *
+   * @return The number of bits.
+   */
+  uint32_t size() const { return size_; }
+
+  /**
+   * @brief Copies the current bits into a plain Bitfield.
+   *
+   * Each word is read atomically; bits set concurrently may or may not be
+   * included.
+   *
+   * @return A snapshot of the bitfield.
+   */
+  Bitfield snapshot() const;
+
+private:
+  std::unique_ptr<std::atomic<uint64_t>[]> words_; ///< Packed bits.
+  uint32_t size_;                                  ///< Number of valid bits.
+};
+
+#endif // BITFIELD_H
@@ -0,0 +1,152 @@
+#include "BufferPool.h"
+#include <new>
+#include <utility>
+
+namespace {
+
+/// Number of size classes, one per power of two.
+const uint32_t SIZE_CLASSES =
+    __builtin_ctzll(BUFFER_POOL_MAX_CLASS / BUFFER_POOL_MIN_CLASS) + 1;
+
+/**
+ * @brief Finds the smallest size class a buffer fits in.
+ *
+ * @param size The size of the buffer.
+ * @return The size class, SIZE_CLASSES if it is too large for any.
+ */
+uint32_t size_class(size_t size) {
+  size_t needed = size > BUFFER_HEADROOM ? size - BUFFER_HEADROOM : 1;
+  if (needed <= BUFFER_POOL_MIN_CLASS) {
+    return 0;
+  }
+  uint32_t bits = 64 - __builtin_clzll(needed - 1); // log2, rounded up
+  return bits - __builtin_ctzll(BUFFER_POOL_MIN_CLASS);
+}
+
+size_t class_capacity(uint32_t size_class) {
+  return (BUFFER_POOL_MIN_CLASS << size_class) + BUFFER_HEADROOM;
+}
+
+BufferSlab *allocate(uint32_t size_class, size_t capacity, BufferPool *pool) {
+  void *memory = ::operator new(sizeof(BufferSlab) + capacity);
+  return new (memory) BufferSlab{{1}, size_class, capacity, pool};
+}
+
+void deallocate(BufferSlab *slab) {
+  slab->~BufferSlab();
+  ::operator delete(slab);
+}
+
+} // namespace
+
+Buffer::Buffer(const Buffer &other) : slab_(other.slab_), size_(other.size_) {
+  if (slab_ != nullptr) {
+    slab_->references.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+Buffer::Buffer(Buffer &&other) noexcept
+    : slab_(std::exchange(other.slab_, nullptr)),
+      size_(std::exchange(other.size_, 0)) {}
+
+Buffer &Buffer::operator=(Buffer other) noexcept {
+  std::swap(slab_, other.slab_);
+  std::swap(size_, other.size_);
+  return *this;
+}
+
+Buffer::~Buffer() {
+  if (slab_ != nullptr &&
+      slab_->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    slab_->pool->release(slab_);
+  }
+}
+
+BufferPool &BufferPool::instance() {
+  static BufferPool pool;
+  return pool;
+}
+
+BufferPool::BufferPool(uint64_t capacity)
+    : capacity_(capacity), free_(SIZE_CLASSES) {}
+
+BufferPool::~BufferPool() {
+  for (std::vector<BufferSlab *> &slabs : free_) {
+    for (BufferSlab *slab : slabs) {
+      deallocate(slab);
+    }
+  }
+}
+
+Buffer BufferPool::acquire(size_t size) {
+  uint32_t cls = size_class(size);
+  if (cls >= SIZE_CLASSES) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.allocations;
+    ++stats_.overflows;
+    return Buffer(allocate(UNPOOLED, size, this), size);
+  }
+
+  size_t capacity = class_capacity(cls);
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<BufferSlab *> &slabs = free_[cls];
+  if (!slabs.empty()) {
+    BufferSlab *slab = slabs.back();
+    slabs.pop_back();
+    slab->references.store(1, std::memory_order_relaxed);
+    ++stats_.reuses;
+    stats_.bytes_cached -= capacity;
+    stats_.bytes_in_use += capacity;
+    return Buffer(slab, size);
+  }
+
+  trim(capacity);
+  ++stats_.allocations;
+  if (stats_.bytes_in_use + stats_.bytes_cached + capacity > capacity_) {
+    // Handed out anyway, but not kept once released
+    ++stats_.overflows;
+    return Buffer(allocate(UNPOOLED, capacity, this), size);
+  }
+  stats_.bytes_in_use += capacity;
+  return Buffer(allocate(cls, capacity, this), size);
+}
+
+void BufferPool::release(BufferSlab *slab) {
+  if (slab->size_class == UNPOOLED) {
+    deallocate(slab);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_.bytes_in_use -= slab->capacity;
+  if (stats_.bytes_in_use + stats_.bytes_cached + slab->capacity >
+      capacity_) {
+    deallocate(slab); // The capacity was lowered meanwhile
+    return;
+  }
+  stats_.bytes_cached += slab->capacity;
+  free_[slab->size_class].push_back(slab);
+}
+
+void BufferPool::trim(uint64_t needed) {
+  // Largest classes first, they free the most for the fewest buffers
+  for (uint32_t cls = SIZE_CLASSES; cls-- > 0;) {
+    std::vector<BufferSlab *> &slabs = free_[cls];
+    while (!slabs.empty() &&
+           stats_.bytes_in_use + stats_.bytes_cached + needed > capacity_) {
+      stats_.bytes_cached -= slabs.back()->capacity;
+      deallocate(slabs.back());
+      slabs.pop_back();
+    }
+  }
+}
+
+void BufferPool::set_capacity(uint64_t capacity) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  capacity_ = capacity;
+  trim(0);
+}
+
+BufferPool::Stats BufferPool::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
@@ -0,0 +1,185 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/// Smallest size class of the buffer pool, for protocol messages.
+const size_t BUFFER_POOL_MIN_CLASS = 256;
+
+/// Largest size class; larger buffers are allocated on their own.
+const size_t BUFFER_POOL_MAX_CLASS = 16 * 1024 * 1024;
+
+/// Extra bytes in every pooled buffer, so a block fits its message header.
+const size_t BUFFER_HEADROOM = 64;
+
+/// Memory the global pool keeps in use and cached at most.
+const uint64_t BUFFER_POOL_CAPACITY = 512 * 1024 * 1024;
+
+class BufferPool;
+
+/**
+ * @brief Header in front of the bytes of every buffer.
+ */
+struct BufferSlab {
+  std::atomic<uint32_t> references; ///< Handles sharing the buffer.
+  uint32_t size_class;              ///< Free list it returns to.
+  size_t capacity;                  ///< Usable bytes after the header.
+  BufferPool *pool;                 ///< Pool it came from.
+
+  std::byte *data() { return reinterpret_cast<std::byte *>(this + 1); }
+};
+
+/**
+ * @brief Reference-counted handle to a pooled buffer.
+ *
+ * Copies share the same bytes, so a block can go from the socket to the
+ * hasher to the disk without being copied, and the buffer returns to its
+ * pool when the last handle goes away. Contents are not initialized. The
+ * handle itself is not thread-safe, but copies may live on other threads.
+ */
+class Buffer {
+public:
+  Buffer() = default;
+  Buffer(const Buffer &other);
+  Buffer(Buffer &&other) noexcept;
+  Buffer &operator=(Buffer other) noexcept;
+  ~Buffer();
+
+  std::byte *data() { return slab_ != nullptr ? slab_->data() : nullptr; }
+  const std::byte *data() const {
+    return slab_ != nullptr ? slab_->data() : nullptr;
+  }
+  std::byte *begin() { return data(); }
+  std::byte *end() { return data() + size_; }
+  const std::byte *begin() const { return data(); }
+  const std::byte *end() const { return data() + size_; }
+
+  std::byte &operator[](size_t index) { return data()[index]; }
+  const std::byte &operator[](size_t index) const { return data()[index]; }
+
+  size_t size() const { return size_; }
+  size_t capacity() const { return slab_ != nullptr ? slab_->capacity : 0; }
+
+  /**
+   * @brief Changes the size within the capacity; new bytes are not
+   * initialized.
+   *
+   * @param size The new size, at most capacity().
+   */
+  void resize(size_t size) { size_ = size <= capacity() ? size : capacity(); }
+
+  /**
+   * @brief Checks whether two handles share the same bytes.
+   */
+  bool shares(const Buffer &other) const { return slab_ == other.slab_; }
+
+  explicit operator bool() const { return slab_ != nullptr; }
+
+private:
+  friend class BufferPool;
+
+  Buffer(BufferSlab *slab, size_t size) : slab_(slab), size_(size) {}
+
+  BufferSlab *slab_ = nullptr; ///< Shared bytes, null if empty.
+  size_t size_ = 0;            ///< Bytes in use.
+};
+
+/**
+ * @brief Recycles the buffers that blocks, pieces and messages live in.
+ *
+ * Buffers come in power-of-two size classes from BUFFER_POOL_MIN_CLASS to
+ * BUFFER_POOL_MAX_CLASS, each with BUFFER_HEADROOM to spare. A released
+ * buffer goes on its class's free list and is handed out again as is,
+ * without being zeroed. The pool keeps at most its capacity in use and
+ * cached; beyond that cached buffers of other classes are freed first, and
+ * buffers are still handed out but freed as soon as they are released.
+ * Thread-safe.
+ */
+class BufferPool {
+public:
+  /**
+   * @brief Counters of the pool since it was created.
+   */
+  struct Stats {
+    uint64_t allocations = 0;  ///< Buffers taken from the heap.
+    uint64_t reuses = 0;       ///< Buffers handed out again.
+    uint64_t overflows = 0;    ///< Buffers handed out beyond the capacity.
+    uint64_t bytes_in_use = 0; ///< Capacity of the buffers handed out.
+    uint64_t bytes_cached = 0; ///< Capacity of the free buffers kept.
+  };
+
+  /**
+   * @brief Gets the pool shared by the whole process.
+   *
+   * @return The pool, with a capacity of BUFFER_POOL_CAPACITY unless
+   * changed.
+   */
+  static BufferPool &instance();
+
+  /**
+   * @brief Constructs an empty pool.
+   *
+   * @param capacity Memory kept in use and cached at most.
+   */
+  explicit BufferPool(uint64_t capacity = BUFFER_POOL_CAPACITY);
+
+  /// @brief Frees the cached buffers; every buffer must have been released.
+  ~BufferPool();
+
+  BufferPool(const BufferPool &) = delete;
+  BufferPool &operator=(const BufferPool &) = delete;
+
+  /**
+   * @brief Hands out a buffer.
+   *
+   * @param size The size of the buffer.
+   * @return A buffer of @p size bytes, uninitialized.
+   */
+  Buffer acquire(size_t size);
+
+  /**
+   * @brief Changes the capacity, freeing cached buffers beyond it.
+   *
+   * @param capacity Memory kept in use and cached at most.
+   */
+  void set_capacity(uint64_t capacity);
+
+  /**
+   * @brief Gets the counters.
+   *
+   * @return A snapshot of the counters.
+   */
+  Stats stats() const;
+
+private:
+  friend class Buffer;
+
+  /// Size class of buffers too large to be pooled.
+  static constexpr uint32_t UNPOOLED = UINT32_MAX;
+
+  /**
+   * @brief Takes a buffer back, once its last handle is gone.
+   *
+   * @param slab The buffer.
+   */
+  void release(BufferSlab *slab);
+
+  /**
+   * @brief Frees cached buffers until @p needed more bytes fit the capacity
+   * or none are left. Must be called with mutex_ held.
+   *
+   * @param needed Bytes about to be allocated.
+   */
+  void trim(uint64_t needed);
+
+  mutable std::mutex mutex_;                    ///< Guards everything below.
+  uint64_t capacity_;                           ///< Limit on pooled memory.
+  std::vector<std::vector<BufferSlab *>> free_; ///< Free buffers by class.
+  Stats stats_;                                 ///< Counters.
+};
+
+#endif // BUFFERPOOL_H
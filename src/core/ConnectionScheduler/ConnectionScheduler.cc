@@ -0,0 +1,109 @@
+#include "ConnectionScheduler.h"
+#include <algorithm>
+
+ConnectionScheduler::ConnectionScheduler(size_t max_half_open)
+    : max_half_open_(max_half_open) {}
+
+bool ConnectionScheduler::add(const Peer &peer, const std::string &source) {
+  Candidate candidate;
+  candidate.source = source;
+  return candidates_.emplace(peer, std::move(candidate)).second;
+}
+
+double ConnectionScheduler::score(const Candidate &candidate) const {
+  // Sources without a record yet count as half successful
+  double success = 0.5;
+  auto it = sources_.find(candidate.source);
+  if (it != sources_.end()) {
+    success = (it->second.successes + 1.0) / (it->second.attempts + 2.0);
+  }
+  return success / (1 + candidate.failures);
+}
+
+std::optional<Peer> ConnectionScheduler::next(Clock::time_point now) {
+  if (half_open_ >= max_half_open_) {
+    return std::nullopt;
+  }
+
+  auto best = candidates_.end();
+  double best_score = 0;
+  for (auto it = candidates_.begin(); it != candidates_.end(); ++it) {
+    const Candidate &candidate = it->second;
+    if (candidate.busy || candidate.retry_at > now) {
+      continue;
+    }
+    double candidate_score = score(candidate);
+    if (best == candidates_.end() || candidate_score > best_score) {
+      best = it;
+      best_score = candidate_score;
+    }
+  }
+  if (best == candidates_.end()) {
+    return std::nullopt;
+  }
+
+  best->second.busy = true;
+  ++half_open_;
+  return best->first;
+}
+
+void ConnectionScheduler::connected(const Peer &peer) {
+  auto it = candidates_.find(peer);
+  if (it == candidates_.end()) {
+    return;
+  }
+  SourceStats &source = sources_[it->second.source];
+  ++source.attempts;
+  ++source.successes;
+  it->second.failures = 0;
+  half_open_ -= std::min<size_t>(half_open_, 1);
+}
+
+void ConnectionScheduler::failed(const Peer &peer, Clock::time_point now) {
+  auto it = candidates_.find(peer);
+  if (it == candidates_.end()) {
+    return;
+  }
+  ++sources_[it->second.source].attempts;
+  half_open_ -= std::min<size_t>(half_open_, 1);
+
+  Candidate &candidate = it->second;
+  if (++candidate.failures >= MAX_CONNECT_FAILURES) {
+    candidates_.erase(it);
+    return;
+  }
+  candidate.busy = false;
+  candidate.retry_at =
+      now + CONNECT_RETRY_DELAY * (1u << (candidate.failures - 1));
+}
+
+void ConnectionScheduler::disconnected(const Peer &peer,
+                                       Clock::time_point now) {
+  auto it = candidates_.find(peer);
+  if (it == candidates_.end() || !it->second.busy) {
+    return;
+  }
+  it->second.busy = false;
+  it->second.retry_at = now + CONNECT_RETRY_DELAY;
+}
+
+std::optional<ConnectionScheduler::Clock::time_point>
+ConnectionScheduler::next_retry(Clock::time_point now) const {
+  std::optional<Clock::time_point> next;
+  for (const auto &entry : candidates_) {
+    const Candidate &candidate = entry.second;
+    if (!candidate.busy && candidate.retry_at > now &&
+        (!next || candidate.retry_at < *next)) {
+      next = candidate.retry_at;
+    }
+  }
+  return next;
+}
+
+bool ConnectionScheduler::has_ready(Clock::time_point now) const {
+  return std::any_of(candidates_.begin(), candidates_.end(),
+                     [now](const auto &entry) {
+                       return !entry.second.busy &&
+                              entry.second.retry_at <= now;
+                     });
+}
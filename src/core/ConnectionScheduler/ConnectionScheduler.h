@@ -0,0 +1,148 @@
+#ifndef CONNECTIONSCHEDULER_H
+#define CONNECTIONSCHEDULER_H
+
+#include "Peer/Peer.h"
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+/// Connection attempts a torrent has in flight at most.
+const size_t MAX_HALF_OPEN_CONNECTIONS = 8;
+
+/// How long a connection attempt may take before it is abandoned.
+const std::chrono::seconds CONNECT_TIMEOUT(10);
+
+/// Delay before retrying a peer that failed, doubled after each failure.
+const std::chrono::seconds CONNECT_RETRY_DELAY(30);
+
+/// Failed attempts in a row after which a peer is forgotten.
+const unsigned MAX_CONNECT_FAILURES = 5;
+
+/**
+ * @brief Decides which peers a torrent connects to, and when.
+ *
+ * Keeps every peer the trackers returned together with its connection state,
+ * so that only a few connection attempts are in flight at once, peers that
+ * failed are retried with exponential backoff and eventually dropped, and
+ * the peers most likely to answer are tried first. Peers are ranked by the
+ * share of successful connections among those from the same source, then
+ * by their own failures. Not thread-safe; the owning torrent calls it from
+ * its strand.
+ */
+class ConnectionScheduler {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  /**
+   * @brief Constructs an empty scheduler.
+   *
+   * @param max_half_open Connection attempts allowed in flight at once.
+   */
+  explicit ConnectionScheduler(
+      size_t max_half_open = MAX_HALF_OPEN_CONNECTIONS);
+
+  /**
+   * @brief Adds a peer to connect to, unless it is already known.
+   *
+   * @param peer The peer.
+   * @param source Where the peer came from, such as a tracker's URL.
+   * @return true if the peer was new.
+   */
+  bool add(const Peer &peer, const std::string &source);
+
+  /**
+   * @brief Picks the best peer to connect to now and marks it as being
+   * connected to.
+   *
+   * @param now The current time.
+   * @return The peer, or nothing if no peer is ready or too many attempts
+   * are in flight.
+   */
+  std::optional<Peer> next(Clock::time_point now);
+
+  /**
+   * @brief Records that a connection attempt succeeded.
+   *
+   * @param peer The peer connected to.
+   */
+  void connected(const Peer &peer);
+
+  /**
+   * @brief Records that a connection attempt failed or timed out.
+   *
+   * @param peer The peer that could not be reached.
+   * @param now The current time.
+   */
+  void failed(const Peer &peer, Clock::time_point now);
+
+  /**
+   * @brief Records that an established connection was closed, making the
+   * peer a candidate again after CONNECT_RETRY_DELAY.
+   *
+   * @param peer The peer that was connected.
+   * @param now The current time.
+   */
+  void disconnected(const Peer &peer, Clock::time_point now);
+
+  /**
+   * @brief Gets the number of connection attempts in flight.
+   *
+   * @return The number of attempts.
+   */
+  size_t half_open() const { return half_open_; }
+
+  /**
+   * @brief Gets when the next peer waiting out its backoff becomes ready.
+   *
+   * @param now The current time.
+   * @return The time, or nothing if no peer is waiting.
+   */
+  std::optional<Clock::time_point> next_retry(Clock::time_point now) const;
+
+  /**
+   * @brief Checks whether any peer could be connected to now, ignoring the
+   * limit on attempts in flight.
+   *
+   * @param now The current time.
+   * @return true if a peer is ready.
+   */
+  bool has_ready(Clock::time_point now) const;
+
+private:
+  /**
+   * @brief What is known about one peer.
+   */
+  struct Candidate {
+    std::string source;           ///< Where the peer came from.
+    bool busy = false;            ///< Being connected to, or connected.
+    unsigned failures = 0;        ///< Failed attempts in a row.
+    Clock::time_point retry_at{}; ///< When the peer may be tried again.
+  };
+
+  /**
+   * @brief Connection attempts to the peers of one source.
+   */
+  struct SourceStats {
+    unsigned attempts = 0;  ///< Attempts finished.
+    unsigned successes = 0; ///< Attempts that succeeded.
+  };
+
+  /**
+   * @brief Estimates how likely a peer is to answer.
+   *
+   * @param candidate The peer.
+   * @return A score, higher is better.
+   */
+  double score(const Candidate &candidate) const;
+
+  size_t max_half_open_;                 ///< Attempts allowed in flight.
+  size_t half_open_ = 0;                 ///< Attempts in flight.
+  std::map<Peer, Candidate> candidates_; ///< Every peer known.
+  std::unordered_map<std::string, SourceStats>
+      sources_; ///< Success of each source so far.
+};
+
+#endif // CONNECTIONSCHEDULER_H
@@ -1,19 +1,36 @@
 #include "FileManager.h"
+#include <algorithm>
+#include <iostream>
 
 FileManager::FileManager(const std::vector<FileInfo> &files,
                          uint32_t piece_length,
-                         std::vector<InfoHash> info_hashes)
+                         const PieceHashes &info_hashes,
+                         const std::vector<Priority> &file_priorities,
+                         const std::string &part_path)
 
-    : files_(files), piece_length_(piece_length) {
+    : files_(files), piece_length_(piece_length), piece_hashes_(info_hashes),
+      file_priorities_(files.size()), file_states_(files.size()),
+      part_path_(part_path) {
   if (info_hashes.size() != total_pieces()) {
     throw std::invalid_argument("Mismatch in hashes and total pieces");
   }
+  if (part_path_.empty() && !files_.empty()) {
+    part_path_ = files_.front().path + ".parts";
+  }
+  for (size_t i = 0; i < files_.size(); ++i) {
+    file_priorities_[i] =
+        i < file_priorities.size() ? file_priorities[i] : Priority::Normal;
+    file_states_[i] = FileState::Empty;
+  }
 }
 
 LinuxFileManager::LinuxFileManager(const std::vector<FileInfo> &files,
                                    uint32_t piece_length,
-                                   std::vector<InfoHash> info_hashes)
-    : FileManager(files, piece_length, info_hashes) {
+                                   const PieceHashes &info_hashes,
+                                   const std::vector<Priority> &file_priorities,
+                                   const std::string &part_path)
+    : FileManager(files, piece_length, info_hashes, file_priorities,
+                  part_path) {
   pre_allocate_space();
 }
 
@@ -33,122 +50,288 @@ uint32_t FileManager::total_pieces() const {
   return num_pieces;
 }
 
-std::vector<std::byte> LinuxFileManager::read_block(uint32_t piece_index,
-                                                    uint32_t offset,
-                                                    uint32_t length) const {
-  std::lock_guard<std::mutex> lock(file_mutex_);
+Priority FileManager::file_priority(size_t file_index) const {
+  return file_index < files_.size() ? file_priorities_[file_index].load()
+                                    : Priority::Skip;
+}
 
-  std::vector<std::byte> buffer(length);
-  uint64_t bytes_read = 0;
-  uint64_t global_offset =
-      static_cast<uint64_t>(piece_index * piece_length_ +
-                            offset); // Ensure uint64_t for multiplication
+std::vector<Priority> FileManager::piece_priorities() const {
+  std::vector<Priority> pieces(total_pieces(), Priority::Skip);
+  for (size_t i = 0; i < files_.size(); ++i) {
+    const FileInfo &file = files_[i];
+    if (file.length == 0) {
+      continue; // Overlaps no piece
+    }
+    Priority priority = file_priorities_[i];
+    auto first = static_cast<uint32_t>(file.start_offset / piece_length_);
+    auto last = static_cast<uint32_t>((file.end_offset - 1) / piece_length_);
+    for (uint32_t piece = first; piece <= last && piece < pieces.size();
+         ++piece) {
+      pieces[piece] = std::max(pieces[piece], priority);
+    }
+  }
+  return pieces;
+}
 
-  for (const auto &file : files_) {
-    if (global_offset < file.end_offset) {
-      uint64_t file_offset = global_offset - file.start_offset;
-      uint64_t bytes_to_read =
-          std::min(length - bytes_read, file.length - file_offset);
-      int fd = open(file.path.c_str(), O_RDONLY);
-      if (fd == -1) {
-        std::cerr << "Failed to open file for reading: " << strerror(errno)
-                  << std::endl;
-        return {};
-      }
+FileManager::Location FileManager::locate(const FileInfo &file,
+                                          uint64_t file_offset) const {
+  if (file_states_[&file - files_.data()] == FileState::Absent) {
+    return {part_path_, file.start_offset + file_offset};
+  }
+  return {file.path, file_offset};
+}
 
-      lseek(fd, file_offset, SEEK_SET);
-      ssize_t result =
-          read(fd, reinterpret_cast<char *>(buffer.data()) + bytes_read,
-               bytes_to_read);
-      close(fd);
+bool FileManager::for_each_segment(uint64_t offset, uint64_t length,
+                                   const SegmentVisitor &visit) const {
+  uint64_t data_offset = 0;
 
-      if (result == -1) {
-        std::cerr << "Failed to read file: " << strerror(errno) << std::endl;
-        return {};
-      }
+  for (const auto &file : files_) {
+    if (data_offset == length) {
+      break;
+    }
 
-      bytes_read += result;
-      global_offset += result;
-      if (bytes_read == length) {
-        break;
-      }
+    uint64_t file_end = file.start_offset + file.length;
+    if (offset >= file_end || offset < file.start_offset) {
+      continue;
+    }
+
+    uint64_t file_offset = offset - file.start_offset;
+    uint64_t segment =
+        std::min(length - data_offset, file.length - file_offset);
+    if (!visit(file, file_offset, data_offset, segment)) {
+      return false;
     }
+
+    offset += segment;
+    data_offset += segment;
+  }
+
+  return data_offset == length;
+}
+
+std::vector<std::byte> LinuxFileManager::read_block(uint32_t piece_index,
+                                                    uint32_t offset,
+                                                    uint32_t length) const {
+  std::vector<std::byte> buffer(length);
+  uint64_t global_offset =
+      static_cast<uint64_t>(piece_index) * piece_length_ + offset;
+
+  if (!read_range(global_offset, buffer.data(), length)) {
+    return {};
   }
 
   return buffer;
 }
 
+bool LinuxFileManager::read_range(uint64_t offset, std::byte *buffer,
+                                  uint64_t length) const {
+  // pread does not move a shared file position, so no lock is needed
+  return for_each_segment(
+      offset, length,
+      [this, buffer](const FileInfo &file, uint64_t file_offset,
+                     uint64_t data_offset, uint64_t size) {
+        Location where = locate(file, file_offset);
+        int fd = open(where.path.c_str(), O_RDONLY);
+        if (fd == -1) {
+          std::cerr << "Failed to open file for reading: " << strerror(errno)
+                    << std::endl;
+          return false;
+        }
+
+        uint64_t done = 0;
+        while (done < size) {
+          ssize_t result = pread(fd, buffer + data_offset + done, size - done,
+                                 where.offset + done);
+          if (result == -1 && errno == EINTR) {
+            continue;
+          }
+          if (result <= 0) {
+            break; // Error, or the file is smaller than the torrent says
+          }
+          done += static_cast<uint64_t>(result);
+        }
+        close(fd);
+
+        if (done != size) {
+          std::cerr << "Failed to read file: " << where.path << std::endl;
+          return false;
+        }
+        return true;
+      });
+}
+
 void LinuxFileManager::pre_allocate_space() {
   std::lock_guard<std::mutex> lock(file_mutex_);
 
-  for (const auto &file : files_) {
-    int fd = open(file.path.c_str(), O_WRONLY | O_CREAT, 0666);
-    if (fd == -1) {
-      std::cerr << "Failed to open file for pre-allocation: " << strerror(errno)
-                << std::endl;
+  for (size_t i = 0; i < files_.size(); ++i) {
+    const FileInfo &file = files_[i];
+    // Skipped files are only created once they are no longer skipped
+    struct stat statbuf;
+    if (file_priorities_[i] == Priority::Skip &&
+        stat(file.path.c_str(), &statbuf) == -1 && errno == ENOENT) {
+      file_states_[i] = FileState::Absent;
       continue;
     }
 
-    if (ftruncate(fd, file.length) == -1) {
-      std::cerr << "Failed to pre-allocate space: " << strerror(errno)
-                << std::endl;
+    // Writes to a file that could not be created fail as they always did
+    file_states_[i] = allocate_file(file).value_or(FileState::Empty);
+  }
+}
+
+std::optional<FileManager::FileState>
+LinuxFileManager::allocate_file(const FileInfo &file) {
+  int fd = open(file.path.c_str(), O_WRONLY | O_CREAT, 0666);
+  if (fd == -1) {
+    std::cerr << "Failed to open file for pre-allocation: " << strerror(errno)
+              << std::endl;
+    return std::nullopt;
+  }
+
+  // Leave files that already have the right size untouched, truncating
+  // would bump their modification time and invalidate resume data
+  FileState state = FileState::Empty;
+  struct stat statbuf;
+  if (fstat(fd, &statbuf) == 0 && statbuf.st_size > 0) {
+    has_existing_data_ = true;
+    state = FileState::InUse;
+    if (static_cast<uint64_t>(statbuf.st_size) == file.length) {
+      close(fd);
+      return state;
     }
+  }
+
+  if (ftruncate(fd, file.length) == -1) {
+    std::cerr << "Failed to pre-allocate space: " << strerror(errno)
+              << std::endl;
     close(fd);
+    return std::nullopt;
   }
+  close(fd);
+  return state;
 }
 
-bool LinuxFileManager::write_piece(uint32_t piece_index,
-                                   std::vector<std::byte> &data) {
-  std::lock_guard<std::mutex> lock(file_mutex_);
-
-  if (piece_index >= total_pieces()) {
-    std::cerr << "Invalid piece index: " << piece_index << std::endl;
+bool LinuxFileManager::set_file_priority(size_t file_index,
+                                         Priority priority) {
+  if (file_index >= files_.size()) {
     return false;
   }
+  std::lock_guard<std::mutex> lock(file_mutex_);
+  const FileInfo &file = files_[file_index];
+  FileState state = file_states_[file_index];
 
-  uint64_t offset = static_cast<uint64_t>(piece_index * piece_length_);
-  uint64_t remaining_data = static_cast<uint64_t>(piece_length_);
-  size_t data_offset = 0;
+  if (priority == Priority::Skip && state == FileState::Empty) {
+    // Nothing of it was downloaded, so it need not exist at all
+    if (unlink(file.path.c_str()) == 0) {
+      file_states_[file_index] = FileState::Absent;
+    }
+  } else if (priority != Priority::Skip && state == FileState::Absent) {
+    // Reads keep going to the part file until its bytes were copied over
+    if (!allocate_file(file) || !move_from_part_file(file)) {
+      return false;
+    }
+    file_states_[file_index] = FileState::InUse;
+  }
 
-  for (const auto &file : files_) {
+  file_priorities_[file_index] = priority;
+  return true;
+}
 
-    if (offset < file.end_offset) {
-      uint64_t file_offset = offset - file.start_offset;
-      uint64_t write_size = std::min(remaining_data, file.length - file_offset);
+bool LinuxFileManager::move_from_part_file(const FileInfo &file) {
+  if (file.length == 0) {
+    return true;
+  }
+  int fd = open(part_path_.c_str(), O_RDONLY);
+  if (fd == -1) {
+    return errno == ENOENT; // Nothing was ever kept for a skipped file
+  }
 
-      std::string data_str(reinterpret_cast<char *>(&data[data_offset]),
-                           write_size);
+  // Pieces shared with a wanted file and pieces read on demand end up in
+  // the part file, which is sparse, so every data region of it within the
+  // file is copied
+  std::vector<std::byte> buffer(piece_length_);
+  bool ok = true;
+  uint64_t position = file.start_offset;
+  while (ok && position < file.end_offset) {
+    off_t data = lseek(fd, static_cast<off_t>(position), SEEK_DATA);
+    if (data == -1) {
+      ok = errno == ENXIO; // No data beyond position
+      break;
+    }
+    off_t hole = lseek(fd, data, SEEK_HOLE);
+    if (hole == -1) {
+      ok = false;
+      break;
+    }
 
-      if (!write_to_file(file.path, file_offset, &data[data_offset],
-                         write_size)) {
-        std::cerr << "Failed to write to file: " << file.path << std::endl;
-        return false;
+    uint64_t end = std::min(static_cast<uint64_t>(hole), file.end_offset);
+    for (auto begin = static_cast<uint64_t>(data); begin < end;) {
+      ssize_t result = pread(fd, buffer.data(),
+                             std::min<uint64_t>(buffer.size(), end - begin),
+                             static_cast<off_t>(begin));
+      if (result == -1 && errno == EINTR) {
+        continue;
       }
-
-      offset += write_size;
-      remaining_data -= write_size;
-      data_offset += write_size;
-
-      if (remaining_data == 0) {
+      if (result <= 0 ||
+          !write_to_file(file.path, begin - file.start_offset, buffer.data(),
+                         static_cast<uint64_t>(result))) {
+        ok = false;
         break;
       }
+      begin += static_cast<uint64_t>(result);
     }
+    position = std::max(position, end);
   }
+  close(fd);
+  return ok;
+}
 
-  return true;
+bool LinuxFileManager::write_piece(uint32_t piece_index,
+                                   std::vector<std::byte> &data) {
+  return write_block(piece_index, 0, data.data(),
+                     static_cast<uint32_t>(data.size()));
+}
+
+bool LinuxFileManager::write_block(uint32_t piece_index, uint32_t offset,
+                                   const std::byte *data, uint32_t length) {
+  std::lock_guard<std::mutex> lock(file_mutex_);
+
+  if (piece_index >= total_pieces()) {
+    std::cerr << "Invalid piece index: " << piece_index << std::endl;
+    return false;
+  }
+
+  uint64_t global_offset =
+      static_cast<uint64_t>(piece_index) * piece_length_ + offset;
+
+  return for_each_segment(
+      global_offset, length,
+      [this, data](const FileInfo &file, uint64_t file_offset,
+                   uint64_t data_offset, uint64_t size) {
+        Location where = locate(file, file_offset);
+        bool in_part_file = &where.path == &part_path_;
+        if (!write_to_file(where.path, where.offset, data + data_offset, size,
+                           in_part_file)) {
+          std::cerr << "Failed to write to file: " << where.path << std::endl;
+          return false;
+        }
+        if (!in_part_file) {
+          file_states_[&file - files_.data()] = FileState::InUse;
+        }
+        return true;
+      });
 }
 
 bool LinuxFileManager::write_to_file(const std::string &path, uint64_t offset,
-                                     const std::byte *data, uint64_t length) {
-  int fd = open(path.c_str(), O_WRONLY);
+                                     const std::byte *data, uint64_t length,
+                                     bool create) {
+  int fd = open(path.c_str(), O_WRONLY | (create ? O_CREAT : 0), 0666);
   if (fd == -1) {
     std::cerr << "Failed to open file for writing: " << strerror(errno)
               << std::endl;
     return false;
   }
 
-  lseek(fd, offset, SEEK_SET);
-  ssize_t bytes_written = write(fd, data, length);
+  ssize_t bytes_written = pwrite(fd, data, length, offset);
   close(fd);
 
   if (static_cast<uint64_t>(bytes_written) != length) {
@@ -2,11 +2,15 @@
 #define FILEMANAGER_H
 
 #include "Torrent/Torrent.h"
+#include <atomic>
 #include <cerrno>
 #include <cstdint>
 #include <cstring>
 #include <fcntl.h>
+#include <functional>
 #include <mutex>
+#include <optional>
+#include <string>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -17,6 +21,12 @@
  *
  * This class provides the interface for reading and writing pieces of a
  * torrent.
+ *
+ * Files can be skipped. A skipped file is not created, and the bytes of it
+ * that must still be downloaded, because they share a piece with a wanted
+ * file or are read on demand, are kept in a part file instead. The part
+ * file mirrors the offsets of the whole torrent and is sparse, so it only
+ * takes the space of what was written to it.
  */
 class FileManager {
 public:
@@ -46,7 +56,153 @@ public:
   virtual bool write_piece(uint32_t piece_index,
                            std::vector<std::byte> &data) = 0;
 
+  /**
+   * @brief Writes a block of data inside a piece.
+   *
+   * @param piece_index The index of the piece to write to.
+   * @param offset The offset within the piece to start writing.
+   * @param data The data to write.
+   * @param length The number of bytes to write.
+   * @return true if the block was written successfully, false otherwise.
+   */
+  virtual bool write_block(uint32_t piece_index, uint32_t offset,
+                           const std::byte *data, uint32_t length) = 0;
+
+  /**
+   * @brief Reads an arbitrary byte range of the torrent.
+   *
+   * Safe to call from several threads at once; large ranges are read with
+   * one sequential read per file they span.
+   *
+   * @param offset The offset of the range within the whole torrent.
+   * @param buffer Destination, at least @p length bytes.
+   * @param length The number of bytes to read.
+   * @return true if the whole range was read, false otherwise.
+   */
+  virtual bool read_range(uint64_t offset, std::byte *buffer,
+                          uint64_t length) const = 0;
+
+  /**
+   * @brief Reads a block of data from a piece into caller-provided memory,
+   * such as a pooled buffer.
+   *
+   * @param piece_index The index of the piece to read from.
+   * @param offset The offset within the piece to start reading.
+   * @param buffer Destination, at least @p length bytes.
+   * @param length The number of bytes to read.
+   * @return true if the whole block was read, false otherwise.
+   */
+  bool read_block_into(uint32_t piece_index, uint32_t offset,
+                       std::byte *buffer, uint32_t length) const {
+    return read_range(uint64_t{piece_index} * piece_length_ + offset, buffer,
+                      length);
+  }
+
+  /**
+   * @brief Gets the expected hashes of the pieces.
+   *
+   * @return The SHA-1 hash of every piece.
+   */
+  const PieceHashes &piece_hashes() const { return piece_hashes_; }
+
+  /**
+   * @brief Checks whether any file held data before this FileManager was
+   * created.
+   *
+   * @return true if existing data may need to be checked.
+   */
+  bool has_existing_data() const { return has_existing_data_; }
+
+  /**
+   * @brief Gets the files managed by this FileManager.
+   *
+   * @return The list of files in the torrent.
+   */
+  const std::vector<FileInfo> &files() const { return files_; }
+
+  /**
+   * @brief Gets the priority of a file.
+   *
+   * @param file_index The index of the file.
+   * @return The priority, Priority::Skip for an invalid index.
+   */
+  Priority file_priority(size_t file_index) const;
+
+  /**
+   * @brief Changes the priority of a file.
+   *
+   * A skipped file that nothing was written to yet is removed again; one
+   * that is no longer skipped is created and takes over its bytes from the
+   * part file. Data already written to a file stays there.
+   *
+   * @param file_index The index of the file.
+   * @param priority The new priority.
+   * @return true if the priority was changed, false otherwise.
+   */
+  virtual bool set_file_priority(size_t file_index, Priority priority) = 0;
+
+  /**
+   * @brief Maps the file priorities onto the pieces.
+   *
+   * @return The priority of every piece, the highest of the files it
+   * overlaps; Priority::Skip only if all of them are skipped.
+   */
+  std::vector<Priority> piece_priorities() const;
+
+  /**
+   * @brief Gets the path of the part file.
+   *
+   * @return The path, whether or not the file exists.
+   */
+  const std::string &part_path() const { return part_path_; }
+
 protected:
+  /**
+   * @brief Whether and how a file exists on disk.
+   */
+  enum class FileState : uint8_t {
+    Absent, ///< Not created, its bytes are kept in the part file.
+    Empty,  ///< Created, nothing written to it yet.
+    InUse   ///< Holds data.
+  };
+
+  /**
+   * @brief Where a segment of a file is stored.
+   */
+  struct Location {
+    const std::string &path; ///< The file itself, or the part file.
+    uint64_t offset;         ///< The offset within that file.
+  };
+
+  /**
+   * @brief Finds where a segment of a file is stored.
+   *
+   * @param file The file, one of files_.
+   * @param file_offset The offset of the segment within the file.
+   * @return The location.
+   */
+  Location locate(const FileInfo &file, uint64_t file_offset) const;
+
+  /**
+   * @brief Callback for one file segment of a byte range.
+   *
+   * Receives the file, the offset within that file, the offset within the
+   * requested range and the segment length. Returning false stops the walk.
+   */
+  using SegmentVisitor =
+      std::function<bool(const FileInfo &, uint64_t, uint64_t, uint64_t)>;
+
+  /**
+   * @brief Splits a byte range of the torrent into per-file segments.
+   *
+   * @param offset The offset of the range within the whole torrent.
+   * @param length The length of the range in bytes.
+   * @param visit Callback invoked for every segment, in order.
+   * @return true if the whole range was visited successfully.
+   */
+  bool for_each_segment(uint64_t offset, uint64_t length,
+                        const SegmentVisitor &visit) const;
+
   /**
    * @brief Pre-allocates space for the files.
    */
@@ -58,9 +214,15 @@ protected:
    * @param files The list of files in the torrent.
    * @param piece_length The length of each piece in bytes.
    * @param info_hashes The info hashes of the torrent.
+   * @param file_priorities The priority of each file, Priority::Normal for
+   * any not listed.
+   * @param part_path Where to keep the bytes of skipped files, empty for
+   * the first file's path with ".parts" appended.
    */
   FileManager(const std::vector<FileInfo> &files, uint32_t piece_length,
-              std::vector<InfoHash> info_hashes);
+              const PieceHashes &info_hashes,
+              const std::vector<Priority> &file_priorities,
+              const std::string &part_path);
 
   /**
    * @brief Gets the total number of pieces.
@@ -71,6 +233,13 @@ protected:
 
   std::vector<FileInfo> files_; ///< The list of files in the torrent.
   uint32_t piece_length_;       ///< The length of each piece in bytes.
+  PieceHashes piece_hashes_;    ///< The expected hash of every piece.
+  bool has_existing_data_ = false; ///< Whether files held data at startup.
+  std::vector<std::atomic<Priority>>
+      file_priorities_; ///< Priority of each file.
+  std::vector<std::atomic<FileState>>
+      file_states_;       ///< Changed with file_mutex_ held.
+  std::string part_path_; ///< Holds the bytes of files not created.
 
   mutable std::mutex
       file_mutex_; ///< Mutex for thread-safe access to file operations.
@@ -90,9 +259,15 @@ public:
    * @param files The list of files in the torrent.
    * @param piece_length The length of each piece in bytes.
    * @param info_hashes The info hashes of the torrent.
+   * @param file_priorities The priority of each file, Priority::Normal for
+   * any not listed. Skipped files are not created.
+   * @param part_path Where to keep the bytes of skipped files, empty for
+   * the first file's path with ".parts" appended.
    */
   LinuxFileManager(const std::vector<FileInfo> &files, uint32_t piece_length,
-                   std::vector<InfoHash> info_hashes);
+                   const PieceHashes &info_hashes,
+                   const std::vector<Priority> &file_priorities = {},
+                   const std::string &part_path = "");
 
   /**
    * @brief Virtual destructor.
@@ -121,6 +296,39 @@ public:
   virtual bool write_piece(uint32_t piece_index,
                            std::vector<std::byte> &data) override;
 
+  /**
+   * @brief Writes a block of data inside a piece.
+   *
+   * @param piece_index The index of the piece to write to.
+   * @param offset The offset within the piece to start writing.
+   * @param data The data to write.
+   * @param length The number of bytes to write.
+   * @return true if the block was written successfully, false otherwise.
+   */
+  virtual bool write_block(uint32_t piece_index, uint32_t offset,
+                           const std::byte *data, uint32_t length) override;
+
+  /**
+   * @brief Reads an arbitrary byte range of the torrent.
+   *
+   * @param offset The offset of the range within the whole torrent.
+   * @param buffer Destination, at least @p length bytes.
+   * @param length The number of bytes to read.
+   * @return true if the whole range was read, false otherwise.
+   */
+  virtual bool read_range(uint64_t offset, std::byte *buffer,
+                          uint64_t length) const override;
+
+  /**
+   * @brief Changes the priority of a file.
+   *
+   * @param file_index The index of the file.
+   * @param priority The new priority.
+   * @return true if the priority was changed, false otherwise.
+   */
+  virtual bool set_file_priority(size_t file_index,
+                                 Priority priority) override;
+
 protected:
   /**
    * @brief Pre-allocates space for the files.
@@ -128,6 +336,25 @@ protected:
   virtual void pre_allocate_space() override;
 
 private:
+  /**
+   * @brief Creates a file with its full size, leaving one that already has
+   * it untouched. Must be called with file_mutex_ held.
+   *
+   * @param file The file.
+   * @return The state the file is in, or nothing if it could not be
+   * created.
+   */
+  std::optional<FileState> allocate_file(const FileInfo &file);
+
+  /**
+   * @brief Copies the bytes of a file that was not created out of the part
+   * file into it. Must be called with file_mutex_ held.
+   *
+   * @param file The file, which must exist now.
+   * @return true if everything the part file held was copied.
+   */
+  bool move_from_part_file(const FileInfo &file);
+
   /**
    * @brief Writes data to a file.
    *
@@ -135,10 +362,12 @@ private:
    * @param offset The offset within the file to start writing.
    * @param data The data to write.
    * @param length The number of bytes to write.
+   * @param create Whether to create the file if it does not exist.
    * @return true if the data was written successfully, false otherwise.
    */
   bool write_to_file(const std::string &path, uint64_t offset,
-                     const std::byte *data, uint64_t length);
+                     const std::byte *data, uint64_t length,
+                     bool create = false);
 };
 
 #endif // FILEMANAGER_H
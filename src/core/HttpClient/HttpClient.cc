@@ -0,0 +1,222 @@
+#include "HttpClient.h"
+#include <mutex>
+#include <stdexcept>
+
+namespace {
+
+long to_millis(std::chrono::steady_clock::duration duration) {
+  return static_cast<long>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(duration).count());
+}
+
+} // namespace
+
+HttpClient::HttpClient(boost::asio::io_context &io_context)
+    : strand_(io_context.get_executor()), timer_(strand_) {
+  static std::once_flag curl_initialized;
+  std::call_once(curl_initialized,
+                 []() { curl_global_init(CURL_GLOBAL_DEFAULT); });
+
+  multi_ = curl_multi_init();
+  if (multi_ == nullptr) {
+    throw std::runtime_error("Failed to initialize libcurl.");
+  }
+  curl_multi_setopt(multi_, CURLMOPT_SOCKETFUNCTION, &socket_callback);
+  curl_multi_setopt(multi_, CURLMOPT_SOCKETDATA, this);
+  curl_multi_setopt(multi_, CURLMOPT_TIMERFUNCTION, &timer_callback);
+  curl_multi_setopt(multi_, CURLMOPT_TIMERDATA, this);
+  curl_multi_setopt(multi_, CURLMOPT_MAXCONNECTS, HTTP_MAX_IDLE_CONNECTIONS);
+}
+
+HttpClient::~HttpClient() {
+  for (auto &entry : requests_) {
+    curl_multi_remove_handle(multi_, entry.first);
+    curl_easy_cleanup(entry.first);
+  }
+  requests_.clear();
+
+  // Closes the pooled connections, reporting their sockets as removed
+  curl_multi_cleanup(multi_);
+  for (auto &entry : watches_) {
+    entry.second->descriptor.release(); // curl closes its own sockets
+  }
+}
+
+void HttpClient::get(const std::string &url, Callback on_done) {
+  boost::asio::post(strand_, [self = shared_from_this(), url,
+                              on_done = std::move(on_done)]() mutable {
+    self->start_request(url, std::move(on_done));
+  });
+}
+
+void HttpClient::close() {
+  boost::asio::post(strand_, [self = shared_from_this()]() {
+    self->closed_ = true;
+    self->timer_.cancel();
+    for (auto &entry : self->requests_) {
+      curl_multi_remove_handle(self->multi_, entry.first);
+      curl_easy_cleanup(entry.first);
+    }
+    self->requests_.clear();
+  });
+}
+
+void HttpClient::start_request(const std::string &url, Callback on_done) {
+  if (closed_) {
+    return;
+  }
+
+  CURL *easy = curl_easy_init();
+  if (easy == nullptr) {
+    HttpResponse response;
+    response.error = "Failed to initialize libcurl.";
+    on_done(std::move(response));
+    return;
+  }
+
+  auto request = std::make_unique<Request>();
+  request->easy = easy;
+  request->on_done = std::move(on_done);
+
+  curl_easy_setopt(easy, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, &write_callback);
+  curl_easy_setopt(easy, CURLOPT_WRITEDATA, request.get());
+  curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(easy, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(easy, CURLOPT_TIMEOUT_MS, to_millis(HTTP_REQUEST_TIMEOUT));
+  curl_easy_setopt(easy, CURLOPT_CONNECTTIMEOUT_MS,
+                   to_millis(HTTP_CONNECT_TIMEOUT));
+  curl_easy_setopt(easy, CURLOPT_DNS_CACHE_TIMEOUT,
+                   static_cast<long>(HTTP_DNS_CACHE_TIME.count()));
+  curl_easy_setopt(easy, CURLOPT_TCP_KEEPALIVE, 1L);
+
+  // Handle SSL if necessary
+  curl_easy_setopt(easy, CURLOPT_SSL_VERIFYPEER, 0L);
+  curl_easy_setopt(easy, CURLOPT_SSL_VERIFYHOST, 0L);
+
+  requests_.emplace(easy, std::move(request));
+  curl_multi_add_handle(multi_, easy);
+}
+
+void HttpClient::arm(const std::shared_ptr<Watch> &watch) {
+  if ((watch->events & CURL_POLL_IN) && !watch->reading) {
+    watch->reading = true;
+    watch->descriptor.async_wait(
+        boost::asio::posix::descriptor_base::wait_read,
+        [self = shared_from_this(), watch](
+            const boost::system::error_code &error) {
+          self->handle_ready(watch, CURL_CSELECT_IN, error);
+        });
+  }
+  if ((watch->events & CURL_POLL_OUT) && !watch->writing) {
+    watch->writing = true;
+    watch->descriptor.async_wait(
+        boost::asio::posix::descriptor_base::wait_write,
+        [self = shared_from_this(), watch](
+            const boost::system::error_code &error) {
+          self->handle_ready(watch, CURL_CSELECT_OUT, error);
+        });
+  }
+}
+
+void HttpClient::handle_ready(const std::shared_ptr<Watch> &watch, int event,
+                              const boost::system::error_code &error) {
+  (event == CURL_CSELECT_IN ? watch->reading : watch->writing) = false;
+  if (watch->removed || closed_ ||
+      error == boost::asio::error::operation_aborted) {
+    return;
+  }
+
+  socket_action(watch->descriptor.native_handle(),
+                error ? CURL_CSELECT_ERR : event);
+  if (!watch->removed) {
+    arm(watch);
+  }
+}
+
+void HttpClient::socket_action(curl_socket_t fd, int events) {
+  int running = 0;
+  curl_multi_socket_action(multi_, fd, events, &running);
+  complete_finished();
+}
+
+void HttpClient::complete_finished() {
+  int pending = 0;
+  while (CURLMsg *message = curl_multi_info_read(multi_, &pending)) {
+    if (message->msg != CURLMSG_DONE) {
+      continue;
+    }
+    CURL *easy = message->easy_handle;
+    CURLcode result = message->data.result;
+    auto it = requests_.find(easy);
+    if (it == requests_.end()) {
+      continue;
+    }
+    std::unique_ptr<Request> request = std::move(it->second);
+    requests_.erase(it);
+
+    HttpResponse response;
+    if (result != CURLE_OK) {
+      response.error = curl_easy_strerror(result);
+    }
+    curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &response.status);
+    response.body = std::move(request->body);
+
+    // The connection stays in the multi handle's pool for the next request
+    curl_multi_remove_handle(multi_, easy);
+    curl_easy_cleanup(easy);
+    request->on_done(std::move(response));
+  }
+}
+
+int HttpClient::socket_callback(CURL *, curl_socket_t fd, int what,
+                                void *client, void *) {
+  auto *self = static_cast<HttpClient *>(client);
+  auto it = self->watches_.find(fd);
+
+  if (what == CURL_POLL_REMOVE) {
+    if (it != self->watches_.end()) {
+      it->second->removed = true;
+      it->second->descriptor.release(); // Cancels the waits, curl closes it
+      self->watches_.erase(it);
+    }
+    return 0;
+  }
+
+  if (it == self->watches_.end()) {
+    it = self->watches_
+             .emplace(fd, std::make_shared<Watch>(self->strand_, fd))
+             .first;
+  }
+  it->second->events = what;
+  self->arm(it->second);
+  return 0;
+}
+
+int HttpClient::timer_callback(CURLM *, long timeout_ms, void *client) {
+  auto *self = static_cast<HttpClient *>(client);
+  if (timeout_ms < 0) {
+    self->timer_.cancel();
+    return 0;
+  }
+
+  // May be called while the client is being destroyed
+  std::shared_ptr<HttpClient> alive = self->weak_from_this().lock();
+  if (alive == nullptr) {
+    return 0;
+  }
+  self->timer_.expires_after(std::chrono::milliseconds(timeout_ms));
+  self->timer_.async_wait(
+      [alive](const boost::system::error_code &error) {
+        if (!error && !alive->closed_) {
+          alive->socket_action(CURL_SOCKET_TIMEOUT, 0);
+        }
+      });
+  return 0;
+}
+
+size_t HttpClient::write_callback(char *data, size_t size, size_t count,
+                                  void *request) {
+  static_cast<Request *>(request)->body.append(data, size * count);
+  return size * count;
+}
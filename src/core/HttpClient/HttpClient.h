@@ -0,0 +1,177 @@
+#ifndef HTTPCLIENT_H
+#define HTTPCLIENT_H
+
+#include <boost/asio.hpp>
+#include <chrono>
+#include <curl/curl.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+/// Longest a request may take, connecting included.
+const std::chrono::seconds HTTP_REQUEST_TIMEOUT(30);
+
+/// Longest connecting to a server may take.
+const std::chrono::seconds HTTP_CONNECT_TIMEOUT(10);
+
+/// How long resolved host names are reused.
+const std::chrono::seconds HTTP_DNS_CACHE_TIME(600);
+
+/// Number of idle connections kept open for reuse.
+const long HTTP_MAX_IDLE_CONNECTIONS = 64;
+
+/**
+ * @brief Result of an HTTP request.
+ */
+struct HttpResponse {
+  std::string error; ///< Why the transfer failed, empty if it succeeded.
+  long status = 0;   ///< HTTP status code, 0 if no response arrived.
+  std::string body;  ///< The response body.
+};
+
+/**
+ * @brief Performs HTTP requests on an IO context without blocking it.
+ *
+ * Drives one libcurl multi handle from Asio: curl tells us which sockets to
+ * watch and when to wake it, and the IO context does the waiting. All
+ * requests share the multi handle, so connections to a server are reused
+ * and host names are resolved once. Everything runs on one strand, so the
+ * client may be shared by any number of threads.
+ *
+ * Handlers keep the client alive, so it must be owned by a std::shared_ptr.
+ */
+class HttpClient : public std::enable_shared_from_this<HttpClient> {
+public:
+  /**
+   * @brief Callback receiving the result of a request.
+   *
+   * Runs on the client's strand.
+   */
+  using Callback = std::function<void(HttpResponse)>;
+
+  /**
+   * @brief Constructs an HttpClient.
+   *
+   * @param io_context The IO context to wait on.
+   * @throws std::runtime_error if libcurl cannot be initialized.
+   */
+  explicit HttpClient(boost::asio::io_context &io_context);
+
+  /// @brief Releases the multi handle.
+  ~HttpClient();
+
+  /// @brief Clients own the multi handle and cannot be copied.
+  HttpClient(const HttpClient &) = delete;
+
+  /// @brief Clients own the multi handle and cannot be copied.
+  HttpClient &operator=(const HttpClient &) = delete;
+
+  /**
+   * @brief Starts a GET request.
+   *
+   * @param url The URL to fetch.
+   * @param on_done Receives the response, or the error if the request
+   * failed or timed out.
+   */
+  void get(const std::string &url, Callback on_done);
+
+  /**
+   * @brief Abandons all requests; their callbacks are never invoked.
+   *
+   * Requests started afterwards are dropped as well.
+   */
+  void close();
+
+private:
+  /**
+   * @brief A request in progress.
+   */
+  struct Request {
+    CURL *easy = nullptr; ///< The easy handle performing the request.
+    std::string body;     ///< The response body received so far.
+    Callback on_done;     ///< Receives the response.
+  };
+
+  /**
+   * @brief A socket curl asked us to watch.
+   */
+  struct Watch {
+    explicit Watch(const boost::asio::any_io_executor &executor, int fd)
+        : descriptor(executor, fd) {}
+
+    boost::asio::posix::stream_descriptor descriptor; ///< Waits on the fd.
+    int events = 0;       ///< CURL_POLL_* events curl is interested in.
+    bool reading = false; ///< A wait for readability is pending.
+    bool writing = false; ///< A wait for writability is pending.
+    bool removed = false; ///< curl is done with the socket.
+  };
+
+  /**
+   * @brief Adds a request to the multi handle, on the strand.
+   *
+   * @param url The URL to fetch.
+   * @param on_done Receives the response.
+   */
+  void start_request(const std::string &url, Callback on_done);
+
+  /**
+   * @brief Starts the waits a watched socket still needs.
+   *
+   * @param watch The socket.
+   */
+  void arm(const std::shared_ptr<Watch> &watch);
+
+  /**
+   * @brief Tells curl that a watched socket is ready.
+   *
+   * @param watch The socket.
+   * @param event CURL_CSELECT_IN or CURL_CSELECT_OUT.
+   * @param error The result of the wait.
+   */
+  void handle_ready(const std::shared_ptr<Watch> &watch, int event,
+                    const boost::system::error_code &error);
+
+  /**
+   * @brief Lets curl act on a socket or, for CURL_SOCKET_TIMEOUT, on its
+   * timeouts, then completes finished requests.
+   *
+   * @param fd The socket, or CURL_SOCKET_TIMEOUT.
+   * @param events The CURL_CSELECT_* events that occurred.
+   */
+  void socket_action(curl_socket_t fd, int events);
+
+  /**
+   * @brief Hands every finished request to its callback.
+   */
+  void complete_finished();
+
+  /**
+   * @brief CURLMOPT_SOCKETFUNCTION, called when a socket's events change.
+   */
+  static int socket_callback(CURL *easy, curl_socket_t fd, int what,
+                             void *client, void *socket_data);
+
+  /**
+   * @brief CURLMOPT_TIMERFUNCTION, called when curl's next timeout changes.
+   */
+  static int timer_callback(CURLM *multi, long timeout_ms, void *client);
+
+  /**
+   * @brief CURLOPT_WRITEFUNCTION, appends received data to a request.
+   */
+  static size_t write_callback(char *data, size_t size, size_t count,
+                               void *request);
+
+  boost::asio::strand<boost::asio::io_context::executor_type>
+      strand_;                       ///< Serializes all use of curl.
+  boost::asio::steady_timer timer_;  ///< Fires curl's timeouts.
+  CURLM *multi_ = nullptr;           ///< Shared by all requests.
+  bool closed_ = false;              ///< Set by close().
+  std::unordered_map<CURL *, std::unique_ptr<Request>>
+      requests_; ///< Requests in progress by easy handle.
+  std::unordered_map<curl_socket_t, std::shared_ptr<Watch>>
+      watches_; ///< Sockets curl asked us to watch.
+};
+
+#endif // HTTPCLIENT_H
@@ -0,0 +1,38 @@
+#include "MemoryBudget.h"
+#include <utility>
+
+MemoryBudget::Reservation::Reservation(Reservation &&other) noexcept
+    : budget_(std::move(other.budget_)),
+      bytes_(std::exchange(other.bytes_, 0)) {}
+
+MemoryBudget::Reservation &
+MemoryBudget::Reservation::operator=(Reservation &&other) noexcept {
+  if (this != &other) {
+    Reservation released(std::move(*this));
+    budget_ = std::move(other.budget_);
+    bytes_ = std::exchange(other.bytes_, 0);
+  }
+  return *this;
+}
+
+MemoryBudget::Reservation::~Reservation() {
+  if (budget_ != nullptr) {
+    budget_->in_use_ -= bytes_;
+  }
+}
+
+std::shared_ptr<MemoryBudget> MemoryBudget::global() {
+  static std::shared_ptr<MemoryBudget> budget =
+      std::make_shared<MemoryBudget>();
+  return budget;
+}
+
+MemoryBudget::Reservation MemoryBudget::reserve(uint64_t bytes) {
+  uint64_t in_use = in_use_.load();
+  do {
+    if (in_use + bytes > limit_) {
+      return Reservation();
+    }
+  } while (!in_use_.compare_exchange_weak(in_use, in_use + bytes));
+  return Reservation(shared_from_this(), bytes);
+}
@@ -0,0 +1,104 @@
+#ifndef MEMORYBUDGET_H
+#define MEMORYBUDGET_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+/// Memory all torrents together may hold in pieces being assembled.
+const uint64_t IN_FLIGHT_MEMORY_BUDGET = 256 * 1024 * 1024;
+
+/**
+ * @brief Bounds the memory held by pieces that are still downloading.
+ *
+ * A piece is assembled in memory only if its size fits the budget; the
+ * blocks of any other piece go to disk as they arrive. Resident memory then
+ * stays near the budget however large the pieces and however many peers
+ * there are. Thread-safe; must be owned by a std::shared_ptr.
+ */
+class MemoryBudget : public std::enable_shared_from_this<MemoryBudget> {
+public:
+  /**
+   * @brief Memory granted by a budget, given back when destroyed.
+   */
+  class Reservation {
+  public:
+    Reservation() = default;
+    Reservation(Reservation &&other) noexcept;
+    Reservation &operator=(Reservation &&other) noexcept;
+    ~Reservation();
+
+    /**
+     * @brief Gets the memory granted.
+     *
+     * @return The number of bytes.
+     */
+    uint64_t bytes() const { return bytes_; }
+
+    /**
+     * @brief Checks whether the budget granted the memory.
+     */
+    explicit operator bool() const { return budget_ != nullptr; }
+
+  private:
+    friend class MemoryBudget;
+
+    Reservation(std::shared_ptr<MemoryBudget> budget, uint64_t bytes)
+        : budget_(std::move(budget)), bytes_(bytes) {}
+
+    std::shared_ptr<MemoryBudget> budget_; ///< Null if nothing was granted.
+    uint64_t bytes_ = 0;                   ///< Memory granted.
+  };
+
+  /**
+   * @brief Gets the budget shared by all torrents of the process.
+   *
+   * @return The budget, IN_FLIGHT_MEMORY_BUDGET unless changed.
+   */
+  static std::shared_ptr<MemoryBudget> global();
+
+  /**
+   * @brief Constructs a budget with nothing in use.
+   *
+   * @param limit Memory that may be reserved at once.
+   */
+  explicit MemoryBudget(uint64_t limit = IN_FLIGHT_MEMORY_BUDGET)
+      : limit_(limit) {}
+
+  /**
+   * @brief Reserves memory if the budget has room for it.
+   *
+   * @param bytes The memory wanted.
+   * @return The reservation, empty if it would exceed the limit.
+   */
+  Reservation reserve(uint64_t bytes);
+
+  /**
+   * @brief Changes the limit. Reservations beyond a lowered limit are kept
+   * until they are given back.
+   *
+   * @param limit Memory that may be reserved at once.
+   */
+  void set_limit(uint64_t limit) { limit_ = limit; }
+
+  /**
+   * @brief Gets the limit.
+   *
+   * @return The number of bytes.
+   */
+  uint64_t limit() const { return limit_; }
+
+  /**
+   * @brief Gets the memory reserved.
+   *
+   * @return The number of bytes.
+   */
+  uint64_t in_use() const { return in_use_; }
+
+private:
+  std::atomic<uint64_t> limit_;     ///< Memory that may be reserved.
+  std::atomic<uint64_t> in_use_{0}; ///< Memory reserved.
+};
+
+#endif // MEMORYBUDGET_H
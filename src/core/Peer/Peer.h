@@ -1,7 +1,15 @@
+#ifndef PEER_H
+#define PEER_H
+
 #include <array>
+#include <boost/asio/ip/tcp.hpp>
+#include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <tuple>
 
 /**
  * @brief Represents a peer in the BitTorrent network.
@@ -20,16 +28,18 @@ struct Peer {
   std::optional<Id> id;
 
   /**
-   * @brief The IP address of the peer.
-   * 
-   * This is a string representation of the IP address (e.g., "192.168.1.1").
+   * @brief The address and port at which the torrent service is running.
+   *
+   * Decoded straight from the tracker's binary peer list, so connecting
+   * needs no resolver. Only the port is set if the peer is known by host.
    */
-  std::string ip;
+  boost::asio::ip::tcp::endpoint endpoint;
 
   /**
-   * @brief The port number at which the torrent service is running.
+   * @brief The DNS name of the peer, if a tracker's dictionary peer list
+   * named it instead of giving a literal address; empty otherwise.
    */
-  uint16_t port;
+  std::string host;
 
   /**
    * @brief Checks if the peer ID is set.
@@ -37,4 +47,33 @@ struct Peer {
    * @return true if the peer ID is set, false otherwise.
    */
   bool is_id_set() const { return id.has_value(); }
+
+  /**
+   * @brief Orders peers by where they are reached, ignoring their ID, so
+   * duplicates from several trackers can be found with a set.
+   */
+  bool operator<(const Peer &other) const {
+    return std::tie(endpoint, host) < std::tie(other.endpoint, other.host);
+  }
 };
+
+/**
+ * @brief Hashes a TCP endpoint for unordered containers.
+ */
+struct EndpointHasher {
+  size_t operator()(const boost::asio::ip::tcp::endpoint &endpoint) const
+      noexcept {
+    const auto &address = endpoint.address();
+    size_t hash;
+    if (address.is_v4()) {
+      hash = std::hash<uint32_t>()(address.to_v4().to_uint());
+    } else {
+      auto bytes = address.to_v6().to_bytes();
+      hash = std::hash<std::string_view>()(std::string_view(
+          reinterpret_cast<const char *>(bytes.data()), bytes.size()));
+    }
+    return hash * 31 + endpoint.port();
+  }
+};
+
+#endif // PEER_H
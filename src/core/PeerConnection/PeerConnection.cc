@@ -1,8 +1,11 @@
 #include "PeerConnection.h"
+#include "Logger/Logger.h"
 #include "Message/Message.h"
 #include "Torrent/Torrent.h"
+#include "Utils/utils.h"
 #include <boost/asio.hpp>
-#include <unordered_set>
+#include <cstring>
+#include <utility>
 #include <vector>
 
 std::vector<std::byte> create_handshake(const InfoHash &info_hash,
@@ -33,22 +36,299 @@ std::vector<std::byte> create_handshake(const InfoHash &info_hash,
   return handshake;
 }
 
+void append_uint32(std::vector<std::byte> &buffer, uint32_t value) {
+  buffer.push_back(static_cast<std::byte>((value >> 24) & 0xFF));
+  buffer.push_back(static_cast<std::byte>((value >> 16) & 0xFF));
+  buffer.push_back(static_cast<std::byte>((value >> 8) & 0xFF));
+  buffer.push_back(static_cast<std::byte>(value & 0xFF));
+}
+
+std::vector<std::byte> create_message(MessageType type,
+                                      uint32_t payload_size) {
+  std::vector<std::byte> message;
+  message.reserve(5 + payload_size);
+  append_uint32(message, 1 + payload_size);
+  message.push_back(static_cast<std::byte>(type));
+  return message;
+}
+
+namespace {
+
+/**
+ * @brief Packs a block's piece and index into one key.
+ */
+uint64_t block_key(uint32_t piece_index, uint32_t block_index) {
+  return (uint64_t{piece_index} << 32) | block_index;
+}
+
+/**
+ * @brief Writes a big-endian 32-bit value.
+ */
+void store_uint32(std::byte *out, uint32_t value) {
+  out[0] = static_cast<std::byte>((value >> 24) & 0xFF);
+  out[1] = static_cast<std::byte>((value >> 16) & 0xFF);
+  out[2] = static_cast<std::byte>((value >> 8) & 0xFF);
+  out[3] = static_cast<std::byte>(value & 0xFF);
+}
+
+/**
+ * @brief Reads a big-endian 32-bit value.
+ */
+uint32_t load_uint32(const std::byte *in) {
+  return (std::to_integer<uint32_t>(in[0]) << 24) |
+         (std::to_integer<uint32_t>(in[1]) << 16) |
+         (std::to_integer<uint32_t>(in[2]) << 8) |
+         std::to_integer<uint32_t>(in[3]);
+}
+
+} // namespace
+
 tcp::socket &PeerConnection::socket() { return socket_; }
 
 void PeerConnection::start() {
   auto self(shared_from_this());
+  schedule_check();
 
   // Start handshake
-  std::vector<std::byte> handshake = create_handshake(info_hash_, peer_id_);
-  boost::asio::async_write(socket_, boost::asio::buffer(handshake),
-                           boost::bind(&PeerConnection::handle_handshake, self,
-                                       boost::asio::placeholders::error));
+  send(create_handshake(info_hash_, peer_id_),
+       boost::bind(&PeerConnection::handle_handshake, self,
+                   boost::asio::placeholders::error));
+}
+
+void PeerConnection::start_inbound() {
+  auto self(shared_from_this());
+  schedule_check();
+  auto handshake = std::make_shared<std::vector<std::byte>>(HANDSHAKE_SIZE);
+  boost::asio::async_read(
+      socket_, boost::asio::buffer(*handshake),
+      boost::bind(&PeerConnection::handle_inbound_handshake, self, handshake,
+                  boost::asio::placeholders::error));
+}
+
+void PeerConnection::start_inbound(std::vector<std::byte> handshake) {
+  schedule_check();
+  handle_inbound_handshake(
+      std::make_shared<std::vector<std::byte>>(std::move(handshake)), {});
+}
+
+void PeerConnection::set_bandwidth_limiters(
+    std::shared_ptr<BandwidthLimiter> download,
+    std::shared_ptr<BandwidthLimiter> upload) {
+  download_limiter_ = std::move(download);
+  upload_limiter_ = std::move(upload);
+}
+
+void PeerConnection::set_timeouts(const ConnectionTimeouts &timeouts) {
+  timeouts_ = timeouts;
+}
+
+void PeerConnection::set_disconnect_handler(
+    std::function<void()> on_disconnect) {
+  on_disconnect_ = std::move(on_disconnect);
 }
 
 void PeerConnection::stop() {
+  read_timer_.cancel();
+  write_timer_.cancel();
   if (socket_.is_open()) {
     socket_.close();
   }
+  if (stopped_) {
+    return;
+  }
+  stopped_ = true;
+
+  timer_wheel_->cancel(std::exchange(check_timer_, 0));
+  release_pieces();
+  piece_picker_->remove_peer(bitfield_);
+  if (on_disconnect_) {
+    std::exchange(on_disconnect_, nullptr)();
+  }
+}
+
+void PeerConnection::release_pieces() {
+  clear_requests();
+
+  // The partial pieces are recorded first, so whoever picks a piece next
+  // finds its blocks
+  for (auto &partial : flush_partial_pieces()) {
+    piece_manager_->add_partial_piece(std::move(partial));
+  }
+  for (const auto &entry : piece_download_states_) {
+    piece_picker_->release(entry.first);
+  }
+  piece_download_states_.clear();
+}
+
+void PeerConnection::cancel_requests(uint32_t piece_index) {
+  for (auto it = request_timers_.begin(); it != request_timers_.end();) {
+    if (it->first >> 32 != piece_index) {
+      ++it;
+      continue;
+    }
+    timer_wheel_->cancel(it->second);
+    send_block_message(MessageType::Cancel, piece_index,
+                       static_cast<uint32_t>(it->first));
+    it = request_timers_.erase(it);
+  }
+}
+
+void PeerConnection::abandon_piece(uint32_t piece_index) {
+  cancel_requests(piece_index);
+
+  auto it = piece_download_states_.find(piece_index);
+  if (it != piece_download_states_.end()) {
+    std::optional<PartialPiece> partial = flush_partial_piece(it->second);
+    if (partial) {
+      piece_manager_->add_partial_piece(std::move(*partial));
+    }
+    piece_download_states_.erase(it);
+    piece_picker_->release(piece_index);
+  }
+
+  if (timed_out_.size() == 0) {
+    timed_out_ = Bitfield(piece_manager_->total_pieces());
+  }
+  timed_out_.set(piece_index);
+}
+
+void PeerConnection::handle_request_timeout(uint32_t piece_index,
+                                            uint32_t block_index) {
+  request_timers_.erase(block_key(piece_index, block_index));
+  Logger::instance()->log("Request for piece " + std::to_string(piece_index) +
+                              " timed out, handing it to other peers.",
+                          Logger::DEBUG);
+  abandon_piece(piece_index);
+  request_pending_ = false;
+  if (!local_state_.choked) {
+    request_piece();
+  }
+}
+
+void PeerConnection::clear_requests() {
+  for (const auto &entry : request_timers_) {
+    timer_wheel_->cancel(entry.second);
+  }
+  request_timers_.clear();
+  for (auto &entry : piece_download_states_) {
+    entry.second.next_block_to_request = 0;
+  }
+  waiting_since_.reset();
+  request_pending_ = false;
+}
+
+void PeerConnection::schedule_check() {
+  auto self(shared_from_this());
+  check_timer_ = timer_wheel_->arm(timeouts_.check,
+                                   [this, self]() { check_timeouts(); });
+}
+
+void PeerConnection::check_timeouts() {
+  check_timer_ = 0;
+  if (stopped_) {
+    return;
+  }
+
+  Clock::time_point now = Clock::now();
+  if (now - last_received_ >= timeouts_.inactivity) {
+    Logger::instance()->log("Dropping a peer that went silent.",
+                            Logger::DEBUG);
+    stop();
+    return;
+  }
+  // Smoothed over the last few checks
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      now - rate_checked_at_);
+  if (elapsed.count() > 0) {
+    uint64_t rate = std::exchange(bytes_since_check_, 0) * 1000 /
+                    static_cast<uint64_t>(elapsed.count());
+    download_rate_ = (download_rate_ + rate) / 2;
+    rate_checked_at_ = now;
+  }
+
+  if (!snubbed_ && waiting_since_ &&
+      now - *waiting_since_ >= timeouts_.snub) {
+    snub();
+  }
+  if (now - last_sent_ >= timeouts_.keep_alive) {
+    send(std::vector<std::byte>(4, std::byte{0})); // Keep-alive
+  }
+  schedule_check();
+}
+
+void PeerConnection::snub() {
+  Logger::instance()->log("Peer sent no data for " +
+                              std::to_string(timeouts_.snub.count()) +
+                              " ms, no longer requesting from it.",
+                          Logger::DEBUG);
+  snubbed_ = true;
+  std::vector<uint32_t> pieces;
+  for (const auto &entry : piece_download_states_) {
+    pieces.push_back(entry.first);
+  }
+  for (uint32_t piece_index : pieces) {
+    abandon_piece(piece_index);
+  }
+  waiting_since_.reset();
+  request_pending_ = false;
+}
+
+void PeerConnection::send(Buffer message, WriteHandler on_sent) {
+  last_sent_ = Clock::now();
+  write_queue_.emplace_back(std::move(message), std::move(on_sent));
+  if (write_queue_.size() == 1) {
+    write_next();
+  }
+}
+
+void PeerConnection::send(const std::vector<std::byte> &message,
+                          WriteHandler on_sent) {
+  Buffer buffer = BufferPool::instance().acquire(message.size());
+  std::copy(message.begin(), message.end(), buffer.begin());
+  send(std::move(buffer), std::move(on_sent));
+}
+
+void PeerConnection::write_next() {
+  if (upload_limiter_ != nullptr) {
+    auto delay = upload_limiter_->reserve(write_queue_.front().first.size());
+    if (delay > delay.zero()) {
+      auto self(shared_from_this());
+      write_timer_.expires_after(delay);
+      write_timer_.async_wait(
+          [this, self](const boost::system::error_code &error) {
+            if (!error) {
+              start_write();
+            }
+          });
+      return;
+    }
+  }
+  start_write();
+}
+
+void PeerConnection::start_write() {
+  auto self(shared_from_this());
+  const Buffer &message = write_queue_.front().first;
+  boost::asio::async_write(socket_,
+                           boost::asio::buffer(message.data(), message.size()),
+                           boost::bind(&PeerConnection::handle_write, self,
+                                       boost::asio::placeholders::error));
+}
+
+void PeerConnection::handle_write(const boost::system::error_code &error) {
+  WriteHandler on_sent = std::move(write_queue_.front().second);
+  write_queue_.pop_front();
+
+  if (error) {
+    write_queue_.clear();
+    stop();
+  } else if (!write_queue_.empty()) {
+    write_next();
+  }
+
+  if (on_sent) {
+    on_sent(error);
+  }
 }
 
 void PeerConnection::handle_handshake(const boost::system::error_code &error) {
@@ -67,28 +347,84 @@ void PeerConnection::handle_handshake(const boost::system::error_code &error) {
 void PeerConnection::handle_handshake_response(
     std::shared_ptr<std::vector<std::byte>> response,
     const boost::system::error_code &error) {
-  if (!error) {
-    send_interested_message();
+  if (!error && is_valid_handshake(*response)) {
+    begin_session();
+  } else {
+    stop();
+  }
+}
+
+void PeerConnection::handle_inbound_handshake(
+    std::shared_ptr<std::vector<std::byte>> handshake,
+    const boost::system::error_code &error) {
+  if (!error && is_valid_handshake(*handshake)) {
+    send(create_handshake(info_hash_, peer_id_));
+    begin_session();
   } else {
     stop();
   }
 }
 
+bool PeerConnection::is_valid_handshake(
+    const std::vector<std::byte> &handshake) const {
+  const char *protocol_string = "BitTorrent protocol";
+  if (handshake.size() != HANDSHAKE_SIZE || handshake[0] != std::byte{19} ||
+      std::memcmp(handshake.data() + 1, protocol_string, 19) != 0) {
+    return false;
+  }
+  // pstrlen, pstr and the reserved bytes come before the info hash
+  return std::equal(info_hash_.begin(), info_hash_.end(),
+                    handshake.begin() + 28);
+}
+
+void PeerConnection::begin_session() {
+  session_started_ = true;
+  send_bitfield_message();
+  if (piece_manager_->needed_count() > 0) {
+    send_interested_message();
+  }
+  read_message();
+}
+
+void PeerConnection::send_bitfield_message() {
+  Bitfield pieces = piece_manager_->bitfield();
+  if (pieces.none()) {
+    return; // Peers with no pieces may skip the message
+  }
+
+  std::vector<std::byte> bytes = pieces.to_bytes();
+  std::vector<std::byte> message =
+      create_message(MessageType::Bitfield, bytes.size());
+  message.insert(message.end(), bytes.begin(), bytes.end());
+  send(std::move(message));
+}
+
 void PeerConnection::send_interested_message() {
-  auto self(shared_from_this());
-  std::vector<std::byte> interested = {std::byte{0x00}, std::byte{0x00},
-                                       std::byte{0x00}, std::byte{0x01},
-                                       std::byte{0x02}};
-  boost::asio::async_write(
-      socket_, boost::asio::buffer(interested, interested.size()),
-      boost::bind(&PeerConnection::handle_interested_message, self,
-                  boost::asio::placeholders::error));
+  local_state_.interested = true;
+  send(create_message(MessageType::Interested, 0));
 }
 
-void PeerConnection::handle_interested_message(
-    const boost::system::error_code &error) {
-  if (!error) {
-    read_message();
+void PeerConnection::send_not_interested_message() {
+  local_state_.interested = false;
+  send(create_message(MessageType::NotInterested, 0));
+}
+
+void PeerConnection::update_interest() {
+  if (!session_started_ || stopped_) {
+    return; // begin_session() declares the interest
+  }
+
+  // A peer that has not announced any pieces has none
+  bool interested = bitfield_.size() != 0 &&
+                    piece_manager_->is_interesting(bitfield_);
+  if (interested && !local_state_.interested) {
+    send_interested_message();
+  } else if (!interested && local_state_.interested) {
+    send_not_interested_message();
+  }
+
+  if (!local_state_.choked && !request_pending_) {
+    request_piece();
   }
 }
 
@@ -102,9 +438,29 @@ void PeerConnection::read_message() {
                   boost::asio::placeholders::bytes_transferred));
 }
 
+void PeerConnection::read_next_message(std::size_t bytes_received) {
+  if (download_limiter_ != nullptr) {
+    auto delay = download_limiter_->reserve(bytes_received);
+    if (delay > delay.zero()) {
+      auto self(shared_from_this());
+      read_timer_.expires_after(delay);
+      read_timer_.async_wait(
+          [this, self](const boost::system::error_code &error) {
+            if (!error) {
+              read_message();
+            }
+          });
+      return;
+    }
+  }
+  read_message();
+}
+
 void PeerConnection::handle_read_length(const boost::system::error_code &error,
                                         std::size_t bytes_transferred) {
   if (!error) {
+    last_received_ = Clock::now();
+
     // Read the first 4 bytes to get the message length
     if (bytes_transferred == 4) {
       uint32_t message_length =
@@ -116,14 +472,15 @@ void PeerConnection::handle_read_length(const boost::system::error_code &error,
         return;
       }
 
-      // Read the remaining part of the message
-      read_buffer_.resize(4 + message_length);
+      // Read up to the begin of a block, to know where the block goes
+      uint32_t header_length =
+          std::min<uint32_t>(message_length, PIECE_HEADER_SIZE - 4);
+      read_buffer_.resize(4 + header_length);
       auto self(shared_from_this());
       boost::asio::async_read(
-          socket_, boost::asio::buffer(&read_buffer_[4], message_length),
-          boost::bind(&PeerConnection::handle_read_message, self,
-                      boost::asio::placeholders::error,
-                      boost::asio::placeholders::bytes_transferred));
+          socket_, boost::asio::buffer(&read_buffer_[4], header_length),
+          boost::bind(&PeerConnection::handle_read_header, self,
+                      message_length, boost::asio::placeholders::error));
     } else {
       read_message();
     }
@@ -132,6 +489,77 @@ void PeerConnection::handle_read_length(const boost::system::error_code &error,
   }
 }
 
+void PeerConnection::handle_read_header(
+    uint32_t message_length, const boost::system::error_code &error) {
+  if (error) {
+    stop();
+    return;
+  }
+
+  uint32_t header_length = read_buffer_.size() - 4;
+  if (message_length > header_length &&
+      read_buffer_[4] == static_cast<std::byte>(MessageType::Piece)) {
+    read_block(load_uint32(&read_buffer_[5]), load_uint32(&read_buffer_[9]),
+               message_length - header_length);
+    return;
+  }
+
+  if (message_length == header_length) {
+    handle_read_message(error, message_length);
+    return;
+  }
+
+  // Read the remaining part of the message
+  read_buffer_.resize(4 + message_length);
+  auto self(shared_from_this());
+  boost::asio::async_read(
+      socket_,
+      boost::asio::buffer(&read_buffer_[4 + header_length],
+                          message_length - header_length),
+      [this, self, message_length](const boost::system::error_code &error,
+                                   std::size_t) {
+        handle_read_message(error, message_length);
+      });
+}
+
+void PeerConnection::read_block(uint32_t piece_index, uint32_t begin,
+                                uint32_t length) {
+  // The handle keeps the buffer alive even if the piece is given up before
+  // the block has arrived
+  Buffer destination;
+  std::byte *target = nullptr;
+  uint32_t block_index = begin / BLOCK_SIZE;
+  auto it = piece_download_states_.find(piece_index);
+  // Only a missing block may go into the piece, one already received is
+  // covered by the running hash
+  if (it != piece_download_states_.end() && it->second.buffered() &&
+      begin % BLOCK_SIZE == 0 && block_index < it->second.total_blocks &&
+      length == it->second.block_length(block_index) &&
+      !it->second.blocks_received[block_index]) {
+    destination = it->second.piece_data_buffer;
+    target = destination.data() + begin;
+  } else {
+    destination = BufferPool::instance().acquire(length);
+    target = destination.data();
+  }
+
+  auto self(shared_from_this());
+  boost::asio::async_read(
+      socket_, boost::asio::buffer(target, length),
+      [this, self, piece_index, begin, length,
+       destination](const boost::system::error_code &error, std::size_t) {
+        if (error) {
+          stop();
+          return;
+        }
+        handle_piece_message(piece_index, begin, length, destination);
+        if (!local_state_.choked && !request_pending_) {
+          request_piece();
+        }
+        read_next_message(PIECE_HEADER_SIZE + length);
+      });
+}
+
 void PeerConnection::handle_read_message(const boost::system::error_code &error,
                                          std::size_t bytes_transferred) {
   if (!error) {
@@ -139,8 +567,9 @@ void PeerConnection::handle_read_message(const boost::system::error_code &error,
       Message message = Message::parseMessage(read_buffer_);
       process_message(message);
 
+      std::size_t message_size = read_buffer_.size();
       read_buffer_.clear();
-      read_message();
+      read_next_message(message_size);
     } else {
       read_message(); // Keep reading
     }
@@ -151,24 +580,33 @@ void PeerConnection::handle_read_message(const boost::system::error_code &error,
 
 void PeerConnection::process_message(const Message &message) {
   auto handle_payload = overloaded{
-      [](std::monostate) {}, [](uint32_t piece_index) {},
+      [](std::monostate) {},
+      [this](uint32_t piece_index) { handle_have_message(piece_index); },
       [this](const std::vector<std::byte> &bitfield_data) {
         handle_bitfield_message(bitfield_data);
       },
-      [](const std::tuple<uint32_t, uint32_t, uint32_t> &request_data) {},
-      [this](const PieceData &piece_data) {
-        handle_piece_message(piece_data);
-      }};
+      [this, &message](
+          const std::tuple<uint32_t, uint32_t, uint32_t> &request_data) {
+        if (message.type == MessageType::Request) {
+          handle_request_message(std::get<0>(request_data),
+                                 std::get<1>(request_data),
+                                 std::get<2>(request_data));
+        }
+      },
+      // Blocks are read straight into their piece by read_block()
+      [](const PieceData &) {}};
 
   switch (message.type) {
   case MessageType::Choke:
     local_state_.choked = true;
+    clear_requests();
     break;
   case MessageType::Unchoke:
     local_state_.choked = false;
+    snubbed_ = false; // Worth another try
     break;
   case MessageType::Interested:
-    remote_state_.interested = true;
+    handle_interested_message();
     break;
   case MessageType::NotInterested:
     remote_state_.interested = false;
@@ -179,13 +617,13 @@ void PeerConnection::process_message(const Message &message) {
   case MessageType::Bitfield:
     std::visit(handle_payload, message.payload);
     break;
-  case MessageType::Request: // TODO
+  case MessageType::Request:
     std::visit(handle_payload, message.payload);
     break;
   case MessageType::Piece:
     std::visit(handle_payload, message.payload);
     break;
-  case MessageType::Cancel: // TODO
+  case MessageType::Cancel: // Blocks are sent as soon as they are requested
     std::visit(handle_payload, message.payload);
     break;
   default:
@@ -198,47 +636,78 @@ void PeerConnection::process_message(const Message &message) {
 }
 
 void PeerConnection::request_piece() {
-  // Get the list of missing pieces from the PieceManager
-  std::unordered_set<uint32_t> missing_pieces =
-      piece_manager_->missing_pieces();
-
-  // If there are no missing pieces, stop the connection
-  if (missing_pieces.size() == 0) {
-    stop();
+  // Nothing left to download, the connection stays open for uploading
+  if (piece_manager_->needed_count() == 0 || snubbed_) {
     return;
   }
 
-  // Iterate over the missing pieces to request one
-  for (const auto &piece_index : missing_pieces) {
-    // Skip if the piece index is out of bounds
-    if (piece_index >= bitfield_.size()) {
-      continue;
-    }
-
-    // Skip if the peer doesn't have this piece
-    if (!bitfield_[piece_index]) {
-      continue;
+  // Finish the blocks of a piece already started before taking a new one
+  for (auto &entry : piece_download_states_) {
+    PieceDownloadState &piece_request = entry.second;
+    if (piece_request.next_block_to_request < piece_request.total_blocks) {
+      request_more_blocks(piece_request);
+      request_pending_ = true;
+      return;
     }
+  }
 
-    // Get the size of the piece and calculate the total number of blocks
-    uint32_t piece_size = piece_manager_->piece_size(piece_index);
-    uint32_t total_blocks = (piece_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  // A missing piece the peer has that no other connection is downloading,
+  // other than those it left unanswered; when streaming, one this
+  // connection is not downloading already
+  Bitfield candidates =
+      timed_out_.size() == 0 ? bitfield_ : bitfield_.and_not(timed_out_);
+  for (const auto &entry : piece_download_states_) {
+    candidates.reset(entry.first);
+  }
+  std::optional<uint32_t> picked =
+      piece_picker_->pick(candidates, download_rate_);
+  if (!picked) {
+    return;
+  }
+  uint32_t piece_index = *picked;
 
-    // Initialize the download state for the piece
-    piece_download_states_.emplace(
-        piece_index, PieceDownloadState(piece_index, total_blocks, piece_size));
+  // Get the size of the piece and calculate the total number of blocks
+  uint32_t piece_size = piece_manager_->piece_size(piece_index);
+  uint32_t total_blocks = (piece_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
 
-    // Request blocks for the piece
-    request_more_blocks(piece_download_states_[piece_index]);
-    request_pending_ = true;
-    break;
+  // Initialize the download state for the piece, in memory if the budget
+  // allows it
+  auto inserted = piece_download_states_.emplace(
+      piece_index,
+      PieceDownloadState(piece_index, total_blocks, piece_size,
+                         piece_picker_->reserve_buffer(piece_index)));
+  if (inserted.second) {
+    restore_partial_piece(inserted.first->second);
   }
+
+  // Request blocks for the piece
+  request_more_blocks(inserted.first->second);
+  request_pending_ = true;
 }
 
 void PeerConnection::send_block_request(uint32_t piece_index,
                                         uint32_t block_index) {
   auto self(shared_from_this());
+  send_block_message(MessageType::Request, piece_index, block_index,
+                     boost::bind(&PeerConnection::handle_piece_request_response,
+                                 self, boost::asio::placeholders::error));
 
+  // The piece goes to other connections if the block does not arrive in time
+  TimerWheel::TimerId &timer =
+      request_timers_[block_key(piece_index, block_index)];
+  timer_wheel_->cancel(timer);
+  timer = timer_wheel_->arm(timeouts_.request,
+                            [this, self, piece_index, block_index]() {
+                              handle_request_timeout(piece_index, block_index);
+                            });
+  if (!waiting_since_) {
+    waiting_since_ = Clock::now();
+  }
+}
+
+void PeerConnection::send_block_message(MessageType type, uint32_t piece_index,
+                                        uint32_t block_index,
+                                        WriteHandler on_sent) {
   // Calculate the beginning offset and length of the block
   uint32_t begin = block_index * BLOCK_SIZE;
   uint32_t length = BLOCK_SIZE;
@@ -250,12 +719,12 @@ void PeerConnection::send_block_request(uint32_t piece_index,
   }
 
   // Create a block request message
-  std::vector<std::byte> request(PIECE_REQUEST_SIZE, std::byte{0});
+  Buffer request = BufferPool::instance().acquire(PIECE_REQUEST_SIZE);
   request[0] = std::byte{0x00};
   request[1] = std::byte{0x00};
   request[2] = std::byte{0x00};
   request[3] = std::byte{0x0d}; // Length of the request message
-  request[4] = std::byte{0x06}; // Request message ID
+  request[4] = static_cast<std::byte>(type); // Request or cancel ID
 
   // Piece index
   request[5] = static_cast<std::byte>((piece_index >> 24) & 0xFF);
@@ -275,11 +744,8 @@ void PeerConnection::send_block_request(uint32_t piece_index,
   request[15] = static_cast<std::byte>((length >> 8) & 0xFF);
   request[16] = static_cast<std::byte>(length & 0xFF);
 
-  // Send the block request to the peer
-  boost::asio::async_write(
-      socket_, boost::asio::buffer(request, PIECE_REQUEST_SIZE),
-      boost::bind(&PeerConnection::handle_piece_request_response, self,
-                  boost::asio::placeholders::error));
+  // Send the message to the peer
+  send(std::move(request), std::move(on_sent));
 }
 
 void PeerConnection::request_more_blocks(PieceDownloadState &piece_request) {
@@ -298,6 +764,63 @@ void PeerConnection::request_more_blocks(PieceDownloadState &piece_request) {
   }
 }
 
+void PeerConnection::restore_partial_piece(PieceDownloadState &piece_request) {
+  auto blocks = piece_manager_->take_partial_piece(piece_request.piece_index);
+  if (!blocks || blocks->size() != piece_request.total_blocks) {
+    return;
+  }
+
+  for (uint32_t block = blocks->find_next(0); block < blocks->size();
+       block = blocks->find_next(block + 1)) {
+    uint32_t begin = block * BLOCK_SIZE;
+    uint32_t length = piece_request.block_length(block);
+    // A piece assembled on disk has its saved blocks in place already
+    if (piece_request.buffered() &&
+        !file_manager_->read_block_into(
+            piece_request.piece_index, begin,
+            piece_request.piece_data_buffer.data() + begin, length)) {
+      continue; // Unreadable, just download the block again
+    }
+    piece_request.blocks_received[block] = true;
+  }
+}
+
+std::vector<PartialPiece> PeerConnection::flush_partial_pieces() {
+  std::vector<PartialPiece> partials;
+  for (const auto &entry : piece_download_states_) {
+    std::optional<PartialPiece> partial = flush_partial_piece(entry.second);
+    if (partial) {
+      partials.push_back(std::move(*partial));
+    }
+  }
+  return partials;
+}
+
+std::optional<PartialPiece>
+PeerConnection::flush_partial_piece(const PieceDownloadState &piece_request) {
+  Bitfield blocks(piece_request.total_blocks);
+
+  for (uint32_t block = 0; block < piece_request.total_blocks; ++block) {
+    if (!piece_request.blocks_received[block]) {
+      continue;
+    }
+    // Blocks of a piece assembled on disk are there already
+    uint32_t begin = block * BLOCK_SIZE;
+    uint32_t length = piece_request.block_length(block);
+    if (!piece_request.buffered() ||
+        file_manager_->write_block(
+            piece_request.piece_index, begin,
+            piece_request.piece_data_buffer.data() + begin, length)) {
+      blocks.set(block);
+    }
+  }
+
+  if (blocks.none()) {
+    return std::nullopt;
+  }
+  return PartialPiece{piece_request.piece_index, std::move(blocks)};
+}
+
 void PeerConnection::handle_piece_request_response(
     const boost::system::error_code &error) {
   if (!error) {
@@ -309,41 +832,122 @@ void PeerConnection::handle_piece_request_response(
 
 void PeerConnection::handle_bitfield_message(
     const std::vector<std::byte> &bitfield_data) {
-  bitfield_.clear();
+  piece_picker_->remove_peer(bitfield_); // Pieces it announced before
+  bitfield_ = Bitfield(bitfield_data.data(), bitfield_data.size(),
+                       piece_manager_->total_pieces());
+  piece_picker_->add_peer(bitfield_);
+  update_interest();
+}
 
-  // Convert the bitfield data to a vector of booleans
-  for (const auto &byte : bitfield_data) {
-    for (int i = 7; i >= 0; --i) {
-      bitfield_.push_back(
-          static_cast<bool>(std::to_integer<int>(byte) & (1 << i)));
+void PeerConnection::handle_have_message(uint32_t piece_index) {
+  // Peers may skip the bitfield message entirely when they have no pieces
+  if (bitfield_.size() == 0) {
+    bitfield_ = Bitfield(piece_manager_->total_pieces());
+  }
+  if (piece_index < bitfield_.size() && !bitfield_.test(piece_index)) {
+    bitfield_.set(piece_index);
+    piece_picker_->add_have(piece_index);
+    if (!local_state_.interested) {
+      update_interest();
     }
   }
 }
 
-void PeerConnection::handle_piece_message(const PieceData &piece_data) {
+void PeerConnection::handle_interested_message() {
+  remote_state_.interested = true;
+
+  // No choking algorithm yet, every interested peer gets served
+  if (remote_state_.choked) {
+    remote_state_.choked = false;
+    send(create_message(MessageType::Unchoke, 0));
+  }
+}
+
+void PeerConnection::handle_request_message(uint32_t piece_index,
+                                            uint32_t begin, uint32_t length) {
+  uint32_t piece_size = piece_manager_->piece_size(piece_index);
+  if (remote_state_.choked || !piece_manager_->has_piece(piece_index) ||
+      length == 0 || length > MAX_SERVED_BLOCK_SIZE || begin > piece_size ||
+      length > piece_size - begin) {
+    return;
+  }
+
+  // The block is read from disk right behind its header
+  Buffer message = BufferPool::instance().acquire(PIECE_HEADER_SIZE + length);
+  if (!file_manager_->read_block_into(piece_index, begin,
+                                      message.data() + PIECE_HEADER_SIZE,
+                                      length)) {
+    return;
+  }
+  store_uint32(message.data(), PIECE_HEADER_SIZE - 4 + length);
+  message[4] = static_cast<std::byte>(MessageType::Piece);
+  store_uint32(message.data() + 5, piece_index);
+  store_uint32(message.data() + 9, begin);
+  send(std::move(message));
+}
+
+void PeerConnection::handle_piece_message(uint32_t piece_index,
+                                          uint32_t begin, uint32_t length,
+                                          const Buffer &destination) {
+  // Any block, even one we gave up on, shows the peer is responsive
+  uint32_t block_index = begin / BLOCK_SIZE;
+  auto timer = request_timers_.find(block_key(piece_index, block_index));
+  if (timer != request_timers_.end()) {
+    timer_wheel_->cancel(timer->second);
+    request_timers_.erase(timer);
+  }
+  waiting_since_ = request_timers_.empty()
+                       ? std::nullopt
+                       : std::optional<Clock::time_point>(Clock::now());
+  if (snubbed_ || timed_out_.size() != 0) {
+    snubbed_ = false;
+    timed_out_ = Bitfield();
+  }
+
   // Find the matching piece request
-  auto it = piece_download_states_.find(piece_data.index);
+  auto it = piece_download_states_.find(piece_index);
 
-  if (it != piece_download_states_.end()) {
+  // A piece hurried on two connections at once was finished by the other
+  if (it != piece_download_states_.end() &&
+      piece_manager_->has_piece(piece_index)) {
+    cancel_requests(piece_index);
+    piece_download_states_.erase(it);
+    piece_picker_->release(piece_index);
+    request_pending_ = false;
+    return;
+  }
+
+  if (it != piece_download_states_.end() && begin % BLOCK_SIZE == 0 &&
+      block_index < it->second.total_blocks &&
+      length == it->second.block_length(block_index)) {
     PieceDownloadState &piece_request = it->second;
-    uint32_t block_offset = piece_data.begin;
 
-    std::copy(piece_data.block.begin(), piece_data.block.end(),
-              piece_request.piece_data_buffer.begin() + block_offset);
+    // A duplicate is dropped, the block it repeats was hashed already
+    if (piece_request.blocks_received[block_index]) {
+      request_pending_ = false;
+      return;
+    }
 
-    uint32_t block_index = piece_data.begin / BLOCK_SIZE;
-    piece_request.blocks_received[block_index] = true;
+    // A buffered block is in place already, any other goes to disk now
+    bool stored = piece_request.buffered()
+                      ? piece_request.piece_data_buffer.shares(destination)
+                      : file_manager_->write_block(
+                            piece_index, begin, destination.data(), length);
+    if (stored) {
+      piece_request.blocks_received[block_index] = true;
+      bytes_since_check_ += length;
+      advance_hash(piece_request, block_index, destination.data());
+    } else if (!piece_request.buffered()) {
+      // Requested again, the disk may have recovered by then
+      piece_request.next_block_to_request =
+          std::min(piece_request.next_block_to_request, block_index);
+    }
 
     // Check if all blocks for this piece are received
     if (std::all_of(piece_request.blocks_received.begin(),
                     piece_request.blocks_received.end(),
                     [](bool received) { return received; })) {
-      file_manager_->write_piece(piece_data.index,
-                                 piece_request.piece_data_buffer);
-      // TODO: Check if write succeeds, I'm just happy it works for now
-      piece_manager_->save_piece(piece_data.index);
-
-      piece_download_states_.erase(it);
+      complete_piece(piece_request);
     } else {
       request_more_blocks(piece_request);
     }
@@ -351,3 +955,81 @@ void PeerConnection::handle_piece_message(const PieceData &piece_data) {
 
   request_pending_ = false;
 }
+
+void PeerConnection::advance_hash(PieceDownloadState &piece_request,
+                                  uint32_t block_index,
+                                  const std::byte *block) {
+  Buffer scratch;
+  while (piece_request.hashed_blocks < piece_request.total_blocks &&
+         piece_request.blocks_received[piece_request.hashed_blocks]) {
+    uint32_t index = piece_request.hashed_blocks;
+    uint32_t length = piece_request.block_length(index);
+    const std::byte *data = block;
+    if (piece_request.buffered()) {
+      data = piece_request.piece_data_buffer.data() + index * BLOCK_SIZE;
+    } else if (index != block_index) {
+      // Arrived out of order and went to disk, so it is read back
+      if (!scratch) {
+        scratch = BufferPool::instance().acquire(BLOCK_SIZE);
+      }
+      if (!file_manager_->read_block_into(piece_request.piece_index,
+                                          index * BLOCK_SIZE, scratch.data(),
+                                          length)) {
+        return; // Hashed from the start once complete
+      }
+      data = scratch.data();
+    }
+    piece_request.hash->update(data, length);
+    ++piece_request.hashed_blocks;
+  }
+}
+
+bool PeerConnection::verify_piece(
+    const PieceDownloadState &piece_request) const {
+  const InfoHash &expected =
+      file_manager_->piece_hashes()[piece_request.piece_index];
+  if (piece_request.hashed_blocks == piece_request.total_blocks) {
+    return piece_request.hash->finish() == expected;
+  }
+  if (piece_request.buffered()) {
+    const Buffer &piece = piece_request.piece_data_buffer;
+    return sha1_digest(piece.data(), piece.size()) == expected;
+  }
+
+  // Read back one block at a time, so verifying takes no more memory
+  Sha1 hash;
+  Buffer block = BufferPool::instance().acquire(BLOCK_SIZE);
+  for (uint32_t index = 0; index < piece_request.total_blocks; ++index) {
+    uint32_t length = piece_request.block_length(index);
+    if (!file_manager_->read_block_into(piece_request.piece_index,
+                                        index * BLOCK_SIZE, block.data(),
+                                        length)) {
+      return false;
+    }
+    hash.update(block.data(), length);
+  }
+  return hash.finish() == expected;
+}
+
+void PeerConnection::complete_piece(PieceDownloadState &piece_request) {
+  uint32_t piece_index = piece_request.piece_index;
+  const Buffer &piece = piece_request.piece_data_buffer;
+
+  if (!verify_piece(piece_request)) {
+    Logger::instance()->log("Piece " + std::to_string(piece_index) +
+                                " failed its hash check, downloading it "
+                                "again.",
+                            Logger::WARNING);
+  } else if (piece_request.buffered() &&
+             !file_manager_->write_block(piece_index, 0, piece.data(),
+                                         piece.size())) {
+    Logger::instance()->log("Could not write piece " +
+                                std::to_string(piece_index) + ".",
+                            Logger::WARNING);
+  } else {
+    piece_manager_->save_piece(piece_index);
+  }
+
+  piece_picker_->release(piece_index);
+  piece_download_states_.erase(piece_index);
+}
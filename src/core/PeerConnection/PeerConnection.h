@@ -1,14 +1,26 @@
 #ifndef PEERCONNECTION_H
 #define PEERCONNECTION_H
 
+#include "BandwidthLimiter/BandwidthLimiter.h"
+#include "Bitfield/Bitfield.h"
+#include "BufferPool/BufferPool.h"
+#include "MemoryBudget/MemoryBudget.h"
 #include "FileManager/FileManager.h"
 #include "Message/Message.h"
 #include "Peer/Peer.h"
 #include "PieceManager/PieceManager.h"
+#include "PiecePicker/PiecePicker.h"
+#include "TimerWheel/TimerWheel.h"
 #include "Torrent/Torrent.h"
+#include "Utils/utils.h"
 #include <boost/asio.hpp>
+#include <algorithm>
 #include <boost/bind/bind.hpp>
+#include <chrono>
+#include <deque>
+#include <functional>
 #include <memory>
+#include <optional>
 #include <unordered_map>
 
 using namespace boost::placeholders;
@@ -16,8 +28,42 @@ using tcp = boost::asio::ip::tcp;
 
 const int HANDSHAKE_SIZE = 68;
 const int PIECE_REQUEST_SIZE = 17;
+const int PIECE_HEADER_SIZE = 13; // Length, id, index and begin of a block
 const int BLOCK_SIZE = 16 * 1024; // 16 KiB
 const int MAX_CONCURRENT_BLOCK_REQUESTS = 4;
+const uint32_t MAX_SERVED_BLOCK_SIZE = 128 * 1024; // Larger requests dropped
+
+/// How long a block request may go unanswered before its piece is handed
+/// to other connections.
+const std::chrono::seconds REQUEST_TIMEOUT(20);
+
+/// Time without a block, while we wait for one, after which a peer is
+/// snubbed and sent no more requests.
+const std::chrono::seconds SNUB_TIMEOUT(60);
+
+/// Time without sending anything after which a keep-alive is sent.
+const std::chrono::seconds KEEP_ALIVE_INTERVAL(90);
+
+/// Time without any message from a peer after which it is dropped.
+const std::chrono::seconds INACTIVITY_TIMEOUT(180);
+
+/// How often a connection checks for the timeouts above.
+const std::chrono::seconds CONNECTION_CHECK_INTERVAL(5);
+
+/**
+ * @brief The timeouts of a connection, the constants above unless
+ * shortened, for instance by tests.
+ */
+struct ConnectionTimeouts {
+  std::chrono::milliseconds request = REQUEST_TIMEOUT; ///< REQUEST_TIMEOUT.
+  std::chrono::milliseconds snub = SNUB_TIMEOUT;       ///< SNUB_TIMEOUT.
+  std::chrono::milliseconds keep_alive =
+      KEEP_ALIVE_INTERVAL; ///< KEEP_ALIVE_INTERVAL.
+  std::chrono::milliseconds inactivity =
+      INACTIVITY_TIMEOUT; ///< INACTIVITY_TIMEOUT.
+  std::chrono::milliseconds check =
+      CONNECTION_CHECK_INTERVAL; ///< CONNECTION_CHECK_INTERVAL.
+};
 
 /**
  * @brief Represents the connection state of a peer.
@@ -29,23 +75,31 @@ struct ConnectionState {
 
 /**
  * @brief Manages the state of a piece being downloaded.
+ *
+ * A piece within the in-flight memory budget is assembled in a buffer and
+ * written once verified; the blocks of any other piece are written to disk
+ * as they arrive. Either way the piece's hash runs along with the download,
+ * over the blocks received without a gap from the start of the piece.
  */
 class PieceDownloadState {
 public:
   uint32_t piece_index;  ///< Index of the piece.
   uint32_t total_blocks; ///< Total number of blocks in the piece.
+  uint32_t piece_size;   ///< Size of the piece in bytes.
   std::vector<bool>
       blocks_received; ///< Tracks which blocks have been received.
-  std::vector<std::byte>
-      piece_data_buffer;          ///< Buffer to store the entire piece data.
-  uint32_t next_block_to_request; ///< Index of the next block to request.
+  MemoryBudget::Reservation memory; ///< Budget for piece_data_buffer.
+  Buffer piece_data_buffer;         ///< The whole piece, empty if on disk.
+  uint32_t next_block_to_request;   ///< Index of the next block to request.
+  std::unique_ptr<Sha1> hash;       ///< Hash of the first hashed_blocks.
+  uint32_t hashed_blocks = 0;       ///< Blocks fed into hash so far.
 
   /**
    * @brief Default constructor for PieceDownloadState.
    */
   PieceDownloadState() // TODO: Create some error handling when this gets
                        // invoked
-      : piece_index(0), total_blocks(0), piece_data_buffer(0),
+      : piece_index(0), total_blocks(0), piece_size(0),
         next_block_to_request(0) {}
 
   /**
@@ -54,14 +108,35 @@ public:
    * @param piece_index Index of the piece.
    * @param total_blocks Total number of blocks in the piece.
    * @param piece_size Size of the piece in bytes.
+   * @param memory Budget to assemble the piece in memory, or empty to write
+   * its blocks straight to disk.
    */
   PieceDownloadState(uint32_t piece_index, uint32_t total_blocks,
-                     uint32_t piece_size)
+                     uint32_t piece_size, MemoryBudget::Reservation memory)
       : piece_index(piece_index), total_blocks(total_blocks),
-        blocks_received(total_blocks, false),
-        piece_data_buffer(
-            piece_size), // Initialize the buffer with the piece size
-        next_block_to_request(0) {}
+        piece_size(piece_size), blocks_received(total_blocks, false),
+        memory(std::move(memory)),
+        piece_data_buffer(this->memory
+                              ? BufferPool::instance().acquire(piece_size)
+                              : Buffer()),
+        next_block_to_request(0), hash(std::make_unique<Sha1>()) {}
+
+  /**
+   * @brief Checks whether the piece is assembled in memory.
+   *
+   * @return true if its blocks are kept in piece_data_buffer.
+   */
+  bool buffered() const { return static_cast<bool>(piece_data_buffer); }
+
+  /**
+   * @brief Gets the length of a block, the last one may be shorter.
+   *
+   * @param block The index of the block.
+   * @return The length in bytes.
+   */
+  uint32_t block_length(uint32_t block) const {
+    return std::min<uint32_t>(BLOCK_SIZE, piece_size - block * BLOCK_SIZE);
+  }
 };
 
 /**
@@ -77,13 +152,55 @@ public:
    * @param peer_id ID of the peer.
    * @param piece_manager Shared pointer to the PieceManager.
    * @param file_manager Shared pointer to the FileManager.
+   * @param piece_picker Reserves pieces for the torrent's connections, or
+   * null for a picker of this connection's own.
+   * @param timer_wheel Runs the connection's timeouts, or null for a wheel
+   * of its own.
    */
   PeerConnection(boost::asio::io_context &io_context, const InfoHash &info_hash,
                  const Peer::Id &peer_id,
                  std::shared_ptr<PieceManager> piece_manager,
-                 std::shared_ptr<LinuxFileManager> file_manager)
-      : socket_(io_context), info_hash_(info_hash), peer_id_(peer_id),
-        piece_manager_(piece_manager), file_manager_(file_manager) {}
+                 std::shared_ptr<LinuxFileManager> file_manager,
+                 std::shared_ptr<PiecePicker> piece_picker = nullptr,
+                 std::shared_ptr<TimerWheel> timer_wheel = nullptr)
+      : PeerConnection(tcp::socket(io_context), info_hash, peer_id,
+                       std::move(piece_manager), std::move(file_manager),
+                       std::move(piece_picker), std::move(timer_wheel)) {}
+
+  /**
+   * @brief Constructs a PeerConnection around an existing socket.
+   *
+   * All handlers of the connection run on the socket's executor, which may
+   * be a strand shared with other connections of the same torrent.
+   *
+   * @param socket The socket, connected or still to be connected.
+   * @param info_hash Info hash of the torrent.
+   * @param peer_id ID of the peer.
+   * @param piece_manager Shared pointer to the PieceManager.
+   * @param file_manager Shared pointer to the FileManager.
+   * @param piece_picker Reserves pieces for the torrent's connections, or
+   * null for a picker of this connection's own.
+   * @param timer_wheel Runs the connection's timeouts on the socket's
+   * executor, or null for a wheel of its own.
+   */
+  PeerConnection(tcp::socket socket, const InfoHash &info_hash,
+                 const Peer::Id &peer_id,
+                 std::shared_ptr<PieceManager> piece_manager,
+                 std::shared_ptr<LinuxFileManager> file_manager,
+                 std::shared_ptr<PiecePicker> piece_picker = nullptr,
+                 std::shared_ptr<TimerWheel> timer_wheel = nullptr)
+      : socket_(std::move(socket)), info_hash_(info_hash), peer_id_(peer_id),
+        piece_manager_(std::move(piece_manager)),
+        file_manager_(std::move(file_manager)),
+        piece_picker_(piece_picker != nullptr
+                          ? std::move(piece_picker)
+                          : std::make_shared<PiecePicker>(piece_manager_)),
+        read_timer_(socket_.get_executor()),
+        write_timer_(socket_.get_executor()),
+        timer_wheel_(timer_wheel != nullptr
+                         ? std::move(timer_wheel)
+                         : std::make_shared<TimerWheel>(
+                               socket_.get_executor())) {}
 
   /**
    * @brief Gets the socket associated with the peer connection.
@@ -93,19 +210,149 @@ public:
   tcp::socket &socket();
 
   /**
-   * @brief Starts the peer connection.
+   * @brief Starts an outgoing peer connection by sending our handshake.
    */
   void start();
 
+  /**
+   * @brief Starts an accepted peer connection by waiting for its handshake.
+   */
+  void start_inbound();
+
+  /**
+   * @brief Starts an accepted peer connection whose handshake was already
+   * read, for instance to find out which torrent it is for.
+   *
+   * @param handshake The handshake message from the peer.
+   */
+  void start_inbound(std::vector<std::byte> handshake);
+
+  /**
+   * @brief Limits the connection's traffic.
+   *
+   * Must be called before the connection is started.
+   *
+   * @param download Limiter for received data, or null.
+   * @param upload Limiter for sent data, or null.
+   */
+  void set_bandwidth_limiters(std::shared_ptr<BandwidthLimiter> download,
+                              std::shared_ptr<BandwidthLimiter> upload);
+
+  /**
+   * @brief Changes the connection's timeouts.
+   *
+   * Must be called before the connection is started.
+   *
+   * @param timeouts The timeouts.
+   */
+  void set_timeouts(const ConnectionTimeouts &timeouts);
+
+  /**
+   * @brief Registers a callback for when the connection stops.
+   *
+   * Runs once, on the connection's executor, after the connection has
+   * released its pieces. Must be called before the connection is started.
+   *
+   * @param on_disconnect The callback.
+   */
+  void set_disconnect_handler(std::function<void()> on_disconnect);
+
   /**
    * @brief Stops the peer connection.
+   *
+   * Blocks received for unfinished pieces are written to disk and recorded
+   * with the PieceManager, and the pieces are released to the picker so
+   * other connections can finish them.
    */
   void stop();
 
+  /**
+   * @brief Tells the peer whether we want any of its pieces, and requests
+   * one if it lets us.
+   *
+   * Called when the pieces we want change, for instance when a file is no
+   * longer skipped or the download is done. Must be called from the
+   * connection's IO thread.
+   */
+  void update_interest();
+
+  /**
+   * @brief Writes the received blocks of unfinished pieces to disk.
+   *
+   * Used when saving resume data, so the blocks survive a restart. Must be
+   * called from the connection's IO thread.
+   *
+   * @return The block map of every unfinished piece.
+   */
+  std::vector<PartialPiece> flush_partial_pieces();
+
+  /**
+   * @brief Checks whether the peer is snubbed, that is sent no requests
+   * because it left them unanswered for SNUB_TIMEOUT. Must be called from
+   * the connection's IO thread.
+   *
+   * @return true if the peer is snubbed.
+   */
+  bool snubbed() const { return snubbed_; }
+
+  /**
+   * @brief Gets how fast the peer sends us blocks, measured every
+   * CONNECTION_CHECK_INTERVAL. Must be called from the connection's IO
+   * thread.
+   *
+   * @return The smoothed rate in bytes per second.
+   */
+  uint64_t download_rate() const { return download_rate_; }
+
 private:
+  using Clock = TimerWheel::Clock;
+
+  /**
+   * @brief Callback invoked once a queued message has been written.
+   */
+  using WriteHandler = std::function<void(const boost::system::error_code &)>;
+
   // These functions really need no explaining, but I will do it anyway so the
   // Doxygen looks a little nicer
 
+  /**
+   * @brief Queues a message for sending.
+   *
+   * Messages are written one at a time in order, since overlapping
+   * async_writes on one socket may interleave.
+   *
+   * @param message The complete message, including its length prefix.
+   * @param on_sent Optional callback invoked after the write.
+   */
+  void send(Buffer message, WriteHandler on_sent = nullptr);
+
+  /**
+   * @brief Queues a message for sending, copying it into a pooled buffer.
+   *
+   * @param message The complete message, including its length prefix.
+   * @param on_sent Optional callback invoked after the write.
+   */
+  void send(const std::vector<std::byte> &message,
+            WriteHandler on_sent = nullptr);
+
+  /**
+   * @brief Starts writing the message at the front of the queue, once the
+   * upload limiter allows it.
+   */
+  void write_next();
+
+  /**
+   * @brief Writes the message at the front of the queue.
+   */
+  void start_write();
+
+  /**
+   * @brief Handles completion of the write at the front of the queue.
+   *
+   * @param error The error code resulting from the write.
+   */
+  void handle_write(const boost::system::error_code &error);
+
   /**
    * @brief Handles the handshake process with the peer.
    *
@@ -123,24 +370,112 @@ private:
   handle_handshake_response(std::shared_ptr<std::vector<std::byte>> response,
                             const boost::system::error_code &error);
 
+  /**
+   * @brief Handles the handshake of a peer that connected to us.
+   *
+   * @param handshake The handshake message from the peer.
+   * @param error The error code resulting from reading the handshake.
+   */
+  void
+  handle_inbound_handshake(std::shared_ptr<std::vector<std::byte>> handshake,
+                           const boost::system::error_code &error);
+
+  /**
+   * @brief Checks that a handshake is for our torrent.
+   *
+   * @param handshake The handshake message from the peer.
+   * @return true if the protocol and info hash match.
+   */
+  bool is_valid_handshake(const std::vector<std::byte> &handshake) const;
+
+  /**
+   * @brief Announces our pieces and interest, then starts reading messages.
+   */
+  void begin_session();
+
+  /**
+   * @brief Sends a 'bitfield' message if we have any pieces.
+   */
+  void send_bitfield_message();
+
   /**
    * @brief Sends an 'interested' message to the peer.
    */
   void send_interested_message();
 
   /**
-   * @brief Handles the response to the 'interested' message.
-   *
-   * @param error The error code resulting from sending the 'interested'
-   * message.
+   * @brief Sends a 'not interested' message to the peer.
    */
-  void handle_interested_message(const boost::system::error_code &error);
+  void send_not_interested_message();
 
   /**
    * @brief Requests a piece from the peer.
    */
   void request_piece();
 
+  /**
+   * @brief Hands the unfinished pieces back to the picker, keeping their
+   * received blocks on disk.
+   */
+  void release_pieces();
+
+  /**
+   * @brief Writes the received blocks of an unfinished piece to disk.
+   *
+   * @param piece_request The state of the piece.
+   * @return The piece's block map, or nothing if no block was written.
+   */
+  std::optional<PartialPiece>
+  flush_partial_piece(const PieceDownloadState &piece_request);
+
+  /**
+   * @brief Cancels the outstanding requests for the blocks of a piece.
+   *
+   * @param piece_index The piece.
+   */
+  void cancel_requests(uint32_t piece_index);
+
+  /**
+   * @brief Gives up a piece so other connections can download it, cancelling
+   * its outstanding requests. The connection does not pick it again until
+   * the peer proves responsive.
+   *
+   * @param piece_index The piece.
+   */
+  void abandon_piece(uint32_t piece_index);
+
+  /**
+   * @brief Handles a block request that went unanswered for
+   * REQUEST_TIMEOUT.
+   *
+   * @param piece_index The piece of the block.
+   * @param block_index The block within the piece.
+   */
+  void handle_request_timeout(uint32_t piece_index, uint32_t block_index);
+
+  /**
+   * @brief Forgets the outstanding requests, which a choking peer discards,
+   * so the blocks are requested again once it unchokes us.
+   */
+  void clear_requests();
+
+  /**
+   * @brief Arms the timer for the next check_timeouts().
+   */
+  void schedule_check();
+
+  /**
+   * @brief Checks for idle, snubbed and silent peers, every
+   * CONNECTION_CHECK_INTERVAL.
+   */
+  void check_timeouts();
+
+  /**
+   * @brief Marks the peer as snubbed and hands its pieces to other
+   * connections.
+   */
+  void snub();
+
   /**
    * @brief Sends a block request to the peer.
    *
@@ -149,6 +484,17 @@ private:
    */
   void send_block_request(uint32_t piece_index, uint32_t block_index);
 
+  /**
+   * @brief Sends a 'request' or 'cancel' message for a block.
+   *
+   * @param type MessageType::Request or MessageType::Cancel.
+   * @param piece_index The index of the piece.
+   * @param block_index The index of the block within the piece.
+   * @param on_sent Optional callback invoked after the write.
+   */
+  void send_block_message(MessageType type, uint32_t piece_index,
+                          uint32_t block_index, WriteHandler on_sent = nullptr);
+
   /**
    * @brief Requests more blocks for a piece.
    *
@@ -156,6 +502,13 @@ private:
    */
   void request_more_blocks(PieceDownloadState &piece_request);
 
+  /**
+   * @brief Restores blocks of a piece saved by a previous session.
+   *
+   * @param piece_request The freshly created state of the piece.
+   */
+  void restore_partial_piece(PieceDownloadState &piece_request);
+
   /**
    * @brief Handles the response to a block request.
    *
@@ -168,6 +521,13 @@ private:
    */
   void read_message();
 
+  /**
+   * @brief Reads the next message once the download limiter allows it.
+   *
+   * @param bytes_received The size of the message just read.
+   */
+  void read_next_message(std::size_t bytes_received);
+
   /**
    * @brief Handles reading the length of a message.
    *
@@ -177,6 +537,27 @@ private:
   void handle_read_length(const boost::system::error_code &error,
                           std::size_t bytes_transferred);
 
+  /**
+   * @brief Handles reading the start of a message, enough to tell a block
+   * from the other messages.
+   *
+   * @param message_length The length of the message.
+   * @param error The error code resulting from the read.
+   */
+  void handle_read_header(uint32_t message_length,
+                          const boost::system::error_code &error);
+
+  /**
+   * @brief Reads the block of a 'piece' message straight into the buffer of
+   * its piece, or into a buffer of its own if the piece is assembled on
+   * disk or the block was not expected or already received.
+   *
+   * @param piece_index The piece of the block.
+   * @param begin The offset of the block within the piece.
+   * @param length The length of the block.
+   */
+  void read_block(uint32_t piece_index, uint32_t begin, uint32_t length);
+
   /**
    * @brief Handles reading the message data.
    *
@@ -201,11 +582,71 @@ private:
   void handle_bitfield_message(const std::vector<std::byte> &bitfield);
 
   /**
-   * @brief Handles a 'piece' message from the peer.
+   * @brief Handles a 'have' message from the peer.
+   *
+   * @param piece_index The index of the piece the peer announced.
+   */
+  void handle_have_message(uint32_t piece_index);
+
+  /**
+   * @brief Handles an 'interested' message by unchoking the peer.
+   */
+  void handle_interested_message();
+
+  /**
+   * @brief Serves a block the peer requested.
+   *
+   * @param piece_index The index of the requested piece.
+   * @param begin The offset of the block within the piece.
+   * @param length The length of the block.
+   */
+  void handle_request_message(uint32_t piece_index, uint32_t begin,
+                              uint32_t length);
+
+  /**
+   * @brief Handles a 'piece' message from the peer, once its block was read.
+   *
+   * @param piece_index The piece of the block.
+   * @param begin The offset of the block within the piece.
+   * @param length The length of the block.
+   * @param destination The buffer the block was read into; the block counts
+   * only if it is still the buffer of the piece, or if the piece is
+   * assembled on disk.
+   */
+  void handle_piece_message(uint32_t piece_index, uint32_t begin,
+                            uint32_t length, const Buffer &destination);
+
+  /**
+   * @brief Feeds the blocks that now extend the piece's gapless prefix into
+   * its running hash.
+   *
+   * @param piece_request The state of the piece.
+   * @param block_index The block just received.
+   * @param block Its data, if the piece is assembled on disk.
+   */
+  void advance_hash(PieceDownloadState &piece_request, uint32_t block_index,
+                    const std::byte *block);
+
+  /**
+   * @brief Checks a piece against its SHA-1 hash.
+   *
+   * Normally the running hash covers the whole piece by now. Otherwise,
+   * for instance if a block could not be read back, the piece is hashed
+   * from the start, reading it back from disk unless it is assembled in
+   * memory.
+   *
+   * @param piece_request The state of the piece, with every block received.
+   * @return true if the hash matches.
+   */
+  bool verify_piece(const PieceDownloadState &piece_request) const;
+
+  /**
+   * @brief Verifies a piece whose blocks have all arrived, and writes it to
+   * disk if its hash matches.
    *
-   * @param piece_data The piece data received from the peer.
+   * @param piece_request The state of the piece, erased afterwards.
    */
-  void handle_piece_message(const PieceData &piece_data);
+  void complete_piece(PieceDownloadState &piece_request);
 
   tcp::socket socket_;                 ///< TCP socket for the connection.
   InfoHash info_hash_;                 ///< Info hash of the torrent.
@@ -213,14 +654,44 @@ private:
   std::vector<std::byte> read_buffer_; ///< Buffer for reading messages.
   ConnectionState local_state_;        ///< Local connection state.
   ConnectionState remote_state_;       ///< Remote connection state.
-  std::vector<bool> bitfield_; ///< Bitfield of pieces available from the peer.
+  Bitfield bitfield_;                  ///< Pieces available from the peer.
   std::shared_ptr<PieceManager>
       piece_manager_; ///< Shared pointer to the PieceManager.
   std::shared_ptr<LinuxFileManager>
-      file_manager_;             ///< Shared pointer to the FileManager.
+      file_manager_; ///< Shared pointer to the FileManager.
+  std::shared_ptr<PiecePicker>
+      piece_picker_;             ///< Reserves the pieces we download.
   bool request_pending_ = false; ///< Indicates if a request is pending.
+  bool stopped_ = false;         ///< Set once stop() has run.
+  bool session_started_ = false; ///< Set once the handshakes are done.
+  std::function<void()> on_disconnect_; ///< Runs when the connection stops.
   std::unordered_map<uint32_t, PieceDownloadState>
       piece_download_states_; ///< States of pieces being downloaded.
+  std::deque<std::pair<Buffer, WriteHandler>>
+      write_queue_; ///< Messages waiting to be written, front in flight.
+  std::shared_ptr<BandwidthLimiter>
+      download_limiter_; ///< Limits received data, null if unlimited.
+  std::shared_ptr<BandwidthLimiter>
+      upload_limiter_; ///< Limits sent data, null if unlimited.
+  boost::asio::steady_timer read_timer_;  ///< Delays reads over the limit.
+  boost::asio::steady_timer write_timer_; ///< Delays writes over the limit.
+  std::shared_ptr<TimerWheel>
+      timer_wheel_; ///< Runs the timeouts below.
+  ConnectionTimeouts timeouts_; ///< How long the timeouts below take.
+  TimerWheel::TimerId check_timer_ = 0; ///< Fires check_timeouts().
+  std::unordered_map<uint64_t, TimerWheel::TimerId>
+      request_timers_; ///< Deadlines of outstanding requests, by block.
+  Clock::time_point last_received_ =
+      Clock::now(); ///< When the peer last sent anything.
+  Clock::time_point last_sent_ = Clock::now(); ///< When we last sent anything.
+  std::optional<Clock::time_point>
+      waiting_since_;     ///< Since when we wait for a block, if we do.
+  bool snubbed_ = false;  ///< The peer left our requests unanswered.
+  Bitfield timed_out_;    ///< Pieces abandoned since the peer last answered.
+  uint64_t bytes_since_check_ = 0; ///< Block bytes since the last check.
+  uint64_t download_rate_ = 0;     ///< Smoothed bytes per second.
+  Clock::time_point rate_checked_at_ =
+      Clock::now(); ///< When download_rate_ was last updated.
 };
 
 #endif // PEERCONNECTION_H
@@ -0,0 +1,104 @@
+#include "PieceChecker.h"
+#include "Utils/utils.h"
+#include <algorithm>
+#include <memory>
+#include <thread>
+
+PieceChecker::PieceChecker(const FileManager &file_manager,
+                           uint32_t piece_length,
+                           PieceHashes hashes)
+    : file_manager_(file_manager), piece_length_(piece_length),
+      hashes_(std::move(hashes)),
+      pieces_per_chunk_(static_cast<uint32_t>(
+          std::max<uint64_t>(1, CHECK_CHUNK_SIZE / piece_length))) {
+  for (const auto &file : file_manager_.files()) {
+    total_size_ += file.length;
+  }
+}
+
+uint32_t PieceChecker::run(const Callback &on_piece, unsigned threads) {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  uint32_t chunks = static_cast<uint32_t>(
+      (total_pieces() + pieces_per_chunk_ - 1) / pieces_per_chunk_);
+  threads = std::min(threads, std::max(1u, chunks));
+
+  std::atomic<uint32_t> valid{0};
+  std::vector<std::thread> workers;
+  for (unsigned i = 1; i < threads; ++i) {
+    workers.emplace_back([this, &on_piece, &valid]() {
+      valid.fetch_add(work(on_piece), std::memory_order_relaxed);
+    });
+  }
+  valid.fetch_add(work(on_piece), std::memory_order_relaxed);
+
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  return valid.load();
+}
+
+uint32_t PieceChecker::work(const Callback &on_piece) {
+  // Deliberately left uninitialised, every byte is overwritten by the read.
+  // Pieces larger than a chunk are streamed through a chunk-sized buffer.
+  std::unique_ptr<std::byte[]> buffer(new std::byte[std::min<uint64_t>(
+      uint64_t{pieces_per_chunk_} * piece_length_, CHECK_CHUNK_SIZE)]);
+  uint32_t valid = 0;
+
+  while (!cancelled_) {
+    uint32_t chunk = next_chunk_.fetch_add(1, std::memory_order_relaxed);
+    uint64_t first = static_cast<uint64_t>(chunk) * pieces_per_chunk_;
+    if (first >= total_pieces()) {
+      break;
+    }
+    uint32_t last = static_cast<uint32_t>(
+        std::min<uint64_t>(first + pieces_per_chunk_, total_pieces()));
+
+    uint64_t offset = first * piece_length_;
+    uint64_t length =
+        std::min<uint64_t>(total_size_, last * uint64_t{piece_length_}) -
+        offset;
+
+    if (length > CHECK_CHUNK_SIZE) {
+      bool ok = check_streaming(offset, length, buffer.get(),
+                                hashes_[static_cast<uint32_t>(first)]);
+      valid += ok;
+      pieces_checked_.fetch_add(1, std::memory_order_relaxed);
+      on_piece(static_cast<uint32_t>(first), ok);
+      continue;
+    }
+    bool readable = file_manager_.read_range(offset, buffer.get(), length);
+
+    for (uint32_t piece = static_cast<uint32_t>(first); piece < last;
+         ++piece) {
+      uint64_t piece_offset = (piece - first) * uint64_t{piece_length_};
+      uint64_t piece_size =
+          std::min<uint64_t>(piece_length_, length - piece_offset);
+      std::byte *data = buffer.get() + piece_offset;
+      // A failed chunk read may be one short file, so retry piece by piece
+      bool ok = (readable || file_manager_.read_range(offset + piece_offset,
+                                                      data, piece_size)) &&
+                sha1_digest(data, piece_size) == hashes_[piece];
+      valid += ok;
+      pieces_checked_.fetch_add(1, std::memory_order_relaxed);
+      on_piece(piece, ok);
+    }
+  }
+
+  return valid;
+}
+
+bool PieceChecker::check_streaming(uint64_t offset, uint64_t length,
+                                   std::byte *buffer,
+                                   const InfoHash &expected) const {
+  Sha1 hash;
+  for (uint64_t done = 0; done < length; done += CHECK_CHUNK_SIZE) {
+    uint64_t size = std::min(CHECK_CHUNK_SIZE, length - done);
+    if (!file_manager_.read_range(offset + done, buffer, size)) {
+      return false;
+    }
+    hash.update(buffer, size);
+  }
+  return hash.finish() == expected;
+}
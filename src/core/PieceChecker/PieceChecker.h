@@ -0,0 +1,103 @@
+#ifndef PIECECHECKER_H
+#define PIECECHECKER_H
+
+#include "FileManager/FileManager.h"
+#include "Torrent/Torrent.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/// Amount of data each checking thread reads in one go.
+const uint64_t CHECK_CHUNK_SIZE = 8 * 1024 * 1024;
+
+/**
+ * @brief Verifies the data on disk against the piece hashes of a torrent.
+ *
+ * The torrent is split into chunks of whole pieces that worker threads claim
+ * in order, so every thread reads large sequential ranges while all cores
+ * hash. Memory use is bounded by one chunk per thread; pieces larger than a
+ * chunk are hashed incrementally as they are read.
+ */
+class PieceChecker {
+public:
+  /**
+   * @brief Callback invoked once per piece with the result of its check.
+   *
+   * Runs on a worker thread and may be called concurrently.
+   */
+  using Callback = std::function<void(uint32_t piece_index, bool valid)>;
+
+  /**
+   * @brief Constructs a PieceChecker.
+   *
+   * @param file_manager Provides access to the data on disk.
+   * @param piece_length The length of each piece in bytes.
+   * @param hashes The expected SHA-1 hash of every piece.
+   */
+  PieceChecker(const FileManager &file_manager, uint32_t piece_length,
+               PieceHashes hashes);
+
+  /**
+   * @brief Checks every piece, blocking until done or cancelled.
+   *
+   * @param on_piece Callback receiving the result of every checked piece.
+   * @param threads Number of worker threads, 0 for one per core.
+   * @return The number of pieces that matched their hash.
+   */
+  uint32_t run(const Callback &on_piece, unsigned threads = 0);
+
+  /**
+   * @brief Asks a running check to stop after the chunks in progress.
+   */
+  void cancel() { cancelled_ = true; }
+
+  /**
+   * @brief Gets the number of pieces checked so far.
+   *
+   * @return The number of checked pieces.
+   */
+  uint32_t pieces_checked() const {
+    return pieces_checked_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Gets the total number of pieces to check.
+   *
+   * @return The number of pieces.
+   */
+  uint32_t total_pieces() const { return hashes_.size(); }
+
+private:
+  /**
+   * @brief Claims and checks chunks until none are left.
+   *
+   * @param on_piece Callback receiving the result of every checked piece.
+   * @return The number of valid pieces this worker found.
+   */
+  uint32_t work(const Callback &on_piece);
+
+  /**
+   * @brief Hashes a piece larger than a chunk in chunk-sized reads.
+   *
+   * @param offset The offset of the piece within the torrent.
+   * @param length The length of the piece.
+   * @param buffer Scratch space of CHECK_CHUNK_SIZE bytes.
+   * @param expected The expected hash of the piece.
+   * @return true if the piece matched its hash.
+   */
+  bool check_streaming(uint64_t offset, uint64_t length, std::byte *buffer,
+                       const InfoHash &expected) const;
+
+  const FileManager &file_manager_;     ///< Source of the data.
+  const uint32_t piece_length_;         ///< Length of each piece in bytes.
+  const PieceHashes hashes_;            ///< Expected piece hashes.
+  uint64_t total_size_ = 0;             ///< Total size of the torrent.
+  uint32_t pieces_per_chunk_;           ///< Whole pieces read at once.
+
+  std::atomic<uint32_t> next_chunk_{0};     ///< Next chunk to be claimed.
+  std::atomic<uint32_t> pieces_checked_{0}; ///< Progress counter.
+  std::atomic<bool> cancelled_{false};      ///< Set by cancel().
+};
+
+#endif // PIECECHECKER_H
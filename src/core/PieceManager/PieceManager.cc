@@ -1,51 +1,201 @@
 #include "PieceManager.h"
+#include <algorithm>
 #include <stdexcept>
 
+namespace {
+
+uint32_t compute_total_pieces(uint64_t total_size, uint32_t piece_length) {
+  return static_cast<uint32_t>((total_size + piece_length - 1) / piece_length);
+}
+
+uint32_t compute_last_piece_size(uint64_t total_size, uint32_t piece_length) {
+  return total_size % piece_length == 0 ? piece_length
+                                        : total_size % piece_length;
+}
+
+} // namespace
+
 PieceManager::PieceManager(const uint64_t total_size,
                            const uint32_t piece_length)
-    : total_size(total_size), piece_length(piece_length) {
-  total_pieces = (total_size + piece_length - 1) / piece_length;
-  downloaded_pieces_.resize(total_pieces, false);
-}
+    : total_size(total_size), piece_length(piece_length),
+      total_pieces_(compute_total_pieces(total_size, piece_length)),
+      last_piece_size(compute_last_piece_size(total_size, piece_length)),
+      downloaded_pieces_(total_pieces_),
+      subscribers_(std::make_shared<const SubscriberList>()),
+      priorities_(std::make_shared<const Priorities>(
+          Priorities{std::vector<Priority>(total_pieces_, Priority::Normal),
+                     Bitfield(total_pieces_), Priority::Normal})) {}
 
 bool PieceManager::has_piece(const uint32_t piece_index) const {
-  std::lock_guard<std::mutex> lock(mutex_);
-  return piece_index < downloaded_pieces_.size() &&
-         downloaded_pieces_[piece_index];
+  return downloaded_pieces_.test(piece_index);
 }
 
 std::unordered_set<uint32_t> PieceManager::missing_pieces() const {
-  std::lock_guard<std::mutex> lock(mutex_);
   std::unordered_set<uint32_t> missing; // Might change this to a queue later
 
-  for (uint32_t i = 0; i < downloaded_pieces_.size(); ++i) {
-    if (!downloaded_pieces_[i]) {
+  for (uint32_t i = 0; i < total_pieces_; ++i) {
+    if (!downloaded_pieces_.test(i)) {
       missing.insert(i);
     }
   }
   return missing;
 }
 
+uint32_t PieceManager::missing_count() const {
+  return total_pieces_ - have_count_.load(std::memory_order_acquire);
+}
+
+uint32_t PieceManager::needed_count() const {
+  auto current = priorities();
+  if (current->skipped.none()) {
+    return missing_count();
+  }
+  return missing_count() -
+         current->skipped.count_and_not(downloaded_pieces_.snapshot());
+}
+
+void PieceManager::set_priorities(std::vector<Priority> pieces) {
+  if (pieces.size() != total_pieces_) {
+    throw std::invalid_argument("Mismatch in priorities and total pieces");
+  }
+  auto updated = std::make_shared<Priorities>(
+      Priorities{std::move(pieces), Bitfield(total_pieces_), Priority::Skip});
+  for (uint32_t i = 0; i < total_pieces_; ++i) {
+    if (updated->pieces[i] == Priority::Skip) {
+      updated->skipped.set(i);
+    }
+    updated->highest = std::max(updated->highest, updated->pieces[i]);
+  }
+  std::atomic_store(&priorities_,
+                    std::shared_ptr<const Priorities>(std::move(updated)));
+  if (needed_count() > 0) {
+    download_completed_ = false; // Completes again once the rest is in
+  }
+}
+
+Bitfield PieceManager::bitfield() const {
+  return downloaded_pieces_.snapshot();
+}
+
+Bitfield PieceManager::wanted_from(const Bitfield &peer_pieces) const {
+  auto current = priorities();
+  Bitfield wanted = peer_pieces.and_not(downloaded_pieces_.snapshot());
+  return current->skipped.none() ? wanted : wanted.and_not(current->skipped);
+}
+
+bool PieceManager::is_interesting(const Bitfield &peer_pieces) const {
+  auto current = priorities();
+  if (current->skipped.none()) {
+    return peer_pieces.any_and_not(downloaded_pieces_.snapshot());
+  }
+  return peer_pieces.and_not(downloaded_pieces_.snapshot())
+      .any_and_not(current->skipped);
+}
+
 void PieceManager::save_piece(const uint32_t piece_index) {
-  std::lock_guard<std::mutex> lock(mutex_);
-  if (piece_index >= downloaded_pieces_.size()) {
+  if (piece_index >= total_pieces_) {
     throw std::out_of_range("Attempted to access an invalid piece index");
   }
 
-  if (!downloaded_pieces_[piece_index]) {
-    downloaded_pieces_[piece_index] = true;
+  // Only the caller that flips the bit counts it and publishes the event
+  if (!downloaded_pieces_.set(piece_index)) {
+    return;
+  }
+
+  uint32_t have = have_count_.fetch_add(1, std::memory_order_acq_rel) + 1;
+  publish({PieceEvent::Type::PieceCompleted, piece_index, have, total_pieces_});
+  // Only one of the callers that see nothing left publishes it
+  if (needed_count() == 0 && !download_completed_.exchange(true)) {
+    publish({PieceEvent::Type::DownloadCompleted, piece_index, have,
+             total_pieces_});
+  }
+  if (have == total_pieces_) {
+    publish(
+        {PieceEvent::Type::TorrentCompleted, piece_index, have, total_pieces_});
   }
 }
 
-uint32_t PieceManager::piece_size(const uint32_t piece_index) {
-  std::lock_guard<std::mutex> lock(mutex_);
-  if (piece_index >= total_pieces) {
+uint32_t PieceManager::piece_size(const uint32_t piece_index) const {
+  if (piece_index >= total_pieces_) {
     return 0;
   }
-  // If it's the last piece, calculate its size separately
-  if (piece_index == total_pieces - 1) {
-    return total_size % piece_length == 0 ? piece_length
-                                          : total_size % piece_length;
+  // If it's the last piece, its size is computed once at construction
+  if (piece_index == total_pieces_ - 1) {
+    return last_piece_size;
   }
   return piece_length;
 }
+
+PieceManager::SubscriptionId PieceManager::subscribe(Subscriber subscriber) {
+  std::lock_guard<std::mutex> lock(subscribers_mutex_);
+  auto updated =
+      std::make_shared<SubscriberList>(*std::atomic_load(&subscribers_));
+  SubscriptionId id = next_subscription_id_++;
+  updated->emplace_back(id, std::move(subscriber));
+  std::atomic_store(&subscribers_,
+                    std::shared_ptr<const SubscriberList>(std::move(updated)));
+  return id;
+}
+
+void PieceManager::unsubscribe(SubscriptionId id) {
+  std::lock_guard<std::mutex> lock(subscribers_mutex_);
+  auto updated =
+      std::make_shared<SubscriberList>(*std::atomic_load(&subscribers_));
+  updated->erase(std::remove_if(updated->begin(), updated->end(),
+                                [id](const auto &entry) {
+                                  return entry.first == id;
+                                }),
+                 updated->end());
+  std::atomic_store(&subscribers_,
+                    std::shared_ptr<const SubscriberList>(std::move(updated)));
+}
+
+void PieceManager::publish(const PieceEvent &event) const {
+  auto subscribers = std::atomic_load(&subscribers_);
+  for (const auto &entry : *subscribers) {
+    entry.second(event);
+  }
+}
+
+void PieceManager::restore_pieces(const Bitfield &pieces) {
+  for (uint32_t i = pieces.find_next(0); i < pieces.size();
+       i = pieces.find_next(i + 1)) {
+    restore_piece(i);
+  }
+}
+
+void PieceManager::restore_piece(uint32_t piece_index) {
+  if (piece_index < total_pieces_ && downloaded_pieces_.set(piece_index)) {
+    have_count_.fetch_add(1, std::memory_order_acq_rel);
+  }
+}
+
+void PieceManager::add_partial_piece(PartialPiece partial) {
+  if (partial.piece_index >= total_pieces_ ||
+      downloaded_pieces_.test(partial.piece_index)) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(partial_mutex_);
+  partial_pieces_[partial.piece_index] = std::move(partial.blocks);
+}
+
+std::optional<Bitfield> PieceManager::take_partial_piece(uint32_t piece_index) {
+  std::lock_guard<std::mutex> lock(partial_mutex_);
+  auto it = partial_pieces_.find(piece_index);
+  if (it == partial_pieces_.end()) {
+    return std::nullopt;
+  }
+  Bitfield blocks = std::move(it->second);
+  partial_pieces_.erase(it);
+  return blocks;
+}
+
+std::vector<PartialPiece> PieceManager::partial_pieces() const {
+  std::lock_guard<std::mutex> lock(partial_mutex_);
+  std::vector<PartialPiece> result;
+  result.reserve(partial_pieces_.size());
+  for (const auto &entry : partial_pieces_) {
+    result.push_back({entry.first, entry.second});
+  }
+  return result;
+}
@@ -1,20 +1,81 @@
 #ifndef PIECEMANAGER_H
 #define PIECEMANAGER_H
 
+#include "Bitfield/Bitfield.h"
 #include <Torrent/Torrent.h>
+#include <atomic>
 #include <cstdint>
+#include <functional>
+#include <memory>
 #include <mutex>
+#include <optional>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+/**
+ * @brief Describes a change in the completion state of a torrent.
+ */
+struct PieceEvent {
+  /**
+   * @brief Kinds of completion events.
+   */
+  enum class Type {
+    PieceCompleted,    ///< A piece was marked as downloaded.
+    DownloadCompleted, ///< The last piece not skipped was marked as
+                       ///< downloaded.
+    TorrentCompleted   ///< The last missing piece was marked as downloaded.
+  };
+
+  Type type;             ///< The kind of event.
+  uint32_t piece_index;  ///< The piece that triggered the event.
+  uint32_t have_count;   ///< Number of downloaded pieces after the change.
+  uint32_t total_pieces; ///< Total number of pieces in the torrent.
+};
+
+/**
+ * @brief Blocks of a piece that are already on disk.
+ */
+struct PartialPiece {
+  uint32_t piece_index; ///< Index of the piece.
+  Bitfield blocks;      ///< One bit per block, set when the block is on disk.
+};
+
 /**
  * @brief Manages the pieces of a torrent download.
  *
  * This class keeps track of which pieces have been downloaded and which are
- * still missing.
+ * still missing. Completion state lives in atomic words so that queries from
+ * many connection threads never block each other, and changes are pushed to
+ * subscribers as PieceEvents.
+ *
+ * Pieces also have a priority, mapped from the files they overlap. Skipped
+ * pieces are never wanted from peers, and the download is done once every
+ * piece that is not skipped is.
  */
 class PieceManager {
 public:
+  /**
+   * @brief Download priorities of the pieces, replaced as a whole.
+   */
+  struct Priorities {
+    std::vector<Priority> pieces; ///< Priority of each piece.
+    Bitfield skipped;             ///< Pieces not to download.
+    Priority highest;             ///< Highest priority of any piece.
+  };
+
+  /**
+   * @brief Callback invoked for every completion event.
+   *
+   * Subscribers run on the thread that completed the piece and must not block.
+   */
+  using Subscriber = std::function<void(const PieceEvent &)>;
+
+  /**
+   * @brief Handle returned by subscribe() and accepted by unsubscribe().
+   */
+  using SubscriptionId = uint64_t;
+
   /**
    * @brief Constructs a PieceManager with the total size and piece length of
    * the torrent.
@@ -35,6 +96,10 @@ public:
   /**
    * @brief Marks a piece as downloaded.
    *
+   * Publishes a PieceCompleted event the first time a piece is saved, a
+   * DownloadCompleted event when no piece that is not skipped is missing any
+   * more, and a TorrentCompleted event when it was the last missing piece.
+   *
    * @param piece_index The index of the piece to mark as downloaded.
    */
   void save_piece(const uint32_t piece_index);
@@ -46,22 +111,169 @@ public:
    */
   std::unordered_set<uint32_t> missing_pieces() const;
 
+  /**
+   * @brief Gets the number of pieces that have not been downloaded yet.
+   *
+   * @return The number of missing pieces.
+   */
+  uint32_t missing_count() const;
+
+  /**
+   * @brief Gets the number of missing pieces that are not skipped.
+   *
+   * @return The number of pieces still to download.
+   */
+  uint32_t needed_count() const;
+
+  /**
+   * @brief Gets a snapshot of the piece priorities.
+   *
+   * @return The priorities, all Priority::Normal unless changed.
+   */
+  std::shared_ptr<const Priorities> priorities() const {
+    return std::atomic_load(&priorities_);
+  }
+
+  /**
+   * @brief Replaces the piece priorities.
+   *
+   * @param pieces The priority of every piece.
+   * @throws std::invalid_argument if there is not one for every piece.
+   */
+  void set_priorities(std::vector<Priority> pieces);
+
+  /**
+   * @brief Gets the total number of pieces in the torrent.
+   *
+   * @return The number of pieces.
+   */
+  uint32_t total_pieces() const { return total_pieces_; }
+
+  /**
+   * @brief Retrieves a snapshot of the downloaded pieces.
+   *
+   * @return A bitfield with a bit set for every downloaded piece.
+   */
+  Bitfield bitfield() const;
+
+  /**
+   * @brief Computes the pieces a peer has that are still missing.
+   *
+   * @param peer_pieces The bitfield advertised by the peer.
+   * @return A bitfield of pieces the peer has and we lack, less skipped
+   * ones.
+   */
+  Bitfield wanted_from(const Bitfield &peer_pieces) const;
+
+  /**
+   * @brief Checks whether a peer has any piece that is still missing and
+   * not skipped.
+   *
+   * @param peer_pieces The bitfield advertised by the peer.
+   * @return true if we are interested in the peer.
+   */
+  bool is_interesting(const Bitfield &peer_pieces) const;
+
   /**
    * @brief Gets the size of a specific piece.
    *
    * @param piece_index The index of the piece.
    * @return The size of the piece in bytes.
    */
-  uint32_t piece_size(const uint32_t piece_index);
+  uint32_t piece_size(const uint32_t piece_index) const;
+
+  /**
+   * @brief Registers a callback for completion events.
+   *
+   * @param subscriber The callback to invoke.
+   * @return An id that can be passed to unsubscribe().
+   */
+  SubscriptionId subscribe(Subscriber subscriber);
+
+  /**
+   * @brief Removes a previously registered callback.
+   *
+   * @param id The id returned by subscribe().
+   */
+  void unsubscribe(SubscriptionId id);
+
+  /**
+   * @brief Marks pieces restored from resume data as downloaded.
+   *
+   * Unlike save_piece() this publishes no events, since nothing changed
+   * compared to the previous session.
+   *
+   * @param pieces The pieces known to be on disk.
+   */
+  void restore_pieces(const Bitfield &pieces);
+
+  /**
+   * @brief Marks a single piece found on disk as downloaded.
+   *
+   * Like restore_pieces() this publishes no events, and may be called from
+   * several checking threads at once.
+   *
+   * @param piece_index The index of the piece.
+   */
+  void restore_piece(uint32_t piece_index);
+
+  /**
+   * @brief Records blocks of an unfinished piece that are already on disk.
+   *
+   * @param partial The piece and its block map.
+   */
+  void add_partial_piece(PartialPiece partial);
+
+  /**
+   * @brief Claims the recorded blocks of an unfinished piece.
+   *
+   * The record is removed, so only the first connection that starts the piece
+   * picks them up.
+   *
+   * @param piece_index The index of the piece.
+   * @return The block map, or std::nullopt if none was recorded.
+   */
+  std::optional<Bitfield> take_partial_piece(uint32_t piece_index);
+
+  /**
+   * @brief Lists recorded unfinished pieces that have not been claimed.
+   *
+   * @return The unclaimed partial pieces.
+   */
+  std::vector<PartialPiece> partial_pieces() const;
 
 private:
-  mutable std::mutex
-      mutex_; ///< Mutex for thread-safe access to member variables.
-  std::vector<bool> downloaded_pieces_; ///< Vector tracking the download status
-                                        ///< of each piece.
-  uint64_t total_size;                  ///< Total size of the torrent in bytes.
-  uint32_t piece_length;                ///< Length of each piece in bytes.
-  uint32_t total_pieces; ///< Total number of pieces in the torrent.
+  using SubscriberList = std::vector<std::pair<SubscriptionId, Subscriber>>;
+
+  /**
+   * @brief Delivers an event to every current subscriber.
+   *
+   * @param event The event to deliver.
+   */
+  void publish(const PieceEvent &event) const;
+
+  const uint64_t total_size;      ///< Total size of the torrent in bytes.
+  const uint32_t piece_length;    ///< Length of each piece in bytes.
+  const uint32_t total_pieces_;   ///< Total number of pieces in the torrent.
+  const uint32_t last_piece_size; ///< Length of the final piece in bytes.
+
+  AtomicBitfield downloaded_pieces_;    ///< Download status of each piece.
+  std::atomic<uint32_t> have_count_{0}; ///< Number of downloaded pieces.
+  std::atomic<bool> download_completed_{
+      false}; ///< Set once DownloadCompleted is published, until more is
+              ///< wanted.
+
+  std::shared_ptr<const SubscriberList>
+      subscribers_; ///< Copy-on-write list, read with atomic loads.
+  std::mutex subscribers_mutex_; ///< Serializes subscribe/unsubscribe.
+  SubscriptionId next_subscription_id_ = 1; ///< Id handed to next subscriber.
+
+  std::shared_ptr<const Priorities>
+      priorities_; ///< Copy-on-write, read with atomic loads.
+
+  std::unordered_map<uint32_t, Bitfield>
+      partial_pieces_; ///< Unclaimed block maps of unfinished pieces.
+  mutable std::mutex partial_mutex_; ///< Guards partial_pieces_.
 };
 
 #endif // PIECEMANAGER_H
@@ -0,0 +1,151 @@
+#include "PiecePicker.h"
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+PiecePicker::PiecePicker(std::shared_ptr<PieceManager> piece_manager,
+                         std::shared_ptr<MemoryBudget> memory_budget)
+    : piece_manager_(std::move(piece_manager)),
+      memory_budget_(std::move(memory_budget)),
+      holders_(piece_manager_->total_pieces()),
+      availability_(piece_manager_->total_pieces()) {}
+
+std::optional<uint32_t> PiecePicker::pick(const Bitfield &peer_pieces,
+                                          uint64_t peer_rate) {
+  if (peer_pieces.size() != holders_.size()) {
+    return std::nullopt; // The peer has not told us what it has yet
+  }
+  Bitfield wanted = piece_manager_->wanted_from(peer_pieces);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Decays with every pick, so a fast peer that left stops setting the bar
+  fastest_rate_ = std::max(peer_rate, fastest_rate_ - fastest_rate_ / 8);
+  if (cursor_) {
+    std::optional<uint32_t> hurried = pick_in_window(wanted, peer_rate);
+    if (hurried) {
+      reserve(*hurried);
+      return hurried;
+    }
+  }
+
+  // Highest priority first, then rarest, the lowest index among equals
+  auto priorities = piece_manager_->priorities();
+  uint32_t piece_index = wanted.size();
+  Priority best = Priority::Skip;
+  uint16_t rarest = std::numeric_limits<uint16_t>::max();
+  for (uint32_t candidate = wanted.find_next(0); candidate < wanted.size();
+       candidate = wanted.find_next(candidate + 1)) {
+    Priority priority = priorities->pieces[candidate];
+    if (holders_[candidate] != 0 || priority < best ||
+        (priority == best && availability_[candidate] >= rarest)) {
+      continue;
+    }
+    piece_index = candidate;
+    best = priority;
+    rarest = availability_[candidate];
+    if (rarest <= 1 && best == priorities->highest) {
+      break; // Nobody but this peer has it, and nothing is more urgent
+    }
+  }
+  if (piece_index >= wanted.size()) {
+    return std::nullopt;
+  }
+  reserve(piece_index);
+  return piece_index;
+}
+
+std::optional<uint32_t>
+PiecePicker::pick_in_window(const Bitfield &wanted,
+                            uint64_t peer_rate) const {
+  if (peer_rate * 2 < fastest_rate_) {
+    return std::nullopt; // Too slow to be trusted with a deadline
+  }
+
+  uint32_t end = std::min<uint64_t>(uint64_t{*cursor_} + window_,
+                                    holders_.size());
+  std::optional<uint32_t> duplicate;
+  for (uint32_t piece_index = *cursor_; piece_index < end; ++piece_index) {
+    if (!wanted.test(piece_index)) {
+      continue;
+    }
+    if (holders_[piece_index] == 0) {
+      return piece_index;
+    }
+    if (!duplicate && holders_[piece_index] == 1 &&
+        piece_index - *cursor_ < STREAM_URGENT_PIECES) {
+      duplicate = piece_index;
+    }
+  }
+  return duplicate;
+}
+
+void PiecePicker::reserve(uint32_t piece_index) {
+  if (holders_[piece_index]++ == 0) {
+    ++reserved_count_;
+  }
+}
+
+MemoryBudget::Reservation PiecePicker::reserve_buffer(uint32_t piece_index) {
+  return memory_budget_->reserve(piece_manager_->piece_size(piece_index));
+}
+
+void PiecePicker::release(uint32_t piece_index) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (piece_index < holders_.size() && holders_[piece_index] != 0 &&
+      --holders_[piece_index] == 0) {
+    --reserved_count_;
+  }
+}
+
+void PiecePicker::add_peer(const Bitfield &peer_pieces) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (uint32_t piece_index = peer_pieces.find_next(0);
+       piece_index < std::min<size_t>(peer_pieces.size(), holders_.size());
+       piece_index = peer_pieces.find_next(piece_index + 1)) {
+    if (availability_[piece_index] < std::numeric_limits<uint16_t>::max()) {
+      ++availability_[piece_index];
+    }
+  }
+}
+
+void PiecePicker::add_have(uint32_t piece_index) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (piece_index < availability_.size() &&
+      availability_[piece_index] < std::numeric_limits<uint16_t>::max()) {
+    ++availability_[piece_index];
+  }
+}
+
+void PiecePicker::remove_peer(const Bitfield &peer_pieces) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (uint32_t piece_index = peer_pieces.find_next(0);
+       piece_index < std::min<size_t>(peer_pieces.size(), holders_.size());
+       piece_index = peer_pieces.find_next(piece_index + 1)) {
+    if (availability_[piece_index] != 0) {
+      --availability_[piece_index];
+    }
+  }
+}
+
+void PiecePicker::set_stream_window(uint32_t cursor, uint32_t window) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (cursor < holders_.size()) {
+    cursor_ = cursor;
+    window_ = window;
+  }
+}
+
+void PiecePicker::clear_stream_window() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  cursor_.reset();
+}
+
+bool PiecePicker::is_reserved(uint32_t piece_index) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return piece_index < holders_.size() && holders_[piece_index] != 0;
+}
+
+uint32_t PiecePicker::reserved_count() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return reserved_count_;
+}
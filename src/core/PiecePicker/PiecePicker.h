@@ -0,0 +1,163 @@
+#ifndef PIECEPICKER_H
+#define PIECEPICKER_H
+
+#include "Bitfield/Bitfield.h"
+#include "MemoryBudget/MemoryBudget.h"
+#include "PieceManager/PieceManager.h"
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+/// Pieces ahead of the read cursor that are downloaded first when streaming.
+const uint32_t STREAM_WINDOW_PIECES = 8;
+
+/// Pieces right at the read cursor whose download may be duplicated on a
+/// second fast peer, so one slow peer cannot stall the reader.
+const uint32_t STREAM_URGENT_PIECES = 2;
+
+/**
+ * @brief Hands out the pieces a torrent's connections download.
+ *
+ * Each missing piece is reserved by at most one connection at a time, so
+ * connections download different pieces instead of racing for the same
+ * one. A connection releases its reservations when the piece completes or
+ * when it disconnects, and the piece becomes available to the others again.
+ * Pieces of higher priority are picked first, and among those the rarest,
+ * by how many connected peers have them. Skipped pieces are never picked.
+ *
+ * When streaming, the pieces of a window ahead of the read cursor are
+ * picked first, nearest first since they are needed soonest, and only by
+ * peers at least half as fast as the fastest one. The pieces closest to
+ * the cursor may be reserved by a second fast peer once all of them are
+ * being downloaded.
+ *
+ * Before a piece is started, the picker decides from the in-flight memory
+ * budget whether it is assembled in memory or written to disk block by
+ * block. Thread-safe.
+ */
+class PiecePicker {
+public:
+  /**
+   * @brief Constructs a picker for the pieces of a torrent.
+   *
+   * @param piece_manager Knows which pieces are still missing.
+   * @param memory_budget Bounds the pieces assembled in memory.
+   */
+  explicit PiecePicker(
+      std::shared_ptr<PieceManager> piece_manager,
+      std::shared_ptr<MemoryBudget> memory_budget = MemoryBudget::global());
+
+  /**
+   * @brief Reserves a missing piece the peer has.
+   *
+   * @param peer_pieces The pieces the peer advertised, less any the
+   * connection is downloading already.
+   * @param peer_rate How fast the peer sends blocks, in bytes per second,
+   * 0 if not known yet.
+   * @return The reserved piece, or nothing if the peer has no missing piece
+   * that is not reserved already.
+   */
+  std::optional<uint32_t> pick(const Bitfield &peer_pieces,
+                               uint64_t peer_rate = 0);
+
+  /**
+   * @brief Reserves memory to assemble a picked piece in.
+   *
+   * @param piece_index The piece.
+   * @return The reservation, empty if the budget is spent and the piece's
+   * blocks should go straight to disk.
+   */
+  MemoryBudget::Reservation reserve_buffer(uint32_t piece_index);
+
+  /**
+   * @brief Gives up a reservation.
+   *
+   * @param piece_index The piece, which may be picked again if it is still
+   * missing.
+   */
+  void release(uint32_t piece_index);
+
+  /**
+   * @brief Counts the pieces of a newly connected peer.
+   *
+   * @param peer_pieces The pieces in the peer's bitfield.
+   */
+  void add_peer(const Bitfield &peer_pieces);
+
+  /**
+   * @brief Counts a piece a peer announced it got.
+   *
+   * @param piece_index The piece.
+   */
+  void add_have(uint32_t piece_index);
+
+  /**
+   * @brief Stops counting the pieces of a disconnected peer.
+   *
+   * @param peer_pieces The pieces the peer had.
+   */
+  void remove_peer(const Bitfield &peer_pieces);
+
+  /**
+   * @brief Downloads the pieces ahead of a read cursor first.
+   *
+   * @param cursor The piece being read.
+   * @param window Number of pieces from the cursor on to hurry.
+   */
+  void set_stream_window(uint32_t cursor,
+                         uint32_t window = STREAM_WINDOW_PIECES);
+
+  /**
+   * @brief Goes back to picking rarest first everywhere.
+   */
+  void clear_stream_window();
+
+  /**
+   * @brief Checks whether a piece is reserved.
+   *
+   * @param piece_index The piece.
+   * @return true if a connection is downloading it.
+   */
+  bool is_reserved(uint32_t piece_index) const;
+
+  /**
+   * @brief Gets the number of reserved pieces.
+   *
+   * @return The number of pieces being downloaded.
+   */
+  uint32_t reserved_count() const;
+
+private:
+  /**
+   * @brief Finds the piece to hurry for a peer, if any. Must be called with
+   * mutex_ held.
+   *
+   * @param wanted Missing pieces the peer has.
+   * @param peer_rate How fast the peer sends blocks.
+   * @return The piece, or nothing to pick rarest first instead.
+   */
+  std::optional<uint32_t> pick_in_window(const Bitfield &wanted,
+                                         uint64_t peer_rate) const;
+
+  /**
+   * @brief Records a connection downloading a piece. Must be called with
+   * mutex_ held.
+   *
+   * @param piece_index The piece.
+   */
+  void reserve(uint32_t piece_index);
+
+  std::shared_ptr<PieceManager> piece_manager_; ///< Missing pieces.
+  std::shared_ptr<MemoryBudget> memory_budget_; ///< Pieces kept in memory.
+  mutable std::mutex mutex_;                    ///< Guards the members below.
+  std::vector<uint8_t> holders_;                ///< Connections on each piece.
+  uint32_t reserved_count_ = 0;                 ///< Pieces with a holder.
+  std::vector<uint16_t> availability_;          ///< Peers with each piece.
+  std::optional<uint32_t> cursor_;              ///< Piece read, if streaming.
+  uint32_t window_ = 0;                         ///< Pieces hurried on.
+  uint64_t fastest_rate_ = 0;                   ///< Fastest recent peer.
+};
+
+#endif // PIECEPICKER_H
@@ -0,0 +1,245 @@
+#include "ResumeData.h"
+#include <algorithm>
+#include <bencode.hpp>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char *const FILE_FORMAT = "yatc resume file";
+const bencode::integer FILE_VERSION = 1;
+
+std::string bytes_to_string(const std::vector<std::byte> &bytes) {
+  return {reinterpret_cast<const char *>(bytes.data()), bytes.size()};
+}
+
+bencode::integer get_integer(const bencode::dict &dict, const char *key) {
+  auto it = dict.find(key);
+  if (it == dict.end()) {
+    throw std::runtime_error(std::string("Resume data is missing ") + key);
+  }
+  return std::get<bencode::integer>(it->second);
+}
+
+const std::string &get_string(const bencode::dict &dict, const char *key) {
+  auto it = dict.find(key);
+  if (it == dict.end()) {
+    throw std::runtime_error(std::string("Resume data is missing ") + key);
+  }
+  return std::get<std::string>(it->second);
+}
+
+bool write_all(int fd, const std::string &content) {
+  size_t written = 0;
+  while (written < content.size()) {
+    ssize_t result =
+        write(fd, content.data() + written, content.size() - written);
+    if (result == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    written += static_cast<size_t>(result);
+  }
+  return true;
+}
+
+} // namespace
+
+std::optional<FileStamp> stat_file(const std::string &path) {
+  struct stat statbuf;
+  if (stat(path.c_str(), &statbuf) != 0) {
+    return std::nullopt;
+  }
+  FileStamp stamp;
+  stamp.size = static_cast<uint64_t>(statbuf.st_size);
+  stamp.mtime = static_cast<int64_t>(statbuf.st_mtim.tv_sec) * 1000000000 +
+                statbuf.st_mtim.tv_nsec;
+  return stamp;
+}
+
+std::string ResumeData::encode() const {
+  bencode::dict dict;
+  dict["file-format"] = FILE_FORMAT;
+  dict["file-version"] = FILE_VERSION;
+  dict["info-hash"] = std::string(
+      reinterpret_cast<const char *>(info_hash.data()), info_hash.size());
+  dict["piece-count"] = static_cast<bencode::integer>(pieces.size());
+  dict["pieces"] = bytes_to_string(pieces.to_bytes());
+
+  bencode::list file_list;
+  for (const auto &stamp : files) {
+    file_list.push_back(bencode::list{
+        static_cast<bencode::integer>(stamp.size),
+        static_cast<bencode::integer>(stamp.mtime)});
+  }
+  dict["files"] = std::move(file_list);
+
+  bencode::list partial_list;
+  for (const auto &partial : partial_pieces) {
+    bencode::dict entry;
+    entry["piece"] = static_cast<bencode::integer>(partial.piece_index);
+    entry["block-count"] =
+        static_cast<bencode::integer>(partial.blocks.size());
+    entry["blocks"] = bytes_to_string(partial.blocks.to_bytes());
+    partial_list.push_back(std::move(entry));
+  }
+  dict["unfinished"] = std::move(partial_list);
+
+  bencode::list priority_list;
+  for (Priority priority : file_priorities) {
+    priority_list.push_back(static_cast<bencode::integer>(priority));
+  }
+  dict["file-priorities"] = std::move(priority_list);
+
+  return bencode::encode(dict);
+}
+
+ResumeData ResumeData::decode(const std::string &content) {
+  try {
+    auto dict = std::get<bencode::dict>(bencode::decode(content));
+    if (get_string(dict, "file-format") != FILE_FORMAT ||
+        get_integer(dict, "file-version") != FILE_VERSION) {
+      throw std::runtime_error("Unsupported resume file format");
+    }
+
+    ResumeData data;
+    const auto &hash = get_string(dict, "info-hash");
+    if (hash.size() != data.info_hash.size()) {
+      throw std::runtime_error("Invalid info hash in resume data");
+    }
+    std::memcpy(data.info_hash.data(), hash.data(), hash.size());
+
+    const auto &pieces = get_string(dict, "pieces");
+    data.pieces =
+        Bitfield(reinterpret_cast<const std::byte *>(pieces.data()),
+                 pieces.size(),
+                 static_cast<uint32_t>(get_integer(dict, "piece-count")));
+
+    for (const auto &entry : std::get<bencode::list>(dict.at("files"))) {
+      const auto &stamp = std::get<bencode::list>(entry);
+      if (stamp.size() != 2) {
+        throw std::runtime_error("Invalid file stamp in resume data");
+      }
+      data.files.push_back(
+          {static_cast<uint64_t>(std::get<bencode::integer>(stamp[0])),
+           static_cast<int64_t>(std::get<bencode::integer>(stamp[1]))});
+    }
+
+    for (const auto &entry : std::get<bencode::list>(dict.at("unfinished"))) {
+      const auto &partial = std::get<bencode::dict>(entry);
+      const auto &blocks = get_string(partial, "blocks");
+      data.partial_pieces.push_back(
+          {static_cast<uint32_t>(get_integer(partial, "piece")),
+           Bitfield(reinterpret_cast<const std::byte *>(blocks.data()),
+                    blocks.size(),
+                    static_cast<uint32_t>(
+                        get_integer(partial, "block-count")))});
+    }
+
+    // Absent from resume files written before files could be skipped
+    auto priorities = dict.find("file-priorities");
+    if (priorities != dict.end()) {
+      for (const auto &entry : std::get<bencode::list>(priorities->second)) {
+        auto priority = std::get<bencode::integer>(entry);
+        if (priority < static_cast<bencode::integer>(Priority::Skip) ||
+            priority > static_cast<bencode::integer>(Priority::Urgent)) {
+          throw std::runtime_error("Invalid file priority in resume data");
+        }
+        data.file_priorities.push_back(static_cast<Priority>(priority));
+      }
+    }
+
+    return data;
+  } catch (const std::bad_variant_access &) {
+    throw std::runtime_error("Malformed resume data");
+  } catch (const std::out_of_range &) {
+    throw std::runtime_error("Malformed resume data");
+  } catch (const bencode::decode_error &e) {
+    throw std::runtime_error("Malformed resume data: " +
+                             std::string(e.what()));
+  }
+}
+
+bool ResumeData::save(const std::string &path) const {
+  std::string content = encode();
+  std::string temp_path = path + ".tmp";
+
+  int fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd == -1) {
+    return false;
+  }
+
+  bool ok = write_all(fd, content) && fsync(fd) == 0;
+  ok = close(fd) == 0 && ok;
+  if (!ok || std::rename(temp_path.c_str(), path.c_str()) != 0) {
+    std::remove(temp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+std::optional<ResumeData> ResumeData::load(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    return std::nullopt;
+  }
+
+  std::string content{std::istreambuf_iterator<char>(file),
+                      std::istreambuf_iterator<char>()};
+  try {
+    return decode(content);
+  } catch (const std::runtime_error &) {
+    return std::nullopt;
+  }
+}
+
+size_t ResumeData::validate(const std::vector<FileInfo> &torrent_files,
+                            uint32_t piece_length) {
+  // A different file list means the stamps cannot be matched up at all
+  if (files.size() != torrent_files.size()) {
+    pieces = Bitfield(pieces.size());
+    partial_pieces.clear();
+    return torrent_files.size();
+  }
+
+  size_t invalid = 0;
+  for (size_t i = 0; i < torrent_files.size(); ++i) {
+    const FileInfo &file = torrent_files[i];
+    auto stamp = stat_file(file.path);
+    if (stamp && *stamp == files[i] && stamp->size == file.length) {
+      continue;
+    }
+    if (!stamp && files[i] == FileStamp{}) {
+      continue; // Its bytes are in the part file, if anywhere
+    }
+
+    ++invalid;
+    if (file.length == 0) {
+      continue;
+    }
+
+    uint32_t first = static_cast<uint32_t>(file.start_offset / piece_length);
+    uint32_t last = static_cast<uint32_t>(
+        (file.start_offset + file.length - 1) / piece_length);
+    for (uint32_t piece = first; piece <= last; ++piece) {
+      pieces.reset(piece);
+    }
+    partial_pieces.erase(
+        std::remove_if(partial_pieces.begin(), partial_pieces.end(),
+                       [first, last](const PartialPiece &partial) {
+                         return partial.piece_index >= first &&
+                                partial.piece_index <= last;
+                       }),
+        partial_pieces.end());
+  }
+
+  return invalid;
+}
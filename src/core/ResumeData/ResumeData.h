@@ -0,0 +1,100 @@
+#ifndef RESUMEDATA_H
+#define RESUMEDATA_H
+
+#include "Bitfield/Bitfield.h"
+#include "PieceManager/PieceManager.h"
+#include "Torrent/Torrent.h"
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Size and modification time of a file on disk.
+ *
+ * Used as a cheap fingerprint to decide whether data described by resume data
+ * is still what is on disk, without rehashing it.
+ */
+struct FileStamp {
+  uint64_t size = 0; ///< File size in bytes.
+  int64_t mtime = 0; ///< Modification time in nanoseconds since the epoch.
+
+  bool operator==(const FileStamp &other) const {
+    return size == other.size && mtime == other.mtime;
+  }
+};
+
+/**
+ * @brief Reads the stamp of a file.
+ *
+ * @param path Path to the file.
+ * @return The stamp, or std::nullopt if the file does not exist.
+ */
+std::optional<FileStamp> stat_file(const std::string &path);
+
+/**
+ * @brief Persistent download state of a torrent.
+ *
+ * Holds the completion bitfield, a stamp and a priority for every file and
+ * the block maps of pieces that were in progress. Serialized as a small
+ * bencoded dictionary.
+ */
+struct ResumeData {
+  InfoHash info_hash = {};                  ///< Torrent this data belongs to.
+  Bitfield pieces;                          ///< Pieces verified and on disk.
+  std::vector<FileStamp> files;             ///< Stamp of each torrent file.
+  std::vector<PartialPiece> partial_pieces; ///< Blocks of unfinished pieces.
+  std::vector<Priority> file_priorities;    ///< Empty if never saved.
+
+  /**
+   * @brief Serializes the resume data.
+   *
+   * @return The bencoded resume data.
+   */
+  std::string encode() const;
+
+  /**
+   * @brief Parses serialized resume data.
+   *
+   * @param content The bencoded resume data.
+   * @return The decoded resume data.
+   * @throws std::runtime_error if the content is malformed.
+   */
+  static ResumeData decode(const std::string &content);
+
+  /**
+   * @brief Writes the resume data atomically.
+   *
+   * The data is written to a temporary file, synced and renamed over
+   * @p path, so a crash never leaves a truncated resume file behind.
+   *
+   * @param path Destination path.
+   * @return true on success, false otherwise.
+   */
+  bool save(const std::string &path) const;
+
+  /**
+   * @brief Reads resume data from disk.
+   *
+   * @param path Path of the resume file.
+   * @return The resume data, or std::nullopt if it is missing or malformed.
+   */
+  static std::optional<ResumeData> load(const std::string &path);
+
+  /**
+   * @brief Drops state for files that changed since the data was saved.
+   *
+   * Every file whose size or modification time differs from its stamp, or
+   * that no longer exists, has the pieces overlapping it cleared. A file
+   * that was never created, as skipped files are not, is still valid while
+   * it does not exist.
+   *
+   * @param torrent_files The files of the torrent, with their offsets.
+   * @param piece_length The length of each piece in bytes.
+   * @return The number of files that failed validation.
+   */
+  size_t validate(const std::vector<FileInfo> &torrent_files,
+                  uint32_t piece_length);
+};
+
+#endif // RESUMEDATA_H
@@ -0,0 +1,87 @@
+#include "Scraper.h"
+#include <algorithm>
+#include <utility>
+
+Scraper::Scraper(std::shared_ptr<HttpClient> http_client,
+                 std::shared_ptr<UdpTrackerClient> udp_client)
+    : http_client_(std::move(http_client)),
+      udp_client_(std::move(udp_client)) {}
+
+void Scraper::scrape(const std::string &announce_url,
+                     std::vector<InfoHash> info_hashes, Callback on_done) {
+  std::string url = scrape_url(announce_url);
+  if (url.compare(0, 6, "udp://") == 0) {
+    if (udp_client_ == nullptr) {
+      on_done({"UDP trackers are not supported", {}});
+      return;
+    }
+    udp_client_->scrape(url, std::move(info_hashes), std::move(on_done));
+    return;
+  }
+  if (url.empty()) {
+    on_done({"Tracker does not support scraping", {}});
+    return;
+  }
+  if (info_hashes.empty()) {
+    on_done({});
+    return;
+  }
+
+  // Responses all run on the HTTP client's strand, so the batches need no
+  // lock of their own
+  struct Batches {
+    ScrapeResponse response;
+    size_t remaining = 0;
+    Callback on_done;
+  };
+  auto batches = std::make_shared<Batches>();
+  batches->response.stats.resize(info_hashes.size());
+  batches->remaining =
+      (info_hashes.size() + HTTP_SCRAPE_BATCH - 1) / HTTP_SCRAPE_BATCH;
+  batches->on_done = std::move(on_done);
+
+  const char query = url.find('?') == std::string::npos ? '?' : '&';
+  for (size_t first = 0; first < info_hashes.size();
+       first += HTTP_SCRAPE_BATCH) {
+    size_t count = std::min(HTTP_SCRAPE_BATCH, info_hashes.size() - first);
+    std::vector<InfoHash> batch(info_hashes.begin() + first,
+                                info_hashes.begin() + first + count);
+    std::string request = url;
+    char separator = query;
+    for (const InfoHash &info_hash : batch) {
+      request += separator;
+      request += "info_hash=" + urlEncode(info_hash);
+      separator = '&';
+    }
+
+    http_client_->get(request, [batches, first, batch = std::move(batch)](
+                                   HttpResponse http_response) {
+      if (batches->on_done == nullptr) {
+        return; // Another batch failed already
+      }
+      ScrapeResponse result;
+      if (!http_response.error.empty()) {
+        result.failure_reason = http_response.error;
+      } else {
+        try {
+          result = parse_scrape_response(http_response.body, batch);
+        } catch (const std::exception &e) {
+          result.failure_reason =
+              http_response.status != 200
+                  ? "HTTP status " + std::to_string(http_response.status)
+                  : e.what();
+        }
+      }
+      if (!result.failure_reason.empty()) {
+        std::exchange(batches->on_done, nullptr)(std::move(result));
+        return;
+      }
+
+      std::copy(result.stats.begin(), result.stats.end(),
+                batches->response.stats.begin() + first);
+      if (--batches->remaining == 0) {
+        std::exchange(batches->on_done, nullptr)(std::move(batches->response));
+      }
+    });
+  }
+}
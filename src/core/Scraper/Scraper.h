@@ -0,0 +1,57 @@
+#ifndef SCRAPER_H
+#define SCRAPER_H
+
+#include "HttpClient/HttpClient.h"
+#include "TrackerClient/TrackerClient.h"
+#include "UdpTrackerClient/UdpTrackerClient.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+/// Most info hashes put in one HTTP scrape request, keeping URLs short.
+const size_t HTTP_SCRAPE_BATCH = 50;
+
+/**
+ * @brief Asks trackers for the swarm statistics of many torrents at once.
+ *
+ * HTTP trackers get one request per batch of info hashes, each passed as a
+ * separate info_hash parameter; UDP trackers are scraped through the shared
+ * UdpTrackerClient. Stateless apart from the clients, so scrapes may be
+ * started from any thread.
+ */
+class Scraper {
+public:
+  /**
+   * @brief Receives the merged result of a scrape.
+   *
+   * Runs on the strand of the HTTP or UDP client that performed it.
+   */
+  using Callback = std::function<void(ScrapeResponse)>;
+
+  /**
+   * @brief Constructs a new Scraper object.
+   *
+   * @param http_client Scrapes http:// and https:// trackers.
+   * @param udp_client Scrapes udp:// trackers, null if unsupported.
+   */
+  Scraper(std::shared_ptr<HttpClient> http_client,
+          std::shared_ptr<UdpTrackerClient> udp_client);
+
+  /**
+   * @brief Scrapes one tracker for the given torrents.
+   *
+   * @param announce_url The tracker's announce URL.
+   * @param info_hashes The torrents to scrape.
+   * @param on_done Receives one entry per info hash, in the same order, or
+   * the failure reason if any batch failed.
+   */
+  void scrape(const std::string &announce_url,
+              std::vector<InfoHash> info_hashes, Callback on_done);
+
+private:
+  std::shared_ptr<HttpClient> http_client_;      ///< Scrapes HTTP trackers.
+  std::shared_ptr<UdpTrackerClient> udp_client_; ///< Scrapes UDP trackers.
+};
+
+#endif // SCRAPER_H
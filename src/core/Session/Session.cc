@@ -0,0 +1,313 @@
+#include "Session.h"
+#include "Logger/Logger.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+Session::Session(unsigned threads, uint16_t port)
+    : work_guard_(io_context_.get_executor()),
+      acceptor_(boost::asio::make_strand(io_context_)),
+      http_client_(std::make_shared<HttpClient>(io_context_)),
+      udp_client_(std::make_shared<UdpTrackerClient>(io_context_)),
+      disk_pool_(SESSION_DISK_THREADS),
+      download_limiter_(std::make_shared<BandwidthLimiter>()),
+      upload_limiter_(std::make_shared<BandwidthLimiter>()),
+      scraper_(http_client_, udp_client_),
+      schedule_strand_(io_context_.get_executor()),
+      schedule_timer_(schedule_strand_) {
+  start_accepting(port);
+  boost::asio::post(schedule_strand_, [this]() { schedule(); });
+
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (unsigned i = 0; i < threads; ++i) {
+    threads_.emplace_back([this]() { io_context_.run(); });
+  }
+}
+
+Session::~Session() { stop(); }
+
+std::shared_ptr<TorrentClient>
+Session::add_torrent(const std::string &torrent_file,
+                     const std::string &seed_path) {
+  auto torrent = std::make_shared<TorrentClient>(
+      io_context_, disk_pool_.get_executor(), http_client_, udp_client_,
+      listen_port_ != 0 ? listen_port_ : LISTEN_PORT, torrent_file, seed_path);
+  if (torrent->torrent() == nullptr) {
+    throw std::runtime_error("Failed to load torrent: " + torrent_file);
+  }
+  // Each torrent's share is limited within the session's limits
+  torrent->set_bandwidth_limiters(
+      std::make_shared<BandwidthLimiter>(0, download_limiter_),
+      std::make_shared<BandwidthLimiter>(0, upload_limiter_));
+
+  {
+    std::lock_guard<std::mutex> lock(torrents_mutex_);
+    if (stopped_) {
+      throw std::runtime_error("Session is stopped");
+    }
+    if (!torrents_.emplace(torrent->torrent()->info_hash, torrent).second) {
+      throw std::runtime_error("Torrent is already in the session: " +
+                               torrent_file);
+    }
+  }
+  reschedule();
+
+  boost::asio::post(disk_pool_, [torrent]() {
+    try {
+      torrent->launch();
+    } catch (const std::exception &e) {
+      Logger::instance()->log("Failed to start " + torrent->torrent()->name +
+                                  ": " + e.what(),
+                              Logger::ERROR);
+    }
+  });
+  return torrent;
+}
+
+bool Session::remove_torrent(const InfoHash &info_hash) {
+  std::lock_guard<std::mutex> lock(torrents_mutex_);
+  auto it = torrents_.find(info_hash);
+  if (it == torrents_.end()) {
+    return false;
+  }
+
+  // Forget torrents that finished closing, the rest stop() waits for
+  closing_.erase(std::remove_if(closing_.begin(), closing_.end(),
+                                [](const std::future<void> &closing) {
+                                  return closing.wait_for(
+                                             std::chrono::seconds(0)) ==
+                                         std::future_status::ready;
+                                }),
+                 closing_.end());
+  closing_.push_back(it->second->close());
+  torrents_.erase(it);
+  return true;
+}
+
+std::shared_ptr<TorrentClient>
+Session::find_torrent(const InfoHash &info_hash) const {
+  std::lock_guard<std::mutex> lock(torrents_mutex_);
+  auto it = torrents_.find(info_hash);
+  return it != torrents_.end() ? it->second : nullptr;
+}
+
+std::vector<std::shared_ptr<TorrentClient>> Session::torrents() const {
+  std::lock_guard<std::mutex> lock(torrents_mutex_);
+  std::vector<std::shared_ptr<TorrentClient>> torrents;
+  torrents.reserve(torrents_.size());
+  for (const auto &entry : torrents_) {
+    torrents.push_back(entry.second);
+  }
+  return torrents;
+}
+
+void Session::scrape() {
+  // One request per tracker for all of its torrents, asking the tracker
+  // each one last reached rather than one that may be down
+  std::unordered_map<std::string, std::vector<std::shared_ptr<TorrentClient>>>
+      by_tracker;
+  for (auto &torrent : torrents()) {
+    std::string url = torrent->scrape_url();
+    if (!url.empty()) {
+      by_tracker[url].push_back(std::move(torrent));
+    }
+  }
+
+  for (auto &entry : by_tracker) {
+    std::vector<InfoHash> info_hashes;
+    for (const auto &torrent : entry.second) {
+      info_hashes.push_back(torrent->torrent()->info_hash);
+    }
+    scraper_.scrape(
+        entry.first, std::move(info_hashes),
+        [this, torrents = std::move(entry.second),
+         url = entry.first](ScrapeResponse response) {
+          if (!response.failure_reason.empty()) {
+            Logger::instance()->log("Scrape of " + url +
+                                        " failed: " + response.failure_reason,
+                                    Logger::DEBUG);
+            return;
+          }
+          for (size_t i = 0; i < torrents.size(); ++i) {
+            torrents[i]->update_swarm(response.stats[i]);
+          }
+          reschedule();
+        });
+  }
+}
+
+void Session::reschedule() {
+  boost::asio::post(schedule_strand_, [this]() { allocate(); });
+}
+
+void Session::allocate() {
+  std::vector<std::shared_ptr<TorrentClient>> torrents = this->torrents();
+  std::vector<SwarmState> states;
+  states.reserve(torrents.size());
+  for (const auto &torrent : torrents) {
+    states.push_back({torrent->swarm(), torrent->complete()});
+  }
+
+  SwarmScheduler scheduler(download_limiter_->rate(), upload_limiter_->rate(),
+                           max_connections_);
+  std::vector<SwarmShare> shares = scheduler.allocate(states);
+  for (size_t i = 0; i < torrents.size(); ++i) {
+    // Setting a rate refills the bucket, so only changes are applied
+    BandwidthLimiter &download = *torrents[i]->download_limiter();
+    if (download.rate() != shares[i].download_rate) {
+      download.set_rate(shares[i].download_rate);
+    }
+    BandwidthLimiter &upload = *torrents[i]->upload_limiter();
+    if (upload.rate() != shares[i].upload_rate) {
+      upload.set_rate(shares[i].upload_rate);
+    }
+    torrents[i]->set_max_connections(shares[i].max_connections);
+  }
+}
+
+void Session::schedule() {
+  {
+    std::lock_guard<std::mutex> lock(torrents_mutex_);
+    if (stopped_) {
+      return;
+    }
+  }
+
+  auto now = std::chrono::steady_clock::now();
+  if (now >= next_scrape_ && torrent_count() > 0) {
+    next_scrape_ = now + SCRAPE_INTERVAL;
+    scrape();
+  }
+  allocate();
+
+  schedule_timer_.expires_after(SCHEDULE_INTERVAL);
+  schedule_timer_.async_wait([this](const boost::system::error_code &error) {
+    if (!error) {
+      schedule();
+    }
+  });
+}
+
+size_t Session::torrent_count() const {
+  std::lock_guard<std::mutex> lock(torrents_mutex_);
+  return torrents_.size();
+}
+
+void Session::stop() {
+  std::vector<std::shared_ptr<TorrentClient>> torrents;
+  std::vector<std::future<void>> closing;
+  {
+    std::lock_guard<std::mutex> lock(torrents_mutex_);
+    if (stopped_) {
+      return;
+    }
+    stopped_ = true;
+    for (auto &entry : torrents_) {
+      torrents.push_back(std::move(entry.second));
+    }
+    torrents_.clear();
+    closing.swap(closing_);
+  }
+
+  boost::asio::post(acceptor_.get_executor(), [this]() {
+    boost::system::error_code error;
+    acceptor_.close(error);
+  });
+  boost::asio::post(schedule_strand_, [this]() { schedule_timer_.cancel(); });
+
+  // Torrents still launching must finish before they can be closed
+  disk_pool_.join();
+  for (const auto &torrent : torrents) {
+    closing.push_back(torrent->close());
+  }
+  for (auto &future : closing) {
+    future.wait();
+  }
+
+  // Announces still in flight are abandoned
+  http_client_->close();
+  udp_client_->close();
+  work_guard_.reset();
+  io_context_.stop();
+  for (auto &thread : threads_) {
+    thread.join();
+  }
+}
+
+void Session::start_accepting(uint16_t port) {
+  try {
+    tcp::endpoint endpoint(tcp::v4(), port);
+    acceptor_.open(endpoint.protocol());
+    acceptor_.set_option(tcp::acceptor::reuse_address(true));
+    acceptor_.bind(endpoint);
+    acceptor_.listen();
+    listen_port_ = acceptor_.local_endpoint().port();
+  } catch (const boost::system::system_error &e) {
+    Logger::instance()->log("Not accepting incoming peers: " +
+                                std::string(e.what()),
+                            Logger::WARNING);
+    return;
+  }
+  accept_connection();
+}
+
+void Session::accept_connection() {
+  // Each peer gets its own strand until it is handed to its torrent
+  acceptor_.async_accept(
+      boost::asio::make_strand(io_context_),
+      [this](const boost::system::error_code &error, tcp::socket socket) {
+        handle_accept(error, std::move(socket));
+      });
+}
+
+void Session::handle_accept(const boost::system::error_code &error,
+                            tcp::socket socket) {
+  if (error == boost::asio::error::operation_aborted) {
+    return;
+  }
+
+  if (!error) {
+    auto peer = std::make_shared<tcp::socket>(std::move(socket));
+    auto handshake = std::make_shared<std::vector<std::byte>>(HANDSHAKE_SIZE);
+    auto timer = std::make_shared<boost::asio::steady_timer>(
+        peer->get_executor(), HANDSHAKE_TIMEOUT);
+
+    timer->async_wait([peer](const boost::system::error_code &error) {
+      if (!error) {
+        boost::system::error_code ignored;
+        peer->close(ignored);
+      }
+    });
+    boost::asio::async_read(
+        *peer, boost::asio::buffer(*handshake),
+        [this, peer, handshake, timer](const boost::system::error_code &error,
+                                       std::size_t) {
+          timer->cancel();
+          if (!error) {
+            route_connection(std::move(*peer), std::move(*handshake));
+          }
+        });
+  }
+  accept_connection();
+}
+
+void Session::route_connection(tcp::socket socket,
+                               std::vector<std::byte> handshake) {
+  // pstrlen, pstr and the reserved bytes come before the info hash
+  const char *protocol_string = "BitTorrent protocol";
+  if (handshake[0] != std::byte{19} ||
+      std::memcmp(handshake.data() + 1, protocol_string, 19) != 0) {
+    return;
+  }
+  InfoHash info_hash;
+  std::copy(handshake.begin() + 28, handshake.begin() + 48,
+            info_hash.begin());
+
+  // Peers for unknown torrents are dropped when the socket goes out of scope
+  std::shared_ptr<TorrentClient> torrent = find_torrent(info_hash);
+  if (torrent != nullptr) {
+    torrent->adopt_connection(std::move(socket), std::move(handshake));
+  }
+}
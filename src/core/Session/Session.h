@@ -0,0 +1,264 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "BandwidthLimiter/BandwidthLimiter.h"
+#include "HttpClient/HttpClient.h"
+#include "MemoryBudget/MemoryBudget.h"
+#include "Scraper/Scraper.h"
+#include "SwarmScheduler/SwarmScheduler.h"
+#include "UdpTrackerClient/UdpTrackerClient.h"
+#include "TorrentClient/TorrentClient.h"
+#include <atomic>
+#include <boost/asio.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/// Threads that check existing data and contact trackers for new torrents,
+/// and read data for TorrentClient::read().
+const unsigned SESSION_DISK_THREADS = 2;
+
+/// How long an incoming peer has to send its handshake.
+const std::chrono::seconds HANDSHAKE_TIMEOUT(10);
+
+/// Open peer connections allowed across all torrents by default.
+const size_t SESSION_MAX_CONNECTIONS = 500;
+
+/// How often bandwidth and connection slots are divided up again.
+const std::chrono::seconds SCHEDULE_INTERVAL(30);
+
+/// How often the trackers are asked for the size of each swarm.
+const std::chrono::seconds SCRAPE_INTERVAL(15 * 60);
+
+/**
+ * @brief Runs many torrents on shared resources.
+ *
+ * One IO context served by a pool of threads carries the traffic of every
+ * torrent, each torrent on its own strand. A single listen socket accepts
+ * all incoming peers and routes them to their torrent by the info hash in
+ * their handshake. New torrents are checked on a small pool of disk threads
+ * so adding many at once does not stall the network, and reads of their
+ * data run there too. All trackers are contacted through one HTTP client
+ * and one UDP socket on the IO context.
+ * Download and upload limits and the connection limit apply to all
+ * torrents together. Every SCHEDULE_INTERVAL they are divided between the
+ * torrents by a SwarmScheduler, according to swarm sizes the trackers
+ * report in announces and in scrapes, which batch every torrent sharing a
+ * tracker into as few requests as possible.
+ */
+class Session {
+public:
+  /**
+   * @brief Starts the network threads and the listen socket.
+   *
+   * @param threads Number of network threads, 0 for one per core.
+   * @param port Port to accept peers on, 0 for any free port.
+   */
+  explicit Session(unsigned threads = 0, uint16_t port = LISTEN_PORT);
+
+  /**
+   * @brief Stops the session, see stop().
+   */
+  ~Session();
+
+  /// @brief Sessions own threads and sockets and cannot be copied.
+  Session(const Session &) = delete;
+
+  /// @brief Sessions own threads and sockets and cannot be copied.
+  Session &operator=(const Session &) = delete;
+
+  /**
+   * @brief Loads a torrent and starts it in the background.
+   *
+   * @param torrent_file The path to the .torrent file.
+   * @param seed_path Directory or file holding existing data to seed, empty
+   * to download to the working directory.
+   * @return The torrent's client.
+   * @throws std::runtime_error if the torrent cannot be loaded or is already
+   * in the session.
+   */
+  std::shared_ptr<TorrentClient>
+  add_torrent(const std::string &torrent_file,
+              const std::string &seed_path = "");
+
+  /**
+   * @brief Closes a torrent and removes it from the session.
+   *
+   * The torrent writes its resume data and closes its connections in the
+   * background.
+   *
+   * @param info_hash The info hash of the torrent.
+   * @return false if no such torrent is in the session.
+   */
+  bool remove_torrent(const InfoHash &info_hash);
+
+  /**
+   * @brief Looks up a torrent by info hash.
+   *
+   * @param info_hash The info hash of the torrent.
+   * @return The torrent's client, or null if it is not in the session.
+   */
+  std::shared_ptr<TorrentClient> find_torrent(const InfoHash &info_hash) const;
+
+  /**
+   * @brief Gets the number of torrents in the session.
+   *
+   * @return The number of torrents.
+   */
+  size_t torrent_count() const;
+
+  /**
+   * @brief Limits the combined download rate of all torrents.
+   *
+   * @param rate The limit in bytes per second, 0 for unlimited.
+   */
+  void set_download_rate_limit(uint64_t rate) {
+    download_limiter_->set_rate(rate);
+    reschedule();
+  }
+
+  /**
+   * @brief Limits the combined upload rate of all torrents.
+   *
+   * @param rate The limit in bytes per second, 0 for unlimited.
+   */
+  void set_upload_rate_limit(uint64_t rate) {
+    upload_limiter_->set_rate(rate);
+    reschedule();
+  }
+
+  /**
+   * @brief Limits the number of open peer connections of all torrents.
+   *
+   * @param max_connections The limit.
+   */
+  void set_max_connections(size_t max_connections) {
+    max_connections_ = max_connections;
+    reschedule();
+  }
+
+  /**
+   * @brief Limits the memory of all torrents' pieces being assembled; the
+   * blocks of pieces beyond it are written to disk as they arrive.
+   *
+   * @param bytes The limit in bytes.
+   */
+  void set_memory_budget(uint64_t bytes) {
+    MemoryBudget::global()->set_limit(bytes);
+  }
+
+  /**
+   * @brief Scrapes the trackers of every torrent now and divides the
+   * session's limits between the torrents once the answers arrive.
+   */
+  void scrape();
+
+  /**
+   * @brief Gets the port incoming peers connect to.
+   *
+   * @return The port, or 0 if the session is not listening.
+   */
+  uint16_t listen_port() const { return listen_port_; }
+
+  /**
+   * @brief Closes every torrent and stops all threads.
+   *
+   * Waits for torrents still being added and for every torrent to write its
+   * resume data. Must not be called from a network thread.
+   */
+  void stop();
+
+private:
+  /**
+   * @brief Opens the listen socket.
+   *
+   * @param port The port to listen on, 0 for any free port.
+   */
+  void start_accepting(uint16_t port);
+
+  /**
+   * @brief Waits for the next incoming peer connection.
+   */
+  void accept_connection();
+
+  /**
+   * @brief Handles the result of accepting a peer connection.
+   *
+   * @param error The error code resulting from the accept.
+   * @param socket The accepted socket.
+   */
+  void handle_accept(const boost::system::error_code &error,
+                     tcp::socket socket);
+
+  /**
+   * @brief Hands a peer to the torrent named in its handshake.
+   *
+   * @param socket The peer's socket.
+   * @param handshake The handshake message the peer sent.
+   */
+  void route_connection(tcp::socket socket, std::vector<std::byte> handshake);
+
+  /**
+   * @brief Gets the torrents of the session.
+   *
+   * @return The torrents, in no particular order.
+   */
+  std::vector<std::shared_ptr<TorrentClient>> torrents() const;
+
+  /**
+   * @brief Divides the session's limits between the torrents soon, on the
+   * scheduling strand.
+   */
+  void reschedule();
+
+  /**
+   * @brief Divides the session's limits between the torrents according to
+   * their swarms. Runs on the scheduling strand.
+   */
+  void allocate();
+
+  /**
+   * @brief Scrapes if due, allocates and arms the timer for the next round.
+   * Runs on the scheduling strand.
+   */
+  void schedule();
+
+  boost::asio::io_context io_context_; ///< Shared by every torrent.
+  boost::asio::executor_work_guard<boost::asio::io_context::executor_type>
+      work_guard_;           ///< Keeps the network threads running.
+  tcp::acceptor acceptor_;   ///< Accepts peers for every torrent.
+  uint16_t listen_port_ = 0; ///< Port the acceptor is bound to.
+  std::vector<std::thread> threads_; ///< Run io_context_.
+  std::shared_ptr<HttpClient>
+      http_client_; ///< Announces every torrent, sharing connections.
+  std::shared_ptr<UdpTrackerClient>
+      udp_client_; ///< Announces every torrent to UDP trackers.
+  boost::asio::thread_pool disk_pool_; ///< Checks existing data and reads.
+  std::shared_ptr<BandwidthLimiter>
+      download_limiter_; ///< Shared by all downloads.
+  std::shared_ptr<BandwidthLimiter>
+      upload_limiter_; ///< Shared by all uploads.
+  Scraper scraper_;    ///< Asks trackers for the size of each swarm.
+  std::atomic<size_t> max_connections_{
+      SESSION_MAX_CONNECTIONS}; ///< Open connections of all torrents.
+  boost::asio::strand<boost::asio::io_context::executor_type>
+      schedule_strand_; ///< Serializes scheduling.
+  boost::asio::steady_timer schedule_timer_; ///< Fires the next round.
+  std::chrono::steady_clock::time_point
+      next_scrape_; ///< When the trackers are scraped again.
+
+  mutable std::mutex torrents_mutex_; ///< Guards torrents_ and stopped_.
+  std::unordered_map<InfoHash, std::shared_ptr<TorrentClient>, InfoHashHasher>
+      torrents_; ///< Torrents by info hash.
+  std::vector<std::future<void>>
+      closing_;          ///< Removed torrents that may still be closing.
+  bool stopped_ = false; ///< Set once stop() has begun.
+};
+
+#endif // SESSION_H
@@ -0,0 +1,117 @@
+#include "SwarmScheduler.h"
+#include <algorithm>
+#include <numeric>
+
+SwarmScheduler::SwarmScheduler(uint64_t download_rate, uint64_t upload_rate,
+                               size_t max_connections)
+    : download_rate_(download_rate), upload_rate_(upload_rate),
+      max_connections_(max_connections) {}
+
+std::vector<uint64_t>
+SwarmScheduler::split(uint64_t rate, const std::vector<double> &weights) {
+  std::vector<uint64_t> rates(weights.size(), 0);
+  double total = std::accumulate(weights.begin(), weights.end(), 0.0);
+  if (rate == 0 || total == 0) {
+    return rates;
+  }
+  for (size_t i = 0; i < weights.size(); ++i) {
+    if (weights[i] > 0) {
+      // Never 0, which would mean unlimited
+      rates[i] = std::max<uint64_t>(
+          1, static_cast<uint64_t>(static_cast<double>(rate) * weights[i] /
+                                   total));
+    }
+  }
+  return rates;
+}
+
+std::vector<SwarmShare>
+SwarmScheduler::allocate(const std::vector<SwarmState> &torrents) const {
+  std::vector<double> download_weights;
+  std::vector<double> upload_weights;
+  std::vector<size_t> peers; // Peers worth connecting to, 0 if unknown
+  for (const SwarmState &torrent : torrents) {
+    double seeders = torrent.swarm.seeders;
+    double leechers = torrent.swarm.leechers;
+    // Leechers only serve the pieces they have
+    download_weights.push_back(torrent.seeding ? 0
+                                               : 1 + seeders + leechers / 4);
+    upload_weights.push_back((leechers + 1) / (seeders + 1));
+    peers.push_back(torrent.seeding ? torrent.swarm.leechers
+                                    : torrent.swarm.seeders +
+                                          torrent.swarm.leechers);
+  }
+
+  std::vector<SwarmShare> shares(torrents.size());
+  std::vector<uint64_t> download = split(download_rate_, download_weights);
+  std::vector<uint64_t> upload = split(upload_rate_, upload_weights);
+  for (size_t i = 0; i < torrents.size(); ++i) {
+    shares[i].download_rate = download[i];
+    shares[i].upload_rate = upload[i];
+  }
+
+  // Torrents whose swarm is smaller than their proportional share get all
+  // of its peers; the rest is shared out again among the others
+  std::vector<bool> capped(torrents.size(), false);
+  auto uncapped_weight = [&]() {
+    double total = 0;
+    for (size_t i = 0; i < torrents.size(); ++i) {
+      if (!capped[i]) {
+        total += 1 + static_cast<double>(peers[i]);
+      }
+    }
+    return total;
+  };
+  size_t remaining = max_connections_;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    double total = uncapped_weight();
+    for (size_t i = 0; i < torrents.size(); ++i) {
+      if (capped[i] || peers[i] == 0) {
+        continue;
+      }
+      double share = static_cast<double>(remaining) *
+                     (1 + static_cast<double>(peers[i])) / total;
+      if (static_cast<double>(peers[i]) <= share) {
+        shares[i].max_connections = peers[i];
+        remaining -= std::min(remaining, peers[i]);
+        capped[i] = true;
+        changed = true;
+      }
+    }
+  }
+
+  // Fewer slots each when there are not enough to go round, but never 0,
+  // which would mean unlimited
+  size_t floor = torrents.empty() ? 0
+                                  : std::max<size_t>(
+                                        1, std::min(MIN_TORRENT_CONNECTIONS,
+                                                    max_connections_ /
+                                                        torrents.size()));
+  double total = uncapped_weight();
+  size_t assigned = 0;
+  for (size_t i = 0; i < torrents.size(); ++i) {
+    if (!capped[i]) {
+      shares[i].max_connections = static_cast<size_t>(
+          static_cast<double>(remaining) *
+          (1 + static_cast<double>(peers[i])) / total);
+    }
+    shares[i].max_connections = std::max(shares[i].max_connections, floor);
+    assigned += shares[i].max_connections;
+  }
+
+  // Raising small shares to the floor is paid for by the largest ones
+  while (assigned > max_connections_) {
+    auto largest = std::max_element(
+        shares.begin(), shares.end(), [](const auto &a, const auto &b) {
+          return a.max_connections < b.max_connections;
+        });
+    if (largest->max_connections <= floor) {
+      break; // More torrents than slots
+    }
+    --largest->max_connections;
+    --assigned;
+  }
+  return shares;
+}
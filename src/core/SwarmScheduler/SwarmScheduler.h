@@ -0,0 +1,82 @@
+#ifndef SWARMSCHEDULER_H
+#define SWARMSCHEDULER_H
+
+#include "TrackerClient/TrackerClient.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// Connection slots every torrent keeps, however small its share.
+const size_t MIN_TORRENT_CONNECTIONS = 2;
+
+/**
+ * @brief What the scheduler knows about one torrent.
+ */
+struct SwarmState {
+  ScrapeStats swarm;    ///< Swarm size last reported by a tracker.
+  bool seeding = false; ///< Whether the torrent is complete.
+};
+
+/**
+ * @brief Limits assigned to one torrent.
+ */
+struct SwarmShare {
+  uint64_t download_rate = 0; ///< Bytes per second, 0 for unlimited.
+  uint64_t upload_rate = 0;   ///< Bytes per second, 0 for unlimited.
+  size_t max_connections = 0; ///< Open connections allowed.
+};
+
+/**
+ * @brief Divides session-wide bandwidth and connection slots between
+ * torrents according to the swarm each one is in.
+ *
+ * Download bandwidth goes to unfinished torrents in proportion to how many
+ * peers can serve them, since a torrent with few sources cannot use much.
+ * Upload bandwidth favours swarms short of seeders, where each uploaded
+ * byte helps most. Connection slots follow the number of peers there are to
+ * connect to, and what a small swarm cannot use goes to the others.
+ */
+class SwarmScheduler {
+public:
+  /**
+   * @brief Constructs a scheduler for the given session limits.
+   *
+   * @param download_rate Session download limit, 0 for unlimited.
+   * @param upload_rate Session upload limit, 0 for unlimited.
+   * @param max_connections Session connection limit.
+   */
+  SwarmScheduler(uint64_t download_rate, uint64_t upload_rate,
+                 size_t max_connections);
+
+  /**
+   * @brief Computes the share of each torrent.
+   *
+   * Rates are 0 when the session limit is, or when the torrent has no use
+   * for that direction; the session limit still applies to it then. Every
+   * torrent gets at least MIN_TORRENT_CONNECTIONS slots, or fewer when there
+   * are not enough to go round. The total stays within the session limit
+   * unless there are more torrents than slots, which still get one each.
+   *
+   * @param torrents The torrents of the session.
+   * @return One share per torrent, in the same order.
+   */
+  std::vector<SwarmShare>
+  allocate(const std::vector<SwarmState> &torrents) const;
+
+private:
+  uint64_t download_rate_; ///< Session download limit, 0 for unlimited.
+  uint64_t upload_rate_;   ///< Session upload limit, 0 for unlimited.
+  size_t max_connections_; ///< Session connection limit.
+
+  /**
+   * @brief Splits a rate in proportion to weights.
+   *
+   * @param rate The rate to split, 0 for unlimited.
+   * @param weights One weight per torrent.
+   * @return One rate per torrent; 0 for torrents of weight 0.
+   */
+  static std::vector<uint64_t> split(uint64_t rate,
+                                     const std::vector<double> &weights);
+};
+
+#endif // SWARMSCHEDULER_H
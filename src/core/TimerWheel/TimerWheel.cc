@@ -0,0 +1,197 @@
+#include "TimerWheel.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+TimerWheel::TimerWheel(boost::asio::any_io_executor executor,
+                       Clock::duration tick, size_t slots, size_t levels)
+    : ticker_(std::move(executor)), tick_(tick), origin_(Clock::now()),
+      slot_bits_(__builtin_ctzll(slots)), levels_(levels),
+      slots_(slots * levels), level_size_(levels) {
+  if (slots < 2 || (slots & (slots - 1)) != 0 || levels == 0 ||
+      slot_bits_ * levels >= 64) {
+    throw std::runtime_error("Invalid timer wheel geometry");
+  }
+}
+
+uint64_t TimerWheel::tick_at(Clock::time_point time) const {
+  return (time - origin_) / tick_;
+}
+
+TimerWheel::TimerId TimerWheel::arm(Clock::duration delay,
+                                    Callback callback) {
+  if (stopped_) {
+    return 0;
+  }
+  Clock::time_point now = Clock::now();
+  if (!ticking_) {
+    current_tick_ = tick_at(now); // Nothing was armed, no tick was missed
+  }
+
+  // Rounded up, a timer never fires early
+  auto elapsed = now + std::max(delay, Clock::duration::zero()) - origin_;
+  uint64_t due_tick = (elapsed + tick_ - Clock::duration(1)) / tick_;
+  TimerId id = next_id_++;
+  Timer &timer = timers_[id];
+  timer.due_tick = std::max(due_tick, current_tick_ + 1);
+  timer.callback = std::move(callback);
+  insert(id, timer);
+
+  if (!ticking_ || timer.due_tick < wake_tick_) {
+    schedule_tick();
+  }
+  return id;
+}
+
+void TimerWheel::insert(TimerId id, Timer &timer) {
+  // The highest digit, in base slots, where the due tick differs from the
+  // current one picks the level
+  size_t level = 0;
+  uint64_t differ = timer.due_tick ^ current_tick_;
+  if (timer.due_tick > current_tick_ && differ != 0) {
+    level = std::min<size_t>((63 - __builtin_clzll(differ)) / slot_bits_,
+                             levels_ - 1);
+  }
+  uint64_t mask = (uint64_t{1} << slot_bits_) - 1;
+  timer.slot = (level << slot_bits_) +
+               ((timer.due_tick >> (level * slot_bits_)) & mask);
+
+  std::vector<TimerId> &slot = slots_[timer.slot];
+  timer.position = slot.size();
+  slot.push_back(id);
+  ++level_size_[level];
+}
+
+void TimerWheel::take(size_t slot, std::vector<TimerId> &ids) {
+  ids.clear();
+  ids.swap(slots_[slot]);
+  level_size_[slot >> slot_bits_] -= ids.size();
+}
+
+bool TimerWheel::cancel(TimerId id) {
+  auto it = timers_.find(id);
+  if (it == timers_.end()) {
+    return false;
+  }
+
+  // The last timer of the slot takes the cancelled one's place, unless the
+  // timer is due and already out of its slot
+  size_t position = it->second.position;
+  if (position != FIRING) {
+    std::vector<TimerId> &slot = slots_[it->second.slot];
+    slot[position] = slot.back();
+    timers_[slot[position]].position = position;
+    slot.pop_back();
+    --level_size_[it->second.slot >> slot_bits_];
+  }
+  timers_.erase(it);
+  return true;
+}
+
+void TimerWheel::stop() {
+  stopped_ = true;
+  ticker_.cancel();
+  timers_.clear();
+  for (auto &slot : slots_) {
+    slot.clear();
+  }
+  std::fill(level_size_.begin(), level_size_.end(), 0);
+}
+
+uint64_t TimerWheel::next_event() const {
+  size_t level = 0;
+  while (level < levels_ && level_size_[level] == 0) {
+    ++level;
+  }
+  if (level == levels_) {
+    return std::numeric_limits<uint64_t>::max();
+  }
+
+  // Nothing happens before the lowest level in use cascades, except for the
+  // timers of level 0, which are all due within its revolution
+  unsigned shift = std::max<size_t>(level, 1) * slot_bits_;
+  uint64_t boundary = ((current_tick_ >> shift) + 1) << shift;
+  if (level == 0) {
+    uint64_t mask = (uint64_t{1} << slot_bits_) - 1;
+    for (uint64_t tick = current_tick_ + 1; tick < boundary; ++tick) {
+      if (!slots_[tick & mask].empty()) {
+        return tick;
+      }
+    }
+  }
+  return boundary;
+}
+
+void TimerWheel::schedule_tick() {
+  if (stopped_ || timers_.empty()) {
+    ticking_ = false;
+    return;
+  }
+  ticking_ = true;
+  wake_tick_ = next_event();
+  ticker_.expires_at(origin_ + tick_ * wake_tick_);
+  ticker_.async_wait(
+      [self = shared_from_this()](const boost::system::error_code &error) {
+        if (error || self->stopped_) {
+          return; // Stopped, or rescheduled for an earlier tick
+        }
+        self->advance();
+        self->schedule_tick();
+      });
+}
+
+void TimerWheel::advance() {
+  uint64_t target = tick_at(Clock::now());
+  uint64_t mask = (uint64_t{1} << slot_bits_) - 1;
+  std::vector<TimerId> ids;
+  std::vector<TimerId> due;
+  while (current_tick_ < target) {
+    uint64_t next = next_event();
+    if (next > target) {
+      current_tick_ = target;
+      break;
+    }
+    current_tick_ = next;
+
+    // Spread the slots of levels whose lower levels all came full circle
+    // over the levels below, highest first
+    size_t top = 0;
+    while (top + 1 < levels_ &&
+           (current_tick_ &
+            ((uint64_t{1} << ((top + 1) * slot_bits_)) - 1)) == 0) {
+      ++top;
+    }
+    for (size_t level = top; level > 0; --level) {
+      take((level << slot_bits_) +
+               ((current_tick_ >> (level * slot_bits_)) & mask),
+           ids);
+      for (TimerId id : ids) {
+        insert(id, timers_.at(id));
+      }
+    }
+
+    take(current_tick_ & mask, ids);
+    due.clear();
+    for (TimerId id : ids) {
+      Timer &timer = timers_.at(id);
+      if (timer.due_tick > current_tick_) {
+        insert(id, timer);
+      } else {
+        timer.position = FIRING;
+        due.push_back(id);
+      }
+    }
+
+    // A callback may cancel timers that are due on the same tick
+    for (TimerId id : due) {
+      auto it = timers_.find(id);
+      if (it == timers_.end()) {
+        continue;
+      }
+      Callback callback = std::move(it->second.callback);
+      timers_.erase(it);
+      callback();
+    }
+  }
+}
@@ -0,0 +1,167 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+/// Resolution of a timer wheel; timers fire up to one tick late.
+const std::chrono::milliseconds TIMER_WHEEL_TICK(100);
+
+/// Slots in each level of a timer wheel, a power of two.
+const size_t TIMER_WHEEL_SLOTS = 256;
+
+/// Levels of a timer wheel; with the defaults they span 13 years.
+const size_t TIMER_WHEEL_LEVELS = 4;
+
+/**
+ * @brief Runs many coarse timeouts off a single steady_timer.
+ *
+ * A hierarchical hashed timer wheel. Level 0 has a slot per tick, and each
+ * slot of a higher level spans a whole revolution of the level below. A
+ * timer goes into the lowest level whose revolution still reaches its due
+ * tick, so arming and cancelling one take constant time. Whenever a level
+ * completes a revolution, the next slot of the level above is spread over
+ * it. The IO context only ever waits for the next tick that has something
+ * to do, instead of keeping one timer per timeout in its heap, and the
+ * wheel sleeps while no timer is armed.
+ *
+ * Callbacks run on the wheel's executor. Not thread-safe; arm() and cancel()
+ * must be called from that executor, usually a torrent's strand. Must be
+ * owned by a std::shared_ptr.
+ */
+class TimerWheel : public std::enable_shared_from_this<TimerWheel> {
+public:
+  using Clock = std::chrono::steady_clock;
+  using Callback = std::function<void()>;
+
+  /**
+   * @brief Identifies an armed timer, never 0.
+   */
+  using TimerId = uint64_t;
+
+  /**
+   * @brief Constructs an empty wheel.
+   *
+   * @param executor Executor the tick and the callbacks run on.
+   * @param tick Resolution of the wheel.
+   * @param slots Number of slots per level, a power of two.
+   * @param levels Number of levels.
+   */
+  explicit TimerWheel(boost::asio::any_io_executor executor,
+                      Clock::duration tick = TIMER_WHEEL_TICK,
+                      size_t slots = TIMER_WHEEL_SLOTS,
+                      size_t levels = TIMER_WHEEL_LEVELS);
+
+  /**
+   * @brief Arms a timer.
+   *
+   * @param delay Time until the callback runs, rounded up to whole ticks.
+   * @param callback The callback.
+   * @return The timer, to pass to cancel(), or 0 if the wheel was stopped.
+   */
+  TimerId arm(Clock::duration delay, Callback callback);
+
+  /**
+   * @brief Cancels a timer.
+   *
+   * @param id The timer, or 0.
+   * @return true if the timer was armed and will now not fire.
+   */
+  bool cancel(TimerId id);
+
+  /**
+   * @brief Cancels every timer and stops ticking for good.
+   *
+   * Releases the callbacks, and with them whatever they kept alive.
+   */
+  void stop();
+
+  /**
+   * @brief Gets the number of armed timers.
+   *
+   * @return The number of timers.
+   */
+  size_t size() const { return timers_.size(); }
+
+private:
+  /**
+   * @brief Position of a due timer that was taken out of its slot.
+   */
+  static constexpr size_t FIRING = static_cast<size_t>(-1);
+
+  /**
+   * @brief An armed timer.
+   */
+  struct Timer {
+    uint64_t due_tick; ///< Tick on which the timer fires.
+    size_t slot;       ///< Index of its slot in slots_.
+    size_t position;   ///< Index in its slot, or FIRING.
+    Callback callback; ///< Runs when the timer fires.
+  };
+
+  /**
+   * @brief Gets the tick a point in time falls in.
+   *
+   * @param time The point in time.
+   * @return The number of whole ticks since origin_.
+   */
+  uint64_t tick_at(Clock::time_point time) const;
+
+  /**
+   * @brief Adds a timer to the slot of its due tick, in the lowest level
+   * that reaches it from the current tick.
+   *
+   * @param id The timer.
+   * @param timer Its entry in timers_.
+   */
+  void insert(TimerId id, Timer &timer);
+
+  /**
+   * @brief Takes all timers out of a slot.
+   *
+   * @param slot Index of the slot in slots_.
+   * @param ids Receives the timers.
+   */
+  void take(size_t slot, std::vector<TimerId> &ids);
+
+  /**
+   * @brief Finds the next tick that fires timers or cascades a level.
+   *
+   * @return The tick.
+   */
+  uint64_t next_event() const;
+
+  /**
+   * @brief Waits for the next tick with something to do, unless no timer
+   * is armed.
+   */
+  void schedule_tick();
+
+  /**
+   * @brief Fires the timers of every tick that has passed.
+   */
+  void advance();
+
+  boost::asio::steady_timer ticker_; ///< Wakes the wheel.
+  Clock::duration tick_;             ///< Resolution of the wheel.
+  Clock::time_point origin_;         ///< Start of tick 0.
+  uint64_t current_tick_ = 0;        ///< Last tick processed.
+  uint64_t wake_tick_ = 0;           ///< Tick ticker_ waits for.
+  unsigned slot_bits_;               ///< log2 of the slots per level.
+  size_t levels_;                    ///< Number of levels.
+  std::vector<std::vector<TimerId>>
+      slots_;                      ///< Armed timers, level after level.
+  std::vector<size_t> level_size_; ///< Armed timers in each level.
+  std::unordered_map<TimerId, Timer> timers_; ///< Armed timers by id.
+  TimerId next_id_ = 1;                       ///< Id of the next timer.
+  bool ticking_ = false;                      ///< ticker_ is waiting.
+  bool stopped_ = false;                      ///< Set by stop().
+};
+
+#endif // TIMERWHEEL_H
@@ -1,12 +1,52 @@
 #include "Torrent.h"
 #include <cstdint>
+#include <cstring>
 #include <iomanip>
 #include <sstream>
+#include <stdexcept>
+
+namespace {
+
+const std::vector<InfoHash> NO_HASHES;
+
+} // namespace
+
+PieceHashes::PieceHashes(std::vector<InfoHash> hashes)
+    : hashes_(
+          std::make_shared<const std::vector<InfoHash>>(std::move(hashes))) {}
+
+PieceHashes::PieceHashes(std::string_view raw) {
+  if (raw.size() % sizeof(InfoHash) != 0) {
+    throw std::runtime_error("Torrent file has a truncated piece hash.");
+  }
+  // std::array has no padding, so the hashes can be copied in one go
+  static_assert(sizeof(InfoHash) == 20, "InfoHash must be 20 packed bytes");
+  std::vector<InfoHash> hashes(raw.size() / sizeof(InfoHash));
+  std::memcpy(hashes.data(), raw.data(), raw.size());
+  hashes_ = std::make_shared<const std::vector<InfoHash>>(std::move(hashes));
+}
+
+std::vector<InfoHash>::const_iterator PieceHashes::begin() const {
+  return hashes_ ? hashes_->begin() : NO_HASHES.begin();
+}
+
+std::vector<InfoHash>::const_iterator PieceHashes::end() const {
+  return hashes_ ? hashes_->end() : NO_HASHES.end();
+}
+
+void assign_file_offsets(std::vector<FileInfo> &files) {
+  uint64_t offset = 0;
+  for (auto &file : files) {
+    file.start_offset = offset;
+    offset += file.length;
+    file.end_offset = offset;
+  }
+}
 
 bool Torrent::is_single_file() const { return files.size() == 1; }
 
 uint32_t Torrent::total_pieces() const {
-  return static_cast<uint32_t>(pieces.size());
+  return pieces.size();
 }
 
 uint64_t Torrent::size() const {
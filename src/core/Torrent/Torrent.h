@@ -2,10 +2,13 @@
 #define TORRENT_H
 
 #include <array>
-#include <bencode.hpp>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <memory>
 #include <stddef.h>
 #include <string>
+#include <string_view>
 #include <vector>
 
 /**
@@ -19,34 +22,135 @@ struct FileInfo {
   std::string path;      ///< Full path of the file.
   uint64_t length;       ///< Total length of the file in bytes.
   uint64_t start_offset; ///< Byte index where the file starts.
-  uint64_t end_offset;   ///< Byte index where the file ends.
+  uint64_t end_offset;   ///< Byte index one past the end of the file.
 };
 
+/**
+ * @brief How eagerly a file or piece is downloaded.
+ */
+enum class Priority : uint8_t {
+  Skip,   ///< Not downloaded at all.
+  Low,    ///< Downloaded after everything else.
+  Normal, ///< The default.
+  High,   ///< Downloaded before everything else.
+  Urgent  ///< Waited for, such as by a read of data not downloaded yet.
+};
+
+/**
+ * @brief Lays files out back to back, in order, as the torrent's pieces see
+ * them.
+ *
+ * Sets the start and end offset of every file from the file lengths.
+ *
+ * @param files The files of the torrent, in info dictionary order.
+ */
+void assign_file_offsets(std::vector<FileInfo> &files);
+
 /**
  * @typedef InfoHash
  * @brief Represents the SHA-1 hash used to identify the torrent.
  */
 using InfoHash = std::array<std::byte, 20>;
 
+/**
+ * @brief Hashes an info hash for unordered containers.
+ *
+ * Info hashes are SHA-1 digests, so their leading bytes are already evenly
+ * distributed and can be used as they are.
+ */
+struct InfoHashHasher {
+  size_t operator()(const InfoHash &info_hash) const noexcept {
+    size_t hash;
+    std::memcpy(&hash, info_hash.data(), sizeof(hash));
+    return hash;
+  }
+};
+
+/**
+ * @brief Immutable list of piece hashes, shared between subsystems.
+ *
+ * The hashes of a torrent are stored once in a contiguous buffer. Copies of
+ * a PieceHashes are handles to that same buffer, so passing one around costs
+ * a reference count update instead of a copy of every hash.
+ */
+class PieceHashes {
+public:
+  /**
+   * @brief Constructs an empty list.
+   */
+  PieceHashes() = default;
+
+  /**
+   * @brief Takes ownership of a list of hashes.
+   *
+   * @param hashes The hash of every piece, in order.
+   */
+  PieceHashes(std::vector<InfoHash> hashes);
+
+  /**
+   * @brief Copies hashes from the concatenated form used in .torrent files.
+   *
+   * @param raw 20 bytes per piece.
+   * @throws std::runtime_error if @p raw is not a whole number of hashes.
+   */
+  explicit PieceHashes(std::string_view raw);
+
+  /**
+   * @brief Gets the hash of a piece.
+   *
+   * @param piece_index The index of the piece; must be less than size().
+   * @return The expected SHA-1 hash of the piece.
+   */
+  const InfoHash &operator[](uint32_t piece_index) const {
+    return (*hashes_)[piece_index];
+  }
+
+  /**
+   * @brief Gets the number of pieces.
+   *
+   * @return The number of hashes.
+   */
+  uint32_t size() const {
+    return hashes_ ? static_cast<uint32_t>(hashes_->size()) : 0;
+  }
+
+  /**
+   * @brief Gets the hashes as one contiguous block of bytes.
+   *
+   * @return size() * 20 bytes, or nullptr if there are no hashes.
+   */
+  const std::byte *data() const {
+    return hashes_ && !hashes_->empty() ? hashes_->front().data() : nullptr;
+  }
+
+  std::vector<InfoHash>::const_iterator begin() const;
+  std::vector<InfoHash>::const_iterator end() const;
+
+private:
+  std::shared_ptr<const std::vector<InfoHash>> hashes_; ///< Shared storage.
+};
+
 /**
  * @struct Torrent
  * @brief Represents the essential information of a torrent.
  *
- * Includes the torrent's metadata such as the name, info dictionary from the
- * bencoded file, tracker URL, piece length, file information, and hashes for
- * each piece of the torrent.
+ * Includes the torrent's metadata such as the name, tracker URL, piece length,
+ * file information, and hashes for each piece of the torrent. The decoded
+ * info dictionary is not kept once these fields have been extracted.
+ *
+ * A loaded torrent is shared between subsystems as a
+ * std::shared_ptr<const Torrent> instead of being copied into each of them.
  */
 struct Torrent {
-  std::string name; ///< Name of the torrent.
-  bencode::dict
-      info; ///< Decoded bencode dictionary containing the torrent's metadata.
+  std::string name;        ///< Name of the torrent.
   std::string tracker_url; ///< URL of the tracker server for announcements.
+  std::vector<std::vector<std::string>>
+      tracker_tiers; ///< All trackers by tier (BEP 12), most preferred first.
   InfoHash info_hash =
       {}; ///< The 20-byte SHA-1 hash of the bencoded 'info' value.
   uint32_t piece_length;       ///< Number of bytes each piece contains.
   std::vector<FileInfo> files; ///< List of files included in the torrent.
-  std::vector<InfoHash>
-      pieces; ///< List of SHA-1 hashes for each piece of the torrent.
+  PieceHashes pieces;          ///< SHA-1 hash of each piece of the torrent.
 
   /**
    * @brief Checks if the torrent represents a single file.
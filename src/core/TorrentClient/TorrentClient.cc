@@ -1,18 +1,225 @@
 #include "TorrentClient.h"
+#include "Utils/utils.h"
+#include <algorithm>
+#include <filesystem>
 #include <iostream>
 #include <memory>
+#include <utility>
 
-TorrentClient::TorrentClient(const std::string &torrent_file) {
+TorrentClient::TorrentClient(const std::string &torrent_file)
+    : TorrentClient(torrent_file, std::string()) {}
+
+TorrentClient::TorrentClient(const std::string &torrent_file,
+                             const std::string &seed_path)
+    : own_io_context_(std::make_unique<boost::asio::io_context>()),
+      io_context_(*own_io_context_), strand_(io_context_.get_executor()),
+      listen_port_(LISTEN_PORT), disk_executor_(io_context_.get_executor()),
+      http_client_(std::make_shared<HttpClient>(io_context_)),
+      udp_client_(std::make_shared<UdpTrackerClient>(io_context_)),
+      acceptor_(strand_), seed_path_(seed_path), announce_timer_(strand_),
+      connect_timer_(strand_),
+      timer_wheel_(std::make_shared<TimerWheel>(strand_)),
+      resume_timer_(strand_) {
+  setup_torrent(torrent_file);
+}
+
+TorrentClient::TorrentClient(boost::asio::io_context &io_context,
+                             boost::asio::any_io_executor disk_executor,
+                             std::shared_ptr<HttpClient> http_client,
+                             std::shared_ptr<UdpTrackerClient> udp_client,
+                             uint16_t listen_port,
+                             const std::string &torrent_file,
+                             const std::string &seed_path)
+    : io_context_(io_context), strand_(io_context_.get_executor()),
+      listen_port_(listen_port), disk_executor_(std::move(disk_executor)), http_client_(std::move(http_client)),
+      udp_client_(std::move(udp_client)),
+      acceptor_(strand_), seed_path_(seed_path), announce_timer_(strand_),
+      connect_timer_(strand_),
+      timer_wheel_(std::make_shared<TimerWheel>(strand_)),
+      resume_timer_(strand_) {
   setup_torrent(torrent_file);
 }
 
 void TorrentClient::start() {
+  if (torrent_ == nullptr) {
+    Logger::instance()->log("No torrent to start.", Logger::ERROR);
+    return;
+  }
+
+  launch();
+  start_accepting();
+  io_context_.run();
+
+  // Shut down on this thread instead, which saves the resume data and
+  // stops the connections and timers, so nothing keeps the client alive
+  io_context_.restart();
+  std::future<void> closed = close();
+  while (closed.wait_for(std::chrono::seconds(0)) !=
+         std::future_status::ready) {
+    if (io_context_.run_one() == 0) {
+      break; // Stopped again
+    }
+  }
+  io_context_.poll(); // Releases the handlers of what close() cancelled
+}
+
+void TorrentClient::launch() {
+  if (torrent_ == nullptr) {
+    return;
+  }
+  // Set before completion can be announced, which reads them
+  pieces_missing_at_launch_ = piece_manager_->missing_count();
+  allocations_at_launch_ = BufferPool::instance().stats().allocations;
+  {
+    // close() drops the subscription, so it must not be added afterwards
+    std::lock_guard<std::mutex> lock(connections_mutex_);
+    if (closed_) {
+      return; // Removed before it got going
+    }
+    completion_subscription_ =
+        piece_manager_->subscribe([this](const PieceEvent &event) {
+          resume_dirty_ = true;
+          if (event.type == PieceEvent::Type::PieceCompleted) {
+            stream_piece_completed(event.piece_index);
+            serve_reads();
+          }
+          // Skipped files may keep the torrent from ever being complete
+          if (event.type == PieceEvent::Type::DownloadCompleted) {
+            boost::asio::post(strand_,
+                              boost::bind(&TorrentClient::announce_completed,
+                                          shared_from_this()));
+          }
+        });
+  }
+
+  if (recheck_needed_) {
+    recheck();
+    serve_reads(); // Checking completes pieces without events
+  }
+
+  if (!seed_path_.empty() && piece_manager_->missing_count() > 0) {
+    Logger::instance()->log(
+        std::to_string(piece_manager_->missing_count()) +
+            " pieces of the seeded data are missing or corrupt, downloading "
+            "them.",
+        Logger::WARNING);
+  }
+
+  boost::asio::post(strand_, boost::bind(&TorrentClient::schedule_resume_save,
+                                         shared_from_this()));
+
   Logger::instance()->log("Initiating tracker session...");
   initiate_tracker_session();
-  io_context_.run();
 }
 
-void TorrentClient::stop() { io_context_.stop(); }
+std::future<void> TorrentClient::close() {
+  PieceManager::SubscriptionId subscription;
+  {
+    std::lock_guard<std::mutex> lock(connections_mutex_);
+    closed_ = true;
+    subscription = std::exchange(completion_subscription_, 0);
+  }
+
+  auto closed = std::make_shared<std::promise<void>>();
+  std::future<void> future = closed->get_future();
+  boost::asio::post(strand_, [self = shared_from_this(), closed,
+                              subscription]() {
+    boost::system::error_code error;
+    self->announce_timer_.cancel();
+    self->connect_timer_.cancel();
+    self->resume_timer_.cancel();
+    self->acceptor_.close(error);
+    if (subscription != 0) {
+      self->piece_manager_->unsubscribe(subscription);
+    }
+
+    // Partial pieces are flushed before the connections go away
+    self->save_resume_data();
+    std::unordered_map<tcp::endpoint, std::shared_ptr<PeerConnection>,
+                       EndpointHasher>
+        connections;
+    {
+      std::lock_guard<std::mutex> lock(self->connections_mutex_);
+      connections.swap(self->peer_connections_);
+    }
+    for (const auto &entry : connections) {
+      entry.second->stop();
+    }
+    self->timer_wheel_->stop();
+    closed->set_value();
+  });
+
+  std::vector<PendingRead> reads;
+  {
+    std::lock_guard<std::mutex> lock(reads_mutex_);
+    reads_closed_ = true;
+    reads.swap(pending_reads_);
+  }
+  for (PendingRead &read : reads) {
+    read.promise.set_exception(std::make_exception_ptr(
+        std::runtime_error("Torrent closed before the data was downloaded")));
+  }
+  return future;
+}
+
+void TorrentClient::set_bandwidth_limiters(
+    std::shared_ptr<BandwidthLimiter> download,
+    std::shared_ptr<BandwidthLimiter> upload) {
+  download_limiter_ = std::move(download);
+  upload_limiter_ = std::move(upload);
+}
+
+void TorrentClient::set_max_connections(size_t max_connections) {
+  max_connections_ = max_connections;
+  // Also refills slots of connections that have closed since the last call
+  boost::asio::post(strand_, boost::bind(&TorrentClient::connect_peers,
+                                         shared_from_this()));
+}
+
+void TorrentClient::update_swarm(const ScrapeStats &swarm) {
+  std::lock_guard<std::mutex> lock(swarm_mutex_);
+  swarm_ = swarm;
+}
+
+ScrapeStats TorrentClient::swarm() const {
+  std::lock_guard<std::mutex> lock(swarm_mutex_);
+  return swarm_;
+}
+
+std::string TorrentClient::scrape_url() const {
+  return tracker_client_ ? tracker_client_->scrape_url() : "";
+}
+
+void TorrentClient::stop() {
+  if (own_io_context_ != nullptr) {
+    io_context_.stop();
+  } else {
+    close(); // The IO context is shared with other torrents
+  }
+}
+
+void TorrentClient::map_seed_path(Torrent &torrent) const {
+  namespace fs = std::filesystem;
+  // A single-file torrent may be given the file itself
+  bool path_is_file = fs::is_regular_file(seed_path_);
+
+  for (auto &file : torrent.files) {
+    std::string path =
+        path_is_file && torrent.files.size() == 1
+            ? seed_path_
+            : (fs::path(seed_path_) / file.path).string();
+
+    std::error_code error;
+    uint64_t size = fs::file_size(path, error);
+    if (error) {
+      throw std::runtime_error("Missing file to seed: " + path);
+    }
+    if (size != file.length) {
+      throw std::runtime_error("File to seed has the wrong size: " + path);
+    }
+    file.path = std::move(path);
+  }
+}
 
 void TorrentClient::setup_torrent(const std::string &torrent_file) {
   Logger *logger = Logger::instance();
@@ -26,104 +233,823 @@ void TorrentClient::setup_torrent(const std::string &torrent_file) {
     return;
   }
 
+  Torrent torrent;
   try {
-    torrent_ = torrent_parser_->parse_torrent_file(torrent_file);
+    torrent = torrent_parser_->parse_torrent_file(torrent_file);
     logger->log("Torrent file parsed: " + torrent_file);
   } catch (const std::exception &e) {
     logger->log("Error parsing torrent file: " + std::string(e.what()));
     return;
   }
 
+  if (!seed_path_.empty()) {
+    try {
+      map_seed_path(torrent);
+      logger->log("Seeding data from " + seed_path_);
+    } catch (const std::exception &e) {
+      logger->log("Error mapping data to seed: " + std::string(e.what()));
+      return;
+    }
+  }
+
+  // From here on the metadata is read-only and shared with the tracker client
+  torrent_ = std::make_shared<const Torrent>(std::move(torrent));
+  tracker_client_ =
+      std::make_unique<TrackerClient>(torrent_, http_client_, udp_client_,
+                                      listen_port_);
+
   try {
-    piece_manager_ =
-        std::make_shared<PieceManager>(torrent_.size(), torrent_.piece_length);
+    piece_manager_ = std::make_shared<PieceManager>(torrent_->size(),
+                                                    torrent_->piece_length);
+    piece_picker_ = std::make_shared<PiecePicker>(piece_manager_);
     logger->log("Piece manager set up for " +
-                std::to_string(torrent_.total_pieces()) + " pieces.");
+                std::to_string(torrent_->total_pieces()) + " pieces.");
   } catch (const std::exception &e) {
     logger->log("Error setting up piece manager: " + std::string(e.what()));
+    torrent_.reset();
     return;
   }
 
+  // Stamps must be checked before the file manager touches the files
+  std::vector<Priority> file_priorities;
+  bool resumed = load_resume_data(file_priorities);
+
   try {
+    if (std::count(file_priorities.begin(), file_priorities.end(),
+                   Priority::Skip) > 0) {
+      std::error_code error;
+      std::filesystem::create_directories(RESUME_DIRECTORY, error);
+    }
     file_manager_ = std::make_shared<LinuxFileManager>(
-        torrent_.files, torrent_.piece_length, torrent_.pieces);
+        torrent_->files, torrent_->piece_length, torrent_->pieces,
+        file_priorities, state_path(".parts"));
+    {
+      std::lock_guard<std::mutex> lock(reads_mutex_);
+      update_piece_priorities();
+    }
+    // Seeded data is trusted only when resume data vouches for all of it
+    recheck_needed_ =
+        seed_path_.empty()
+            ? !resumed && file_manager_->has_existing_data()
+            : piece_manager_->missing_count() > 0;
   } catch (const std::exception &e) {
     logger->log("Error setting up file manager: " + std::string(e.what()));
+    torrent_.reset();
     return;
   }
 
   logger->log("Torrent setup complete.");
 }
 
+std::string TorrentClient::state_path(const std::string &extension) const {
+  const InfoHash &info_hash = torrent_->info_hash;
+  return RESUME_DIRECTORY + "/" + to_hex(info_hash.data(), info_hash.size()) +
+         extension;
+}
+
+bool TorrentClient::load_resume_data(std::vector<Priority> &file_priorities) {
+  Logger *logger = Logger::instance();
+  resume_path_ = state_path(".resume");
+
+  auto start_time = std::chrono::steady_clock::now();
+  std::optional<ResumeData> resume = ResumeData::load(resume_path_);
+  if (!resume) {
+    return false;
+  }
+
+  if (resume->info_hash != torrent_->info_hash ||
+      resume->pieces.size() != torrent_->total_pieces()) {
+    logger->log("Ignoring resume data for a different torrent.",
+                Logger::WARNING);
+    return false;
+  }
+
+  size_t invalid = resume->validate(torrent_->files, torrent_->piece_length);
+  if (invalid > 0) {
+    logger->log(std::to_string(invalid) +
+                    " file(s) changed since the resume data was saved.",
+                Logger::WARNING);
+  }
+
+  piece_manager_->restore_pieces(resume->pieces);
+  for (auto &partial : resume->partial_pieces) {
+    piece_manager_->add_partial_piece(std::move(partial));
+  }
+  if (resume->file_priorities.size() == torrent_->files.size()) {
+    file_priorities = std::move(resume->file_priorities);
+  }
+
+  auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start_time);
+  logger->log("Resumed " + std::to_string(resume->pieces.count()) +
+                  " pieces in " + std::to_string(elapsed.count()) + " us.",
+              Logger::INFO);
+  return true;
+}
+
+void TorrentClient::recheck() {
+  if (piece_manager_ == nullptr || file_manager_ == nullptr) {
+    return;
+  }
+
+  Logger *logger = Logger::instance();
+  logger->log("Checking existing data...", Logger::INFO);
+  auto start_time = std::chrono::steady_clock::now();
+
+  pieces_checked_ = 0;
+  checking_ = true;
+  PieceChecker checker(*file_manager_, torrent_->piece_length,
+                       torrent_->pieces);
+  uint32_t valid = checker.run([this](uint32_t piece_index, bool valid) {
+    if (valid) {
+      piece_manager_->restore_piece(piece_index);
+    }
+    pieces_checked_.fetch_add(1, std::memory_order_relaxed);
+  });
+  checking_ = false;
+  recheck_needed_ = false;
+  resume_dirty_ = true;
+
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start_time);
+  logger->log("Found " + std::to_string(valid) + " of " +
+                  std::to_string(torrent_->total_pieces()) + " pieces in " +
+                  std::to_string(elapsed.count()) + " ms.",
+              Logger::INFO);
+}
+
+void TorrentClient::save_resume_data() {
+  if (piece_manager_ == nullptr || file_manager_ == nullptr) {
+    return;
+  }
+
+  ResumeData resume;
+  resume.info_hash = torrent_->info_hash;
+  resume.pieces = piece_manager_->bitfield();
+  resume.partial_pieces = piece_manager_->partial_pieces();
+  {
+    std::lock_guard<std::mutex> lock(connections_mutex_);
+    for (const auto &entry : peer_connections_) {
+      auto partials = entry.second->flush_partial_pieces();
+      resume.partial_pieces.insert(resume.partial_pieces.end(),
+                                   partials.begin(), partials.end());
+    }
+  }
+
+  // Stamps are taken after flushing, since that may have touched the files
+  for (size_t i = 0; i < torrent_->files.size(); ++i) {
+    resume.files.push_back(
+        stat_file(torrent_->files[i].path).value_or(FileStamp{}));
+    resume.file_priorities.push_back(file_manager_->file_priority(i));
+  }
+
+  std::error_code error;
+  std::filesystem::create_directories(RESUME_DIRECTORY, error);
+  if (!resume.save(resume_path_)) {
+    Logger::instance()->log("Failed to write resume data to " + resume_path_,
+                            Logger::WARNING);
+  }
+}
+
+void TorrentClient::schedule_resume_save() {
+  {
+    std::lock_guard<std::mutex> lock(connections_mutex_);
+    if (closed_) {
+      return;
+    }
+  }
+
+  resume_timer_.expires_after(RESUME_SAVE_INTERVAL);
+  auto self(shared_from_this());
+  resume_timer_.async_wait(
+      [this, self](const boost::system::error_code &error) {
+        if (error) {
+          return;
+        }
+        if (resume_dirty_.exchange(false)) {
+          save_resume_data();
+        }
+        schedule_resume_save();
+      });
+}
+
 void TorrentClient::initiate_tracker_session() {
-  int retry_count = 0;
-  const int max_retries = 3; // Maximum number of retry attempts
-  while (retry_count < max_retries) {
-    tracker_client_ = std::make_unique<TrackerClient>(torrent_);
-    try {
-      TrackerResponse response =
-          tracker_client_->announce(TrackerClient::Event::Started);
+  started_at_ = std::chrono::steady_clock::now();
+  boost::asio::post(strand_, [self = shared_from_this()]() {
+    self->announce(TrackerClient::Event::Started);
+  });
+}
 
-      for (auto peer : response.peers) {
-        add_connection(peer);
-      }
+void TorrentClient::announce(TrackerClient::Event event) {
+  {
+    std::lock_guard<std::mutex> lock(connections_mutex_);
+    if (closed_) {
+      return;
+    }
+  }
+
+  tracker_client_->set_left(
+      std::min<uint64_t>(torrent_->size(),
+                         uint64_t{piece_manager_->needed_count()} *
+                             torrent_->piece_length));
+  // Responses arrive on the tracker clients' strands, hop back onto ours
+  auto self(shared_from_this());
+  tracker_client_->announce(
+      event,
+      [self](TrackerResponse response) {
+        boost::asio::post(self->strand_,
+                          [self, response = std::move(response)]() {
+                            self->add_peers(response.peers, response.tracker);
+                          });
+      },
+      [self, event](TrackerResponse response) {
+        boost::asio::post(self->strand_, [self, event,
+                                          response = std::move(response)]() {
+          self->handle_announce(event, response);
+        });
+      });
+}
+
+void TorrentClient::handle_announce(TrackerClient::Event event,
+                                    const TrackerResponse &response) {
+  {
+    std::lock_guard<std::mutex> lock(connections_mutex_);
+    if (closed_) {
+      return;
+    }
+  }
+
+  if (!response.failure_reason.empty()) {
+    // Peers may still find us through other peers or connect to us
+    uint32_t backoff = 1u << std::min<uint32_t>(announce_failures_, 16);
+    std::chrono::seconds delay =
+        std::min(ANNOUNCE_RETRY_DELAY * backoff, DEFAULT_ANNOUNCE_INTERVAL);
+    ++announce_failures_;
+    Logger::instance()->log("Trackers unavailable for " + torrent_->name +
+                                ": " + response.failure_reason +
+                                ". Retrying in " +
+                                std::to_string(delay.count()) + " s.",
+                            Logger::WARNING);
+    // A start or completion the tracker never heard of is reported again
+    schedule_announce(delay, event);
+    return;
+  }
+  announce_failures_ = 0;
+  if (response.seeders > 0 || response.leechers > 0) {
+    ScrapeStats stats = swarm();
+    stats.seeders = response.seeders;
+    stats.leechers = response.leechers;
+    update_swarm(stats);
+  }
+
+  std::chrono::seconds interval =
+      response.interval > 0 ? std::chrono::seconds(response.interval)
+                            : DEFAULT_ANNOUNCE_INTERVAL;
+  schedule_announce(std::max(interval, MIN_ANNOUNCE_INTERVAL),
+                    TrackerClient::Event::Empty);
+}
+
+void TorrentClient::add_peers(const std::vector<Peer> &peers,
+                              const std::string &source) {
+  {
+    std::lock_guard<std::mutex> lock(connections_mutex_);
+    if (closed_) {
+      return;
+    }
+  }
 
-      // Successfully connected and received response
+  for (const auto &peer : peers) {
+    connection_scheduler_.add(peer, source);
+  }
+  connect_peers();
+}
+
+void TorrentClient::wanted_pieces_changed() {
+  std::vector<std::shared_ptr<PeerConnection>> connections;
+  {
+    std::lock_guard<std::mutex> lock(connections_mutex_);
+    if (closed_) {
+      return;
+    }
+    for (const auto &entry : peer_connections_) {
+      connections.push_back(entry.second);
+    }
+  }
+  // The connections run on the strand as well
+  for (const auto &connection : connections) {
+    connection->update_interest();
+  }
+
+  // A torrent that had all it wanted may want more now
+  connect_peers();
+}
+
+void TorrentClient::connect_peers() {
+  {
+    std::lock_guard<std::mutex> lock(connections_mutex_);
+    if (closed_) {
+      return;
+    }
+  }
+  // Seeds have nothing to gain from connecting to other peers
+  if (piece_manager_->needed_count() == 0) {
+    return;
+  }
+
+  auto now = std::chrono::steady_clock::now();
+  size_t limit = max_connections_;
+  size_t open = open_connections();
+  while (limit == 0 || open < limit) {
+    std::optional<Peer> peer = connection_scheduler_.next(now);
+    if (!peer) {
       break;
-    } catch (const std::exception &e) {
-      retry_count++;
+    }
+    add_connection(*peer);
+    ++open;
+  }
+
+  // Every slot that can be filled is, once the attempts have finished
+  if (time_to_full_speed_ms_ == 0 && connection_scheduler_.half_open() == 0 &&
+      open > 0 &&
+      ((limit != 0 && open >= limit) ||
+       !connection_scheduler_.has_ready(now))) {
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        now - started_at_);
+    time_to_full_speed_ms_ = std::max<int64_t>(1, elapsed.count());
+    Logger::instance()->log(torrent_->name + " reached full speed after " +
+                                std::to_string(elapsed.count()) + " ms with " +
+                                std::to_string(open) + " connections.",
+                            Logger::INFO);
+  }
 
-      std::cerr << "Tracker connection failed: " << e.what() << ". Retrying ("
-                << retry_count << "/" << max_retries << ")" << std::endl;
-      if (retry_count == max_retries) {
-        throw; // Rethrow the exception
+  std::optional<std::chrono::steady_clock::time_point> retry =
+      connection_scheduler_.next_retry(now);
+  if (retry) {
+    connect_timer_.expires_at(*retry);
+    connect_timer_.async_wait([this, self = shared_from_this()](
+                                  const boost::system::error_code &error) {
+      if (!error) {
+        connect_peers();
       }
+    });
+  }
+}
+
+size_t TorrentClient::open_connections() const {
+  // Connections leave the table as they close
+  std::lock_guard<std::mutex> lock(connections_mutex_);
+  return peer_connections_.size();
+}
+
+void TorrentClient::schedule_announce(std::chrono::seconds delay,
+                                      TrackerClient::Event event) {
+  announce_timer_.expires_after(delay);
+  auto self(shared_from_this());
+  announce_timer_.async_wait(
+      [this, self, event](const boost::system::error_code &error) {
+        if (!error) {
+          announce(event);
+        }
+      });
+}
+
+void TorrentClient::announce_completed() {
+  Logger::instance()->log("Download complete.", Logger::INFO);
+
+  // Peers need not keep us unchoked any longer
+  wanted_pieces_changed();
+
+  // The pool is shared, so other torrents' traffic counts as well
+  double mebibytes = static_cast<double>(pieces_missing_at_launch_) *
+                     torrent_->piece_length / (1024 * 1024);
+  if (mebibytes > 0) {
+    uint64_t allocations =
+        BufferPool::instance().stats().allocations - allocations_at_launch_;
+    Logger::instance()->log(
+        "Buffer pool: " + std::to_string(allocations) + " allocations for " +
+            std::to_string(mebibytes) + " MiB downloaded, " +
+            std::to_string(allocations / mebibytes) + " per MiB.",
+        Logger::INFO);
+  }
+  if (!tracker_client_) {
+    return;
+  }
+
+  // The completion replaces the regular announce that was due
+  announce_timer_.cancel();
+  announce(TrackerClient::Event::Completed);
+}
+
+void TorrentClient::start_accepting() {
+  try {
+    tcp::endpoint endpoint(tcp::v4(), listen_port_);
+    acceptor_.open(endpoint.protocol());
+    acceptor_.set_option(tcp::acceptor::reuse_address(true));
+    acceptor_.bind(endpoint);
+    acceptor_.listen();
+  } catch (const boost::system::system_error &e) {
+    Logger::instance()->log("Not accepting incoming peers: " +
+                                std::string(e.what()),
+                            Logger::WARNING);
+    return;
+  }
+  accept_connection();
+}
+
+std::shared_ptr<PeerConnection>
+TorrentClient::make_connection(tcp::socket socket) {
+  auto connection = std::make_shared<PeerConnection>(
+      std::move(socket), torrent_->info_hash, tracker_client_->peer_id(),
+      piece_manager_, file_manager_, piece_picker_, timer_wheel_);
+  connection->set_bandwidth_limiters(download_limiter_, upload_limiter_);
+  return connection;
+}
+
+bool TorrentClient::register_connection(
+    const tcp::endpoint &endpoint,
+    const std::shared_ptr<PeerConnection> &connection) {
+  std::lock_guard<std::mutex> lock(connections_mutex_);
+  if (closed_) {
+    return false;
+  }
+  return peer_connections_.emplace(endpoint, connection).second;
+}
+
+void TorrentClient::remove_connection(const tcp::endpoint &endpoint,
+                                      const PeerConnection *connection) {
+  std::lock_guard<std::mutex> lock(connections_mutex_);
+  auto it = peer_connections_.find(endpoint);
+  if (it != peer_connections_.end() && it->second.get() == connection) {
+    peer_connections_.erase(it);
+  }
+}
+
+void TorrentClient::watch_connection(
+    const tcp::endpoint &endpoint,
+    const std::shared_ptr<PeerConnection> &connection,
+    std::optional<Peer> peer) {
+  // The connection owns the handler and we own the connection, so the
+  // handler refers back to both weakly
+  std::weak_ptr<TorrentClient> weak_self = shared_from_this();
+  std::weak_ptr<PeerConnection> weak_connection = connection;
+  connection->set_disconnect_handler([weak_self, endpoint, weak_connection,
+                                      peer = std::move(peer)]() {
+    std::shared_ptr<TorrentClient> self = weak_self.lock();
+    if (self == nullptr) {
+      return;
+    }
+    self->remove_connection(endpoint, weak_connection.lock().get());
+    if (peer) {
+      self->connection_scheduler_.disconnected(
+          *peer, std::chrono::steady_clock::now());
+    }
+    self->connect_peers();
+  });
+}
+
+void TorrentClient::accept_connection() {
+  auto connection = make_connection(tcp::socket(strand_));
+  acceptor_.async_accept(connection->socket(),
+                         boost::bind(&TorrentClient::handle_accept,
+                                     shared_from_this(), connection,
+                                     boost::asio::placeholders::error));
+}
+
+void TorrentClient::handle_accept(std::shared_ptr<PeerConnection> connection,
+                                  const boost::system::error_code &error) {
+  if (error == boost::asio::error::operation_aborted) {
+    return;
+  }
+
+  if (!error) {
+    boost::system::error_code endpoint_error;
+    tcp::endpoint endpoint = connection->socket().remote_endpoint(
+        endpoint_error);
+    if (!endpoint_error && register_connection(endpoint, connection)) {
+      watch_connection(endpoint, connection, std::nullopt);
+      connection->start_inbound();
     }
   }
+  accept_connection();
+}
+
+void TorrentClient::adopt_connection(tcp::socket socket,
+                                     std::vector<std::byte> handshake) {
+  // Rebind the socket to our strand, the owner accepted it on its own
+  boost::system::error_code error;
+  tcp::endpoint local = socket.local_endpoint(error);
+  if (error) {
+    return;
+  }
+  tcp::socket::native_handle_type handle = socket.release(error);
+  if (error) {
+    return;
+  }
+  auto connection =
+      make_connection(tcp::socket(strand_, local.protocol(), handle));
+
+  boost::asio::post(strand_, [this, self = shared_from_this(), connection,
+                              handshake = std::move(handshake)]() mutable {
+    boost::system::error_code error;
+    tcp::endpoint endpoint = connection->socket().remote_endpoint(error);
+    if (!error && register_connection(endpoint, connection)) {
+      watch_connection(endpoint, connection, std::nullopt);
+      connection->start_inbound(std::move(handshake));
+    }
+  });
 }
 
 void TorrentClient::add_connection(const Peer &peer) {
-  auto connection = std::make_shared<PeerConnection>(
-      io_context_, torrent_.info_hash, tracker_client_->peer_id(),
-      piece_manager_, file_manager_);
-  {
-    std::lock_guard<std::mutex> lock(connections_mutex_);
-    peer_connections_.push_back(connection);
+  if (peer.host.empty()) {
+    connect_to(peer, peer.endpoint);
+    return;
+  }
+
+  // Only peers named by host need a lookup, the table is keyed by address
+  auto resolver = std::make_shared<tcp::resolver>(strand_);
+  TimerWheel::TimerId timeout = timer_wheel_->arm(
+      CONNECT_TIMEOUT, [resolver]() { resolver->cancel(); });
+  resolver->async_resolve(
+      peer.host, std::to_string(peer.endpoint.port()),
+      [this, self = shared_from_this(), peer, resolver,
+       timeout](const boost::system::error_code &error,
+                tcp::resolver::results_type endpoints) {
+        timer_wheel_->cancel(timeout);
+        if (error || endpoints.empty()) {
+          connection_scheduler_.failed(peer, std::chrono::steady_clock::now());
+          connect_peers();
+          return;
+        }
+        connect_to(peer, endpoints.begin()->endpoint());
+      });
+}
+
+void TorrentClient::connect_to(const Peer &peer,
+                               const tcp::endpoint &endpoint) {
+  auto connection = make_connection(tcp::socket(strand_));
+  if (!register_connection(endpoint, connection)) {
+    // Already connected to that address some other way
+    connection_scheduler_.failed(peer, std::chrono::steady_clock::now());
+    return;
   }
-  tcp::resolver resolver(io_context_);
-  auto endpoints = resolver.resolve(peer.ip, std::to_string(peer.port));
-  boost::asio::async_connect(connection->socket(), endpoints,
-                             boost::bind(&TorrentClient::handle_connect, this,
-                                         connection,
-                                         boost::asio::placeholders::error));
+
+  // Dead peers would otherwise hold a socket for minutes
+  TimerWheel::TimerId timeout = timer_wheel_->arm(
+      CONNECT_TIMEOUT, [connection]() { connection->stop(); });
+
+  connection->socket().async_connect(
+      endpoint, boost::bind(&TorrentClient::handle_connect, shared_from_this(),
+                            connection, peer, endpoint, timeout,
+                            boost::asio::placeholders::error));
 }
 
-void TorrentClient::handle_connect(std::shared_ptr<PeerConnection> connection,
-                                   const boost::system::error_code &error) {
+void TorrentClient::handle_connect(
+    std::shared_ptr<PeerConnection> connection, const Peer &peer,
+    const tcp::endpoint &endpoint, TimerWheel::TimerId timeout,
+    const boost::system::error_code &error) {
+  timer_wheel_->cancel(timeout);
   if (!error) {
+    connection_scheduler_.connected(peer);
+    watch_connection(endpoint, connection, peer);
     connection->start();
   } else {
-    {
-      std::lock_guard<std::mutex> lock(connections_mutex_);
-      auto it = std::remove(peer_connections_.begin(), peer_connections_.end(),
-                            connection);
-      peer_connections_.erase(it, peer_connections_.end());
-    }
+    remove_connection(endpoint, connection.get());
+    connection_scheduler_.failed(peer, std::chrono::steady_clock::now());
   }
+  connect_peers();
 }
 
 TorrentInfo TorrentClient::download_info() const {
-  TorrentInfo info;
-  info.name = torrent_.name;
-  info.connections = peer_connections_.size();
+  TorrentInfo info{};
+  if (torrent_ == nullptr) {
+    return info;
+  }
+
+  info.name = torrent_->name;
+  info.connections = open_connections();
   if (piece_manager_ != nullptr) {
-    info.pieces_needed = piece_manager_->missing_pieces().size();
+    info.pieces_needed = piece_manager_->needed_count();
   } else {
     info.pieces_needed = 0;
   }
 
-  info.total_pieces = torrent_.total_pieces();
-  info.piece_length = torrent_.piece_length;
+  info.total_pieces = torrent_->total_pieces();
+  info.piece_length = torrent_->piece_length;
+  info.checking = checking_;
+  info.pieces_checked = pieces_checked_;
+  info.time_to_full_speed =
+      std::chrono::milliseconds(time_to_full_speed_ms_.load());
+  info.time_to_first_byte =
+      std::chrono::milliseconds(time_to_first_byte_ms_.load());
+  info.stalls = stalls_;
 
   return info;
 }
+
+Priority TorrentClient::file_priority(size_t file_index) const {
+  return file_manager_ != nullptr ? file_manager_->file_priority(file_index)
+                                  : Priority::Skip;
+}
+
+bool TorrentClient::set_file_priority(size_t file_index, Priority priority) {
+  if (file_manager_ == nullptr) {
+    return false;
+  }
+  if (priority == Priority::Skip) {
+    std::error_code error;
+    std::filesystem::create_directories(RESUME_DIRECTORY, error);
+  }
+  if (!file_manager_->set_file_priority(file_index, priority)) {
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> lock(reads_mutex_);
+    update_piece_priorities();
+  }
+  resume_dirty_ = true;
+
+  boost::asio::post(strand_, boost::bind(&TorrentClient::wanted_pieces_changed,
+                                         shared_from_this()));
+  return true;
+}
+
+std::future<std::vector<std::byte>>
+TorrentClient::read(size_t file_index, uint64_t offset, uint64_t length) {
+  std::promise<std::vector<std::byte>> promise;
+  std::future<std::vector<std::byte>> future = promise.get_future();
+  if (file_manager_ == nullptr) {
+    promise.set_exception(std::make_exception_ptr(
+        std::runtime_error("Torrent failed to load")));
+    return future;
+  }
+  if (length > MAX_READ_LENGTH) {
+    promise.set_exception(std::make_exception_ptr(std::length_error(
+        "Read longer than " + std::to_string(MAX_READ_LENGTH) + " bytes")));
+    return future;
+  }
+  if (file_index >= torrent_->files.size() ||
+      offset > torrent_->files[file_index].length ||
+      length > torrent_->files[file_index].length - offset) {
+    promise.set_exception(std::make_exception_ptr(
+        std::out_of_range("Read beyond the end of the file")));
+    return future;
+  }
+
+  PendingRead read{torrent_->files[file_index].start_offset + offset, length,
+                   {}, std::move(promise)};
+  if (length > 0) {
+    // Checked under the lock so a completion in between is not missed
+    std::lock_guard<std::mutex> lock(reads_mutex_);
+    if (reads_closed_) {
+      read.promise.set_exception(std::make_exception_ptr(
+          std::runtime_error("Torrent closed")));
+      return future;
+    }
+    auto first = static_cast<uint32_t>(read.offset / torrent_->piece_length);
+    auto last = static_cast<uint32_t>((read.offset + length - 1) /
+                                      torrent_->piece_length);
+    bool promoted = false;
+    for (uint32_t piece = first; piece <= last; ++piece) {
+      if (!piece_manager_->has_piece(piece)) {
+        read.missing.push_back(piece);
+        promoted = urgent_pieces_.insert(piece).second || promoted;
+      }
+    }
+
+    if (!read.missing.empty()) {
+      pending_reads_.push_back(std::move(read));
+      if (promoted) {
+        update_piece_priorities();
+        boost::asio::post(strand_,
+                          boost::bind(&TorrentClient::wanted_pieces_changed,
+                                      shared_from_this()));
+      }
+      return future;
+    }
+  }
+
+  auto ready = std::make_shared<PendingRead>(std::move(read));
+  boost::asio::post(disk_executor_, [self = shared_from_this(), ready]() {
+    self->finish_read(*ready);
+  });
+  return future;
+}
+
+void TorrentClient::finish_read(PendingRead &read) {
+  std::vector<std::byte> data(read.length);
+  if (!file_manager_->read_range(read.offset, data.data(), read.length)) {
+    read.promise.set_exception(std::make_exception_ptr(
+        std::runtime_error("Failed to read the torrent's data")));
+    return;
+  }
+  read.promise.set_value(std::move(data));
+}
+
+void TorrentClient::serve_reads() {
+  auto ready = std::make_shared<std::vector<PendingRead>>();
+  {
+    std::lock_guard<std::mutex> lock(reads_mutex_);
+    if (pending_reads_.empty()) {
+      return;
+    }
+    for (auto it = pending_reads_.begin(); it != pending_reads_.end();) {
+      auto &missing = it->missing;
+      missing.erase(std::remove_if(missing.begin(), missing.end(),
+                                   [this](uint32_t piece) {
+                                     return piece_manager_->has_piece(piece);
+                                   }),
+                    missing.end());
+      if (missing.empty()) {
+        ready->push_back(std::move(*it));
+        it = pending_reads_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+
+    size_t urgent = urgent_pieces_.size();
+    for (auto it = urgent_pieces_.begin(); it != urgent_pieces_.end();) {
+      it = piece_manager_->has_piece(*it) ? urgent_pieces_.erase(it)
+                                          : std::next(it);
+    }
+    if (urgent_pieces_.size() != urgent) {
+      update_piece_priorities();
+    }
+  }
+
+  // Completions are published on the thread that verified the piece, which
+  // must not be kept waiting for the disk, and neither must the strand
+  if (!ready->empty()) {
+    boost::asio::post(disk_executor_, [self = shared_from_this(), ready]() {
+      for (PendingRead &read : *ready) {
+        self->finish_read(read);
+      }
+    });
+  }
+}
+
+void TorrentClient::update_piece_priorities() {
+  std::vector<Priority> pieces = file_manager_->piece_priorities();
+  for (uint32_t piece : urgent_pieces_) {
+    pieces[piece] = Priority::Urgent;
+  }
+  piece_manager_->set_priorities(std::move(pieces));
+}
+
+void TorrentClient::stream_from(uint64_t offset) {
+  if (torrent_ == nullptr || torrent_->piece_length == 0) {
+    return;
+  }
+  uint64_t piece_index = offset / torrent_->piece_length;
+  if (piece_index >= torrent_->total_pieces()) {
+    return;
+  }
+  auto cursor = static_cast<uint32_t>(piece_index);
+  piece_picker_->set_stream_window(cursor);
+
+  // Checked under the lock so a completion in between is not missed
+  std::lock_guard<std::mutex> lock(stream_mutex_);
+  bool available = piece_manager_->has_piece(cursor);
+  auto now = std::chrono::steady_clock::now();
+  if (!stream_started_at_) {
+    stream_started_at_ = now;
+  }
+  if (available && !stream_started_) {
+    stream_started_ = true;
+    time_to_first_byte_ms_ = std::max<int64_t>(
+        1, std::chrono::duration_cast<std::chrono::milliseconds>(
+               now - *stream_started_at_)
+               .count());
+  } else if (!available && stream_started_ && stream_cursor_ != cursor) {
+    ++stalls_; // The reader caught up with the download
+  }
+  stream_cursor_ = cursor;
+}
+
+void TorrentClient::stop_streaming() {
+  if (piece_picker_ != nullptr) {
+    piece_picker_->clear_stream_window();
+  }
+  std::lock_guard<std::mutex> lock(stream_mutex_);
+  stream_cursor_.reset();
+}
+
+void TorrentClient::stream_piece_completed(uint32_t piece_index) {
+  std::lock_guard<std::mutex> lock(stream_mutex_);
+  if (stream_started_ || stream_cursor_ != piece_index) {
+    return;
+  }
+  stream_started_ = true;
+  time_to_first_byte_ms_ = std::max<int64_t>(
+      1, std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now() - *stream_started_at_)
+             .count());
+}
+
+PieceManager::SubscriptionId
+TorrentClient::subscribe(PieceManager::Subscriber subscriber) {
+  if (piece_manager_ == nullptr) {
+    return 0;
+  }
+  return piece_manager_->subscribe(std::move(subscriber));
+}
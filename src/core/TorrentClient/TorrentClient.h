@@ -1,28 +1,71 @@
 #ifndef TORRENTCLIENT_H
 #define TORRENTCLIENT_H
 
+#include "BandwidthLimiter/BandwidthLimiter.h"
+#include "ConnectionScheduler/ConnectionScheduler.h"
 #include "FileManager/FileManager.h"
 #include "PeerConnection/PeerConnection.h"
+#include "PieceChecker/PieceChecker.h"
 #include "PieceManager/PieceManager.h"
+#include "PiecePicker/PiecePicker.h"
+#include "ResumeData/ResumeData.h"
+#include "TimerWheel/TimerWheel.h"
 #include "TorrentParser/TorrentParser.h"
 #include "TrackerClient/TrackerClient.h"
+#include "UdpTrackerClient/UdpTrackerClient.h"
+#include <atomic>
 #include <boost/asio.hpp>
+#include <chrono>
+#include <future>
 #include <memory>
+#include <optional>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
+/// Directory holding one resume file per torrent, named by info hash.
+const std::string RESUME_DIRECTORY = ".yatc";
+
+/// How often resume data is written while the torrent is running.
+const std::chrono::seconds RESUME_SAVE_INTERVAL(30);
+
+/// Port on which incoming peer connections are accepted.
+const uint16_t LISTEN_PORT = 6881;
+
+/// Longest read() accepted, so a single read cannot hog memory or a disk
+/// thread.
+const uint64_t MAX_READ_LENGTH = 16 * 1024 * 1024;
+
 struct TorrentInfo {
   std::string name;
   size_t connections;
   size_t pieces_needed;
   size_t total_pieces;
   size_t piece_length;
+  bool checking;         ///< Whether existing data is being verified.
+  size_t pieces_checked; ///< Pieces verified so far while checking.
+  /// From the start until every connection slot that could be filled was,
+  /// zero until then.
+  std::chrono::milliseconds time_to_full_speed;
+  /// From the first stream_from() until the piece at its offset was
+  /// complete, zero until then.
+  std::chrono::milliseconds time_to_first_byte;
+  /// Times the read cursor moved onto a missing piece after the first byte.
+  size_t stalls;
 };
 
 /**
  * @brief Manages the overall process of downloading and uploading a torrent.
+ *
+ * A client either runs on its own IO context, driven by start(), or is
+ * hosted by a Session that runs many torrents on one shared IO context.
+ * Either way every handler of the torrent and its connections runs on one
+ * strand, so per-torrent state needs no further locking. Handlers keep the
+ * client alive, so it must be owned by a std::shared_ptr.
  */
-class TorrentClient {
+class TorrentClient : public std::enable_shared_from_this<TorrentClient> {
 public:
   /**
    * @brief Constructs a TorrentClient with the specified torrent file.
@@ -31,10 +74,48 @@ public:
    */
   TorrentClient(const std::string &torrentFile);
 
+  /**
+   * @brief Constructs a TorrentClient that seeds existing data.
+   *
+   * The files of the torrent are looked up below @p seed_path instead of the
+   * working directory and must already have their full size; they are never
+   * created or truncated. start() verifies them unless resume data shows they
+   * are complete and unchanged, and then goes straight to uploading.
+   *
+   * @param torrentFile The path to the .torrent file.
+   * @param seed_path The directory holding the data, or the file itself for
+   * a single-file torrent.
+   */
+  TorrentClient(const std::string &torrentFile, const std::string &seed_path);
+
+  /**
+   * @brief Constructs a TorrentClient hosted on a shared IO context.
+   *
+   * The client does not listen for peers itself; its owner routes incoming
+   * connections to it through adopt_connection().
+   *
+   * @param io_context The IO context to run on.
+   * @param disk_executor Runs the disk reads of read(), off the network
+   * threads.
+   * @param http_client Announces to HTTP trackers, shared with other torrents.
+   * @param udp_client Announces to UDP trackers, shared with other torrents.
+   * @param listen_port The port announced to the tracker.
+   * @param torrentFile The path to the .torrent file.
+   * @param seed_path Directory or file holding existing data to seed, empty
+   * to download to the working directory.
+   */
+  TorrentClient(boost::asio::io_context &io_context,
+                boost::asio::any_io_executor disk_executor,
+                std::shared_ptr<HttpClient> http_client,
+                std::shared_ptr<UdpTrackerClient> udp_client,
+                uint16_t listen_port, const std::string &torrentFile,
+                const std::string &seed_path = "");
+
   /**
    * @brief Starts the torrent client.
    *
-   * Initiates the downloading and uploading process.
+   * Initiates the downloading and uploading process and runs the client's
+   * own IO context until stop() is called, then closes the client.
    */
   void start();
 
@@ -45,25 +126,313 @@ public:
    */
   void stop();
 
+  /**
+   * @brief Starts the torrent without running the IO context.
+   *
+   * Checks existing data if needed and starts announcing to the tracker;
+   * peers are connected to as its responses arrive. Blocks while checking,
+   * so a Session calls this on its disk threads rather than on the network
+   * threads.
+   */
+  void launch();
+
+  /**
+   * @brief Stops the torrent on its strand: cancels its timers, closes its
+   * connections and writes resume data.
+   *
+   * @return A future that becomes ready once the torrent is closed.
+   */
+  std::future<void> close();
+
+  /**
+   * @brief Takes over an incoming connection whose handshake was read by
+   * the owner, usually to find out which torrent it is for.
+   *
+   * @param socket The connected socket.
+   * @param handshake The handshake message the peer sent.
+   */
+  void adopt_connection(tcp::socket socket, std::vector<std::byte> handshake);
+
+  /**
+   * @brief Limits the traffic of connections made from now on.
+   *
+   * @param download Limiter for received data, or null.
+   * @param upload Limiter for sent data, or null.
+   */
+  void set_bandwidth_limiters(std::shared_ptr<BandwidthLimiter> download,
+                              std::shared_ptr<BandwidthLimiter> upload);
+
+  /**
+   * @brief Gets the limiter for received data.
+   *
+   * @return The limiter, or null if unlimited.
+   */
+  std::shared_ptr<BandwidthLimiter> download_limiter() const {
+    return download_limiter_;
+  }
+
+  /**
+   * @brief Gets the limiter for sent data.
+   *
+   * @return The limiter, or null if unlimited.
+   */
+  std::shared_ptr<BandwidthLimiter> upload_limiter() const {
+    return upload_limiter_;
+  }
+
+  /**
+   * @brief Limits the number of open peer connections.
+   *
+   * Peers the trackers return beyond the limit are kept and connected to
+   * as slots free up, which is checked on every call. Existing connections
+   * are not closed.
+   *
+   * @param max_connections The limit, 0 for unlimited.
+   */
+  void set_max_connections(size_t max_connections);
+
+  /**
+   * @brief Records swarm statistics reported by a tracker.
+   *
+   * @param swarm The seeders, leechers and completed downloads.
+   */
+  void update_swarm(const ScrapeStats &swarm);
+
+  /**
+   * @brief Gets the last swarm statistics reported by a tracker.
+   *
+   * @return The statistics, all 0 if no tracker reported any yet.
+   */
+  ScrapeStats swarm() const;
+
+  /**
+   * @brief Gets the tracker to scrape for the swarm statistics.
+   *
+   * @return The tracker that last answered an announce, or the first one to
+   * try; empty if the torrent has none.
+   */
+  std::string scrape_url() const;
+
+  /**
+   * @brief Gets the torrent metadata.
+   *
+   * @return The torrent, or null if it failed to load.
+   */
+  std::shared_ptr<const Torrent> torrent() const { return torrent_; }
+
   TorrentInfo download_info() const;
 
+  /**
+   * @brief Checks whether every piece that is not skipped has been
+   * downloaded.
+   *
+   * @return true if the torrent is complete and only uploads.
+   */
+  bool complete() const {
+    return piece_manager_ != nullptr && piece_manager_->needed_count() == 0;
+  }
+
+  /**
+   * @brief Verifies all data on disk against the piece hashes.
+   *
+   * Valid pieces are marked as downloaded without publishing events. Runs on
+   * every core and blocks until done; progress is reported through
+   * download_info(). start() calls this automatically when files already
+   * hold data and no resume data could be used.
+   */
+  void recheck();
+
+  /**
+   * @brief Registers a callback for piece completion events.
+   *
+   * The callback runs on the client's network thread, so subscribers such as
+   * the UI should hand the event over to their own thread.
+   *
+   * @param subscriber The callback to invoke.
+   * @return An id that can be passed to PieceManager::unsubscribe(), or 0 if
+   * the torrent failed to load.
+   */
+  PieceManager::SubscriptionId subscribe(PieceManager::Subscriber subscriber);
+
+  /**
+   * @brief Gets the priority of a file.
+   *
+   * @param file_index The index of the file in Torrent::files.
+   * @return The priority, Priority::Skip for an invalid index.
+   */
+  Priority file_priority(size_t file_index) const;
+
+  /**
+   * @brief Changes the priority of a file.
+   *
+   * Pieces are downloaded in the order of the highest priority among the
+   * files they overlap. Skipped files are neither downloaded nor created,
+   * except for the bytes they share with a piece of a wanted file and the
+   * pieces read() asks for, which are kept in a part file next to the
+   * resume data. Priorities are kept in the resume data.
+   *
+   * @param file_index The index of the file in Torrent::files.
+   * @param priority The new priority.
+   * @return true if the priority was changed, false otherwise.
+   */
+  bool set_file_priority(size_t file_index, Priority priority);
+
+  /**
+   * @brief Reads data of a file, downloading it first if needed.
+   *
+   * Data whose pieces are complete is read from disk right away. Otherwise
+   * the missing pieces are downloaded before anything else, skipped or not,
+   * and the read completes once all of them are verified. Reads still
+   * waiting when the torrent is closed fail.
+   *
+   * @param file_index The index of the file in Torrent::files.
+   * @param offset The offset within the file.
+   * @param length The number of bytes to read.
+   * @return The data; throws std::out_of_range for a range beyond the end
+   * of the file, std::length_error for one longer than MAX_READ_LENGTH, or
+   * std::runtime_error if it could not be read.
+   */
+  std::future<std::vector<std::byte>> read(size_t file_index, uint64_t offset,
+                                           uint64_t length);
+
+  /**
+   * @brief Streams the torrent from a byte offset.
+   *
+   * The pieces from the one holding @p offset on are downloaded first, from
+   * the fastest peers and nearest first; those right at the offset are
+   * requested from a second peer if the first is slow to deliver. The rest
+   * is still downloaded rarest first. Call again as the reader moves on.
+   *
+   * @param offset The offset in the torrent's data being read.
+   */
+  void stream_from(uint64_t offset);
+
+  /**
+   * @brief Stops streaming, going back to rarest first everywhere.
+   */
+  void stop_streaming();
+
 private:
+  /**
+   * @brief A read() waiting for pieces to be downloaded.
+   */
+  struct PendingRead {
+    uint64_t offset;               ///< Offset within the whole torrent.
+    uint64_t length;               ///< Number of bytes to read.
+    std::vector<uint32_t> missing; ///< Pieces not complete yet.
+    std::promise<std::vector<std::byte>> promise; ///< Set once read.
+  };
+
+  /**
+   * @brief Reads the data of a read() whose pieces are all complete. Runs
+   * on disk_executor_.
+   *
+   * @param read The read, whose promise is set.
+   */
+  void finish_read(PendingRead &read);
+
+  /**
+   * @brief Finishes, on disk_executor_, the reads whose pieces have all been
+   * completed since they were issued.
+   */
+  void serve_reads();
+
+  /**
+   * @brief Maps the file priorities onto the pieces, the pieces waited for
+   * by reads going first. Must be called with reads_mutex_ held.
+   */
+  void update_piece_priorities();
+
+  /**
+   * @brief Records a piece completing for the streaming statistics.
+   *
+   * @param piece_index The piece.
+   */
+  void stream_piece_completed(uint32_t piece_index);
+
+  std::unique_ptr<boost::asio::io_context>
+      own_io_context_; ///< IO context of a standalone client, else null.
   boost::asio::io_context
-      io_context_; ///< IO context for managing asynchronous operations.
+      &io_context_; ///< IO context for managing asynchronous operations.
+  boost::asio::strand<boost::asio::io_context::executor_type>
+      strand_;           ///< Serializes the handlers of this torrent.
+  uint16_t listen_port_; ///< Port announced to the tracker.
+  boost::asio::any_io_executor
+      disk_executor_; ///< Runs the disk reads of read().
+  std::shared_ptr<HttpClient>
+      http_client_; ///< Performs HTTP tracker requests without blocking.
+  std::shared_ptr<UdpTrackerClient>
+      udp_client_; ///< Performs UDP tracker requests without blocking.
 
   std::unique_ptr<TrackerClient>
       tracker_client_; ///< Manages communication with the tracker.
   std::shared_ptr<PieceManager>
       piece_manager_; ///< Manages the pieces of the torrent.
+  std::shared_ptr<PiecePicker>
+      piece_picker_; ///< Keeps connections from downloading the same piece.
   std::shared_ptr<LinuxFileManager>
       file_manager_; ///< Manages file operations on Linux.
   std::unique_ptr<TorrentParser> torrent_parser_; ///< Parses the .torrent file.
-  Torrent torrent_;                               ///< The torrent metadata.
-  std::vector<std::shared_ptr<PeerConnection>>
-      peer_connections_; ///< List of peer connections.
+  std::shared_ptr<const Torrent>
+      torrent_; ///< The torrent metadata, null if setup failed.
+  std::unordered_map<tcp::endpoint, std::shared_ptr<PeerConnection>,
+                     EndpointHasher>
+      peer_connections_; ///< Live connections by the peer's address.
 
-  std::mutex
+  mutable std::mutex
       connections_mutex_; ///< Mutex for thread-safe access to peer connections.
+  bool closed_ = false;   ///< Set by close(), guarded by connections_mutex_.
+  PieceManager::SubscriptionId
+      completion_subscription_ = 0; ///< Guarded by connections_mutex_.
+  std::shared_ptr<BandwidthLimiter>
+      download_limiter_; ///< Limits received data, null if unlimited.
+  std::shared_ptr<BandwidthLimiter>
+      upload_limiter_; ///< Limits sent data, null if unlimited.
+
+  tcp::acceptor acceptor_; ///< Accepts incoming peer connections.
+  std::string seed_path_;  ///< Root of existing data to seed, if any.
+
+  boost::asio::steady_timer announce_timer_; ///< Fires the next announce.
+  uint32_t announce_failures_ = 0; ///< Failed announces in a row.
+  ConnectionScheduler
+      connection_scheduler_; ///< Peers from trackers and their state.
+  boost::asio::steady_timer
+      connect_timer_; ///< Wakes up when a failed peer may be retried.
+  std::shared_ptr<TimerWheel>
+      timer_wheel_; ///< Runs the torrent's timeouts on strand_.
+  std::atomic<size_t> max_connections_{0}; ///< Connection limit, 0 if none.
+  std::chrono::steady_clock::time_point
+      started_at_; ///< When the tracker session began.
+  std::atomic<int64_t>
+      time_to_full_speed_ms_{0}; ///< See TorrentInfo, 0 until reached.
+  uint32_t pieces_missing_at_launch_ = 0; ///< Pieces this session fetches.
+  uint64_t allocations_at_launch_ = 0; ///< Buffer pool allocations before.
+
+  std::mutex reads_mutex_; ///< Guards the read() state below.
+  std::vector<PendingRead> pending_reads_; ///< Reads waiting for pieces.
+  std::unordered_set<uint32_t>
+      urgent_pieces_;          ///< Missing pieces of pending reads.
+  bool reads_closed_ = false; ///< Set by close(), new reads fail.
+
+  std::mutex stream_mutex_; ///< Guards the streaming state below.
+  std::optional<uint32_t> stream_cursor_; ///< Piece read, if streaming.
+  std::optional<std::chrono::steady_clock::time_point>
+      stream_started_at_; ///< First stream_from(), if any.
+  bool stream_started_ = false; ///< Whether the first byte was available.
+  std::atomic<int64_t>
+      time_to_first_byte_ms_{0}; ///< See TorrentInfo, 0 until reached.
+  std::atomic<size_t> stalls_{0}; ///< See TorrentInfo.
+
+  mutable std::mutex swarm_mutex_; ///< Guards swarm_.
+  ScrapeStats swarm_;              ///< Last statistics a tracker reported.
+
+  boost::asio::steady_timer resume_timer_; ///< Fires periodic resume saves.
+  std::string resume_path_;                ///< Path of the resume file.
+  std::atomic<bool> resume_dirty_{false};  ///< Pieces completed since save.
+
+  bool recheck_needed_ = false;            ///< Existing data is unverified.
+  std::atomic<bool> checking_{false};      ///< A recheck is running.
+  std::atomic<uint32_t> pieces_checked_{0}; ///< Progress of the recheck.
 
   /**
    * @brief Sets up the torrent by parsing the .torrent file.
@@ -72,25 +441,199 @@ private:
    */
   void setup_torrent(const std::string &torrent_file);
 
+  /**
+   * @brief Points the torrent's files at the data below seed_path_.
+   *
+   * @param torrent The freshly parsed torrent to update.
+   * @throws std::runtime_error if a file is missing or has the wrong size.
+   */
+  void map_seed_path(Torrent &torrent) const;
+
+  /**
+   * @brief Gets the path of a file the torrent keeps its state in.
+   *
+   * @param extension The kind of state, such as ".resume".
+   * @return The path in RESUME_DIRECTORY, named by info hash.
+   */
+  std::string state_path(const std::string &extension) const;
+
+  /**
+   * @brief Restores state saved by a previous session.
+   *
+   * Pieces are trusted when the size and modification time of their files
+   * still match the resume file; nothing is rehashed.
+   *
+   * @param file_priorities Set to the file priorities it holds, if any.
+   * @return true if resume data was found and applied.
+   */
+  bool load_resume_data(std::vector<Priority> &file_priorities);
+
+  /**
+   * @brief Writes the current state to the resume file.
+   *
+   * Must be called from the IO thread or after it has stopped.
+   */
+  void save_resume_data();
+
+  /**
+   * @brief Arms the timer for the next periodic resume data save.
+   */
+  void schedule_resume_save();
+
   /**
    * @brief Initiates the session with the tracker.
    */
   void initiate_tracker_session();
 
   /**
-   * @brief Adds a connection to a peer.
+   * @brief Sends an announce to the tracker, on the strand.
+   *
+   * @param event The event to report.
+   */
+  void announce(TrackerClient::Event event);
+
+  /**
+   * @brief Hands peers a tracker returned to the connection scheduler and
+   * connects to the best ones.
+   *
+   * @param peers The peers.
+   * @param source The tracker that returned them.
+   */
+  void add_peers(const std::vector<Peer> &peers, const std::string &source);
+
+  /**
+   * @brief Starts connection attempts while slots are free, and arms
+   * connect_timer_ for the next peer waiting out its backoff.
+   */
+  void connect_peers();
+
+  /**
+   * @brief Lets the open connections and connect_peers() act on a change in
+   * the pieces we want. Runs on the strand.
+   */
+  void wanted_pieces_changed();
+
+  /**
+   * @brief Counts the connections, including attempts in flight.
+   *
+   * @return The number of connections.
+   */
+  size_t open_connections() const;
+
+  /**
+   * @brief Schedules the next announce once all trackers of a tier have
+   * answered, honoring their interval or backing off on failure.
+   *
+   * @param event The event that was reported.
+   * @param response The tracker's response.
+   */
+  void handle_announce(TrackerClient::Event event,
+                       const TrackerResponse &response);
+
+  /**
+   * @brief Arms the timer for the next announce.
+   *
+   * @param delay Time until the announce.
+   * @param event The event to report.
+   */
+  void schedule_announce(std::chrono::seconds delay,
+                         TrackerClient::Event event);
+
+  /**
+   * @brief Tells the tracker and the peers that every piece not skipped has
+   * been downloaded.
+   */
+  void announce_completed();
+
+  /**
+   * @brief Starts listening for incoming peer connections.
+   */
+  void start_accepting();
+
+  /**
+   * @brief Waits for the next incoming peer connection.
+   */
+  void accept_connection();
+
+  /**
+   * @brief Creates a connection to a peer of this torrent.
+   *
+   * @param socket The socket, bound to strand_.
+   * @return The connection, not yet started.
+   */
+  std::shared_ptr<PeerConnection> make_connection(tcp::socket socket);
+
+  /**
+   * @brief Registers a connection unless the torrent has been closed.
+   *
+   * @param endpoint The peer's address.
+   * @param connection The connection to register.
+   * @return false if the torrent was closed or the peer is connected
+   * already, and the connection dropped.
+   */
+  bool register_connection(const tcp::endpoint &endpoint,
+                           const std::shared_ptr<PeerConnection> &connection);
+
+  /**
+   * @brief Removes a connection from the peer table.
+   *
+   * @param endpoint The peer's address.
+   * @param connection The connection, removed only if it is still the one
+   * registered for @p endpoint.
+   */
+  void remove_connection(const tcp::endpoint &endpoint,
+                         const PeerConnection *connection);
+
+  /**
+   * @brief Arranges for a started connection to be removed once it closes,
+   * and for another peer to take its slot.
+   *
+   * @param endpoint The peer's address.
+   * @param connection The connection.
+   * @param peer The peer if we connected to it, nothing if it connected to
+   * us.
+   */
+  void watch_connection(const tcp::endpoint &endpoint,
+                        const std::shared_ptr<PeerConnection> &connection,
+                        std::optional<Peer> peer);
+
+  /**
+   * @brief Handles the result of accepting a peer connection.
+   *
+   * @param connection The peer connection.
+   * @param error The error code resulting from the accept.
+   */
+  void handle_accept(std::shared_ptr<PeerConnection> connection,
+                     const boost::system::error_code &error);
+
+  /**
+   * @brief Adds a connection to a peer, looking up its address first if
+   * the tracker named it by host.
    *
    * @param peer The peer to connect to.
    */
   void add_connection(const Peer &peer);
 
+  /**
+   * @brief Connects to a peer, abandoning the attempt after CONNECT_TIMEOUT.
+   *
+   * @param peer The peer to connect to.
+   * @param endpoint The peer's address.
+   */
+  void connect_to(const Peer &peer, const tcp::endpoint &endpoint);
+
   /**
    * @brief Handles the result of attempting to connect to a peer.
    *
    * @param connection The peer connection.
+   * @param peer The peer connected to.
+   * @param endpoint The peer's address.
+   * @param timeout The attempt's timer on timer_wheel_, cancelled here.
    * @param error The error code resulting from the connection attempt.
    */
   void handle_connect(std::shared_ptr<PeerConnection> connection,
+                      const Peer &peer, const tcp::endpoint &endpoint,
+                      TimerWheel::TimerId timeout,
                       const boost::system::error_code &error);
 };
 
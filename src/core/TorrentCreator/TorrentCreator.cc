@@ -0,0 +1,324 @@
+#include "TorrentCreator.h"
+#include "Utils/utils.h"
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <ctime>
+#include <deque>
+#include <exception>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+/**
+ * @brief Piece-aligned slice of the data, read but not yet hashed.
+ */
+struct Chunk {
+  uint32_t first_piece;              ///< Index of the first piece.
+  uint64_t length;                   ///< Number of valid bytes in data.
+  std::unique_ptr<std::byte[]> data; ///< Buffer, returned after hashing.
+};
+
+/**
+ * @brief Reads the files of a torrent back to back as one stream.
+ */
+class SequentialReader {
+public:
+  SequentialReader(const std::vector<std::string> &paths,
+                   const std::vector<FileInfo> &files)
+      : paths_(paths), files_(files) {}
+
+  ~SequentialReader() {
+    if (fd_ != -1) {
+      close(fd_);
+    }
+  }
+
+  /**
+   * @brief Fills a buffer with the next bytes of the stream.
+   *
+   * @throws std::runtime_error if a file cannot be read or has shrunk.
+   */
+  void read(std::byte *buffer, uint64_t length) {
+    while (length > 0) {
+      if (fd_ == -1) {
+        open_next();
+      }
+
+      size_t want = static_cast<size_t>(std::min(length, remaining_));
+      ssize_t result = ::read(fd_, buffer, want);
+      if (result == -1 && errno == EINTR) {
+        continue;
+      }
+      if (result <= 0) {
+        throw std::runtime_error("Failed to read " + paths_[index_]);
+      }
+
+      buffer += result;
+      length -= static_cast<uint64_t>(result);
+      remaining_ -= static_cast<uint64_t>(result);
+      if (remaining_ == 0) {
+        close(fd_);
+        fd_ = -1;
+        ++index_;
+      }
+    }
+  }
+
+private:
+  void open_next() {
+    // Empty files contribute nothing to the stream
+    while (index_ < files_.size() && files_[index_].length == 0) {
+      ++index_;
+    }
+    if (index_ == files_.size()) {
+      throw std::runtime_error("Files are shorter than expected");
+    }
+
+    fd_ = open(paths_[index_].c_str(), O_RDONLY);
+    if (fd_ == -1) {
+      throw std::runtime_error("Failed to open " + paths_[index_]);
+    }
+    posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+    remaining_ = files_[index_].length;
+  }
+
+  const std::vector<std::string> &paths_;
+  const std::vector<FileInfo> &files_;
+  size_t index_ = 0;       ///< File currently being read.
+  int fd_ = -1;            ///< Descriptor of that file, -1 if none is open.
+  uint64_t remaining_ = 0; ///< Bytes left in that file.
+};
+
+} // namespace
+
+TorrentCreator::TorrentCreator(const std::string &path,
+                               const std::string &tracker_url) {
+  fs::path root = fs::path(path).lexically_normal();
+  if (root.filename().empty()) {
+    root = root.parent_path(); // Trailing slash
+  }
+  torrent_.tracker_url = tracker_url;
+  torrent_.tracker_tiers = {{tracker_url}};
+  torrent_.name = root.filename().string();
+
+  if (fs::is_regular_file(root)) {
+    torrent_.files.push_back({torrent_.name, fs::file_size(root), 0, 0});
+    source_paths_.push_back(root.string());
+    single_file_ = true;
+  } else if (fs::is_directory(root)) {
+    std::vector<std::pair<std::string, uint64_t>> entries;
+    for (const auto &entry : fs::recursive_directory_iterator(root)) {
+      if (entry.is_regular_file()) {
+        entries.emplace_back(
+            entry.path().lexically_relative(root).generic_string(),
+            entry.file_size());
+      }
+    }
+    // Directory order is arbitrary, sorting keeps the info hash reproducible
+    std::sort(entries.begin(), entries.end());
+
+    for (auto &entry : entries) {
+      source_paths_.push_back((root / entry.first).string());
+      torrent_.files.push_back({std::move(entry.first), entry.second, 0, 0});
+    }
+  } else {
+    throw std::runtime_error("No such file or directory: " + path);
+  }
+
+  assign_file_offsets(torrent_.files);
+  if (torrent_.size() == 0) {
+    throw std::runtime_error("Nothing to create a torrent from in " + path);
+  }
+  torrent_.piece_length = choose_piece_length(torrent_.size());
+}
+
+uint32_t TorrentCreator::choose_piece_length(uint64_t total_size) {
+  uint64_t target = total_size / TARGET_PIECE_COUNT;
+  uint32_t piece_length = MIN_AUTO_PIECE_LENGTH;
+  while (piece_length < target && piece_length < MAX_AUTO_PIECE_LENGTH) {
+    piece_length <<= 1;
+  }
+  return piece_length;
+}
+
+void TorrentCreator::set_piece_length(uint32_t piece_length) {
+  if (piece_length < MIN_AUTO_PIECE_LENGTH ||
+      (piece_length & (piece_length - 1)) != 0) {
+    throw std::invalid_argument(
+        "Piece length must be a power of two of at least 16 KiB");
+  }
+  torrent_.piece_length = piece_length;
+}
+
+std::string TorrentCreator::create(unsigned threads) {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  hash_pieces(threads);
+
+  bencode::dict info = build_info_dict();
+  std::string encoded_info = bencode::encode(info);
+  torrent_.info_hash = sha1_digest(
+      reinterpret_cast<const std::byte *>(encoded_info.data()),
+      encoded_info.size());
+
+  bencode::dict dict;
+  dict["announce"] = torrent_.tracker_url;
+  dict["created by"] = "yatc";
+  dict["creation date"] = static_cast<bencode::integer>(std::time(nullptr));
+  dict["info"] = std::move(info);
+  content_ = bencode::encode(dict);
+  return content_;
+}
+
+bool TorrentCreator::save(const std::string &torrent_file) const {
+  std::ofstream file(torrent_file, std::ios::binary | std::ios::trunc);
+  file.write(content_.data(), static_cast<std::streamsize>(content_.size()));
+  return file.good();
+}
+
+void TorrentCreator::hash_pieces(unsigned threads) {
+  const uint32_t piece_length = torrent_.piece_length;
+  const uint64_t total_size = torrent_.size();
+  const uint32_t total_pieces =
+      static_cast<uint32_t>((total_size + piece_length - 1) / piece_length);
+  const uint32_t pieces_per_chunk = static_cast<uint32_t>(
+      std::max<uint64_t>(1, CREATE_CHUNK_SIZE / piece_length));
+  const uint64_t chunk_size = uint64_t{pieces_per_chunk} * piece_length;
+  // One buffer being filled, one being hashed per thread, one spare
+  const size_t max_buffers = threads + 2;
+
+  std::vector<InfoHash> hashes(total_pieces);
+  bytes_hashed_ = 0;
+
+  std::mutex mutex;
+  std::condition_variable chunk_ready;
+  std::condition_variable buffer_free;
+  std::deque<Chunk> ready;
+  std::vector<std::unique_ptr<std::byte[]>> free_buffers;
+  size_t allocated = 0;
+  bool reading_done = false;
+
+  auto hash_chunks = [&]() {
+    while (true) {
+      Chunk chunk;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        chunk_ready.wait(lock,
+                         [&]() { return !ready.empty() || reading_done; });
+        if (ready.empty()) {
+          return;
+        }
+        chunk = std::move(ready.front());
+        ready.pop_front();
+      }
+
+      for (uint64_t offset = 0; offset < chunk.length;
+           offset += piece_length) {
+        uint64_t size =
+            std::min<uint64_t>(piece_length, chunk.length - offset);
+        hashes[chunk.first_piece + offset / piece_length] =
+            sha1_digest(chunk.data.get() + offset, size);
+      }
+      bytes_hashed_.fetch_add(chunk.length, std::memory_order_relaxed);
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        free_buffers.push_back(std::move(chunk.data));
+      }
+      buffer_free.notify_one();
+    }
+  };
+
+  std::vector<std::thread> hashers;
+  for (unsigned i = 0; i < threads; ++i) {
+    hashers.emplace_back(hash_chunks);
+  }
+
+  // This thread is the reader, so the disk sees one sequential stream
+  std::exception_ptr error;
+  try {
+    SequentialReader reader(source_paths_, torrent_.files);
+    for (uint32_t first = 0; first < total_pieces; first += pieces_per_chunk) {
+      Chunk chunk;
+      chunk.first_piece = first;
+      chunk.length =
+          std::min(chunk_size, total_size - first * uint64_t{piece_length});
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (free_buffers.empty() && allocated < max_buffers) {
+          // Deliberately left uninitialised, the read overwrites it
+          chunk.data.reset(new std::byte[chunk_size]);
+          ++allocated;
+        } else {
+          buffer_free.wait(lock, [&]() { return !free_buffers.empty(); });
+          chunk.data = std::move(free_buffers.back());
+          free_buffers.pop_back();
+        }
+      }
+
+      reader.read(chunk.data.get(), chunk.length);
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        ready.push_back(std::move(chunk));
+      }
+      chunk_ready.notify_one();
+    }
+  } catch (...) {
+    error = std::current_exception();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    reading_done = true;
+  }
+  chunk_ready.notify_all();
+  for (auto &hasher : hashers) {
+    hasher.join();
+  }
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  torrent_.pieces = PieceHashes(std::move(hashes));
+}
+
+bencode::dict TorrentCreator::build_info_dict() const {
+  std::string pieces(reinterpret_cast<const char *>(torrent_.pieces.data()),
+                     torrent_.pieces.size() * sizeof(InfoHash));
+
+  bencode::dict info;
+  info["name"] = torrent_.name;
+  info["piece length"] = static_cast<bencode::integer>(torrent_.piece_length);
+  info["pieces"] = std::move(pieces);
+
+  if (single_file_) {
+    info["length"] = static_cast<bencode::integer>(torrent_.files[0].length);
+    return info;
+  }
+
+  bencode::list files;
+  for (const auto &file : torrent_.files) {
+    bencode::list path;
+    for (const auto &part : fs::path(file.path)) {
+      path.push_back(part.string());
+    }
+    bencode::dict entry;
+    entry["length"] = static_cast<bencode::integer>(file.length);
+    entry["path"] = std::move(path);
+    files.push_back(std::move(entry));
+  }
+  info["files"] = std::move(files);
+  return info;
+}
@@ -0,0 +1,122 @@
+#ifndef TORRENTCREATOR_H
+#define TORRENTCREATOR_H
+
+#include "Torrent/Torrent.h"
+#include <atomic>
+#include <bencode.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// Smallest piece length chosen automatically.
+const uint32_t MIN_AUTO_PIECE_LENGTH = 16 * 1024;
+
+/// Largest piece length chosen automatically.
+const uint32_t MAX_AUTO_PIECE_LENGTH = 16 * 1024 * 1024;
+
+/// Number of pieces automatic piece length selection aims for.
+const uint64_t TARGET_PIECE_COUNT = 1500;
+
+/// Amount of data the reader hands to the hashing threads at once.
+const uint64_t CREATE_CHUNK_SIZE = 8 * 1024 * 1024;
+
+/**
+ * @brief Builds .torrent files from data on disk.
+ *
+ * One thread reads the files sequentially in large chunks while a pool of
+ * threads hashes the chunks already read, so reading and hashing overlap.
+ * A fixed number of chunk buffers is recycled between them, bounding memory
+ * use regardless of the size of the data.
+ */
+class TorrentCreator {
+public:
+  /**
+   * @brief Collects the files to include in the torrent.
+   *
+   * A directory becomes a multi-file torrent with every regular file below
+   * it, in path order; a single file becomes a single-file torrent.
+   *
+   * @param path The file or directory to create a torrent from.
+   * @param tracker_url The announce URL to embed.
+   * @throws std::runtime_error if @p path does not exist or holds no data.
+   */
+  TorrentCreator(const std::string &path, const std::string &tracker_url);
+
+  /**
+   * @brief Overrides the automatically chosen piece length.
+   *
+   * @param piece_length The piece length, a power of two of at least 16 KiB.
+   * @throws std::invalid_argument if the piece length is not valid.
+   */
+  void set_piece_length(uint32_t piece_length);
+
+  /**
+   * @brief Hashes all data and builds the torrent.
+   *
+   * @param threads Number of hashing threads, 0 for one per core.
+   * @return The bencoded .torrent file.
+   * @throws std::runtime_error if the data cannot be read.
+   */
+  std::string create(unsigned threads = 0);
+
+  /**
+   * @brief Writes the torrent built by create() to a file.
+   *
+   * @param torrent_file The path of the .torrent file.
+   * @return true if the file was written successfully.
+   */
+  bool save(const std::string &torrent_file) const;
+
+  /**
+   * @brief Gets the torrent being built.
+   *
+   * File paths are relative to the torrent, as TorrentParser reports them.
+   * Piece hashes and the info hash are filled in by create().
+   *
+   * @return The torrent metadata.
+   */
+  const Torrent &torrent() const { return torrent_; }
+
+  /**
+   * @brief Gets the number of bytes hashed so far by create().
+   *
+   * @return The number of hashed bytes.
+   */
+  uint64_t bytes_hashed() const {
+    return bytes_hashed_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Picks a piece length for a torrent of the given size.
+   *
+   * Aims for about TARGET_PIECE_COUNT pieces, using a power of two between
+   * MIN_AUTO_PIECE_LENGTH and MAX_AUTO_PIECE_LENGTH.
+   *
+   * @param total_size The total size of the data in bytes.
+   * @return The piece length in bytes.
+   */
+  static uint32_t choose_piece_length(uint64_t total_size);
+
+private:
+  /**
+   * @brief Hashes every piece and stores the result in torrent_.pieces.
+   *
+   * @param threads Number of hashing threads.
+   */
+  void hash_pieces(unsigned threads);
+
+  /**
+   * @brief Builds the info dictionary from the files and piece hashes.
+   *
+   * @return The info dictionary.
+   */
+  bencode::dict build_info_dict() const;
+
+  Torrent torrent_;                       ///< The torrent being built.
+  std::vector<std::string> source_paths_; ///< On-disk path of every file.
+  std::string content_;                   ///< Result of the last create().
+  bool single_file_ = false;              ///< Created from a single file.
+  std::atomic<uint64_t> bytes_hashed_{0}; ///< Progress of create().
+};
+
+#endif // TORRENTCREATOR_H
@@ -1,128 +1,192 @@
 #include "TorrentParser.h"
 #include "Logger/Logger.h"
+#include "Utils/utils.h"
 #include <cstdint>
-#include <fstream>
+#include <fcntl.h>
 #include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+/**
+ * @brief Read-only memory mapping of a whole file.
+ */
+class MappedFile {
+public:
+  explicit MappedFile(const std::string &filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+      throw std::runtime_error("Failed to open torrent file.");
+    }
 
-std::array<std::byte, 20> compute_sha1(const std::string &data) {
-  unsigned char hash[SHA_DIGEST_LENGTH]; // SHA_DIGEST_LENGTH is 20
-  SHA1(reinterpret_cast<const unsigned char *>(data.c_str()), data.size(),
-       hash);
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) == 0 && statbuf.st_size > 0) {
+      size_ = static_cast<size_t>(statbuf.st_size);
+      void *data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      data_ = data == MAP_FAILED ? nullptr : static_cast<const char *>(data);
+    }
+    close(fd);
 
-  std::array<std::byte, 20> result;
-  std::transform(std::begin(hash), std::end(hash), result.begin(),
-                 [](unsigned char c) -> std::byte { return std::byte{c}; });
-  return result;
-}
+    if (data_ == nullptr) {
+      throw std::runtime_error("Failed to open torrent file.");
+    }
+  }
 
-std::string
-TorrentParser::read_torrent_file(const std::string &filename) const {
-  std::ifstream file(filename, std::ios::binary);
-  if (!file.is_open()) {
-    throw std::runtime_error("Failed to open torrent file.");
+  ~MappedFile() { munmap(const_cast<char *>(data_), size_); }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  std::string_view content() const { return {data_, size_}; }
+
+private:
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+};
+
+} // namespace
+
+bencode::dict_view
+TorrentParser::decode_content(std::string_view content,
+                              std::string_view &info_span) const {
+  const char *begin = content.data();
+  const char *end = begin + content.size();
+  if (begin == end || *begin != 'd') {
+    throw std::runtime_error("Torrent file is not a bencoded dictionary.");
+  }
+
+  // Walk the top-level dictionary by hand to learn where 'info' starts and
+  // ends, since the decoded value does not remember its position
+  bencode::dict_view dict;
+  ++begin;
+  while (true) {
+    if (begin == end) {
+      throw std::runtime_error("Torrent file is truncated.");
+    }
+    if (*begin == 'e') {
+      break;
+    }
+
+    auto key = std::get<bencode::string_view>(
+        bencode::decode_view_some(begin, end));
+    const char *value_begin = begin;
+    auto value = bencode::decode_view_some(begin, end);
+    if (key == "info") {
+      info_span = std::string_view(value_begin, begin - value_begin);
+    }
+    dict.emplace(key, std::move(value));
   }
-  return {std::istreambuf_iterator<char>(file),
-          std::istreambuf_iterator<char>()};
-}
 
-bencode::dict TorrentParser::decode_content(const std::string &content) const {
-  return std::get<bencode::dict>(bencode::decode(content));
+  return dict;
 }
 
 std::string
-TorrentParser::extract_tracker_url(const bencode::dict &dict) const {
+TorrentParser::extract_tracker_url(const bencode::dict_view &dict) const {
   if (dict.find("announce") == dict.end()) {
     throw std::runtime_error("Torrent file does not contain announce URL.");
   }
-  return std::get<std::string>(dict.at("announce"));
+  return std::string(std::get<bencode::string_view>(dict.at("announce")));
 }
 
-bencode::dict
-TorrentParser::extract_info_dict(const bencode::dict &dict) const {
+std::vector<std::vector<std::string>>
+TorrentParser::extract_tracker_tiers(const bencode::dict_view &dict) const {
+  std::vector<std::vector<std::string>> tiers;
+  auto announce_list = dict.find("announce-list");
+  if (announce_list != dict.end()) {
+    for (const auto &tier :
+         std::get<bencode::list_view>(announce_list->second)) {
+      std::vector<std::string> urls;
+      for (const auto &url : std::get<bencode::list_view>(tier)) {
+        urls.emplace_back(std::get<bencode::string_view>(url));
+      }
+      if (!urls.empty()) {
+        tiers.push_back(std::move(urls));
+      }
+    }
+  }
+
+  // Without a usable announce-list the announce URL is the only tracker
+  if (tiers.empty()) {
+    tiers.push_back({extract_tracker_url(dict)});
+  }
+  return tiers;
+}
+
+const bencode::dict_view &
+TorrentParser::extract_info_dict(const bencode::dict_view &dict) const {
   if (dict.find("info") == dict.end()) {
     throw std::runtime_error("Torrent file does not contain info dictionary.");
   }
-  return std::get<bencode::dict>(dict.at("info"));
+  return std::get<bencode::dict_view>(dict.at("info"));
 }
 
-InfoHash
-TorrentParser::compute_info_hash(const bencode::dict &info_dict) const {
-  auto info_bencoded = bencode::encode(info_dict);
-  return compute_sha1(info_bencoded);
+InfoHash TorrentParser::compute_info_hash(std::string_view info_span) const {
+  return sha1_digest(reinterpret_cast<const std::byte *>(info_span.data()),
+                     info_span.size());
 }
 
-void TorrentParser::extract_file_info(Torrent &torrent,
-                                      const bencode::dict &info_dict) const {
+void TorrentParser::extract_file_info(
+    Torrent &torrent, const bencode::dict_view &info_dict) const {
   if (info_dict.find("files") != info_dict.end()) { // Multi-file torrent
-    const auto &files = std::get<bencode::list>(info_dict.at("files"));
-
-    // Starting offset for file start
-    uint64_t current_offset = 0;
+    const auto &files = std::get<bencode::list_view>(info_dict.at("files"));
 
     for (const auto &file_entry : files) {
-      const auto &file_dict = std::get<bencode::dict>(file_entry);
-      FileInfo file_info;
+      const auto &file_dict = std::get<bencode::dict_view>(file_entry);
+      FileInfo file_info{};
       file_info.length =
-          (uint64_t)std::get<bencode::integer>(file_dict.at("length"));
+          (uint64_t)std::get<bencode::integer_view>(file_dict.at("length"));
 
       // Construct the path from the path list
-      const auto &path_list = std::get<bencode::list>(file_dict.at("path"));
+      const auto &path_list =
+          std::get<bencode::list_view>(file_dict.at("path"));
       for (const auto &path_part : path_list) {
         if (!file_info.path.empty()) {
           file_info.path += "/";
         }
-        file_info.path += std::get<std::string>(path_part);
+        file_info.path += std::get<bencode::string_view>(path_part);
       }
 
-      // Calculate start and end offsets based on the current cumulative offset
-      file_info.start_offset = current_offset;
-      file_info.end_offset = current_offset + file_info.length - 1;
-
-      // Update the current offset for the next file
-      current_offset += file_info.length;
-
       torrent.files.push_back(std::move(file_info));
     }
 
   } else { // Single-file torrent
     uint64_t length =
-        (uint64_t)std::get<bencode::integer>(info_dict.at("length"));
-    torrent.files.emplace_back(FileInfo{
-        std::get<std::string>(info_dict.at("name")), // File name
-        length,                                      // File length
-        0,                                           // Start offset
-        length                                       // End offset
-    });
+        (uint64_t)std::get<bencode::integer_view>(info_dict.at("length"));
+    torrent.files.push_back(FileInfo{
+        std::string(std::get<bencode::string_view>(info_dict.at("name"))),
+        length, 0, 0});
   }
+
+  // Offsets follow from the lengths, the same way for both layouts
+  assign_file_offsets(torrent.files);
 }
 
 void TorrentParser::extract_pieces(Torrent &torrent,
-                                   const bencode::dict &info_dict) const {
-  torrent.piece_length = static_cast<uint32_t>(std::get<bencode::integer>(
+                                   const bencode::dict_view &info_dict) const {
+  torrent.piece_length = static_cast<uint32_t>(std::get<bencode::integer_view>(
       info_dict.at("piece length"))); // Assuming piece length is stored as int
 
-  const auto &pieces_string = std::get<std::string>(info_dict.at("pieces"));
-  for (size_t i = 0; i < pieces_string.size(); i += 20) {
-    InfoHash piece_hash;
-
-    std::transform(pieces_string.begin() + i, pieces_string.begin() + i + 20,
-                   piece_hash.begin(), [](char c) {
-                     return std::byte{static_cast<unsigned char>(c)};
-                   });
-
-    torrent.pieces.push_back(piece_hash);
-  }
+  // One copy out of the mapping, shared by every subsystem from here on
+  torrent.pieces =
+      PieceHashes(std::get<bencode::string_view>(info_dict.at("pieces")));
 }
 
 Torrent TorrentParser::parse_torrent_file(const std::string &filename) const {
-  std::string content = read_torrent_file(filename);
-  auto dict = decode_content(content);
+  MappedFile file(filename);
+  return parse_torrent(file.content());
+}
+
+Torrent TorrentParser::parse_torrent(std::string_view content) const {
+  std::string_view info_span;
+  auto dict = decode_content(content, info_span);
 
   Torrent torrent;
-  torrent.tracker_url = extract_tracker_url(dict);
-  auto info_dict = extract_info_dict(dict);
-  torrent.info_hash = compute_info_hash(info_dict);
-  torrent.info = info_dict;
+  torrent.tracker_tiers = extract_tracker_tiers(dict);
+  torrent.tracker_url = torrent.tracker_tiers.front().front();
+  const auto &info_dict = extract_info_dict(dict);
+  torrent.info_hash = compute_info_hash(info_span);
 
   extract_file_info(torrent, info_dict);
   extract_pieces(torrent, info_dict);
@@ -3,8 +3,9 @@
 
 #include "Torrent/Torrent.h"
 #include <bencode.hpp>
-#include <openssl/sha.h>
 #include <string>
+#include <string_view>
+#include <vector>
 
 /**
  * @brief Provides functionality to parse torrent files.
@@ -16,28 +17,37 @@
 class TorrentParser {
 private:
   /**
-   * @brief Reads the entire content of a torrent file into a string.
+   * @brief Decodes the top level of a torrent without copying any data.
    *
-   * @param filename Path to the torrent file.
-   * @return std::string The content of the torrent file as a string.
+   * All strings in the result point into @p content.
+   *
+   * @param content The bencoded torrent.
+   * @param info_span Receives the raw bytes of the 'info' value.
+   * @return bencode::dict_view The metainfo dictionary.
    */
-  std::string read_torrent_file(const std::string &filename) const;
+  bencode::dict_view decode_content(std::string_view content,
+                                    std::string_view &info_span) const;
 
   /**
-   * @brief Decodes a bencoded string into a dictionary.
+   * @brief Extracts the tracker URL from the torrent's metainfo dictionary.
    *
-   * @param content The bencoded string to decode.
-   * @return bencode::dict A dictionary representing the decoded content.
+   * @param dict The metainfo dictionary.
+   * @return std::string The extracted tracker URL.
    */
-  bencode::dict decode_content(const std::string &content) const;
+  std::string extract_tracker_url(const bencode::dict_view &dict) const;
 
   /**
-   * @brief Extracts the tracker URL from the torrent's metainfo dictionary.
+   * @brief Extracts the tracker tiers from the torrent's metainfo dictionary.
+   *
+   * Uses announce-list (BEP 12) when present and falls back to a single
+   * tier holding the announce URL.
    *
    * @param dict The metainfo dictionary.
-   * @return std::string The extracted tracker URL.
+   * @return The tiers, each a non-empty list of tracker URLs.
+   * @throws std::runtime_error if the torrent names no tracker at all.
    */
-  std::string extract_tracker_url(const bencode::dict &dict) const;
+  std::vector<std::vector<std::string>>
+  extract_tracker_tiers(const bencode::dict_view &dict) const;
 
   /**
    * @brief Extracts the 'info' dictionary from the torrent's metainfo
@@ -45,19 +55,20 @@ private:
    *
    * This dictionary contains details about the files and pieces in the torrent.
    * @param dict The metainfo dictionary.
-   * @return bencode::dict The 'info' dictionary.
+   * @return bencode::dict_view The 'info' dictionary.
    */
-  bencode::dict extract_info_dict(const bencode::dict &dict) const;
+  const bencode::dict_view &
+  extract_info_dict(const bencode::dict_view &dict) const;
 
   /**
    * @brief Computes the SHA-1 hash of the bencoded 'info' dictionary.
    *
-   * This hash is used as the torrent's InfoHash to verify the integrity and
-   * identity of the torrent.
-   * @param info_dict The 'info' dictionary.
+   * The bytes are hashed exactly as they appear in the torrent file, so the
+   * hash matches even if the file does not use canonical bencoding.
+   * @param info_span The raw bytes of the 'info' value.
    * @return InfoHash The computed SHA-1 hash.
    */
-  InfoHash compute_info_hash(const bencode::dict &info_dict) const;
+  InfoHash compute_info_hash(std::string_view info_span) const;
 
   /**
    * @brief Extracts file information from the 'info' dictionary and populates
@@ -68,7 +79,7 @@ private:
    * @param info_dict The 'info' dictionary containing file details.
    */
   void extract_file_info(Torrent &torrent,
-                         const bencode::dict &info_dict) const;
+                         const bencode::dict_view &info_dict) const;
 
   /**
    * @brief Extracts the piece hashes from the 'info' dictionary and stores them
@@ -77,7 +88,8 @@ private:
    * @param torrent Reference to the Torrent object to populate.
    * @param info_dict The 'info' dictionary containing piece hashes.
    */
-  void extract_pieces(Torrent &torrent, const bencode::dict &info_dict) const;
+  void extract_pieces(Torrent &torrent,
+                      const bencode::dict_view &info_dict) const;
 
 public:
   /**
@@ -94,10 +106,21 @@ public:
    * @brief Parses a torrent file and returns a Torrent object containing all
    * relevant data.
    *
+   * The file is memory-mapped and decoded in place; only the fields kept in
+   * the Torrent are copied out of it.
+   *
    * @param filename Path to the torrent file to parse.
    * @return Torrent A Torrent object populated with data from the torrent file.
    */
   Torrent parse_torrent_file(const std::string &filename) const;
+
+  /**
+   * @brief Parses a torrent held in memory.
+   *
+   * @param content The bencoded torrent.
+   * @return Torrent A Torrent object populated with data from the torrent.
+   */
+  Torrent parse_torrent(std::string_view content) const;
 };
 
 #endif // TORRENTPARSER_H
@@ -1,12 +1,13 @@
 #include "TrackerClient.h"
+#include "UdpTrackerClient/UdpTrackerClient.h"
+#include <algorithm>
+#include <bencode.hpp>
+#include <cstdint>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
 #include <random>
-
-size_t WriteCallback(char *contents, size_t size, size_t nmemb, void *userp) {
-  ((std::string *)userp)->append((char *)contents, size * nmemb);
-  return size * nmemb;
-}
+#include <set>
 
 std::array<std::byte, 20> stringToByteArray(const std::string &str) {
   if (str.size() != 20) {
@@ -84,23 +85,41 @@ std::string arrayToString(const std::array<std::byte, 20> &data) {
   return ss.str();
 }
 
-TrackerClient::TrackerClient(const Torrent &torrent, const uint16_t port)
-    : torrent_(torrent), port_(port), uploaded_(0), downloaded_(0) {
+TrackerClient::TrackerClient(std::shared_ptr<const Torrent> torrent,
+                             std::shared_ptr<HttpClient> http_client,
+                             std::shared_ptr<UdpTrackerClient> udp_client,
+                             const uint16_t port)
+    : torrent_(std::move(torrent)), http_client_(std::move(http_client)),
+      udp_client_(std::move(udp_client)), port_(port), uploaded_(0),
+      downloaded_(0) {
   peer_id_ = generatePeerId();
-  left_ = torrent_.size();
+  key_ = std::random_device{}();
+  left_ = torrent_->size();
+
+  // Trackers of a tier are tried in random order (BEP 12)
+  std::mt19937 random(std::random_device{}());
+  tiers_ = torrent_->tracker_tiers;
+  if (tiers_.empty() && !torrent_->tracker_url.empty()) {
+    tiers_.push_back({torrent_->tracker_url});
+  }
+  for (auto &tier : tiers_) {
+    std::shuffle(tier.begin(), tier.end(), random);
+  }
   logger_ = Logger::instance();
   logger_->log("TrackerClient constructed with generated peer ID",
                Logger::DEBUG);
 }
 
 std::string
-TrackerClient::build_query_string(TrackerClient::Event event) const {
+TrackerClient::build_query_string(const std::string &url,
+                                  TrackerClient::Event event) const {
   std::stringstream ss;
-  ss << torrent_.tracker_url << "?"
-     << "info_hash=" << urlEncode(torrent_.info_hash)
+  // The URL may carry a query of its own, such as a passkey
+  ss << url << (url.find('?') == std::string::npos ? "?" : "&")
+     << "info_hash=" << urlEncode(torrent_->info_hash)
      << "&peer_id=" << urlEncode(peer_id_) << "&port=" << port_
      << "&uploaded=" << uploaded_ << "&downloaded=" << downloaded_
-     << "&left=" << left_;
+     << "&left=" << left_.load();
 
   switch (event) {
   case Event::Started:
@@ -125,7 +144,7 @@ TrackerClient::build_query_string(TrackerClient::Event event) const {
   return ss.str();
 }
 
-TrackerResponse parseTrackerResponse(const std::string &readBuffer) {
+TrackerResponse parse_tracker_response(const std::string &readBuffer) {
   TrackerResponse response;
   try {
     auto data = bencode::decode(readBuffer);
@@ -134,16 +153,25 @@ TrackerResponse parseTrackerResponse(const std::string &readBuffer) {
 
     // Check for failure reason
     if (dict.find("failure reason") != dict.end()) {
-      std::cout << "Tracker connection failed" << std::endl;
       response.failure_reason = std::get<std::string>(dict["failure reason"]);
-      std::cout << "Failure reason: " << response.failure_reason << std::endl;
       return response;
     }
 
+    // Swarm size, if the tracker reports it
+    if (dict.find("complete") != dict.end()) {
+      response.seeders = static_cast<uint32_t>(
+          std::get<bencode::integer>(dict["complete"]));
+    }
+    if (dict.find("incomplete") != dict.end()) {
+      response.leechers = static_cast<uint32_t>(
+          std::get<bencode::integer>(dict["incomplete"]));
+    }
+
     // Parse interval
     if (dict.find("interval") != dict.end()) {
-      response.interval =
-          static_cast<uint16_t>(std::get<bencode::integer>(dict["interval"]));
+      auto interval = std::get<bencode::integer>(dict["interval"]);
+      response.interval = static_cast<uint32_t>(std::max<bencode::integer>(
+          0, std::min<bencode::integer>(interval, UINT32_MAX)));
     }
 
     // Parse peers
@@ -151,28 +179,28 @@ TrackerResponse parseTrackerResponse(const std::string &readBuffer) {
       auto peersVariant = dict["peers"];
       if (peersVariant.index() ==
           1) { // Check if it is a string (compact format)
-        auto peersString = std::get<std::string>(peersVariant);
-        for (size_t i = 0; i < peersString.size(); i += 6) {
-          Peer peer;
-          struct in_addr ip_addr;
-          std::memcpy(&ip_addr, peersString.data() + i, 4);
-          peer.ip = inet_ntoa(ip_addr);
-          peer.port = ntohs(
-              *reinterpret_cast<const uint16_t *>(peersString.data() + i + 4));
-          response.peers.emplace_back(peer);
-        }
+        decode_compact_peers(std::get<std::string>(peersVariant), false,
+                             response.peers);
       } else if (peersVariant.index() == 2) { // List of dictionaries format
         auto peersList = std::get<bencode::list>(peersVariant);
         for (auto &peerDictVariant : peersList) {
           auto peerDict = std::get<bencode::dict>(peerDictVariant);
 
           Peer peer;
-          if (peerDict.find("ip") != peerDict.end()) {
-            peer.ip = std::get<std::string>(peerDict["ip"]);
-          }
           if (peerDict.find("port") != peerDict.end()) {
-            peer.port = static_cast<uint16_t>(
-                std::get<bencode::integer>(peerDict["port"]));
+            peer.endpoint.port(static_cast<uint16_t>(
+                std::get<bencode::integer>(peerDict["port"])));
+          }
+          if (peerDict.find("ip") != peerDict.end()) {
+            // Usually an address, but the peer may be named by host
+            const auto &ip = std::get<std::string>(peerDict["ip"]);
+            boost::system::error_code error;
+            auto address = boost::asio::ip::make_address(ip, error);
+            if (!error) {
+              peer.endpoint.address(address);
+            } else {
+              peer.host = ip;
+            }
           }
           if (peerDict.find("peer id") != peerDict.end()) {
             peer.id =
@@ -183,6 +211,10 @@ TrackerResponse parseTrackerResponse(const std::string &readBuffer) {
         }
       }
     }
+    if (dict.find("peers6") != dict.end()) {
+      decode_compact_peers(std::get<std::string>(dict["peers6"]), true,
+                           response.peers);
+    }
   } catch (const bencode::decode_error &e) {
     std::cerr << readBuffer << std::endl;
     throw std::runtime_error("Failed to parse tracker response");
@@ -190,30 +222,271 @@ TrackerResponse parseTrackerResponse(const std::string &readBuffer) {
   return response;
 }
 
-TrackerResponse TrackerClient::announce(TrackerClient::Event event) {
-  CURL *curl = curl_easy_init();
-  std::string readBuffer;
-  if (curl) {
-    std::string url = build_query_string(event);
-    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
-    logger_->log("Making HTTP request to tracker URL: " + url, Logger::DEBUG);
-
-    // Handle SSL if necessary
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
-    CURLcode res = curl_easy_perform(curl);
-    if (res != CURLE_OK) {
-      logger_->log("curl_easy_perform() failed: " +
-                       std::string(curl_easy_strerror(res)),
-                   Logger::ERROR);
+struct TrackerClient::Round {
+  Event event;                 ///< The event reported.
+  Callback on_peers;           ///< Receives each tracker's new peers.
+  Callback on_done;            ///< Receives the merged response.
+  std::mutex mutex;            ///< Guards the fields below.
+  size_t tier = 0;             ///< Index of the tier being announced to.
+  size_t pending = 0;          ///< Trackers of the tier yet to answer.
+  bool succeeded = false;      ///< A tracker of the tier answered.
+  TrackerResponse merged;      ///< The responses of the tier so far.
+  std::vector<std::string> failures; ///< Why each tracker failed.
+  std::set<Peer> seen;               ///< Peers already handed to on_peers.
+};
+
+void TrackerClient::announce(TrackerClient::Event event, Callback on_peers,
+                             Callback on_done) {
+  auto round = std::make_shared<Round>();
+  round->event = event;
+  round->on_peers = std::move(on_peers);
+  round->on_done = std::move(on_done);
+  announce_tier(std::move(round));
+}
+
+void TrackerClient::announce_tier(std::shared_ptr<Round> round) {
+  std::vector<std::string> urls;
+  {
+    std::lock_guard<std::mutex> lock(tiers_mutex_);
+    if (round->tier < tiers_.size()) {
+      urls = tiers_[round->tier];
+    }
+  }
+  if (urls.empty()) {
+    // Every tier failed
+    std::string reason;
+    for (const auto &failure : round->failures) {
+      reason += (reason.empty() ? "" : "; ") + failure;
+    }
+    round->merged.failure_reason =
+        reason.empty() ? "No trackers to announce to" : reason;
+    round->on_done(std::move(round->merged));
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(round->mutex);
+    round->pending = urls.size();
+  }
+  for (const auto &url : urls) {
+    announce_to(url, round->event, [this, round,
+                                    url](TrackerResponse response) {
+      TrackerResponse fresh;
+      bool tier_done;
+      {
+        std::lock_guard<std::mutex> lock(round->mutex);
+        if (response.failure_reason.empty()) {
+          round->succeeded = true;
+          TrackerResponse &merged = round->merged;
+          merged.interval = std::max(merged.interval, response.interval);
+          merged.seeders = std::max(merged.seeders, response.seeders);
+          merged.leechers = std::max(merged.leechers, response.leechers);
+          for (auto &peer : response.peers) {
+            if (round->seen.insert(peer).second) {
+              merged.peers.push_back(peer);
+              fresh.peers.push_back(std::move(peer));
+            }
+          }
+        } else {
+          round->failures.push_back(url + ": " + response.failure_reason);
+        }
+        tier_done = --round->pending == 0;
+      }
+
+      if (response.failure_reason.empty()) {
+        promote(round->tier, url);
+        if (!fresh.peers.empty()) {
+          fresh.interval = response.interval;
+          fresh.tracker = url;
+          round->on_peers(std::move(fresh));
+        }
+      }
+      if (!tier_done) {
+        return;
+      }
+      if (round->succeeded) {
+        round->on_done(std::move(round->merged));
+      } else {
+        ++round->tier;
+        announce_tier(round);
+      }
+    });
+  }
+}
+
+void TrackerClient::promote(size_t tier, const std::string &url) {
+  std::lock_guard<std::mutex> lock(tiers_mutex_);
+  if (tier >= tiers_.size()) {
+    return;
+  }
+  auto &urls = tiers_[tier];
+  auto it = std::find(urls.begin(), urls.end(), url);
+  if (it != urls.end()) {
+    std::rotate(urls.begin(), it, it + 1);
+  }
+  last_answered_ = url;
+}
+
+std::vector<std::vector<std::string>> TrackerClient::tracker_tiers() const {
+  std::lock_guard<std::mutex> lock(tiers_mutex_);
+  return tiers_;
+}
+
+std::string TrackerClient::scrape_url() const {
+  std::lock_guard<std::mutex> lock(tiers_mutex_);
+  if (!last_answered_.empty()) {
+    return last_answered_;
+  }
+  for (const auto &tier : tiers_) {
+    if (!tier.empty()) {
+      return tier.front();
     }
-    curl_easy_cleanup(curl);
-  } else {
-    logger_->log("Failed to initialize libcurl.", Logger::ERROR);
+  }
+  return "";
+}
+
+void TrackerClient::announce_to(const std::string &tracker_url,
+                                TrackerClient::Event event, Callback on_done) {
+  if (tracker_url.compare(0, 6, "udp://") == 0) {
+    announce_udp(tracker_url, event, std::move(on_done));
+    return;
   }
 
-  logger_->log("Parsing tracker response", Logger::DEBUG);
-  return parseTrackerResponse(readBuffer);
+  std::string url = build_query_string(tracker_url, event);
+  logger_->log("Making HTTP request to tracker URL: " + url, Logger::DEBUG);
+
+  http_client_->get(url, [on_done = std::move(on_done)](
+                             HttpResponse http_response) {
+    TrackerResponse response;
+    if (!http_response.error.empty()) {
+      response.failure_reason = http_response.error;
+    } else {
+      try {
+        response = parse_tracker_response(http_response.body);
+      } catch (const std::exception &e) {
+        // Error pages are rarely bencoded, the status says more
+        response.failure_reason =
+            http_response.status != 200
+                ? "HTTP status " + std::to_string(http_response.status)
+                : e.what();
+      }
+    }
+    on_done(std::move(response));
+  });
+}
+
+void decode_compact_peers(std::string_view data, bool ipv6,
+                          std::vector<Peer> &peers) {
+  const size_t address_size = ipv6 ? 16 : 4;
+  const size_t peer_size = address_size + 2;
+  const auto *bytes = reinterpret_cast<const unsigned char *>(data.data());
+  peers.reserve(peers.size() + data.size() / peer_size);
+  for (size_t i = 0; i + peer_size <= data.size(); i += peer_size) {
+    Peer peer;
+    if (ipv6) {
+      boost::asio::ip::address_v6::bytes_type address;
+      std::memcpy(address.data(), bytes + i, address_size);
+      peer.endpoint.address(boost::asio::ip::address_v6(address));
+    } else {
+      boost::asio::ip::address_v4::bytes_type address;
+      std::memcpy(address.data(), bytes + i, address_size);
+      peer.endpoint.address(boost::asio::ip::address_v4(address));
+    }
+    peer.endpoint.port(static_cast<uint16_t>(
+        (bytes[i + address_size] << 8) | bytes[i + address_size + 1]));
+    peers.push_back(std::move(peer));
+  }
+}
+
+std::string scrape_url(const std::string &announce_url) {
+  if (announce_url.compare(0, 6, "udp://") == 0) {
+    return announce_url;
+  }
+  size_t slash = announce_url.rfind('/');
+  if (slash == std::string::npos ||
+      announce_url.compare(slash + 1, 8, "announce") != 0) {
+    return "";
+  }
+  return announce_url.substr(0, slash + 1) + "scrape" +
+         announce_url.substr(slash + 9);
+}
+
+ScrapeResponse parse_scrape_response(const std::string &body,
+                                     const std::vector<InfoHash> &info_hashes) {
+  ScrapeResponse response;
+  response.stats.resize(info_hashes.size());
+  try {
+    auto data = bencode::decode(body);
+    auto dict = std::get<bencode::dict>(data);
+    if (dict.find("failure reason") != dict.end()) {
+      response.failure_reason = std::get<std::string>(dict["failure reason"]);
+      response.stats.clear();
+      return response;
+    }
+    if (dict.find("files") == dict.end()) {
+      return response;
+    }
+
+    auto files = std::get<bencode::dict>(dict["files"]);
+    for (size_t i = 0; i < info_hashes.size(); ++i) {
+      std::string key(reinterpret_cast<const char *>(info_hashes[i].data()),
+                      info_hashes[i].size());
+      auto file = files.find(key);
+      if (file == files.end()) {
+        continue;
+      }
+      auto counts = std::get<bencode::dict>(file->second);
+      auto count = [&counts](const std::string &name) -> uint32_t {
+        auto it = counts.find(name);
+        return it == counts.end()
+                   ? 0
+                   : static_cast<uint32_t>(
+                         std::get<bencode::integer>(it->second));
+      };
+      response.stats[i].seeders = count("complete");
+      response.stats[i].completed = count("downloaded");
+      response.stats[i].leechers = count("incomplete");
+    }
+  } catch (const bencode::decode_error &e) {
+    throw std::runtime_error("Failed to parse scrape response");
+  } catch (const std::bad_variant_access &e) {
+    throw std::runtime_error("Malformed scrape response");
+  }
+  return response;
+}
+
+void TrackerClient::announce_udp(const std::string &url,
+                                 TrackerClient::Event event,
+                                 Callback on_done) {
+  if (udp_client_ == nullptr) {
+    TrackerResponse response;
+    response.failure_reason = "UDP trackers are not supported";
+    on_done(std::move(response));
+    return;
+  }
+
+  UdpAnnounce announce;
+  announce.info_hash = torrent_->info_hash;
+  announce.peer_id = peer_id_;
+  announce.downloaded = downloaded_;
+  announce.left = left_;
+  announce.uploaded = uploaded_;
+  announce.key = key_;
+  announce.port = port_;
+  switch (event) {
+  case Event::Completed:
+    announce.event = 1;
+    break;
+  case Event::Started:
+    announce.event = 2;
+    break;
+  case Event::Stopped:
+    announce.event = 3;
+    break;
+  case Event::Empty:
+  default:
+    break;
+  }
+  logger_->log("Announcing to UDP tracker " + url, Logger::DEBUG);
+  udp_client_->announce(url, announce, std::move(on_done));
 }
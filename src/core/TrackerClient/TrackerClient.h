@@ -1,12 +1,30 @@
 #ifndef TRACKERCLIENT_H
 #define TRACKERCLIENT_H
 
+#include "HttpClient/HttpClient.h"
 #include "Logger/Logger.h"
 #include "PeerConnection/PeerConnection.h"
 #include "Torrent/Torrent.h"
+#include <atomic>
+#include <chrono>
 #include <cstdint>
-#include <curl/curl.h>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <vector>
+
+/// Announce interval used when the tracker does not name one.
+const std::chrono::seconds DEFAULT_ANNOUNCE_INTERVAL(1800);
+
+/// Shortest announce interval honored, however often the tracker asks.
+const std::chrono::seconds MIN_ANNOUNCE_INTERVAL(60);
+
+/// Delay before retrying a failed announce, doubled after each failure.
+const std::chrono::seconds ANNOUNCE_RETRY_DELAY(15);
+
+class UdpTrackerClient;
 
 /**
  * @brief Generates a unique peer ID for use in peer-to-peer connections.
@@ -27,19 +45,107 @@ struct TrackerResponse {
   std::string failure_reason;
 
   /// @brief The number of seconds the client should wait before making a
-  /// rerequest.
-  uint16_t interval;
+  /// rerequest, 0 if the tracker did not say.
+  uint32_t interval = 0;
+
+  /// @brief Peers with the complete torrent, 0 if not reported.
+  uint32_t seeders = 0;
+
+  /// @brief Peers still downloading, 0 if not reported.
+  uint32_t leechers = 0;
 
   /// @brief List of peers returned by the tracker.
   std::vector<Peer> peers;
+
+  /// @brief Announce URL of the tracker that returned the peers, set on the
+  /// responses passed to TrackerClient::announce()'s on_peers.
+  std::string tracker;
+};
+
+/**
+ * @brief Swarm statistics of one torrent as reported by a scrape.
+ */
+struct ScrapeStats {
+  uint32_t seeders = 0;   ///< Peers with the complete torrent.
+  uint32_t completed = 0; ///< Times the torrent has been downloaded.
+  uint32_t leechers = 0;  ///< Peers still downloading.
+};
+
+/**
+ * @brief Response to a scrape request.
+ */
+struct ScrapeResponse {
+  std::string failure_reason;     ///< Why the scrape failed, empty if not.
+  std::vector<ScrapeStats> stats; ///< One entry per requested info hash.
 };
 
 /**
- * @brief Handles communication with the tracker for a torrent session.
+ * @brief Parses the bencoded body of an announce response.
+ *
+ * @param body The response body.
+ * @return TrackerResponse The parsed response.
+ * @throws std::runtime_error if the body is not a valid response.
+ */
+TrackerResponse parse_tracker_response(const std::string &body);
+
+/**
+ * @brief Decodes a compact peer list (BEP 23, BEP 7).
+ *
+ * Each IPv4 peer takes 6 bytes and each IPv6 peer 18: the address followed
+ * by the port, both in network byte order. Trailing bytes that do not make
+ * up a whole peer are ignored.
+ *
+ * @param data The packed peers.
+ * @param ipv6 Whether the list holds IPv6 peers, as in "peers6".
+ * @param peers Receives the decoded peers.
+ */
+void decode_compact_peers(std::string_view data, bool ipv6,
+                          std::vector<Peer> &peers);
+
+/**
+ * @brief Percent-encodes a 20-byte value for use in a tracker URL.
+ *
+ * @param data The info hash or peer ID.
+ * @return std::string The encoded value.
+ */
+std::string urlEncode(const std::array<std::byte, 20> &data);
+
+/**
+ * @brief Derives a tracker's scrape URL from its announce URL.
+ *
+ * HTTP trackers that support scraping serve it where the last path
+ * component "announce" is replaced by "scrape" (BEP 48). UDP trackers
+ * scrape on the announce URL itself.
+ *
+ * @param announce_url The announce URL.
+ * @return std::string The scrape URL, empty if the tracker cannot scrape.
+ */
+std::string scrape_url(const std::string &announce_url);
+
+/**
+ * @brief Parses the bencoded body of an HTTP scrape response.
+ *
+ * @param body The response body.
+ * @param info_hashes The torrents asked for; those missing from the response
+ * are reported with all counts 0.
+ * @return ScrapeResponse One entry per info hash, in the same order.
+ * @throws std::runtime_error if the body is not a valid response.
+ */
+ScrapeResponse parse_scrape_response(const std::string &body,
+                                     const std::vector<InfoHash> &info_hashes);
+
+/**
+ * @brief Handles communication with the trackers of a torrent session.
+ *
+ * This class provides functionality to send announce requests to the
+ * trackers and handle the responses. It manages the state of the torrent
+ * session, including tracking downloaded and uploaded amounts.
  *
- * This class provides functionality to send announce requests to the tracker
- * and handle the responses. It manages the state of the torrent session,
- * including tracking downloaded and uploaded amounts.
+ * Trackers are grouped in tiers (BEP 12), each shuffled once. An announce
+ * goes to every tracker of the first tier in parallel and moves on to the
+ * next tier only if all of them fail; a tracker that answers moves to the
+ * front of its tier. Announces finish asynchronously, so the client must
+ * outlive them.
  */
 class TrackerClient {
 public:
@@ -57,15 +163,53 @@ public:
   };
 
   /**
-   * @brief Sends an announce request to the tracker to update the current
+   * @brief Callback receiving a tracker response.
+   *
+   * Runs on the strand of the HTTP or UDP client that performed the
+   * request. Transfer and parse errors are reported through
+   * TrackerResponse::failure_reason.
+   */
+  using Callback = std::function<void(TrackerResponse)>;
+
+  /**
+   * @brief Sends an announce request to the trackers to update the current
    * status of the torrent session.
    *
-   * @param event The type of event to report to the tracker; defaults to
-   * Event::Empty.
-   * @return TrackerResponse The response from the tracker.
+   * Returns immediately; the requests run on the HTTP and UDP clients.
+   *
+   * @param event The type of event to report to the trackers.
+   * @param on_peers Receives the peers of each tracker as soon as it
+   * answers, leaving out peers an earlier tracker already returned. May run
+   * concurrently with itself.
+   * @param on_done Runs once all trackers of the tier have answered, with
+   * the peers of all of them, the longest interval and the largest swarm.
+   * Its failure reason is set only if every tracker failed.
+   */
+  void announce(Event event, Callback on_peers, Callback on_done);
+
+  /**
+   * @brief Sends an announce request to a single tracker.
+   *
+   * @param url The tracker's announce URL, http(s):// or udp://.
+   * @param event The type of event to report to the tracker.
+   * @param on_done Receives the response from the tracker.
+   */
+  void announce_to(const std::string &url, Event event, Callback on_done);
+
+  /**
+   * @brief Gets the trackers in the order they are tried.
+   *
+   * @return The tiers, most preferred tracker first in each.
    */
+  std::vector<std::vector<std::string>> tracker_tiers() const;
 
-  TrackerResponse announce(Event event = Event::Empty);
+  /**
+   * @brief Gets the tracker to scrape for this torrent.
+   *
+   * @return The tracker that last answered an announce, else the most
+   * preferred one of the first tier; empty if there are no trackers.
+   */
+  std::string scrape_url() const;
 
   /**
    * @brief Retrieves the peer ID used by this client.
@@ -74,27 +218,48 @@ public:
    */
   Peer::Id peer_id() const { return peer_id_; }
 
+  /**
+   * @brief Updates the number of bytes reported as still to download.
+   *
+   * @param left The remaining bytes, 0 when seeding.
+   */
+  void set_left(uint64_t left) { left_ = left; }
+
   /**
    * @brief Retrieves the info hash of the torrent.
    *
    * @return InfoHash The info hash of the torrent.
    */
-  InfoHash info_hash() const { return torrent_.info_hash; }
+  InfoHash info_hash() const { return torrent_->info_hash; }
 
   /**
    * @brief Constructs a new Tracker Client object.
    *
    * @param torrent The torrent associated with this client.
+   * @param http_client Announces to http:// and https:// trackers.
+   * @param udp_client Announces to udp:// trackers, null if unsupported.
    * @param port The port number this peer listens on; defaults to 6881.
    */
-  TrackerClient(const Torrent &torrent, const uint16_t port = 6881);
+  TrackerClient(std::shared_ptr<const Torrent> torrent,
+                std::shared_ptr<HttpClient> http_client,
+                std::shared_ptr<UdpTrackerClient> udp_client,
+                const uint16_t port = 6881);
 
   /// @brief Default destructor.
   ~TrackerClient() = default;
 
 private:
   /// @brief The torrent associated with this tracker client.
-  Torrent torrent_;
+  std::shared_ptr<const Torrent> torrent_;
+
+  /// @brief Performs HTTP announces, shared with other torrents.
+  std::shared_ptr<HttpClient> http_client_;
+
+  /// @brief Performs UDP announces, shared with other torrents.
+  std::shared_ptr<UdpTrackerClient> udp_client_;
+
+  /// @brief Identifies this client to UDP trackers across address changes.
+  uint32_t key_;
 
   /// @brief This downloader's peer ID, randomly generated at the start of a new
   /// download.
@@ -110,7 +275,16 @@ private:
   uint64_t downloaded_;
 
   /// @brief Number of bytes this peer still needs to download.
-  uint64_t left_;
+  std::atomic<uint64_t> left_;
+
+  /// @brief Guards tiers_, which responses reorder on the clients' strands.
+  mutable std::mutex tiers_mutex_;
+
+  /// @brief The trackers by tier, each tier shuffled, successful ones first.
+  std::vector<std::vector<std::string>> tiers_;
+
+  /// @brief The tracker that last answered an announce, empty if none has.
+  std::string last_answered_;
 
   Logger *logger_;
 
@@ -118,10 +292,40 @@ private:
    * @brief Builds the query string for announce requests based on the event
    * type.
    *
+   * @param url The tracker's announce URL.
    * @param event The event type to report in the query string.
    * @return std::string The constructed query string.
    */
-  std::string build_query_string(Event event) const;
+  std::string build_query_string(const std::string &url, Event event) const;
+
+  /**
+   * @brief Announces to a udp:// tracker.
+   *
+   * @param url The tracker's announce URL.
+   * @param event The event type to report.
+   * @param on_done Receives the response from the tracker.
+   */
+  void announce_udp(const std::string &url, Event event, Callback on_done);
+
+  /**
+   * @brief An announce to the trackers of one tier at a time.
+   */
+  struct Round;
+
+  /**
+   * @brief Announces to every tracker of the round's current tier.
+   *
+   * @param round The announce in progress.
+   */
+  void announce_tier(std::shared_ptr<Round> round);
+
+  /**
+   * @brief Moves a tracker that answered to the front of its tier.
+   *
+   * @param tier Index of the tier.
+   * @param url The tracker.
+   */
+  void promote(size_t tier, const std::string &url);
 };
 
 #endif // TRACKERCLIENT_H
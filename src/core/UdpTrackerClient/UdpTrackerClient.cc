@@ -0,0 +1,423 @@
+#include "UdpTrackerClient.h"
+#include "Utils/utils.h"
+#include <algorithm>
+
+namespace {
+
+/// Magic constant identifying the protocol in connect requests.
+const uint64_t PROTOCOL_ID = 0x41727101980;
+
+const uint32_t ACTION_CONNECT = 0;
+const uint32_t ACTION_ANNOUNCE = 1;
+const uint32_t ACTION_SCRAPE = 2;
+const uint32_t ACTION_ERROR = 3;
+
+/// Largest payload a UDP datagram can carry.
+const size_t MAX_DATAGRAM_SIZE = 65507;
+
+void append_uint(std::vector<std::byte> &packet, uint64_t value,
+                 size_t size) {
+  for (size_t i = size; i-- > 0;) {
+    packet.push_back(static_cast<std::byte>((value >> (8 * i)) & 0xff));
+  }
+}
+
+uint64_t bytes_to_uint64(const std::vector<std::byte> &bytes, size_t offset) {
+  return (uint64_t{bytes_to_uint32(bytes, offset)} << 32) |
+         bytes_to_uint32(bytes, offset + 4);
+}
+
+/**
+ * @brief Splits udp://host:port/path into host and port.
+ *
+ * @return false if the URL is not a udp:// URL with a port.
+ */
+bool split_url(const std::string &url, std::string &host, std::string &port) {
+  const std::string scheme = "udp://";
+  if (url.compare(0, scheme.size(), scheme) != 0) {
+    return false;
+  }
+  std::string authority =
+      url.substr(scheme.size(), url.find('/', scheme.size()) - scheme.size());
+  size_t colon = authority.rfind(':');
+  if (colon == std::string::npos || colon + 1 == authority.size()) {
+    return false;
+  }
+  host = authority.substr(0, colon);
+  port = authority.substr(colon + 1);
+  if (host.size() > 2 && host.front() == '[' && host.back() == ']') {
+    host = host.substr(1, host.size() - 2);
+  }
+  return !host.empty();
+}
+
+} // namespace
+
+UdpTrackerClient::UdpTrackerClient(boost::asio::io_context &io_context,
+                                   std::chrono::milliseconds timeout,
+                                   unsigned retries)
+    : strand_(io_context.get_executor()),
+      socket_(strand_, udp::endpoint(udp::v4(), 0)), resolver_(strand_),
+      base_timeout_(timeout), retries_(retries),
+      random_(std::random_device{}()), receive_buffer_(MAX_DATAGRAM_SIZE) {}
+
+void UdpTrackerClient::announce(const std::string &url,
+                                const UdpAnnounce &announce,
+                                AnnounceCallback on_done) {
+  std::vector<std::byte> body(announce.info_hash.begin(),
+                              announce.info_hash.end());
+  body.insert(body.end(), announce.peer_id.begin(), announce.peer_id.end());
+  append_uint(body, announce.downloaded, 8);
+  append_uint(body, announce.left, 8);
+  append_uint(body, announce.uploaded, 8);
+  append_uint(body, announce.event, 4);
+  append_uint(body, 0, 4); // Let the tracker use the sender's address
+  append_uint(body, announce.key, 4);
+  append_uint(body, static_cast<uint32_t>(announce.num_want), 4);
+  append_uint(body, announce.port, 2);
+
+  submit(url, ACTION_ANNOUNCE, std::move(body),
+         [on_done = std::move(on_done)](
+             const std::string &error, const std::vector<std::byte> &payload) {
+           TrackerResponse response;
+           if (!error.empty()) {
+             response.failure_reason = error;
+           } else if (payload.size() < 12) {
+             response.failure_reason = "Truncated announce response";
+           } else {
+             response.interval = bytes_to_uint32(payload, 0);
+             response.leechers = bytes_to_uint32(payload, 4);
+             response.seeders = bytes_to_uint32(payload, 8);
+             // The socket is IPv4, so the tracker sends IPv4 peers
+             decode_compact_peers(
+                 std::string_view(
+                     reinterpret_cast<const char *>(payload.data()) + 12,
+                     payload.size() - 12),
+                 false, response.peers);
+           }
+           on_done(std::move(response));
+         });
+}
+
+void UdpTrackerClient::scrape(const std::string &url,
+                              std::vector<InfoHash> info_hashes,
+                              ScrapeCallback on_done) {
+  struct Batches {
+    ScrapeResponse response;
+    size_t remaining = 0;
+    ScrapeCallback on_done;
+  };
+  auto batches = std::make_shared<Batches>();
+  batches->response.stats.resize(info_hashes.size());
+  batches->remaining =
+      (info_hashes.size() + UDP_SCRAPE_BATCH - 1) / UDP_SCRAPE_BATCH;
+  batches->on_done = std::move(on_done);
+
+  if (info_hashes.empty()) {
+    boost::asio::post(strand_, [batches]() {
+      batches->on_done(std::move(batches->response));
+    });
+    return;
+  }
+
+  for (size_t first = 0; first < info_hashes.size();
+       first += UDP_SCRAPE_BATCH) {
+    size_t count = std::min(UDP_SCRAPE_BATCH, info_hashes.size() - first);
+    std::vector<std::byte> body;
+    for (size_t i = first; i < first + count; ++i) {
+      body.insert(body.end(), info_hashes[i].begin(), info_hashes[i].end());
+    }
+
+    submit(url, ACTION_SCRAPE, std::move(body),
+           [batches, first, count](const std::string &error,
+                                   const std::vector<std::byte> &payload) {
+             if (batches->on_done == nullptr) {
+               return; // Another batch failed already
+             }
+             std::string failure = error;
+             if (failure.empty() && payload.size() < count * 12) {
+               failure = "Truncated scrape response";
+             }
+             if (!failure.empty()) {
+               batches->response.failure_reason = failure;
+               batches->response.stats.clear();
+               std::exchange(batches->on_done, nullptr)(
+                   std::move(batches->response));
+               return;
+             }
+
+             for (size_t i = 0; i < count; ++i) {
+               ScrapeStats &stats = batches->response.stats[first + i];
+               stats.seeders = bytes_to_uint32(payload, i * 12);
+               stats.completed = bytes_to_uint32(payload, i * 12 + 4);
+               stats.leechers = bytes_to_uint32(payload, i * 12 + 8);
+             }
+             if (--batches->remaining == 0) {
+               std::exchange(batches->on_done, nullptr)(
+                   std::move(batches->response));
+             }
+           });
+  }
+}
+
+void UdpTrackerClient::close() {
+  boost::asio::post(strand_, [self = shared_from_this()]() {
+    self->closed_ = true;
+    boost::system::error_code error;
+    self->socket_.close(error);
+    self->resolver_.cancel();
+    for (auto &entry : self->trackers_) {
+      entry.second->timer.cancel();
+      entry.second->waiting.clear();
+    }
+    for (auto &entry : self->requests_) {
+      entry.second->timer.cancel();
+    }
+    self->connects_.clear();
+    self->requests_.clear();
+  });
+}
+
+void UdpTrackerClient::submit(const std::string &url, uint32_t action,
+                              std::vector<std::byte> body,
+                              ResponseHandler on_response) {
+  boost::asio::post(strand_, [self = shared_from_this(), url, action,
+                              body = std::move(body),
+                              on_response = std::move(on_response)]() mutable {
+    if (self->closed_) {
+      return;
+    }
+    if (!self->receiving_) {
+      self->receive();
+    }
+
+    auto request = std::make_shared<Request>(self->strand_);
+    request->action = action;
+    request->body = std::move(body);
+    request->on_response = std::move(on_response);
+    if (!split_url(url, request->host, request->port)) {
+      self->fail(request, "Invalid UDP tracker URL: " + url);
+      return;
+    }
+    self->resolve(std::move(request));
+  });
+}
+
+void UdpTrackerClient::resolve(std::shared_ptr<Request> request) {
+  auto cached = endpoints_.find(request->host + ":" + request->port);
+  if (cached != endpoints_.end()) {
+    request->endpoint = cached->second;
+    with_connection(std::move(request));
+    return;
+  }
+
+  resolver_.async_resolve(
+      udp::v4(), request->host, request->port,
+      [self = shared_from_this(),
+       request](const boost::system::error_code &error,
+                udp::resolver::results_type results) {
+        if (self->closed_) {
+          return;
+        }
+        if (error || results.empty()) {
+          self->fail(request, "Cannot resolve " + request->host + ": " +
+                                  error.message());
+          return;
+        }
+        request->endpoint = results.begin()->endpoint();
+        self->endpoints_[request->host + ":" + request->port] =
+            request->endpoint;
+        self->with_connection(request);
+      });
+}
+
+void UdpTrackerClient::with_connection(std::shared_ptr<Request> request) {
+  std::unique_ptr<Tracker> &tracker = trackers_[request->endpoint];
+  if (tracker == nullptr) {
+    tracker = std::make_unique<Tracker>(strand_);
+  }
+  if (!tracker->connecting &&
+      std::chrono::steady_clock::now() < tracker->expires) {
+    send_request(std::move(request));
+    return;
+  }
+
+  tracker->waiting.push_back(std::move(request));
+  if (!tracker->connecting) {
+    tracker->connecting = true;
+    tracker->attempt = 0;
+    send_connect(tracker->waiting.back()->endpoint);
+  }
+}
+
+void UdpTrackerClient::send_connect(const udp::endpoint &endpoint) {
+  Tracker &tracker = *trackers_[endpoint];
+  connects_.erase(tracker.transaction_id);
+  uint32_t transaction_id = next_transaction_id();
+  tracker.transaction_id = transaction_id;
+  connects_[transaction_id] = endpoint;
+
+  std::vector<std::byte> packet;
+  append_uint(packet, PROTOCOL_ID, 8);
+  append_uint(packet, ACTION_CONNECT, 4);
+  append_uint(packet, transaction_id, 4);
+  send(endpoint, std::move(packet));
+
+  tracker.timer.expires_after(timeout(tracker.attempt));
+  tracker.timer.async_wait([self = shared_from_this(), endpoint,
+                            transaction_id](
+                               const boost::system::error_code &error) {
+    if (error || self->closed_) {
+      return;
+    }
+    Tracker &tracker = *self->trackers_[endpoint];
+    if (!tracker.connecting || tracker.transaction_id != transaction_id) {
+      return;
+    }
+    if (++tracker.attempt <= self->retries_) {
+      self->send_connect(endpoint);
+      return;
+    }
+
+    self->connects_.erase(transaction_id);
+    tracker.connecting = false;
+    auto waiting = std::move(tracker.waiting);
+    tracker.waiting.clear();
+    for (const auto &request : waiting) {
+      self->fail(request, "UDP tracker did not respond");
+    }
+  });
+}
+
+void UdpTrackerClient::send_request(std::shared_ptr<Request> request) {
+  requests_.erase(request->transaction_id);
+  uint32_t transaction_id = next_transaction_id();
+  request->transaction_id = transaction_id;
+  requests_[transaction_id] = request;
+
+  std::vector<std::byte> packet;
+  append_uint(packet, trackers_[request->endpoint]->connection_id, 8);
+  append_uint(packet, request->action, 4);
+  append_uint(packet, transaction_id, 4);
+  packet.insert(packet.end(), request->body.begin(), request->body.end());
+  send(request->endpoint, std::move(packet));
+
+  request->timer.expires_after(timeout(request->attempt));
+  request->timer.async_wait([self = shared_from_this(), request,
+                             transaction_id](
+                                const boost::system::error_code &error) {
+    if (error || self->closed_ || request->transaction_id != transaction_id) {
+      return;
+    }
+    self->requests_.erase(transaction_id);
+    if (++request->attempt > self->retries_) {
+      self->fail(request, "UDP tracker did not respond");
+      return;
+    }
+    // The connection ID may have expired in the meantime
+    self->with_connection(request);
+  });
+}
+
+void UdpTrackerClient::fail(const std::shared_ptr<Request> &request,
+                            const std::string &error) {
+  if (!closed_) {
+    request->on_response(error, {});
+  }
+}
+
+void UdpTrackerClient::send(const udp::endpoint &endpoint,
+                            std::vector<std::byte> packet) {
+  auto buffer = std::make_shared<std::vector<std::byte>>(std::move(packet));
+  socket_.async_send_to(
+      boost::asio::buffer(*buffer), endpoint,
+      [buffer](const boost::system::error_code &, std::size_t) {});
+}
+
+void UdpTrackerClient::receive() {
+  receiving_ = true;
+  socket_.async_receive_from(
+      boost::asio::buffer(receive_buffer_), sender_,
+      [self = shared_from_this()](const boost::system::error_code &error,
+                                  std::size_t size) {
+        if (self->closed_ || error == boost::asio::error::operation_aborted) {
+          self->receiving_ = false;
+          return;
+        }
+        if (!error) {
+          self->handle_datagram(size);
+        }
+        self->receive();
+      });
+}
+
+void UdpTrackerClient::handle_datagram(size_t size) {
+  if (size < 8) {
+    return;
+  }
+  std::vector<std::byte> datagram(receive_buffer_.begin(),
+                                  receive_buffer_.begin() + size);
+  uint32_t action = bytes_to_uint32(datagram, 0);
+  uint32_t transaction_id = bytes_to_uint32(datagram, 4);
+  std::string message(reinterpret_cast<const char *>(datagram.data()) + 8,
+                      size - 8);
+
+  // Only the tracker we asked may answer
+  auto connect = connects_.find(transaction_id);
+  if (connect != connects_.end()) {
+    if (connect->second != sender_) {
+      return;
+    }
+    Tracker &tracker = *trackers_[sender_];
+    connects_.erase(connect);
+    tracker.connecting = false;
+    tracker.timer.cancel();
+    auto waiting = std::move(tracker.waiting);
+    tracker.waiting.clear();
+
+    if (action == ACTION_CONNECT && size >= 16) {
+      tracker.connection_id = bytes_to_uint64(datagram, 8);
+      tracker.expires =
+          std::chrono::steady_clock::now() + UDP_CONNECTION_ID_LIFETIME;
+      for (auto &request : waiting) {
+        send_request(std::move(request));
+      }
+    } else {
+      for (const auto &request : waiting) {
+        fail(request, action == ACTION_ERROR ? message
+                                             : "Malformed connect response");
+      }
+    }
+    return;
+  }
+
+  auto it = requests_.find(transaction_id);
+  if (it == requests_.end() || it->second->endpoint != sender_) {
+    return;
+  }
+  std::shared_ptr<Request> request = std::move(it->second);
+  requests_.erase(it);
+  request->timer.cancel();
+
+  if (action == ACTION_ERROR) {
+    fail(request, message);
+  } else if (action != request->action) {
+    fail(request, "Unexpected UDP tracker response");
+  } else {
+    request->on_response(
+        "", std::vector<std::byte>(datagram.begin() + 8, datagram.end()));
+  }
+}
+
+uint32_t UdpTrackerClient::next_transaction_id() {
+  uint32_t transaction_id;
+  do {
+    transaction_id = static_cast<uint32_t>(random_());
+  } while (connects_.count(transaction_id) != 0 ||
+           requests_.count(transaction_id) != 0);
+  return transaction_id;
+}
+
+std::chrono::milliseconds UdpTrackerClient::timeout(unsigned attempt) const {
+  return base_timeout_ * (1u << std::min(attempt, 16u));
+}
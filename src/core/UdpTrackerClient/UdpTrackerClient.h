@@ -0,0 +1,230 @@
+#ifndef UDPTRACKERCLIENT_H
+#define UDPTRACKERCLIENT_H
+
+#include "TrackerClient/TrackerClient.h"
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using boost::asio::ip::udp;
+
+/// Wait for the first response, doubled on each retransmission (BEP 15).
+const std::chrono::milliseconds UDP_TRACKER_TIMEOUT(15000);
+
+/// Retransmissions before a request fails: 15 + 30 + 60 + 120 s in total.
+const unsigned UDP_TRACKER_RETRIES = 3;
+
+/// How long a connection ID may be used after the tracker handed it out.
+const std::chrono::seconds UDP_CONNECTION_ID_LIFETIME(60);
+
+/// Most info hashes a tracker accepts in one scrape packet.
+const size_t UDP_SCRAPE_BATCH = 74;
+
+/**
+ * @brief Parameters of a UDP announce.
+ */
+struct UdpAnnounce {
+  InfoHash info_hash;      ///< The torrent announced.
+  Peer::Id peer_id;        ///< Our peer ID.
+  uint64_t downloaded = 0; ///< Bytes downloaded so far.
+  uint64_t left = 0;       ///< Bytes still missing.
+  uint64_t uploaded = 0;   ///< Bytes uploaded so far.
+  uint32_t event = 0;      ///< 0 none, 1 completed, 2 started, 3 stopped.
+  uint32_t key = 0;        ///< Identifies us across IP address changes.
+  int32_t num_want = -1;   ///< Peers wanted, -1 for the tracker's default.
+  uint16_t port = 0;       ///< Port we accept peers on.
+};
+
+/**
+ * @brief Talks to UDP trackers (BEP 15) on an IO context.
+ *
+ * One socket serves every tracker and torrent. Host names are resolved once
+ * and connection IDs are cached for their lifetime, so a re-announce is a
+ * single packet each way. Requests waiting for the same tracker share one
+ * connect exchange. Unanswered packets are retransmitted with exponential
+ * backoff. Everything runs on one strand, so the client may be shared by
+ * any number of threads.
+ *
+ * Handlers keep the client alive, so it must be owned by a std::shared_ptr.
+ */
+class UdpTrackerClient
+    : public std::enable_shared_from_this<UdpTrackerClient> {
+public:
+  /// @brief Receives an announce response; runs on the client's strand.
+  using AnnounceCallback = std::function<void(TrackerResponse)>;
+
+  /// @brief Receives a scrape response; runs on the client's strand.
+  using ScrapeCallback = std::function<void(ScrapeResponse)>;
+
+  /**
+   * @brief Opens the socket.
+   *
+   * @param io_context The IO context to run on.
+   * @param timeout Wait for the first response, doubled on each retry.
+   * @param retries Retransmissions before a request fails.
+   * @throws boost::system::system_error if the socket cannot be opened.
+   */
+  explicit UdpTrackerClient(
+      boost::asio::io_context &io_context,
+      std::chrono::milliseconds timeout = UDP_TRACKER_TIMEOUT,
+      unsigned retries = UDP_TRACKER_RETRIES);
+
+  /**
+   * @brief Announces a torrent.
+   *
+   * @param url The tracker, as udp://host:port[/path].
+   * @param announce The announce parameters.
+   * @param on_done Receives the peers, or the failure reason.
+   */
+  void announce(const std::string &url, const UdpAnnounce &announce,
+                AnnounceCallback on_done);
+
+  /**
+   * @brief Asks a tracker for the swarm statistics of many torrents.
+   *
+   * Info hashes are sent UDP_SCRAPE_BATCH to a packet.
+   *
+   * @param url The tracker, as udp://host:port[/path].
+   * @param info_hashes The torrents to scrape.
+   * @param on_done Receives the statistics in the order of @p info_hashes.
+   */
+  void scrape(const std::string &url, std::vector<InfoHash> info_hashes,
+              ScrapeCallback on_done);
+
+  /**
+   * @brief Abandons all requests and closes the socket; callbacks of
+   * requests in progress are never invoked.
+   */
+  void close();
+
+private:
+  /// @brief Receives the payload of a response, or an error.
+  using ResponseHandler =
+      std::function<void(const std::string &error,
+                         const std::vector<std::byte> &payload)>;
+
+  /**
+   * @brief An announce or scrape packet waiting for its response.
+   */
+  struct Request {
+    explicit Request(const boost::asio::any_io_executor &executor)
+        : timer(executor) {}
+
+    std::string host;                ///< Host of the tracker.
+    std::string port;                ///< Port of the tracker.
+    udp::endpoint endpoint;          ///< Address of the tracker, once known.
+    uint32_t action = 0;             ///< 1 announce, 2 scrape.
+    std::vector<std::byte> body;     ///< Packet contents after the header.
+    unsigned attempt = 0;            ///< Transmissions so far.
+    uint32_t transaction_id = 0;     ///< Of the transmission in flight.
+    boost::asio::steady_timer timer; ///< Fires the retransmission.
+    ResponseHandler on_response;     ///< Receives the response.
+  };
+
+  /**
+   * @brief What we know about one tracker.
+   */
+  struct Tracker {
+    explicit Tracker(const boost::asio::any_io_executor &executor)
+        : timer(executor) {}
+
+    uint64_t connection_id = 0;      ///< Valid until expires.
+    std::chrono::steady_clock::time_point
+        expires;                     ///< End of the connection ID's life.
+    bool connecting = false;         ///< A connect exchange is in flight.
+    uint32_t transaction_id = 0;     ///< Of the connect in flight.
+    unsigned attempt = 0;            ///< Connect transmissions so far.
+    boost::asio::steady_timer timer; ///< Fires the connect retransmission.
+    std::vector<std::shared_ptr<Request>>
+        waiting; ///< Requests waiting for a connection ID.
+  };
+
+  /**
+   * @brief Splits a udp:// URL and queues a request for it, on the strand.
+   */
+  void submit(const std::string &url, uint32_t action,
+              std::vector<std::byte> body, ResponseHandler on_response);
+
+  /**
+   * @brief Resolves the request's tracker, using the cache if possible.
+   */
+  void resolve(std::shared_ptr<Request> request);
+
+  /**
+   * @brief Sends the request once a connection ID is at hand.
+   */
+  void with_connection(std::shared_ptr<Request> request);
+
+  /**
+   * @brief Sends, or retransmits, a connect packet to a tracker.
+   */
+  void send_connect(const udp::endpoint &endpoint);
+
+  /**
+   * @brief Sends, or retransmits, a request.
+   */
+  void send_request(std::shared_ptr<Request> request);
+
+  /**
+   * @brief Fails a request, unless it is closed.
+   */
+  void fail(const std::shared_ptr<Request> &request,
+            const std::string &error);
+
+  /**
+   * @brief Sends a packet, dropping it on error; timeouts retransmit it.
+   */
+  void send(const udp::endpoint &endpoint, std::vector<std::byte> packet);
+
+  /**
+   * @brief Waits for the next datagram.
+   */
+  void receive();
+
+  /**
+   * @brief Matches a datagram to the exchange it answers.
+   *
+   * @param size Length of the datagram in receive_buffer_.
+   */
+  void handle_datagram(size_t size);
+
+  /**
+   * @brief Returns a transaction ID not in use.
+   */
+  uint32_t next_transaction_id();
+
+  /**
+   * @brief Returns the wait before retransmitting after @p attempt tries.
+   */
+  std::chrono::milliseconds timeout(unsigned attempt) const;
+
+  boost::asio::strand<boost::asio::io_context::executor_type>
+      strand_;                               ///< Serializes all state.
+  udp::socket socket_;                     ///< Serves every tracker.
+  udp::resolver resolver_;                 ///< Resolves tracker host names.
+  std::chrono::milliseconds base_timeout_; ///< First retransmission delay.
+  unsigned retries_;                       ///< Retransmissions allowed.
+  bool closed_ = false;                    ///< Set by close().
+  bool receiving_ = false;                 ///< A receive is pending.
+  std::mt19937 random_;                    ///< Draws transaction IDs.
+  std::vector<std::byte> receive_buffer_;  ///< Holds the datagram received.
+  udp::endpoint sender_;                   ///< Sender of that datagram.
+
+  std::unordered_map<std::string, udp::endpoint>
+      endpoints_; ///< Resolved trackers by "host:port".
+  std::map<udp::endpoint, std::unique_ptr<Tracker>>
+      trackers_; ///< Connection state by tracker address.
+  std::unordered_map<uint32_t, udp::endpoint>
+      connects_; ///< Connects in flight by transaction ID.
+  std::unordered_map<uint32_t, std::shared_ptr<Request>>
+      requests_; ///< Requests in flight by transaction ID.
+};
+
+#endif // UDPTRACKERCLIENT_H
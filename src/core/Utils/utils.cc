@@ -1,6 +1,9 @@
 #include "utils.h"
 #include <iomanip>
 #include <iostream>
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+#include <stdexcept>
 
 uint32_t bytes_to_uint32(const std::vector<std::byte> &bytes, size_t offset) {
   uint32_t value = 0;
@@ -19,3 +22,44 @@ void print_bytes(const std::vector<std::byte> &bytes) {
   }
   std::cout << std::dec << std::endl;
 }
+
+std::string to_hex(const std::byte *data, size_t length) {
+  static const char digits[] = "0123456789abcdef";
+  std::string hex;
+  hex.reserve(length * 2);
+  for (size_t i = 0; i < length; ++i) {
+    unsigned value = std::to_integer<unsigned>(data[i]);
+    hex += digits[value >> 4];
+    hex += digits[value & 0x0f];
+  }
+  return hex;
+}
+
+std::array<std::byte, 20> sha1_digest(const std::byte *data, size_t length) {
+  std::array<std::byte, 20> digest;
+  SHA1(reinterpret_cast<const unsigned char *>(data), length,
+       reinterpret_cast<unsigned char *>(digest.data()));
+  return digest;
+}
+
+Sha1::Sha1() : context_(EVP_MD_CTX_new()) {
+  if (context_ == nullptr ||
+      EVP_DigestInit_ex(context_, EVP_sha1(), nullptr) != 1) {
+    EVP_MD_CTX_free(context_);
+    throw std::runtime_error("Failed to initialise SHA-1");
+  }
+}
+
+Sha1::~Sha1() { EVP_MD_CTX_free(context_); }
+
+void Sha1::update(const std::byte *data, size_t length) {
+  EVP_DigestUpdate(context_, data, length);
+}
+
+std::array<std::byte, 20> Sha1::finish() {
+  std::array<std::byte, 20> digest;
+  EVP_DigestFinal_ex(context_, reinterpret_cast<unsigned char *>(digest.data()),
+                     nullptr);
+  EVP_DigestInit_ex(context_, EVP_sha1(), nullptr);
+  return digest;
+}
@@ -1,12 +1,49 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <array>
 #include <cstddef>
 #include <cstdint>
+#include <string>
 #include <vector>
 
 uint32_t bytes_to_uint32(const std::vector<std::byte> &bytes,
                          size_t offset = 0);
 
 void print_bytes(const std::vector<std::byte> &bytes);
+
+std::string to_hex(const std::byte *data, size_t length);
+
+std::array<std::byte, 20> sha1_digest(const std::byte *data, size_t length);
+
+struct evp_md_ctx_st; // OpenSSL's EVP_MD_CTX
+
+/**
+ * @brief Incremental SHA-1, for data that is hashed as it streams in.
+ */
+class Sha1 {
+public:
+  Sha1();
+  ~Sha1();
+  Sha1(const Sha1 &) = delete;
+  Sha1 &operator=(const Sha1 &) = delete;
+
+  /**
+   * @brief Feeds more data into the hash.
+   *
+   * @param data Pointer to the data.
+   * @param length Number of bytes at @p data.
+   */
+  void update(const std::byte *data, size_t length);
+
+  /**
+   * @brief Completes the hash and resets for the next message.
+   *
+   * @return The digest of everything passed to update().
+   */
+  std::array<std::byte, 20> finish();
+
+private:
+  struct evp_md_ctx_st *context_; ///< OpenSSL digest state.
+};
 #endif //! UTILS_H
@@ -58,6 +58,15 @@ gboolean MainWindow::on_timeout(gpointer user_data) {
   return TRUE;
 }
 
+gboolean MainWindow::on_progress(gpointer user_data) {
+  MainWindow *self = static_cast<MainWindow *>(user_data);
+  self->redraw_pending_ = false;
+  for (GtkWidget *area : self->drawing_areas_) {
+    gtk_widget_queue_draw(area);
+  }
+  return G_SOURCE_REMOVE;
+}
+
 void MainWindow::draw_callback(GtkDrawingArea *area, cairo_t *cr, int width,
                                int height, gpointer user_data) {
   MainWindow *self = static_cast<MainWindow *>(user_data);
@@ -66,12 +75,16 @@ void MainWindow::draw_callback(GtkDrawingArea *area, cairo_t *cr, int width,
 
     // Calculate the progress in percentage
     float progress =
-        1.0 - (static_cast<double>(info.pieces_needed) / info.total_pieces);
+        info.checking
+            ? static_cast<double>(info.pieces_checked) / info.total_pieces
+            : 1.0 - (static_cast<double>(info.pieces_needed) /
+                     info.total_pieces);
 
     std::stringstream ss;
     ss << "Torrent: " << info.name << "\n"
        << "Connections: " << info.connections << "\n"
-       << "Progress: " << static_cast<int>(progress * 100) << "%";
+       << (info.checking ? "Checking: " : "Progress: ")
+       << static_cast<int>(progress * 100) << "%";
 
     // Background
     cairo_set_source_rgb(cr, 0.95, 0.95, 0.95);
@@ -202,7 +215,14 @@ void MainWindow::file_open_response(GtkNativeDialog *dialog, int response_id,
 
     // Initialize TorrentClient
     MainWindow *self = static_cast<MainWindow *>(user_data);
-    self->torrent_client_ = std::make_unique<TorrentClient>(filepath);
+    self->torrent_client_ = std::make_shared<TorrentClient>(filepath);
+
+    // Redraw on completion events instead of waiting for the next tick
+    self->torrent_client_->subscribe([self](const PieceEvent &) {
+      if (!self->redraw_pending_.exchange(true)) {
+        g_idle_add(MainWindow::on_progress, self);
+      }
+    });
 
     // Create thread
     self->torrent_client_thread_ =
@@ -1,4 +1,5 @@
 #include "TorrentClient/TorrentClient.h"
+#include <atomic>
 #include <gio/gio.h>
 #include <gtk/gtk.h>
 #include <memory>
@@ -29,12 +30,13 @@ private:
   GtkApplication *app_;   /**< Pointer to the GtkApplication instance. */
   GtkWidget *window_;     /**< Pointer to the main application window widget. */
   guint update_timer_id_; /**< Timer ID for periodic updates. */
-  std::unique_ptr<TorrentClient>
-      torrent_client_; /**< Unique pointer to the TorrentClient instance. */
+  std::shared_ptr<TorrentClient>
+      torrent_client_; /**< Shared pointer to the TorrentClient instance. */
   std::thread
       torrent_client_thread_; /**< Thread for running the TorrentClient. */
   std::vector<GtkWidget *>
       drawing_areas_; /**< Vector of pointers to drawing area widgets. */
+  std::atomic<bool> redraw_pending_{false}; /**< Progress redraw queued. */
 
   /**
    * @brief Callback for GtkApplication activation.
@@ -59,6 +61,14 @@ private:
    */
   static gboolean on_timeout(gpointer user_data);
 
+  /**
+   * @brief Idle callback that redraws after a piece completion event.
+   *
+   * @param user_data User data passed to the callback.
+   * @return gboolean G_SOURCE_REMOVE, the callback runs once per event batch.
+   */
+  static gboolean on_progress(gpointer user_data);
+
   /**
    * @brief Drawing callback for the drawing area.
    *
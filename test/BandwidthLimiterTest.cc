@@ -0,0 +1,51 @@
+#include "BandwidthLimiter/BandwidthLimiter.h"
+#include <gtest/gtest.h>
+
+using namespace std::chrono;
+
+TEST(BandwidthLimiterTest, UnlimitedNeverWaits) {
+  BandwidthLimiter limiter;
+  EXPECT_EQ(limiter.reserve(1ull << 40), BandwidthLimiter::Clock::duration{});
+  EXPECT_EQ(limiter.bytes_transferred(), 1ull << 40);
+}
+
+TEST(BandwidthLimiterTest, WaitsForTheOverdraft) {
+  BandwidthLimiter limiter(1000);
+
+  // A full second of burst is available up front
+  EXPECT_EQ(limiter.reserve(1000), BandwidthLimiter::Clock::duration{});
+
+  auto delay = limiter.reserve(500);
+  EXPECT_GT(delay, milliseconds(400));
+  EXPECT_LE(delay, milliseconds(500));
+
+  // The debt carries over to the next transfer
+  EXPECT_GT(limiter.reserve(500), milliseconds(900));
+  EXPECT_EQ(limiter.bytes_transferred(), 2000u);
+}
+
+TEST(BandwidthLimiterTest, ChangingTheRateResetsTheBucket) {
+  BandwidthLimiter limiter(100);
+  EXPECT_GT(limiter.reserve(300), milliseconds(1900));
+
+  limiter.set_rate(0);
+  EXPECT_EQ(limiter.rate(), 0u);
+  EXPECT_EQ(limiter.reserve(300), BandwidthLimiter::Clock::duration{});
+
+  limiter.set_rate(1000);
+  EXPECT_EQ(limiter.reserve(1000), BandwidthLimiter::Clock::duration{});
+}
+
+TEST(BandwidthLimiterTest, ChargesTheParentToo) {
+  auto session = std::make_shared<BandwidthLimiter>(1000);
+  BandwidthLimiter torrent(0, session);
+
+  // Unlimited itself, the torrent still waits for the session's bucket
+  EXPECT_EQ(torrent.reserve(1000), BandwidthLimiter::Clock::duration{});
+  EXPECT_GT(torrent.reserve(500), milliseconds(400));
+  EXPECT_EQ(session->bytes_transferred(), 1500u);
+
+  // The tighter of the two limits wins
+  BandwidthLimiter slow(100, session);
+  EXPECT_GT(slow.reserve(300), milliseconds(1900));
+}
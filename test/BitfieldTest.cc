@@ -0,0 +1,82 @@
+#include "Bitfield/Bitfield.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+TEST(BitfieldTest, ParsesWireBytesMostSignificantBitFirst) {
+  std::vector<std::byte> wire = {std::byte{0x80}, std::byte{0x01},
+                                 std::byte{0xFF}};
+  Bitfield bitfield(wire.data(), wire.size(), 20);
+
+  EXPECT_EQ(bitfield.size(), 20);
+  EXPECT_TRUE(bitfield.test(0));
+  EXPECT_FALSE(bitfield.test(1));
+  EXPECT_TRUE(bitfield.test(15));
+  EXPECT_TRUE(bitfield.test(19));
+  EXPECT_FALSE(bitfield.test(20)); // Spare bits are cleared
+  EXPECT_EQ(bitfield.count(), 6);
+}
+
+TEST(BitfieldTest, RoundTripsThroughWireFormat) {
+  std::vector<std::byte> wire(37);
+  for (size_t i = 0; i < wire.size(); ++i) {
+    wire[i] = static_cast<std::byte>(i * 37 + 11);
+  }
+  wire.back() &= std::byte{0xF0}; // 292 bits, last nibble is padding
+
+  Bitfield bitfield(wire.data(), wire.size(), 292);
+  EXPECT_EQ(bitfield.to_bytes(), wire);
+}
+
+TEST(BitfieldTest, SetResetAndCount) {
+  Bitfield bitfield(130);
+  EXPECT_TRUE(bitfield.none());
+  bitfield.set(0);
+  bitfield.set(64);
+  bitfield.set(129);
+  bitfield.set(130); // Out of range, ignored
+  EXPECT_EQ(bitfield.count(), 3);
+  bitfield.reset(64);
+  EXPECT_EQ(bitfield.count(), 2);
+  bitfield.set_all();
+  EXPECT_TRUE(bitfield.all());
+  EXPECT_EQ(bitfield.count(), 130);
+}
+
+TEST(BitfieldTest, AndNotAcrossManyWords) {
+  const uint32_t size = 1000;
+  Bitfield peer(size);
+  Bitfield ours(size);
+  for (uint32_t i = 0; i < size; i += 3) {
+    peer.set(i);
+  }
+  for (uint32_t i = 0; i < size; i += 2) {
+    ours.set(i);
+  }
+
+  uint32_t expected = 0;
+  for (uint32_t i = 0; i < size; ++i) {
+    if (i % 3 == 0 && i % 2 != 0) {
+      ++expected;
+    }
+  }
+
+  EXPECT_EQ(peer.count_and_not(ours), expected);
+  EXPECT_TRUE(peer.any_and_not(ours));
+
+  Bitfield wanted = peer.and_not(ours);
+  EXPECT_EQ(wanted.count(), expected);
+  EXPECT_EQ(wanted.find_next(0), 3);
+  EXPECT_EQ(wanted.find_next(4), 9);
+
+  ours.set_all();
+  EXPECT_FALSE(peer.any_and_not(ours));
+  EXPECT_EQ(peer.count_and_not(ours), 0);
+}
+
+TEST(BitfieldTest, FindNextReturnsSizeWhenExhausted) {
+  Bitfield bitfield(200);
+  EXPECT_EQ(bitfield.find_next(0), 200);
+  bitfield.set(199);
+  EXPECT_EQ(bitfield.find_next(0), 199);
+  EXPECT_EQ(bitfield.find_next(200), 200);
+}
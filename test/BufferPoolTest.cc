@@ -0,0 +1,75 @@
+#include "BufferPool/BufferPool.h"
+#include <gtest/gtest.h>
+#include <thread>
+
+TEST(BufferPoolTest, ReusesReleasedBuffersOfTheSameClass) {
+  BufferPool pool;
+  const std::byte *first = nullptr;
+  {
+    Buffer block = pool.acquire(16 * 1024);
+    EXPECT_EQ(block.size(), 16u * 1024);
+    EXPECT_GE(block.capacity(), 16u * 1024 + 13); // Fits a message header
+    first = block.data();
+  }
+
+  // A slightly smaller buffer of the same class gets the same memory
+  Buffer again = pool.acquire(16 * 1024 - 100);
+  EXPECT_EQ(again.data(), first);
+  EXPECT_EQ(pool.stats().allocations, 1u);
+  EXPECT_EQ(pool.stats().reuses, 1u);
+
+  // Twice the size is another class
+  Buffer piece = pool.acquire(32 * 1024);
+  EXPECT_NE(piece.data(), first);
+  EXPECT_EQ(pool.stats().allocations, 2u);
+}
+
+TEST(BufferPoolTest, CopiesShareTheBytesUntilTheLastIsGone) {
+  BufferPool pool;
+  Buffer copy;
+  {
+    Buffer original = pool.acquire(100);
+    original[0] = std::byte{42};
+    copy = original;
+    EXPECT_TRUE(copy.shares(original));
+  }
+  EXPECT_EQ(copy[0], std::byte{42});
+  EXPECT_GT(pool.stats().bytes_in_use, 0u);
+
+  copy = Buffer();
+  EXPECT_EQ(pool.stats().bytes_in_use, 0u);
+  EXPECT_GT(pool.stats().bytes_cached, 0u);
+}
+
+TEST(BufferPoolTest, StaysWithinItsCapacity) {
+  BufferPool pool(80 * 1024);
+  {
+    Buffer first = pool.acquire(32 * 1024);
+    Buffer second = pool.acquire(32 * 1024);
+    EXPECT_EQ(pool.stats().overflows, 0u);
+
+    // Handed out beyond the capacity, but not kept afterwards
+    Buffer third = pool.acquire(16 * 1024);
+    EXPECT_EQ(pool.stats().overflows, 1u);
+  }
+  EXPECT_EQ(pool.stats().bytes_in_use, 0u);
+  EXPECT_LE(pool.stats().bytes_cached, 80u * 1024);
+
+  // A cached buffer of another class is freed to make room
+  Buffer block = pool.acquire(16 * 1024);
+  EXPECT_EQ(pool.stats().overflows, 1u);
+  EXPECT_LE(pool.stats().bytes_in_use + pool.stats().bytes_cached,
+            80u * 1024);
+
+  pool.set_capacity(0);
+  EXPECT_EQ(pool.stats().bytes_cached, 0u);
+}
+
+TEST(BufferPoolTest, HandlesOutlivingTheirThread) {
+  BufferPool pool;
+  // Too large for any class, so freed as soon as it is released
+  Buffer buffer = pool.acquire(BUFFER_POOL_MAX_CLASS + BUFFER_HEADROOM + 1);
+  std::thread([buffer]() mutable { buffer[0] = std::byte{1}; }).join();
+  EXPECT_EQ(buffer[0], std::byte{1});
+  EXPECT_EQ(pool.stats().bytes_in_use, 0u);
+}
@@ -0,0 +1,109 @@
+#include "ConnectionScheduler/ConnectionScheduler.h"
+#include <gtest/gtest.h>
+
+namespace {
+
+using Clock = ConnectionScheduler::Clock;
+using boost::asio::ip::tcp;
+
+Peer make_peer(uint16_t port) {
+  Peer peer;
+  peer.endpoint = tcp::endpoint(boost::asio::ip::make_address("10.0.0.1"),
+                                port);
+  return peer;
+}
+
+} // namespace
+
+TEST(ConnectionSchedulerTest, LimitsAttemptsInFlight) {
+  ConnectionScheduler scheduler(2);
+  Clock::time_point now = Clock::now();
+  for (uint16_t port = 1; port <= 5; ++port) {
+    EXPECT_TRUE(scheduler.add(make_peer(port), "tracker"));
+  }
+  EXPECT_FALSE(scheduler.add(make_peer(1), "other"));
+
+  std::optional<Peer> first = scheduler.next(now);
+  std::optional<Peer> second = scheduler.next(now);
+  ASSERT_TRUE(first && second);
+  EXPECT_FALSE(scheduler.next(now));
+  EXPECT_EQ(scheduler.half_open(), 2u);
+
+  scheduler.connected(*first);
+  std::optional<Peer> third = scheduler.next(now);
+  ASSERT_TRUE(third);
+  EXPECT_NE(third->endpoint, first->endpoint);
+  EXPECT_NE(third->endpoint, second->endpoint);
+}
+
+TEST(ConnectionSchedulerTest, BacksOffAndForgetsFailingPeers) {
+  ConnectionScheduler scheduler;
+  Clock::time_point now = Clock::now();
+  Peer peer = make_peer(1);
+  scheduler.add(peer, "tracker");
+
+  Clock::duration backoff = CONNECT_RETRY_DELAY;
+  for (unsigned failure = 1; failure < MAX_CONNECT_FAILURES; ++failure) {
+    ASSERT_TRUE(scheduler.next(now));
+    scheduler.failed(peer, now);
+    EXPECT_EQ(scheduler.half_open(), 0u);
+    EXPECT_FALSE(scheduler.next(now));
+    EXPECT_EQ(scheduler.next_retry(now), now + backoff);
+    now += backoff;
+    backoff *= 2;
+  }
+
+  ASSERT_TRUE(scheduler.next(now));
+  scheduler.failed(peer, now);
+  EXPECT_FALSE(scheduler.next_retry(now));
+  EXPECT_FALSE(scheduler.has_ready(now));
+  // A tracker returning it again gives it a new chance
+  EXPECT_TRUE(scheduler.add(peer, "tracker"));
+}
+
+TEST(ConnectionSchedulerTest, PrefersSourcesThatWorked) {
+  ConnectionScheduler scheduler(1);
+  Clock::time_point now = Clock::now();
+  scheduler.add(make_peer(1), "bad");
+  scheduler.add(make_peer(2), "good");
+
+  // One failure from "bad" and one success from "good"
+  std::optional<Peer> peer = scheduler.next(now);
+  ASSERT_TRUE(peer);
+  bool first_is_bad = peer->endpoint.port() == 1;
+  if (first_is_bad) {
+    scheduler.failed(*peer, now);
+    peer = scheduler.next(now);
+    scheduler.connected(*peer);
+  } else {
+    scheduler.connected(*peer);
+    peer = scheduler.next(now);
+    scheduler.failed(*peer, now);
+  }
+
+  for (uint16_t port = 10; port < 20; ++port) {
+    scheduler.add(make_peer(port), port % 2 ? "good" : "bad");
+  }
+  for (int i = 0; i < 5; ++i) {
+    peer = scheduler.next(now);
+    ASSERT_TRUE(peer);
+    EXPECT_EQ(peer->endpoint.port() % 2, 1) << "picked a peer from bad";
+    scheduler.connected(*peer);
+  }
+}
+
+TEST(ConnectionSchedulerTest, RetriesPeersThatDisconnected) {
+  ConnectionScheduler scheduler;
+  Clock::time_point now = Clock::now();
+  Peer peer = make_peer(1);
+  scheduler.add(peer, "tracker");
+
+  ASSERT_TRUE(scheduler.next(now));
+  scheduler.connected(peer);
+  EXPECT_FALSE(scheduler.has_ready(now));
+
+  scheduler.disconnected(peer, now);
+  EXPECT_FALSE(scheduler.next(now));
+  EXPECT_EQ(scheduler.next_retry(now), now + CONNECT_RETRY_DELAY);
+  EXPECT_TRUE(scheduler.next(now + CONNECT_RETRY_DELAY));
+}
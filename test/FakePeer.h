@@ -0,0 +1,106 @@
+#ifndef FAKEPEER_H
+#define FAKEPEER_H
+
+#include "Torrent/Torrent.h"
+#include "Utils/utils.h"
+#include <boost/asio.hpp>
+#include <string>
+#include <vector>
+
+using tcp = boost::asio::ip::tcp;
+
+/**
+ * @brief Reads exactly @p length bytes from a fake peer's socket.
+ */
+inline std::vector<std::byte> read_exactly(tcp::socket &socket,
+                                           size_t length) {
+  std::vector<std::byte> buffer(length);
+  boost::asio::read(socket, boost::asio::buffer(buffer));
+  return buffer;
+}
+
+/**
+ * @brief Reads the next message, length prefix included.
+ */
+inline std::vector<std::byte> read_message(tcp::socket &socket) {
+  auto prefix = read_exactly(socket, 4);
+  auto body = read_exactly(socket, bytes_to_uint32(prefix));
+  prefix.insert(prefix.end(), body.begin(), body.end());
+  return prefix;
+}
+
+/**
+ * @brief Checks whether a message read by read_message() is a request.
+ */
+inline bool is_request(const std::vector<std::byte> &message) {
+  return message.size() == 17 && message[4] == std::byte{6};
+}
+
+/**
+ * @brief Builds the handshake a peer sends for a torrent.
+ */
+inline std::vector<std::byte> make_handshake(const InfoHash &info_hash) {
+  std::vector<std::byte> handshake{std::byte{19}};
+  for (char c : std::string("BitTorrent protocol")) {
+    handshake.push_back(static_cast<std::byte>(c));
+  }
+  handshake.resize(28);
+  handshake.insert(handshake.end(), info_hash.begin(), info_hash.end());
+  handshake.resize(68);
+  return handshake;
+}
+
+/**
+ * @brief Builds the bitfield and unchoke a seeder sends after its handshake.
+ *
+ * @param pieces The first and only byte of the bitfield.
+ */
+inline std::vector<std::byte> seeder_greeting(uint8_t pieces) {
+  std::vector<std::byte> messages;
+  for (int byte : {0, 0, 0, 2, 5, int{pieces}, 0, 0, 0, 1, 1}) {
+    messages.push_back(static_cast<std::byte>(byte));
+  }
+  return messages;
+}
+
+/**
+ * @brief Builds a piece message carrying one block.
+ */
+inline std::vector<std::byte> piece_message(uint32_t index, uint32_t begin,
+                                            const std::byte *data,
+                                            uint32_t length) {
+  std::vector<std::byte> message;
+  for (uint32_t value : {9 + length, index, begin}) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+      message.push_back(static_cast<std::byte>(value >> shift));
+    }
+  }
+  message.insert(message.begin() + 4, std::byte{7});
+  message.insert(message.end(), data, data + length);
+  return message;
+}
+
+/**
+ * @brief Waits for the next block request and answers it.
+ *
+ * @param client The fake peer's end of the connection.
+ * @param content The data of the torrent.
+ * @param piece_length The piece length of the torrent.
+ * @return The piece of the block.
+ */
+inline uint32_t answer_request(tcp::socket &client, const std::byte *content,
+                               uint32_t piece_length) {
+  std::vector<std::byte> message;
+  while (!is_request(message)) {
+    message = read_message(client);
+  }
+  uint32_t index = bytes_to_uint32(message, 5);
+  uint32_t begin = bytes_to_uint32(message, 9);
+  uint32_t length = bytes_to_uint32(message, 13);
+  auto piece = piece_message(
+      index, begin, content + uint64_t{index} * piece_length + begin, length);
+  boost::asio::write(client, boost::asio::buffer(piece));
+  return index;
+}
+
+#endif // FAKEPEER_H
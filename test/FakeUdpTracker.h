@@ -0,0 +1,117 @@
+#ifndef FAKEUDPTRACKER_H
+#define FAKEUDPTRACKER_H
+
+#include "UdpTrackerClient/UdpTrackerClient.h"
+#include "Utils/utils.h"
+#include <atomic>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Appends @p value to @p packet as @p size big-endian bytes.
+ */
+inline void append_uint(std::vector<std::byte> &packet, uint64_t value,
+                        size_t size) {
+  for (size_t i = size; i-- > 0;) {
+    packet.push_back(static_cast<std::byte>((value >> (8 * i)) & 0xff));
+  }
+}
+
+/**
+ * @brief Minimal BEP 15 tracker returning fixed peers and statistics.
+ *
+ * Drops the first @p drop packets it receives to exercise retransmission.
+ * Returns 10.0.0.1:6881 unless given other peers as (IPv4, port) pairs.
+ */
+class FakeUdpTracker {
+public:
+  explicit FakeUdpTracker(
+      int drop = 0,
+      std::vector<std::pair<uint32_t, uint16_t>> peers = {{0x0a000001, 6881}})
+      : socket_(io_context_, udp::endpoint(udp::v4(), 0)), drop_(drop),
+        peers_(std::move(peers)), buffer_(2048) {
+    receive();
+    thread_ = std::thread([this]() { io_context_.run(); });
+  }
+
+  ~FakeUdpTracker() {
+    io_context_.stop();
+    thread_.join();
+  }
+
+  std::string url() const {
+    return "udp://127.0.0.1:" +
+           std::to_string(socket_.local_endpoint().port()) + "/announce";
+  }
+
+  std::atomic<int> connects{0}; ///< Connect requests answered.
+  std::atomic<int> scrapes{0};  ///< Scrape requests answered.
+
+private:
+  void receive() {
+    socket_.async_receive_from(
+        boost::asio::buffer(buffer_), sender_,
+        [this](const boost::system::error_code &error, std::size_t size) {
+          if (error) {
+            return;
+          }
+          if (drop_ > 0) {
+            --drop_;
+          } else {
+            answer(std::vector<std::byte>(buffer_.begin(),
+                                          buffer_.begin() + size));
+          }
+          receive();
+        });
+  }
+
+  void answer(const std::vector<std::byte> &request) {
+    uint32_t action = bytes_to_uint32(request, 8);
+    uint32_t transaction_id = bytes_to_uint32(request, 12);
+    std::vector<std::byte> response;
+    append_uint(response, action, 4);
+    append_uint(response, transaction_id, 4);
+
+    if (action == 0) {
+      ++connects;
+      append_uint(response, 0x1122334455667788, 8);
+    } else if (bytes_to_uint32(request, 0) != 0x11223344) {
+      response.clear();
+      append_uint(response, 3, 4);
+      append_uint(response, transaction_id, 4);
+      for (char c : std::string("bad connection id")) {
+        response.push_back(static_cast<std::byte>(c));
+      }
+    } else if (action == 1) {
+      append_uint(response, 1200, 4); // interval
+      append_uint(response, 3, 4);    // leechers
+      append_uint(response, 7, 4);    // seeders
+      for (const auto &peer : peers_) {
+        append_uint(response, peer.first, 4);
+        append_uint(response, peer.second, 2);
+      }
+    } else if (action == 2) {
+      ++scrapes;
+      size_t count = (request.size() - 16) / 20;
+      for (size_t i = 0; i < count; ++i) {
+        // The first byte of each info hash doubles as its seeder count
+        append_uint(response, std::to_integer<uint32_t>(request[16 + i * 20]),
+                    4);
+        append_uint(response, 2, 4);
+        append_uint(response, 1, 4);
+      }
+    }
+    socket_.send_to(boost::asio::buffer(response), sender_);
+  }
+
+  boost::asio::io_context io_context_;
+  udp::socket socket_;
+  std::atomic<int> drop_;
+  std::vector<std::pair<uint32_t, uint16_t>> peers_;
+  std::vector<std::byte> buffer_;
+  udp::endpoint sender_;
+  std::thread thread_;
+};
+
+#endif // FAKEUDPTRACKER_H
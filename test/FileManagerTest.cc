@@ -63,3 +63,68 @@ TEST_F(LinuxFileManagerTest, PreAllocateSpace) {
   EXPECT_EQ(stat("file2.txt", &statbuf), 0);
   EXPECT_EQ(statbuf.st_size, 500);
 }
+
+TEST(LinuxFileManagerSkipTest, KeepsSkippedBytesInThePartFile) {
+  // Piece 2 spans both files, piece 3 lies in the second one only
+  std::vector<FileInfo> files = {{"keep.bin", 250, 0, 250},
+                                 {"skip.bin", 150, 250, 400}};
+  std::vector<InfoHash> hashes(4);
+  {
+    LinuxFileManager lfm(files, 100, hashes,
+                         {Priority::Normal, Priority::Skip}, "skip.parts");
+    struct stat statbuf;
+    EXPECT_EQ(stat("skip.bin", &statbuf), -1); // Not preallocated
+    EXPECT_EQ(lfm.piece_priorities(),
+              (std::vector<Priority>{Priority::Normal, Priority::Normal,
+                                     Priority::Normal, Priority::Skip}));
+
+    std::vector<std::byte> piece(100);
+    for (size_t i = 0; i < piece.size(); ++i) {
+      piece[i] = std::byte(i);
+    }
+    ASSERT_TRUE(lfm.write_piece(2, piece));
+    EXPECT_EQ(stat("skip.bin", &statbuf), -1);
+    EXPECT_EQ(lfm.read_block(2, 0, 100), piece);
+
+    // Wanted again, the file takes over what the part file held
+    ASSERT_TRUE(lfm.set_file_priority(1, Priority::Low));
+    ASSERT_EQ(stat("skip.bin", &statbuf), 0);
+    EXPECT_EQ(statbuf.st_size, 150);
+    EXPECT_EQ(lfm.read_block(2, 0, 100), piece);
+    remove("skip.parts");
+    EXPECT_EQ(lfm.read_block(2, 0, 100), piece);
+    EXPECT_EQ(lfm.piece_priorities()[3], Priority::Low);
+  }
+  remove("keep.bin");
+  remove("skip.bin");
+
+  // A file nothing was written to is removed again when skipped
+  std::vector<FileInfo> fresh = {{"fresh.bin", 100, 0, 100}};
+  LinuxFileManager lfm(fresh, 100, std::vector<InfoHash>(1));
+  ASSERT_TRUE(lfm.set_file_priority(0, Priority::Skip));
+  struct stat statbuf;
+  EXPECT_EQ(stat("fresh.bin", &statbuf), -1);
+  EXPECT_EQ(lfm.file_priority(0), Priority::Skip);
+  EXPECT_FALSE(lfm.set_file_priority(1, Priority::Skip));
+}
+
+TEST(LinuxFileManagerSkipTest, TakesOverPiecesInsideASkippedFile) {
+  // Piece 3 lies wholly inside the skipped file, as a piece read on demand
+  std::vector<FileInfo> files = {{"keep.bin", 250, 0, 250},
+                                 {"skip.bin", 450, 250, 700}};
+  std::vector<InfoHash> hashes(7);
+  {
+    LinuxFileManager lfm(files, 100, hashes,
+                         {Priority::Normal, Priority::Skip}, "skip.parts");
+    std::vector<std::byte> piece(100, std::byte{0x5A});
+    ASSERT_TRUE(lfm.write_piece(3, piece));
+
+    ASSERT_TRUE(lfm.set_file_priority(1, Priority::Normal));
+    remove("skip.parts");
+    EXPECT_EQ(lfm.read_block(3, 0, 100), piece);
+    EXPECT_EQ(lfm.read_block(5, 0, 100),
+              std::vector<std::byte>(100, std::byte{0}));
+  }
+  remove("keep.bin");
+  remove("skip.bin");
+}
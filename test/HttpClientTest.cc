@@ -0,0 +1,155 @@
+#include "HttpClient/HttpClient.h"
+#include <atomic>
+#include <future>
+#include <gtest/gtest.h>
+#include <thread>
+
+using boost::asio::ip::tcp;
+
+namespace {
+
+/**
+ * @brief Keep-alive HTTP server answering every request with its path.
+ */
+class EchoServer {
+public:
+  EchoServer() : acceptor_(io_context_, tcp::endpoint(tcp::v4(), 0)) {
+    accept();
+    thread_ = std::thread([this]() { io_context_.run(); });
+  }
+
+  ~EchoServer() {
+    io_context_.stop();
+    thread_.join();
+  }
+
+  std::string url(const std::string &path) const {
+    return "http://127.0.0.1:" +
+           std::to_string(acceptor_.local_endpoint().port()) + path;
+  }
+
+  int connections() const { return connections_; }
+
+private:
+  struct Connection {
+    explicit Connection(tcp::socket socket) : socket(std::move(socket)) {}
+    tcp::socket socket;
+    boost::asio::streambuf request;
+    std::string response;
+  };
+
+  void accept() {
+    acceptor_.async_accept(
+        [this](const boost::system::error_code &error, tcp::socket socket) {
+          if (error) {
+            return;
+          }
+          ++connections_;
+          serve(std::make_shared<Connection>(std::move(socket)));
+          accept();
+        });
+  }
+
+  void serve(std::shared_ptr<Connection> connection) {
+    boost::asio::async_read_until(
+        connection->socket, connection->request, "\r\n\r\n",
+        [this, connection](const boost::system::error_code &error,
+                           std::size_t length) {
+          if (error) {
+            return;
+          }
+          std::string head(
+              boost::asio::buffers_begin(connection->request.data()),
+              boost::asio::buffers_begin(connection->request.data()) + length);
+          connection->request.consume(length);
+
+          // "GET <path> HTTP/1.1"
+          std::string path = head.substr(4, head.find(' ', 4) - 4);
+          connection->response = "HTTP/1.1 200 OK\r\nContent-Length: " +
+                                 std::to_string(path.size()) + "\r\n\r\n" +
+                                 path;
+          boost::asio::async_write(
+              connection->socket, boost::asio::buffer(connection->response),
+              [this, connection](const boost::system::error_code &error,
+                                 std::size_t) {
+                if (!error) {
+                  serve(connection);
+                }
+              });
+        });
+  }
+
+  boost::asio::io_context io_context_;
+  tcp::acceptor acceptor_;
+  std::thread thread_;
+  std::atomic<int> connections_{0};
+};
+
+} // namespace
+
+class HttpClientTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    client = std::make_shared<HttpClient>(io_context);
+    thread = std::thread([this]() { io_context.run(); });
+  }
+
+  void TearDown() override {
+    client->close();
+    work_guard.reset();
+    io_context.stop();
+    thread.join();
+  }
+
+  HttpResponse get(const std::string &url) {
+    auto done = std::make_shared<std::promise<HttpResponse>>();
+    std::future<HttpResponse> response = done->get_future();
+    client->get(url, [done](HttpResponse result) {
+      done->set_value(std::move(result));
+    });
+    return response.get();
+  }
+
+  boost::asio::io_context io_context;
+  boost::asio::executor_work_guard<boost::asio::io_context::executor_type>
+      work_guard{io_context.get_executor()};
+  std::shared_ptr<HttpClient> client;
+  std::thread thread;
+};
+
+TEST_F(HttpClientTest, ReusesConnectionForSequentialRequests) {
+  EchoServer server;
+  for (int i = 0; i < 3; ++i) {
+    HttpResponse response = get(server.url("/announce?n=" + std::to_string(i)));
+    EXPECT_TRUE(response.error.empty()) << response.error;
+    EXPECT_EQ(response.status, 200);
+    EXPECT_EQ(response.body, "/announce?n=" + std::to_string(i));
+  }
+  EXPECT_EQ(server.connections(), 1);
+}
+
+TEST_F(HttpClientTest, RunsConcurrentRequests) {
+  EchoServer server;
+  const int count = 10;
+  std::vector<std::future<HttpResponse>> responses;
+  for (int i = 0; i < count; ++i) {
+    auto done = std::make_shared<std::promise<HttpResponse>>();
+    responses.push_back(done->get_future());
+    client->get(server.url("/" + std::to_string(i)),
+                [done](HttpResponse result) {
+                  done->set_value(std::move(result));
+                });
+  }
+
+  for (int i = 0; i < count; ++i) {
+    HttpResponse response = responses[i].get();
+    EXPECT_EQ(response.status, 200);
+    EXPECT_EQ(response.body, "/" + std::to_string(i));
+  }
+}
+
+TEST_F(HttpClientTest, ReportsConnectionErrors) {
+  HttpResponse response = get("http://127.0.0.1:9/announce");
+  EXPECT_FALSE(response.error.empty());
+  EXPECT_EQ(response.status, 0);
+}
@@ -0,0 +1,44 @@
+#include "MemoryBudget/MemoryBudget.h"
+#include <gtest/gtest.h>
+
+TEST(MemoryBudgetTest, GrantsMemoryUpToTheLimit) {
+  auto budget = std::make_shared<MemoryBudget>(100);
+  MemoryBudget::Reservation first = budget->reserve(60);
+  EXPECT_TRUE(first);
+  EXPECT_EQ(first.bytes(), 60u);
+  EXPECT_FALSE(budget->reserve(50));
+  EXPECT_EQ(budget->in_use(), 60u);
+
+  {
+    MemoryBudget::Reservation second = budget->reserve(40);
+    EXPECT_TRUE(second);
+    EXPECT_EQ(budget->in_use(), 100u);
+  }
+  EXPECT_EQ(budget->in_use(), 60u);
+}
+
+TEST(MemoryBudgetTest, ReservationsMoveWithTheirOwner) {
+  auto budget = std::make_shared<MemoryBudget>(100);
+  MemoryBudget::Reservation moved;
+  {
+    MemoryBudget::Reservation reservation = budget->reserve(70);
+    moved = std::move(reservation);
+  }
+  EXPECT_EQ(budget->in_use(), 70u);
+
+  // Assigning over a reservation gives back what it held
+  moved = budget->reserve(30);
+  EXPECT_EQ(budget->in_use(), 30u);
+  moved = MemoryBudget::Reservation();
+  EXPECT_EQ(budget->in_use(), 0u);
+}
+
+TEST(MemoryBudgetTest, LoweredLimitAppliesToNewReservations) {
+  auto budget = std::make_shared<MemoryBudget>(100);
+  MemoryBudget::Reservation held = budget->reserve(80);
+  budget->set_limit(50);
+  EXPECT_TRUE(held);
+  EXPECT_FALSE(budget->reserve(1));
+  held = MemoryBudget::Reservation();
+  EXPECT_TRUE(budget->reserve(50));
+}
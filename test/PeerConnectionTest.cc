@@ -0,0 +1,498 @@
+#include "FakePeer.h"
+#include "PeerConnection/PeerConnection.h"
+#include "Utils/utils.h"
+#include <atomic>
+#include <future>
+#include <gtest/gtest.h>
+#include <thread>
+
+class PeerConnectionTest : public ::testing::Test {
+protected:
+  std::vector<FileInfo> files = {{"peer_upload.bin", 300, 0, 300}};
+  uint32_t piece_length = 128;
+  InfoHash info_hash = {std::byte{0x42}};
+  std::vector<std::byte> content;
+
+  void SetUp() override {
+    content.resize(300);
+    for (size_t i = 0; i < content.size(); ++i) {
+      content[i] = static_cast<std::byte>(i);
+    }
+  }
+
+  void TearDown() override {
+    if (io_thread.joinable()) { // Failed before disconnect_peer()
+      io_context.stop();
+      io_thread.join();
+    }
+    remove("peer_upload.bin");
+  }
+
+  /**
+   * @brief Connects a fake peer to a connection, which runs on io_context
+   * in io_thread, and sends its handshake.
+   *
+   * @param connection The connection, started as an inbound one.
+   * @param after_handshake Messages the peer sends right after the
+   * handshake.
+   * @return The peer's end of the connection.
+   */
+  tcp::socket connect_peer(std::shared_ptr<PeerConnection> connection,
+                           const std::vector<std::byte> &after_handshake = {}) {
+    io_context.restart();
+    tcp::acceptor acceptor(io_context, tcp::endpoint(tcp::v4(), 0));
+    tcp::socket client(client_context);
+    client.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(),
+                                 acceptor.local_endpoint().port()));
+    acceptor.accept(connection->socket());
+    connection->start_inbound();
+    io_thread = std::thread([this]() { io_context.run(); });
+
+    std::vector<std::byte> handshake = make_handshake(info_hash);
+    handshake.insert(handshake.end(), after_handshake.begin(),
+                     after_handshake.end());
+    boost::asio::write(client, boost::asio::buffer(handshake));
+    return client;
+  }
+
+  /**
+   * @brief Connects a fake peer that has some pieces and unchokes us.
+   *
+   * @param connection The connection, started as an inbound one.
+   * @param pieces The first byte of the peer's bitfield.
+   * @return The peer's end of the connection, with our handshake read.
+   */
+  tcp::socket connect_seeder(std::shared_ptr<PeerConnection> connection,
+                             uint8_t pieces) {
+    tcp::socket client =
+        connect_peer(std::move(connection), seeder_greeting(pieces));
+    read_exactly(client, 68);
+    return client;
+  }
+
+  /**
+   * @brief Closes the fake peer and stops the connection's IO thread.
+   *
+   * @param client The peer's end of the connection.
+   */
+  void disconnect_peer(tcp::socket &client) {
+    client.close();
+    io_context.stop();
+    io_thread.join();
+  }
+
+  /**
+   * @brief Creates a connection for the pieces of files, with shortened
+   * timeouts run by a wheel with a 10 ms tick.
+   *
+   * @param piece_manager Tracks the pieces.
+   * @param picker Reserves the pieces.
+   * @param timeouts The timeouts.
+   * @return The connection.
+   */
+  std::shared_ptr<PeerConnection>
+  timed_connection(std::shared_ptr<PieceManager> piece_manager,
+                   std::shared_ptr<PiecePicker> picker,
+                   const ConnectionTimeouts &timeouts) {
+    auto file_manager = std::make_shared<LinuxFileManager>(
+        files, piece_length, std::vector<InfoHash>(3));
+    auto connection = std::make_shared<PeerConnection>(
+        io_context, info_hash, Peer::Id{}, std::move(piece_manager),
+        file_manager, std::move(picker),
+        std::make_shared<TimerWheel>(io_context.get_executor(),
+                                     std::chrono::milliseconds(10)));
+    connection->set_timeouts(timeouts);
+    return connection;
+  }
+
+  /**
+   * @brief Runs a function on the connection's IO thread and waits for it.
+   *
+   * @param function The function.
+   * @return What it returned.
+   */
+  template <typename Function> auto on_io_thread(Function function) {
+    std::promise<decltype(function())> result;
+    boost::asio::post(io_context,
+                      [&result, &function]() { result.set_value(function()); });
+    return result.get_future().get();
+  }
+
+  boost::asio::io_context io_context;
+  boost::asio::io_context client_context;
+  std::thread io_thread;
+
+  /**
+   * @brief Downloads the whole file from a fake peer whose first copy of
+   * piece 1 is corrupt.
+   */
+  void download_with_corrupt_piece(std::shared_ptr<MemoryBudget> budget) {
+    std::vector<InfoHash> hashes;
+    for (uint32_t begin = 0; begin < content.size(); begin += piece_length) {
+      uint32_t length =
+          std::min<uint32_t>(piece_length, content.size() - begin);
+      hashes.push_back(sha1_digest(content.data() + begin, length));
+    }
+    auto file_manager =
+        std::make_shared<LinuxFileManager>(files, piece_length, hashes);
+    auto piece_manager = std::make_shared<PieceManager>(300, piece_length);
+    auto picker = std::make_shared<PiecePicker>(piece_manager, budget);
+
+    auto connection = std::make_shared<PeerConnection>(
+        io_context, info_hash, Peer::Id{}, piece_manager, file_manager, picker);
+    // All three pieces
+    tcp::socket client = connect_seeder(connection, 0xE0);
+
+    // The first copy of piece 1 is corrupt, so it has to be requested again
+    std::vector<uint32_t> requested;
+    bool corrupted = false;
+    while (requested.size() < 4) {
+      auto message = read_message(client);
+      if (!is_request(message)) {
+        continue; // Interested
+      }
+      uint32_t index = bytes_to_uint32(message, 5);
+      uint32_t begin = bytes_to_uint32(message, 9);
+      uint32_t length = bytes_to_uint32(message, 13);
+      requested.push_back(index);
+
+      std::vector<std::byte> piece(13);
+      piece[3] = static_cast<std::byte>(9 + length);
+      piece[4] = std::byte{7};
+      piece[8] = static_cast<std::byte>(index);
+      piece[12] = static_cast<std::byte>(begin);
+      auto data = content.begin() + index * piece_length + begin;
+      piece.insert(piece.end(), data, data + length);
+      if (index == 1 && !corrupted) {
+        piece.back() ^= std::byte{0xFF};
+        corrupted = true;
+      }
+      boost::asio::write(client, boost::asio::buffer(piece));
+    }
+    EXPECT_EQ(requested, (std::vector<uint32_t>{0, 1, 1, 2}));
+
+    for (int i = 0; i < 100 && piece_manager->missing_count() > 0; ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(piece_manager->missing_count(), 0u);
+
+    std::vector<std::byte> written(content.size());
+    EXPECT_TRUE(file_manager->read_range(0, written.data(), written.size()));
+    EXPECT_EQ(written, content);
+    EXPECT_EQ(budget->in_use(), 0u);
+
+    disconnect_peer(client);
+  }
+};
+
+TEST_F(PeerConnectionTest, ServesRequestedBlocksToInboundPeer) {
+  auto file_manager = std::make_shared<LinuxFileManager>(
+      files, piece_length, std::vector<InfoHash>(3));
+  file_manager->write_block(0, 0, content.data(), 128);
+  file_manager->write_block(1, 0, content.data() + 128, 128);
+  auto piece_manager = std::make_shared<PieceManager>(300, piece_length);
+  piece_manager->restore_piece(1);
+
+  auto connection = std::make_shared<PeerConnection>(
+      io_context, info_hash, Peer::Id{}, piece_manager, file_manager);
+  tcp::socket client = connect_peer(connection);
+
+  auto reply = read_exactly(client, 68);
+  EXPECT_TRUE(
+      std::equal(info_hash.begin(), info_hash.end(), reply.begin() + 28));
+  auto bitfield = read_message(client);
+  ASSERT_EQ(bitfield.size(), 6);
+  EXPECT_EQ(bitfield[4], std::byte{5});
+  EXPECT_EQ(bitfield[5], std::byte{0x40}); // Only piece 1
+  auto their_interest = read_message(client);
+  EXPECT_EQ(their_interest[4], std::byte{2}); // Pieces 0 and 2 are missing
+
+  std::vector<std::byte> interested = {std::byte{0}, std::byte{0},
+                                       std::byte{0}, std::byte{1},
+                                       std::byte{2}};
+  boost::asio::write(client, boost::asio::buffer(interested));
+  auto unchoke = read_message(client);
+  ASSERT_EQ(unchoke.size(), 5);
+  EXPECT_EQ(unchoke[4], std::byte{1});
+
+  // A request for a piece we lack is ignored, the next one is served
+  std::vector<std::byte> request = {
+      std::byte{0}, std::byte{0},  std::byte{0}, std::byte{13}, std::byte{6},
+      std::byte{0}, std::byte{0},  std::byte{0}, std::byte{0},  std::byte{0},
+      std::byte{0}, std::byte{0},  std::byte{0}, std::byte{0},  std::byte{0},
+      std::byte{0}, std::byte{64}};
+  boost::asio::write(client, boost::asio::buffer(request));
+  request[8] = std::byte{1};  // Piece 1
+  request[12] = std::byte{8}; // Offset 8
+  boost::asio::write(client, boost::asio::buffer(request));
+
+  auto piece = read_message(client);
+  ASSERT_EQ(piece.size(), 13 + 64);
+  EXPECT_EQ(piece[4], std::byte{7});
+  EXPECT_EQ(bytes_to_uint32(piece, 5), 1);
+  EXPECT_EQ(bytes_to_uint32(piece, 9), 8);
+  EXPECT_TRUE(std::equal(piece.begin() + 13, piece.end(),
+                         content.begin() + 128 + 8));
+
+  disconnect_peer(client);
+}
+
+TEST_F(PeerConnectionTest, VerifiesDownloadedPiecesBeforeWritingThem) {
+  download_with_corrupt_piece(std::make_shared<MemoryBudget>());
+}
+
+TEST_F(PeerConnectionTest, WritesBlocksStraightToDiskOverTheMemoryBudget) {
+  // No piece fits, so every piece is assembled on disk and read back
+  download_with_corrupt_piece(std::make_shared<MemoryBudget>(0));
+}
+
+TEST_F(PeerConnectionTest, HashesBlocksThatArriveOutOfOrder) {
+  // Two pieces of four blocks, each answered last block first
+  const uint32_t large_piece = 4 * BLOCK_SIZE;
+  std::vector<FileInfo> large_files = {
+      {"peer_download.bin", 2 * large_piece, 0, 2 * large_piece}};
+  std::vector<std::byte> data(2 * large_piece);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<std::byte>(i * 7 + i / 4096);
+  }
+  std::vector<InfoHash> hashes = {
+      sha1_digest(data.data(), large_piece),
+      sha1_digest(data.data() + large_piece, large_piece)};
+
+  for (uint64_t budget_size : {uint64_t{IN_FLIGHT_MEMORY_BUDGET}, 0ul}) {
+    auto file_manager =
+        std::make_shared<LinuxFileManager>(large_files, large_piece, hashes);
+    auto piece_manager =
+        std::make_shared<PieceManager>(data.size(), large_piece);
+    auto picker = std::make_shared<PiecePicker>(
+        piece_manager, std::make_shared<MemoryBudget>(budget_size));
+
+    auto connection = std::make_shared<PeerConnection>(
+        io_context, info_hash, Peer::Id{}, piece_manager, file_manager,
+        picker);
+    tcp::socket client = connect_seeder(connection, 0xC0); // Both pieces
+
+    for (int piece = 0; piece < 2; ++piece) {
+      std::vector<std::vector<std::byte>> requests;
+      while (requests.size() < 4) {
+        auto message = read_message(client);
+        if (is_request(message)) {
+          requests.push_back(message);
+        }
+      }
+      for (auto it = requests.rbegin(); it != requests.rend(); ++it) {
+        uint32_t index = bytes_to_uint32(*it, 5);
+        uint32_t begin = bytes_to_uint32(*it, 9);
+        std::vector<std::byte> reply = *it;
+        reply[2] = std::byte{0x40}; // 9 + BLOCK_SIZE
+        reply[3] = std::byte{9};
+        reply[4] = std::byte{7};
+        reply.resize(13);
+        auto block = data.begin() + index * large_piece + begin;
+        reply.insert(reply.end(), block, block + BLOCK_SIZE);
+        boost::asio::write(client, boost::asio::buffer(reply));
+      }
+    }
+
+    for (int i = 0; i < 100 && piece_manager->missing_count() > 0; ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(piece_manager->missing_count(), 0u) << budget_size;
+    std::vector<std::byte> written(data.size());
+    EXPECT_TRUE(file_manager->read_range(0, written.data(), written.size()));
+    EXPECT_EQ(written, data);
+
+    disconnect_peer(client);
+  }
+  remove("peer_download.bin");
+}
+
+TEST_F(PeerConnectionTest, DropsRepeatedBlocksOfAHashedPiece) {
+  // One piece of two blocks, whose first block arrives again, corrupt
+  const uint32_t large_piece = 2 * BLOCK_SIZE;
+  std::vector<FileInfo> large_files = {
+      {"peer_download.bin", large_piece, 0, large_piece}};
+  std::vector<std::byte> data(large_piece);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<std::byte>(i * 3);
+  }
+  std::vector<std::byte> garbage(BLOCK_SIZE, std::byte{0xEE});
+  std::vector<InfoHash> hashes = {sha1_digest(data.data(), large_piece)};
+
+  for (uint64_t budget_size : {uint64_t{IN_FLIGHT_MEMORY_BUDGET}, 0ul}) {
+    auto file_manager =
+        std::make_shared<LinuxFileManager>(large_files, large_piece, hashes);
+    auto piece_manager =
+        std::make_shared<PieceManager>(data.size(), large_piece);
+    auto picker = std::make_shared<PiecePicker>(
+        piece_manager, std::make_shared<MemoryBudget>(budget_size));
+    auto connection = std::make_shared<PeerConnection>(
+        io_context, info_hash, Peer::Id{}, piece_manager, file_manager,
+        picker);
+    tcp::socket client = connect_seeder(connection, 0x80);
+
+    int requests = 0;
+    while (requests < 2) {
+      auto message = read_message(client);
+      if (is_request(message)) {
+        ++requests;
+      }
+    }
+    for (const auto &message :
+         {piece_message(0, 0, data.data(), BLOCK_SIZE),
+          piece_message(0, 0, garbage.data(), BLOCK_SIZE),
+          piece_message(0, BLOCK_SIZE, data.data() + BLOCK_SIZE,
+                        BLOCK_SIZE)}) {
+      boost::asio::write(client, boost::asio::buffer(message));
+    }
+
+    for (int i = 0; i < 100 && piece_manager->missing_count() > 0; ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(piece_manager->missing_count(), 0u) << budget_size;
+    std::vector<std::byte> written(data.size());
+    EXPECT_TRUE(file_manager->read_range(0, written.data(), written.size()));
+    EXPECT_EQ(written, data) << budget_size;
+
+    disconnect_peer(client);
+  }
+  remove("peer_download.bin");
+}
+
+TEST_F(PeerConnectionTest, HandsUnansweredPiecesToOtherPeers) {
+  auto piece_manager = std::make_shared<PieceManager>(300, piece_length);
+  auto picker = std::make_shared<PiecePicker>(piece_manager);
+  ConnectionTimeouts timeouts;
+  timeouts.request = std::chrono::milliseconds(100);
+  auto connection = timed_connection(piece_manager, picker, timeouts);
+  tcp::socket client = connect_seeder(connection, 0xC0); // Pieces 0 and 1
+
+  std::vector<uint32_t> requested;
+  auto first_request = std::chrono::steady_clock::now();
+  while (requested.size() < 2) {
+    auto message = read_message(client);
+    if (is_request(message)) {
+      requested.push_back(bytes_to_uint32(message, 5));
+      if (requested.size() == 1) {
+        first_request = std::chrono::steady_clock::now();
+      }
+    }
+  }
+
+  // The unanswered piece is given up and the connection moves on
+  EXPECT_GE(std::chrono::steady_clock::now() - first_request,
+            std::chrono::milliseconds(100));
+  EXPECT_NE(requested[0], requested[1]);
+  EXPECT_FALSE(picker->is_reserved(requested[0]));
+  EXPECT_TRUE(picker->is_reserved(requested[1]));
+
+  disconnect_peer(client);
+}
+
+TEST_F(PeerConnectionTest, SnubsPeersThatSendNoData) {
+  auto piece_manager = std::make_shared<PieceManager>(300, piece_length);
+  auto picker = std::make_shared<PiecePicker>(piece_manager);
+  ConnectionTimeouts timeouts;
+  timeouts.snub = std::chrono::milliseconds(200);
+  timeouts.check = std::chrono::milliseconds(20);
+  auto connection = timed_connection(piece_manager, picker, timeouts);
+  tcp::socket client = connect_seeder(connection, 0x80); // Piece 0
+
+  // The request for piece 0 goes unanswered until it is cancelled
+  int requests = 0;
+  for (bool cancelled = false; !cancelled;) {
+    auto message = read_message(client);
+    requests += is_request(message);
+    cancelled = message.size() == 17 && message[4] == std::byte{8};
+  }
+  EXPECT_EQ(requests, 1);
+  EXPECT_TRUE(on_io_thread([&]() { return connection->snubbed(); }));
+  EXPECT_FALSE(picker->is_reserved(0));
+
+  // A late block shows the peer is responsive again
+  auto block = piece_message(0, 0, content.data(), piece_length);
+  boost::asio::write(client, boost::asio::buffer(block));
+  for (bool requested = false; !requested;) {
+    auto message = read_message(client);
+    requested = is_request(message);
+  }
+  EXPECT_FALSE(on_io_thread([&]() { return connection->snubbed(); }));
+  EXPECT_TRUE(picker->is_reserved(0));
+
+  disconnect_peer(client);
+}
+
+TEST_F(PeerConnectionTest, SendsKeepAlivesWhileIdle) {
+  auto piece_manager = std::make_shared<PieceManager>(300, piece_length);
+  auto picker = std::make_shared<PiecePicker>(piece_manager);
+  ConnectionTimeouts timeouts;
+  timeouts.keep_alive = std::chrono::milliseconds(100);
+  timeouts.check = std::chrono::milliseconds(20);
+  auto connection = timed_connection(piece_manager, picker, timeouts);
+  tcp::socket client = connect_seeder(connection, 0x00); // No pieces
+
+  auto start = std::chrono::steady_clock::now();
+  for (int keep_alives = 0; keep_alives < 2;) {
+    keep_alives += read_message(client).size() == 4;
+  }
+  EXPECT_GE(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(200));
+
+  disconnect_peer(client);
+}
+
+TEST_F(PeerConnectionTest, DropsSilentPeers) {
+  auto piece_manager = std::make_shared<PieceManager>(300, piece_length);
+  auto picker = std::make_shared<PiecePicker>(piece_manager);
+  ConnectionTimeouts timeouts;
+  timeouts.inactivity = std::chrono::milliseconds(100);
+  timeouts.check = std::chrono::milliseconds(20);
+  auto connection = timed_connection(piece_manager, picker, timeouts);
+  std::atomic<bool> disconnected{false};
+  connection->set_disconnect_handler([&]() { disconnected = true; });
+  tcp::socket client = connect_seeder(connection, 0x00);
+
+  // Whatever the connection sent, then the end of the stream
+  boost::system::error_code error;
+  std::vector<std::byte> buffer(64);
+  while (!error) {
+    client.read_some(boost::asio::buffer(buffer), error);
+  }
+  EXPECT_EQ(error, boost::asio::error::eof);
+  for (int i = 0; i < 100 && !disconnected; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_TRUE(disconnected);
+
+  disconnect_peer(client);
+}
+
+TEST_F(PeerConnectionTest, FollowsChangesInTheWantedPieces) {
+  auto piece_manager = std::make_shared<PieceManager>(300, piece_length);
+  piece_manager->set_priorities(std::vector<Priority>(3, Priority::Skip));
+  auto picker = std::make_shared<PiecePicker>(piece_manager);
+  auto connection = timed_connection(piece_manager, picker, {});
+  tcp::socket client = connect_seeder(connection, 0xE0); // Every piece
+
+  // Nothing is wanted yet, so the first message is sent after the change
+  on_io_thread([&]() {
+    piece_manager->set_priorities(std::vector<Priority>(3, Priority::Normal));
+    connection->update_interest();
+    return true;
+  });
+  EXPECT_EQ(read_message(client)[4], std::byte{2}); // Interested
+  EXPECT_TRUE(is_request(read_message(client)));
+
+  // Once nothing is wanted any more, the interest is withdrawn
+  on_io_thread([&]() {
+    piece_manager->set_priorities(std::vector<Priority>(3, Priority::Skip));
+    connection->update_interest();
+    return true;
+  });
+  std::vector<std::byte> message;
+  while (message.size() != 5 || message[4] != std::byte{3}) {
+    message = read_message(client);
+  }
+
+  disconnect_peer(client);
+}
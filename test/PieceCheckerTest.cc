@@ -0,0 +1,84 @@
+#include "PieceChecker/PieceChecker.h"
+#include "Utils/utils.h"
+#include <gtest/gtest.h>
+#include <mutex>
+
+class PieceCheckerTest : public ::testing::Test {
+protected:
+  std::vector<FileInfo> files;
+  uint32_t piece_length = 100;
+  std::vector<std::byte> content;
+  std::vector<InfoHash> hashes;
+
+  void SetUp() override {
+    files = {{"check1.bin", 250, 0, 250}, {"check2.bin", 170, 250, 420}};
+    content.resize(420);
+    for (size_t i = 0; i < content.size(); ++i) {
+      content[i] = static_cast<std::byte>(i * 7 + 3);
+    }
+    for (size_t offset = 0; offset < content.size(); offset += piece_length) {
+      size_t size = std::min<size_t>(piece_length, content.size() - offset);
+      hashes.push_back(sha1_digest(content.data() + offset, size));
+    }
+  }
+
+  void TearDown() override {
+    for (const auto &file : files) {
+      remove(file.path.c_str());
+    }
+  }
+};
+
+TEST_F(PieceCheckerTest, FindsValidAndCorruptPieces) {
+  LinuxFileManager manager(files, piece_length, hashes);
+  content[120] = std::byte{0}; // Corrupts piece 1
+  for (uint32_t piece = 0; piece < hashes.size(); ++piece) {
+    uint32_t size = std::min<uint32_t>(piece_length,
+                                       content.size() - piece * piece_length);
+    manager.write_block(piece, 0, content.data() + piece * piece_length, size);
+  }
+
+  PieceChecker checker(manager, piece_length, hashes);
+  std::mutex mutex;
+  std::vector<int> results(hashes.size(), -1);
+  uint32_t valid = checker.run(
+      [&](uint32_t piece, bool ok) {
+        std::lock_guard<std::mutex> lock(mutex);
+        results[piece] = ok;
+      },
+      3);
+
+  EXPECT_EQ(valid, 4);
+  EXPECT_EQ(checker.pieces_checked(), 5);
+  EXPECT_EQ(results, (std::vector<int>{1, 0, 1, 1, 1}));
+}
+
+TEST_F(PieceCheckerTest, EmptyFilesHaveNoValidPieces) {
+  LinuxFileManager manager(files, piece_length, hashes);
+  EXPECT_FALSE(manager.has_existing_data());
+
+  PieceChecker checker(manager, piece_length, hashes);
+  EXPECT_EQ(checker.run([](uint32_t, bool) {}), 0);
+  EXPECT_EQ(checker.pieces_checked(), 5);
+}
+
+TEST_F(PieceCheckerTest, StreamsPiecesLargerThanAChunk) {
+  uint32_t large_piece = CHECK_CHUNK_SIZE + 1024 * 1024;
+  std::vector<FileInfo> large_files = {
+      {"check_large.bin", uint64_t{large_piece} + 4096, 0, 0}};
+  std::vector<std::byte> data(large_files[0].length);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<std::byte>(i % 251);
+  }
+  std::vector<InfoHash> large_hashes = {
+      sha1_digest(data.data(), large_piece),
+      sha1_digest(data.data() + large_piece, 4096)};
+
+  LinuxFileManager manager(large_files, large_piece, large_hashes);
+  manager.write_block(0, 0, data.data(), large_piece);
+  manager.write_block(1, 0, data.data() + large_piece, 4096);
+
+  PieceChecker checker(manager, large_piece, large_hashes);
+  EXPECT_EQ(checker.run([](uint32_t, bool) {}, 2), 2);
+  remove("check_large.bin");
+}
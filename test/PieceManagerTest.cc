@@ -53,6 +53,94 @@ TEST_F(PieceManagerTest, PieceSize) {
   EXPECT_EQ(pm_large.piece_size(11), 0);  // Out of bounds
 }
 
+TEST_F(PieceManagerTest, InterestAndMissingCount) {
+  Bitfield peer(10);
+  peer.set(3);
+  EXPECT_EQ(pm->missing_count(), 10);
+  EXPECT_TRUE(pm->is_interesting(peer));
+
+  pm->save_piece(3);
+  EXPECT_EQ(pm->missing_count(), 9);
+  EXPECT_FALSE(pm->is_interesting(peer));
+  EXPECT_EQ(pm->wanted_from(peer).count(), 0);
+}
+
+TEST_F(PieceManagerTest, SkippedPiecesAreNotNeeded) {
+  std::vector<Priority> priorities(10, Priority::Normal);
+  priorities[3] = Priority::Skip;
+  priorities[4] = Priority::High;
+  pm->set_priorities(priorities);
+  EXPECT_EQ(pm->priorities()->highest, Priority::High);
+  EXPECT_EQ(pm->needed_count(), 9);
+  EXPECT_EQ(pm->missing_count(), 10);
+
+  Bitfield peer(10);
+  peer.set(3);
+  EXPECT_FALSE(pm->is_interesting(peer));
+  peer.set(4);
+  EXPECT_EQ(pm->wanted_from(peer).count(), 1);
+  EXPECT_TRUE(pm->wanted_from(peer).test(4));
+
+  pm->save_piece(3);
+  pm->save_piece(4);
+  EXPECT_EQ(pm->needed_count(), 8);
+  EXPECT_THROW(pm->set_priorities({Priority::Normal}), std::invalid_argument);
+}
+
+TEST_F(PieceManagerTest, PublishesCompletionEvents) {
+  PieceManager small(200, 100);
+  std::vector<PieceEvent> events;
+  auto id = small.subscribe(
+      [&events](const PieceEvent &event) { events.push_back(event); });
+
+  small.save_piece(1);
+  small.save_piece(1); // Saving twice publishes once
+  ASSERT_EQ(events.size(), 1);
+  EXPECT_EQ(events[0].type, PieceEvent::Type::PieceCompleted);
+  EXPECT_EQ(events[0].have_count, 1);
+
+  small.save_piece(0);
+  ASSERT_EQ(events.size(), 4);
+  EXPECT_EQ(events[2].type, PieceEvent::Type::DownloadCompleted);
+  EXPECT_EQ(events[3].type, PieceEvent::Type::TorrentCompleted);
+  EXPECT_EQ(small.missing_count(), 0);
+
+  small.unsubscribe(id);
+}
+
+TEST_F(PieceManagerTest, CompletesDownloadsWithSkippedPieces) {
+  PieceManager small(300, 100);
+  small.set_priorities({Priority::Normal, Priority::Skip, Priority::Normal});
+  std::vector<PieceEvent::Type> events;
+  small.subscribe(
+      [&events](const PieceEvent &event) { events.push_back(event.type); });
+
+  small.save_piece(0);
+  small.save_piece(2);
+  EXPECT_EQ(events, (std::vector<PieceEvent::Type>{
+                        PieceEvent::Type::PieceCompleted,
+                        PieceEvent::Type::PieceCompleted,
+                        PieceEvent::Type::DownloadCompleted}));
+
+  // Wanting the skipped piece after all completes the download again
+  events.clear();
+  small.set_priorities(std::vector<Priority>(3, Priority::Normal));
+  small.save_piece(1);
+  EXPECT_EQ(events, (std::vector<PieceEvent::Type>{
+                        PieceEvent::Type::PieceCompleted,
+                        PieceEvent::Type::DownloadCompleted,
+                        PieceEvent::Type::TorrentCompleted}));
+}
+
+TEST_F(PieceManagerTest, UnsubscribeStopsEvents) {
+  int calls = 0;
+  auto id = pm->subscribe([&calls](const PieceEvent &) { ++calls; });
+  pm->save_piece(0);
+  pm->unsubscribe(id);
+  pm->save_piece(1);
+  EXPECT_EQ(calls, 1);
+}
+
 std::ostringstream Logger::null_stream_;
 
 int main(int argc, char **argv) {
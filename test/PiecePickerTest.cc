@@ -0,0 +1,127 @@
+#include "PiecePicker/PiecePicker.h"
+#include <gtest/gtest.h>
+
+class PiecePickerTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    piece_manager = std::make_shared<PieceManager>(1000, 100);
+    picker = std::make_unique<PiecePicker>(piece_manager);
+    everything = Bitfield(10);
+    everything.set_all();
+  }
+
+  std::shared_ptr<PieceManager> piece_manager;
+  std::unique_ptr<PiecePicker> picker;
+  Bitfield everything;
+};
+
+TEST_F(PiecePickerTest, HandsOutEachPieceOnce) {
+  for (uint32_t piece = 0; piece < 10; ++piece) {
+    EXPECT_EQ(picker->pick(everything), piece);
+  }
+  EXPECT_FALSE(picker->pick(everything));
+  EXPECT_EQ(picker->reserved_count(), 10u);
+}
+
+TEST_F(PiecePickerTest, SkipsPiecesWeHaveOrThePeerLacks) {
+  piece_manager->save_piece(0);
+  Bitfield peer(10);
+  peer.set(0);
+  peer.set(3);
+  EXPECT_EQ(picker->pick(peer), 3u);
+  EXPECT_FALSE(picker->pick(peer));
+
+  // Before its bitfield arrives a peer has nothing
+  EXPECT_FALSE(picker->pick(Bitfield()));
+}
+
+TEST_F(PiecePickerTest, ReleasedPiecesCanBePickedAgain) {
+  ASSERT_EQ(picker->pick(everything), 0u);
+  ASSERT_EQ(picker->pick(everything), 1u);
+
+  // A connection that dropped gives its piece back to the others
+  picker->release(0);
+  EXPECT_FALSE(picker->is_reserved(0));
+  EXPECT_TRUE(picker->is_reserved(1));
+  EXPECT_EQ(picker->pick(everything), 0u);
+
+  picker->release(1);
+  picker->release(1);
+  EXPECT_EQ(picker->reserved_count(), 1u);
+}
+
+TEST_F(PiecePickerTest, ReservesBuffersWithinTheMemoryBudget) {
+  auto budget = std::make_shared<MemoryBudget>(250);
+  PiecePicker limited(piece_manager, budget);
+  MemoryBudget::Reservation first = limited.reserve_buffer(0);
+  MemoryBudget::Reservation second = limited.reserve_buffer(1);
+  EXPECT_EQ(first.bytes(), 100u);
+  EXPECT_TRUE(second);
+
+  // A third piece goes straight to disk until one of the others is done
+  EXPECT_FALSE(limited.reserve_buffer(2));
+  first = MemoryBudget::Reservation();
+  EXPECT_TRUE(limited.reserve_buffer(2));
+}
+
+TEST_F(PiecePickerTest, PicksTheRarestPieceFirst) {
+  Bitfield common = everything;
+  common.reset(6);
+  common.reset(7);
+  Bitfield rare(10);
+  rare.set(6);
+  rare.set(7);
+  picker->add_peer(common);
+  picker->add_peer(common);
+  picker->add_peer(rare);
+  picker->remove_peer(common);
+  picker->add_peer(common);
+  picker->add_have(7);
+
+  // Only one peer has piece 6, two have all others, the lowest index first
+  EXPECT_EQ(picker->pick(everything), 6u);
+  EXPECT_EQ(picker->pick(everything), 0u);
+  EXPECT_EQ(picker->pick(everything), 1u);
+}
+
+TEST_F(PiecePickerTest, PicksHigherPrioritiesFirst) {
+  std::vector<Priority> priorities(10, Priority::Normal);
+  priorities[0] = Priority::Low;
+  priorities[1] = Priority::Skip;
+  priorities[5] = Priority::High;
+  piece_manager->set_priorities(priorities);
+
+  EXPECT_EQ(picker->pick(everything), 5u);
+  EXPECT_EQ(picker->pick(everything), 2u);
+  for (uint32_t piece : {3, 4, 6, 7, 8, 9}) {
+    EXPECT_EQ(picker->pick(everything), piece);
+  }
+  EXPECT_EQ(picker->pick(everything), 0u);
+  EXPECT_FALSE(picker->pick(everything)); // Piece 1 is skipped
+}
+
+TEST_F(PiecePickerTest, HurriesThePiecesAheadOfTheReadCursor) {
+  picker->add_peer(everything);
+  picker->set_stream_window(4, 3);
+  EXPECT_EQ(picker->pick(everything, 1000), 4u);
+  EXPECT_EQ(picker->pick(everything, 1000), 5u);
+  EXPECT_EQ(picker->pick(everything, 1000), 6u);
+
+  // A slow peer is not trusted with a deadline and gets pieces elsewhere
+  picker->release(6);
+  EXPECT_EQ(picker->pick(everything, 100), 0u);
+  EXPECT_EQ(picker->pick(everything, 1000), 6u);
+
+  // Once the window is taken, the piece at the cursor goes to a second
+  // fast peer, but never to a third
+  Bitfield second = everything;
+  second.reset(4);
+  EXPECT_EQ(picker->pick(everything, 1000), 4u);
+  EXPECT_EQ(picker->pick(second, 1000), 5u);
+  EXPECT_EQ(picker->pick(everything, 1000), 1u);
+  picker->release(4);
+  EXPECT_TRUE(picker->is_reserved(4));
+
+  picker->clear_stream_window();
+  EXPECT_EQ(picker->pick(everything, 1000), 2u);
+}
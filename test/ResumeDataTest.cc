@@ -0,0 +1,102 @@
+#include "ResumeData/ResumeData.h"
+#include <cstdio>
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+class ResumeDataTest : public ::testing::Test {
+protected:
+  std::vector<FileInfo> files;
+
+  void SetUp() override {
+    files = {{"resume1.bin", 250, 0, 250}, {"resume2.bin", 150, 250, 400}};
+    for (const auto &file : files) {
+      int fd = open(file.path.c_str(), O_WRONLY | O_CREAT, 0666);
+      ftruncate(fd, file.length);
+      close(fd);
+    }
+  }
+
+  void TearDown() override {
+    for (const auto &file : files) {
+      remove(file.path.c_str());
+    }
+    remove("test.resume");
+  }
+
+  ResumeData make_resume() {
+    ResumeData resume;
+    resume.info_hash[0] = std::byte{0xAB};
+    resume.pieces = Bitfield(4);
+    resume.pieces.set(0);
+    resume.pieces.set(3);
+    for (const auto &file : files) {
+      resume.files.push_back(*stat_file(file.path));
+    }
+    Bitfield blocks(7);
+    blocks.set(2);
+    resume.partial_pieces.push_back({1, blocks});
+    resume.file_priorities = {Priority::High, Priority::Skip};
+    return resume;
+  }
+};
+
+TEST_F(ResumeDataTest, EncodeDecodeRoundTrip) {
+  ResumeData resume = make_resume();
+  ResumeData decoded = ResumeData::decode(resume.encode());
+
+  EXPECT_EQ(decoded.info_hash, resume.info_hash);
+  EXPECT_EQ(decoded.pieces, resume.pieces);
+  ASSERT_EQ(decoded.files.size(), 2);
+  EXPECT_EQ(decoded.files[1], resume.files[1]);
+  ASSERT_EQ(decoded.partial_pieces.size(), 1);
+  EXPECT_EQ(decoded.partial_pieces[0].piece_index, 1);
+  EXPECT_EQ(decoded.partial_pieces[0].blocks, resume.partial_pieces[0].blocks);
+  EXPECT_EQ(decoded.file_priorities, resume.file_priorities);
+}
+
+TEST_F(ResumeDataTest, DecodeRejectsGarbage) {
+  EXPECT_THROW(ResumeData::decode("not bencode"), std::runtime_error);
+  EXPECT_THROW(ResumeData::decode("d3:fooi1ee"), std::runtime_error);
+}
+
+TEST_F(ResumeDataTest, SaveAndLoad) {
+  ResumeData resume = make_resume();
+  ASSERT_TRUE(resume.save("test.resume"));
+
+  auto loaded = ResumeData::load("test.resume");
+  ASSERT_TRUE(loaded.has_value());
+  EXPECT_EQ(loaded->pieces, resume.pieces);
+  EXPECT_FALSE(ResumeData::load("missing.resume").has_value());
+}
+
+TEST_F(ResumeDataTest, ValidateKeepsUnchangedFiles) {
+  ResumeData resume = make_resume();
+  EXPECT_EQ(resume.validate(files, 100), 0);
+  EXPECT_EQ(resume.pieces.count(), 2);
+  EXPECT_EQ(resume.partial_pieces.size(), 1);
+}
+
+TEST_F(ResumeDataTest, ValidateDropsPiecesOfChangedFiles) {
+  ResumeData resume = make_resume();
+
+  // Growing the second file changes its stamp; it covers pieces 2 and 3
+  int fd = open("resume2.bin", O_WRONLY);
+  ftruncate(fd, 151);
+  close(fd);
+
+  EXPECT_EQ(resume.validate(files, 100), 1);
+  EXPECT_TRUE(resume.pieces.test(0));
+  EXPECT_FALSE(resume.pieces.test(3));
+  EXPECT_EQ(resume.partial_pieces.size(), 1); // Piece 1 lies in file one
+}
+
+TEST_F(ResumeDataTest, ValidateKeepsFilesThatWereNeverCreated) {
+  // A skipped file is absent, and its stamp says so
+  remove("resume2.bin");
+  ResumeData resume = make_resume();
+  resume.files[1] = FileStamp{};
+
+  EXPECT_EQ(resume.validate(files, 100), 0);
+  EXPECT_TRUE(resume.pieces.test(3));
+}
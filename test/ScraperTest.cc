@@ -0,0 +1,93 @@
+#include "FakeUdpTracker.h"
+#include "Scraper/Scraper.h"
+#include <future>
+#include <gtest/gtest.h>
+#include <thread>
+
+TEST(ScraperTest, DerivesScrapeUrls) {
+  EXPECT_EQ(scrape_url("http://t.example/announce"),
+            "http://t.example/scrape");
+  EXPECT_EQ(scrape_url("http://t.example/x/announce.php?key=1"),
+            "http://t.example/x/scrape.php?key=1");
+  EXPECT_EQ(scrape_url("udp://t.example:6969/announce"),
+            "udp://t.example:6969/announce");
+  EXPECT_EQ(scrape_url("http://t.example/a"), "");
+  EXPECT_EQ(scrape_url("http://t.example/announce/x"), "");
+}
+
+TEST(ScraperTest, ParsesFilesByInfoHash) {
+  InfoHash first{};
+  InfoHash second{std::byte{1}};
+  std::string key(20, '\0');
+  std::string body = "d5:filesd20:" + key +
+                     "d8:completei5e10:downloadedi50e10:incompletei10eeee";
+
+  ScrapeResponse response = parse_scrape_response(body, {first, second});
+  EXPECT_TRUE(response.failure_reason.empty());
+  ASSERT_EQ(response.stats.size(), 2u);
+  EXPECT_EQ(response.stats[0].seeders, 5u);
+  EXPECT_EQ(response.stats[0].completed, 50u);
+  EXPECT_EQ(response.stats[0].leechers, 10u);
+  // Torrents the tracker does not know are reported empty
+  EXPECT_EQ(response.stats[1].seeders, 0u);
+
+  EXPECT_EQ(parse_scrape_response("d14:failure reason4:nopee", {first})
+                .failure_reason,
+            "nope");
+  EXPECT_THROW(parse_scrape_response("<html>", {first}), std::runtime_error);
+}
+
+class ScraperClientTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    udp_client = std::make_shared<UdpTrackerClient>(
+        io_context, std::chrono::milliseconds(50), 2);
+    http_client = std::make_shared<HttpClient>(io_context);
+    scraper = std::make_unique<Scraper>(http_client, udp_client);
+    thread = std::thread([this]() { io_context.run(); });
+  }
+
+  void TearDown() override {
+    udp_client->close();
+    http_client->close();
+    work_guard.reset();
+    io_context.stop();
+    thread.join();
+  }
+
+  ScrapeResponse scrape(const std::string &url,
+                        std::vector<InfoHash> info_hashes) {
+    auto done = std::make_shared<std::promise<ScrapeResponse>>();
+    std::future<ScrapeResponse> response = done->get_future();
+    scraper->scrape(url, std::move(info_hashes),
+                    [done](ScrapeResponse result) {
+                      done->set_value(std::move(result));
+                    });
+    return response.get();
+  }
+
+  boost::asio::io_context io_context;
+  boost::asio::executor_work_guard<boost::asio::io_context::executor_type>
+      work_guard{io_context.get_executor()};
+  std::shared_ptr<UdpTrackerClient> udp_client;
+  std::shared_ptr<HttpClient> http_client;
+  std::unique_ptr<Scraper> scraper;
+  std::thread thread;
+};
+
+TEST_F(ScraperClientTest, ScrapesUdpTrackers) {
+  FakeUdpTracker tracker;
+  ScrapeResponse response =
+      scrape(tracker.url(), {InfoHash{std::byte{3}}, InfoHash{std::byte{9}}});
+  EXPECT_TRUE(response.failure_reason.empty()) << response.failure_reason;
+  ASSERT_EQ(response.stats.size(), 2u);
+  EXPECT_EQ(response.stats[0].seeders, 3u);
+  EXPECT_EQ(response.stats[1].seeders, 9u);
+}
+
+TEST_F(ScraperClientTest, ReportsTrackersThatCannotScrape) {
+  EXPECT_FALSE(
+      scrape("http://127.0.0.1:9/a", {InfoHash{}}).failure_reason.empty());
+  EXPECT_FALSE(scrape("http://127.0.0.1:9/announce", {InfoHash{}})
+                   .failure_reason.empty());
+}
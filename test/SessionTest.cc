@@ -0,0 +1,237 @@
+#include "FakePeer.h"
+#include "Session/Session.h"
+#include "TorrentCreator/TorrentCreator.h"
+#include "Utils/utils.h"
+#include <fstream>
+#include <gtest/gtest.h>
+#include <set>
+#include <thread>
+
+class SessionTest : public ::testing::Test {
+protected:
+  std::vector<std::string> names = {"session_a", "session_b"};
+  std::vector<InfoHash> info_hashes;
+
+  void SetUp() override {
+    for (size_t i = 0; i < names.size(); ++i) {
+      std::ofstream data(names[i] + ".bin", std::ios::binary);
+      data << std::string(40000, static_cast<char>('a' + i));
+      data.close();
+
+      TorrentCreator creator(names[i] + ".bin", "http://127.0.0.1:9/announce");
+      creator.create(1);
+      creator.save(names[i] + ".torrent");
+      info_hashes.push_back(creator.torrent().info_hash);
+    }
+  }
+
+  /**
+   * @brief Connects a fake peer to a session that has some pieces of a
+   * torrent and unchokes us.
+   *
+   * @param session The session.
+   * @param info_hash The torrent.
+   * @param pieces The first byte of the peer's bitfield.
+   * @return The peer's end of the connection, with our handshake read.
+   */
+  tcp::socket connect_seeder(Session &session, const InfoHash &info_hash,
+                             uint8_t pieces) {
+    tcp::socket client(client_context);
+    client.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(),
+                                 session.listen_port()));
+    auto greeting = make_handshake(info_hash);
+    auto messages = seeder_greeting(pieces);
+    greeting.insert(greeting.end(), messages.begin(), messages.end());
+    boost::asio::write(client, boost::asio::buffer(greeting));
+    read_exactly(client, 68);
+    return client;
+  }
+
+  void TearDown() override {
+    for (size_t i = 0; i < names.size(); ++i) {
+      remove((names[i] + ".bin").c_str());
+      remove((names[i] + ".torrent").c_str());
+      std::string hex = to_hex(info_hashes[i].data(), info_hashes[i].size());
+      remove((RESUME_DIRECTORY + "/" + hex + ".resume").c_str());
+      remove((RESUME_DIRECTORY + "/" + hex + ".parts").c_str());
+    }
+    remove(RESUME_DIRECTORY.c_str()); // Only if nothing else is left in it
+  }
+
+  boost::asio::io_context client_context;
+};
+
+TEST_F(SessionTest, AddsFindsAndRemovesTorrents) {
+  Session session(1, 0);
+  auto a = session.add_torrent("session_a.torrent");
+  auto b = session.add_torrent("session_b.torrent");
+
+  EXPECT_EQ(session.torrent_count(), 2u);
+  EXPECT_EQ(session.find_torrent(info_hashes[0]), a);
+  EXPECT_EQ(session.find_torrent(info_hashes[1]), b);
+
+  EXPECT_TRUE(session.remove_torrent(info_hashes[0]));
+  EXPECT_FALSE(session.remove_torrent(info_hashes[0]));
+  EXPECT_EQ(session.find_torrent(info_hashes[0]), nullptr);
+  EXPECT_EQ(session.torrent_count(), 1u);
+}
+
+TEST_F(SessionTest, RejectsDuplicateAndUnreadableTorrents) {
+  Session session(1, 0);
+  session.add_torrent("session_a.torrent");
+  EXPECT_THROW(session.add_torrent("session_a.torrent"), std::runtime_error);
+  EXPECT_THROW(session.add_torrent("missing.torrent"), std::runtime_error);
+  EXPECT_EQ(session.torrent_count(), 1u);
+}
+
+TEST_F(SessionTest, RoutesIncomingPeersByInfoHash) {
+  Session session(2, 0);
+  session.add_torrent("session_a.torrent");
+  session.add_torrent("session_b.torrent");
+  ASSERT_NE(session.listen_port(), 0);
+  tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(),
+                         session.listen_port());
+
+  boost::asio::io_context client_context;
+  for (const InfoHash &info_hash : info_hashes) {
+    tcp::socket client(client_context);
+    client.connect(endpoint);
+    auto handshake = make_handshake(info_hash);
+    boost::asio::write(client, boost::asio::buffer(handshake));
+
+    std::vector<std::byte> reply(68);
+    boost::asio::read(client, boost::asio::buffer(reply));
+    EXPECT_TRUE(
+        std::equal(info_hash.begin(), info_hash.end(), reply.begin() + 28));
+  }
+
+  // Peers asking for a torrent we do not have are dropped
+  tcp::socket stranger(client_context);
+  stranger.connect(endpoint);
+  auto handshake = make_handshake(InfoHash{std::byte{0x42}});
+  boost::asio::write(stranger, boost::asio::buffer(handshake));
+  std::vector<std::byte> reply(68);
+  boost::system::error_code error;
+  boost::asio::read(stranger, boost::asio::buffer(reply), error);
+  EXPECT_EQ(error, boost::asio::error::eof);
+}
+
+TEST_F(SessionTest, ReadsDataOnceItsPiecesAreComplete) {
+  Session session(1, 0);
+  auto torrent = session.add_torrent("session_a.torrent");
+
+  // Served from disk once the existing data is checked
+  auto data = torrent->read(0, 30000, 20);
+  ASSERT_EQ(data.wait_for(std::chrono::seconds(10)),
+            std::future_status::ready);
+  EXPECT_EQ(data.get(), std::vector<std::byte>(20, std::byte{'a'}));
+  EXPECT_THROW(torrent->read(0, 39990, 11).get(), std::out_of_range);
+  EXPECT_THROW(torrent->read(1, 0, 1).get(), std::out_of_range);
+  EXPECT_THROW(torrent->read(0, 0, MAX_READ_LENGTH + 1).get(),
+               std::length_error);
+
+  // Without data or peers the read waits, until the torrent goes away
+  remove("session_b.bin");
+  auto missing = session.add_torrent("session_b.torrent");
+  auto waiting = missing->read(0, 100, 1000);
+  EXPECT_EQ(waiting.wait_for(std::chrono::milliseconds(100)),
+            std::future_status::timeout);
+  EXPECT_TRUE(session.remove_torrent(info_hashes[1]));
+  EXPECT_THROW(waiting.get(), std::runtime_error);
+}
+
+TEST_F(SessionTest, ReportsTimeToFirstByteAndStalls) {
+  // Three pieces of 16 KiB, none of them on disk
+  remove("session_b.bin");
+  Session session(1, 0);
+  auto torrent = session.add_torrent("session_b.torrent");
+  std::vector<std::byte> content(40000, std::byte{'b'});
+
+  torrent->stream_from(100);
+  EXPECT_EQ(torrent->download_info().time_to_first_byte.count(), 0);
+
+  // The first byte arrives with the piece under the cursor
+  tcp::socket client = connect_seeder(session, info_hashes[1], 0x80);
+  EXPECT_EQ(answer_request(client, content.data(), MIN_AUTO_PIECE_LENGTH),
+            0u);
+  for (int i = 0; i < 100 && torrent->download_info().pieces_needed > 2;
+       ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  TorrentInfo info = torrent->download_info();
+  EXPECT_EQ(info.pieces_needed, 2u);
+  EXPECT_GT(info.time_to_first_byte.count(), 0);
+  EXPECT_EQ(info.stalls, 0u);
+
+  // Moving onto a missing piece stalls, staying on it or going back to a
+  // complete one does not
+  torrent->stream_from(MIN_AUTO_PIECE_LENGTH);
+  torrent->stream_from(MIN_AUTO_PIECE_LENGTH + 100);
+  EXPECT_EQ(torrent->download_info().stalls, 1u);
+  torrent->stream_from(0);
+  torrent->stream_from(2 * MIN_AUTO_PIECE_LENGTH);
+  EXPECT_EQ(torrent->download_info().stalls, 2u);
+  EXPECT_EQ(torrent->download_info().time_to_first_byte,
+            info.time_to_first_byte);
+}
+
+TEST_F(SessionTest, ReadsFetchTheirMissingPiecesFirst) {
+  remove("session_b.bin");
+  Session session(1, 0);
+  auto torrent = session.add_torrent("session_b.torrent");
+  std::vector<std::byte> content(40000, std::byte{'b'});
+
+  // Spans the end of piece 1 and the start of piece 2
+  auto data = torrent->read(0, 2 * MIN_AUTO_PIECE_LENGTH - 10, 20);
+  EXPECT_EQ(data.wait_for(std::chrono::milliseconds(50)),
+            std::future_status::timeout);
+
+  // A peer with every piece is asked for those of the read before piece 0
+  tcp::socket client = connect_seeder(session, info_hashes[1], 0xE0);
+  std::vector<uint32_t> answered;
+  while (data.wait_for(std::chrono::seconds(0)) !=
+             std::future_status::ready &&
+         answered.size() < 3) {
+    answered.push_back(
+        answer_request(client, content.data(), MIN_AUTO_PIECE_LENGTH));
+  }
+  ASSERT_GE(answered.size(), 2u);
+  EXPECT_EQ(std::set<uint32_t>(answered.begin(), answered.begin() + 2),
+            (std::set<uint32_t>{1, 2}));
+  ASSERT_EQ(data.wait_for(std::chrono::seconds(10)),
+            std::future_status::ready);
+  EXPECT_EQ(data.get(), std::vector<std::byte>(20, std::byte{'b'}));
+}
+
+TEST_F(SessionTest, ReadsWakeUpIdleConnections) {
+  remove("session_b.bin");
+  Session session(1, 0);
+  auto torrent = session.add_torrent("session_b.torrent");
+  std::vector<std::byte> content(40000, std::byte{'b'});
+
+  // The seeder is connected while nothing is wanted, so it sits idle
+  ASSERT_TRUE(torrent->set_file_priority(0, Priority::Skip));
+  tcp::socket client = connect_seeder(session, info_hashes[1], 0xE0);
+  for (int i = 0; i < 100 && torrent->download_info().connections == 0; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_EQ(torrent->download_info().connections, 1u);
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  auto data = torrent->read(0, MIN_AUTO_PIECE_LENGTH, 20);
+  EXPECT_EQ(answer_request(client, content.data(), MIN_AUTO_PIECE_LENGTH), 1u);
+  ASSERT_EQ(data.wait_for(std::chrono::seconds(10)),
+            std::future_status::ready);
+  EXPECT_EQ(data.get(), std::vector<std::byte>(20, std::byte{'b'}));
+}
+
+TEST_F(SessionTest, StandaloneClientIsReleasedOnceStopped) {
+  auto client = std::make_shared<TorrentClient>("session_a.torrent");
+  std::weak_ptr<TorrentClient> weak_client = client;
+  std::thread runner([client]() { client->start(); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  client->stop();
+  runner.join();
+  client.reset();
+  EXPECT_TRUE(weak_client.expired());
+}
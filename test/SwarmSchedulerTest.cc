@@ -0,0 +1,88 @@
+#include "SwarmScheduler/SwarmScheduler.h"
+#include <gtest/gtest.h>
+
+namespace {
+
+SwarmState swarm(uint32_t seeders, uint32_t leechers, bool seeding = false) {
+  SwarmState state;
+  state.swarm.seeders = seeders;
+  state.swarm.leechers = leechers;
+  state.seeding = seeding;
+  return state;
+}
+
+} // namespace
+
+TEST(SwarmSchedulerTest, LeavesUnlimitedRatesUnlimited) {
+  SwarmScheduler scheduler(0, 0, 100);
+  std::vector<SwarmShare> shares =
+      scheduler.allocate({swarm(10, 10), swarm(0, 5, true)});
+  ASSERT_EQ(shares.size(), 2u);
+  for (const SwarmShare &share : shares) {
+    EXPECT_EQ(share.download_rate, 0u);
+    EXPECT_EQ(share.upload_rate, 0u);
+  }
+}
+
+TEST(SwarmSchedulerTest, DownloadsFromWellSeededSwarmsFirst) {
+  SwarmScheduler scheduler(100000, 0, 100);
+  std::vector<SwarmShare> shares =
+      scheduler.allocate({swarm(50, 0), swarm(1, 0), swarm(0, 30, true)});
+  EXPECT_GT(shares[0].download_rate, 10 * shares[1].download_rate);
+  EXPECT_GT(shares[1].download_rate, 0u);
+  EXPECT_LE(shares[0].download_rate + shares[1].download_rate, 100000u);
+  // Seeds do not download, so they are not limited
+  EXPECT_EQ(shares[2].download_rate, 0u);
+}
+
+TEST(SwarmSchedulerTest, UploadsToStarvedSwarmsFirst) {
+  SwarmScheduler scheduler(0, 100000, 100);
+  std::vector<SwarmShare> shares =
+      scheduler.allocate({swarm(100, 10, true), swarm(1, 40, true)});
+  EXPECT_GT(shares[1].upload_rate, shares[0].upload_rate);
+  EXPECT_GT(shares[0].upload_rate, 0u);
+}
+
+TEST(SwarmSchedulerTest, GivesUnusableSlotsToLargerSwarms) {
+  SwarmScheduler scheduler(0, 0, 100);
+  std::vector<SwarmShare> shares =
+      scheduler.allocate({swarm(3, 0), swarm(60, 60)});
+  EXPECT_EQ(shares[0].max_connections, 3u);
+  EXPECT_EQ(shares[1].max_connections, 97u);
+}
+
+TEST(SwarmSchedulerTest, KeepsSlotsForEveryTorrent) {
+  SwarmScheduler scheduler(0, 0, 100);
+  std::vector<SwarmShare> shares =
+      scheduler.allocate({swarm(1000, 1000), swarm(0, 0), swarm(0, 0, true)});
+  EXPECT_GT(shares[0].max_connections, 90u);
+  // Torrents with an unknown swarm still get to find peers
+  EXPECT_EQ(shares[1].max_connections, MIN_TORRENT_CONNECTIONS);
+  EXPECT_EQ(shares[2].max_connections, MIN_TORRENT_CONNECTIONS);
+  EXPECT_EQ(shares[0].max_connections + shares[1].max_connections +
+                shares[2].max_connections,
+            100u);
+}
+
+TEST(SwarmSchedulerTest, StaysWithinConnectionLimit) {
+  SwarmScheduler scheduler(0, 0, 10);
+  std::vector<SwarmState> torrents(6, swarm(0, 0));
+  torrents.push_back(swarm(1000, 1000));
+  std::vector<SwarmShare> shares = scheduler.allocate(torrents);
+
+  size_t total = 0;
+  for (const SwarmShare &share : shares) {
+    EXPECT_GE(share.max_connections, 1u);
+    total += share.max_connections;
+  }
+  EXPECT_EQ(total, 10u);
+}
+
+TEST(SwarmSchedulerTest, GivesOneSlotEachWhenThereAreTooFew) {
+  SwarmScheduler scheduler(0, 0, 3);
+  std::vector<SwarmShare> shares =
+      scheduler.allocate(std::vector<SwarmState>(5, swarm(10, 10)));
+  for (const SwarmShare &share : shares) {
+    EXPECT_EQ(share.max_connections, 1u);
+  }
+}
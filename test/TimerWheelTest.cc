@@ -0,0 +1,88 @@
+#include "TimerWheel/TimerWheel.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+class TimerWheelTest : public ::testing::Test {
+protected:
+  boost::asio::io_context io_context;
+  // Eight 10 ms slots per level, so 100 ms is on the second level
+  std::shared_ptr<TimerWheel> wheel = std::make_shared<TimerWheel>(
+      io_context.get_executor(), std::chrono::milliseconds(10), 8);
+};
+
+TEST_F(TimerWheelTest, FiresInOrderAndNeverEarly) {
+  std::vector<int> fired;
+  auto start = TimerWheel::Clock::now();
+  TimerWheel::Clock::duration last_elapsed{};
+  for (int delay : {100, 30, 5, 60}) {
+    wheel->arm(std::chrono::milliseconds(delay), [&, delay]() {
+      last_elapsed = TimerWheel::Clock::now() - start;
+      EXPECT_GE(last_elapsed, std::chrono::milliseconds(delay));
+      fired.push_back(delay);
+    });
+  }
+  EXPECT_EQ(wheel->size(), 4u);
+
+  io_context.run(); // Returns once no timer is left
+  EXPECT_EQ(fired, (std::vector<int>{5, 30, 60, 100}));
+  EXPECT_LT(last_elapsed, 1s);
+  EXPECT_EQ(wheel->size(), 0u);
+}
+
+TEST_F(TimerWheelTest, CancelledTimersDoNotFire) {
+  std::vector<int> fired;
+  TimerWheel::TimerId first = wheel->arm(20ms, [&]() { fired.push_back(1); });
+  TimerWheel::TimerId second = wheel->arm(20ms, [&]() { fired.push_back(2); });
+  wheel->arm(20ms, [&]() { fired.push_back(3); });
+  wheel->arm(10ms, [&, second]() { EXPECT_TRUE(wheel->cancel(second)); });
+
+  EXPECT_TRUE(wheel->cancel(first));
+  EXPECT_FALSE(wheel->cancel(first));
+  EXPECT_FALSE(wheel->cancel(0));
+  io_context.run();
+  EXPECT_EQ(fired, (std::vector<int>{3}));
+}
+
+TEST_F(TimerWheelTest, CallbacksCanRearm) {
+  int runs = 0;
+  std::function<void()> again = [&]() {
+    if (++runs < 5) {
+      wheel->arm(10ms, again);
+    }
+  };
+  wheel->arm(0ms, again);
+  io_context.run();
+  EXPECT_EQ(runs, 5);
+}
+
+TEST_F(TimerWheelTest, StopDropsEverything) {
+  bool fired = false;
+  auto guard = std::make_shared<int>();
+  wheel->arm(10ms, [&fired, guard]() { fired = true; });
+  wheel->stop();
+  EXPECT_EQ(guard.use_count(), 1); // The callback was released
+  EXPECT_EQ(wheel->arm(10ms, [&fired]() { fired = true; }), 0u);
+
+  io_context.run();
+  EXPECT_FALSE(fired);
+}
+
+TEST_F(TimerWheelTest, CascadesThroughLevelsAndBeyondTheLast) {
+  // Two levels of four 1 ms slots only reach 16 ms ahead
+  auto small = std::make_shared<TimerWheel>(
+      io_context.get_executor(), std::chrono::milliseconds(1), 4, 2);
+  std::vector<int> fired;
+  auto start = TimerWheel::Clock::now();
+  for (int delay : {45, 3, 17, 9}) {
+    small->arm(std::chrono::milliseconds(delay), [&, delay]() {
+      EXPECT_GE(TimerWheel::Clock::now() - start,
+                std::chrono::milliseconds(delay));
+      fired.push_back(delay);
+    });
+  }
+
+  io_context.run();
+  EXPECT_EQ(fired, (std::vector<int>{3, 9, 17, 45}));
+}
@@ -0,0 +1,78 @@
+#include "TorrentCreator/TorrentCreator.h"
+#include "TorrentParser/TorrentParser.h"
+#include "Utils/utils.h"
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+
+class TorrentCreatorTest : public ::testing::Test {
+protected:
+  std::string root = "creator_test_data";
+  std::vector<std::byte> content; // All files back to back, in path order
+
+  void write_file(const std::string &path, size_t length, int seed) {
+    std::filesystem::create_directories(
+        std::filesystem::path(root + "/" + path).parent_path());
+    std::ofstream file(root + "/" + path, std::ios::binary);
+    for (size_t i = 0; i < length; ++i) {
+      char c = static_cast<char>((i * 31 + seed) % 256);
+      file.put(c);
+      content.push_back(static_cast<std::byte>(c));
+    }
+  }
+
+  void SetUp() override {
+    write_file("a.bin", 40000, 1);
+    write_file("empty.txt", 0, 2);
+    write_file("sub/b.bin", 25000, 3);
+  }
+
+  void TearDown() override {
+    std::filesystem::remove_all(root);
+    remove("creator_test.torrent");
+  }
+};
+
+TEST_F(TorrentCreatorTest, ChoosesPowerOfTwoPieceLength) {
+  EXPECT_EQ(TorrentCreator::choose_piece_length(1000), MIN_AUTO_PIECE_LENGTH);
+  EXPECT_EQ(TorrentCreator::choose_piece_length(10ull << 30), 8 << 20);
+  EXPECT_EQ(TorrentCreator::choose_piece_length(1ull << 50),
+            MAX_AUTO_PIECE_LENGTH);
+}
+
+TEST_F(TorrentCreatorTest, CreatedTorrentParsesBack) {
+  TorrentCreator creator(root + "/", "http://tracker.example/announce");
+  creator.create(3);
+  ASSERT_TRUE(creator.save("creator_test.torrent"));
+  EXPECT_EQ(creator.bytes_hashed(), content.size());
+
+  Torrent parsed = TorrentParser().parse_torrent_file("creator_test.torrent");
+  EXPECT_EQ(parsed.info_hash, creator.torrent().info_hash);
+  EXPECT_EQ(parsed.tracker_url, "http://tracker.example/announce");
+  ASSERT_EQ(parsed.files.size(), 3);
+  EXPECT_EQ(parsed.files[1].path, "empty.txt");
+  EXPECT_EQ(parsed.files[2].path, "sub/b.bin");
+  EXPECT_EQ(parsed.files[2].start_offset, 40000);
+  EXPECT_EQ(parsed.files[2].end_offset, 65000);
+
+  uint32_t piece_length = parsed.piece_length;
+  ASSERT_EQ(parsed.pieces.size(),
+            (content.size() + piece_length - 1) / piece_length);
+  for (size_t i = 0; i < parsed.pieces.size(); ++i) {
+    size_t offset = i * piece_length;
+    size_t size = std::min<size_t>(piece_length, content.size() - offset);
+    EXPECT_EQ(parsed.pieces[i], sha1_digest(content.data() + offset, size));
+  }
+}
+
+TEST_F(TorrentCreatorTest, SingleFileTorrent) {
+  TorrentCreator creator(root + "/a.bin", "http://tracker.example/announce");
+  creator.create(1);
+  ASSERT_TRUE(creator.save("creator_test.torrent"));
+
+  Torrent parsed = TorrentParser().parse_torrent_file("creator_test.torrent");
+  ASSERT_TRUE(parsed.is_single_file());
+  EXPECT_EQ(parsed.files[0].path, "a.bin");
+  EXPECT_EQ(parsed.files[0].length, 40000);
+  EXPECT_EQ(parsed.pieces.size(), 3);
+}
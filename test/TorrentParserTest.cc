@@ -0,0 +1,51 @@
+#include "TorrentParser/TorrentParser.h"
+#include "Utils/utils.h"
+#include <gtest/gtest.h>
+
+TEST(TorrentParserTest, HashesInfoBytesAsWritten) {
+  // Keys out of order, re-encoding the info dict would change its hash
+  std::string info = "d6:pieces20:aaaaaaaaaaaaaaaaaaaa4:name4:file"
+                     "12:piece lengthi16384e6:lengthi100ee";
+  std::string content = "d8:announce9:http://t/4:info" + info + "e";
+
+  Torrent torrent = TorrentParser().parse_torrent(content);
+  EXPECT_EQ(torrent.info_hash,
+            sha1_digest(reinterpret_cast<const std::byte *>(info.data()),
+                        info.size()));
+  EXPECT_EQ(torrent.tracker_url, "http://t/");
+  ASSERT_EQ(torrent.files.size(), 1);
+  EXPECT_EQ(torrent.files[0].path, "file");
+  EXPECT_EQ(torrent.files[0].end_offset, 100);
+  ASSERT_EQ(torrent.pieces.size(), 1);
+  EXPECT_EQ(torrent.pieces[0][19], std::byte{'a'});
+}
+
+TEST(TorrentParserTest, RejectsMalformedTorrents) {
+  TorrentParser parser;
+  EXPECT_THROW(parser.parse_torrent("le"), std::runtime_error);
+  EXPECT_THROW(parser.parse_torrent("d8:announce1:x"), std::runtime_error);
+  EXPECT_THROW(parser.parse_torrent("d8:announce1:xe"), std::runtime_error);
+  EXPECT_THROW(parser.parse_torrent("d8:announce1:x4:infod6:pieces3:abc"
+                                    "4:name1:f12:piece lengthi1e6:lengthi1eee"),
+               std::runtime_error);
+}
+
+TEST(TorrentParserTest, ReadsTrackerTiers) {
+  std::string info = "d6:pieces20:aaaaaaaaaaaaaaaaaaaa4:name4:file"
+                     "12:piece lengthi16384e6:lengthi100ee";
+  std::string content = "d8:announce9:http://t/13:announce-list"
+                        "ll9:http://a/9:http://b/el9:http://c/elee"
+                        "4:info" + info + "e";
+
+  Torrent torrent = TorrentParser().parse_torrent(content);
+  std::vector<std::vector<std::string>> tiers = {
+      {"http://a/", "http://b/"}, {"http://c/"}};
+  EXPECT_EQ(torrent.tracker_tiers, tiers);
+  EXPECT_EQ(torrent.tracker_url, "http://a/");
+
+  // Without announce-list the announce URL forms the only tier
+  content = "d8:announce9:http://t/4:info" + info + "e";
+  torrent = TorrentParser().parse_torrent(content);
+  tiers = {{"http://t/"}};
+  EXPECT_EQ(torrent.tracker_tiers, tiers);
+}
@@ -34,13 +34,36 @@ TEST_F(TorrentTest, TotalPiecesNoPieces) {
 }
 
 TEST_F(TorrentTest, TotalPiecesOnePiece) {
-  torrent.pieces.push_back({});
+  torrent.pieces = PieceHashes(std::vector<InfoHash>(1));
   ASSERT_EQ(1, torrent.total_pieces());
 }
 
 TEST_F(TorrentTest, TotalPiecesMultiplePieces) {
-  torrent.pieces.push_back({});
-  torrent.pieces.push_back({});
-  torrent.pieces.push_back({});
+  torrent.pieces = PieceHashes(std::vector<InfoHash>(3));
   ASSERT_EQ(3, torrent.total_pieces());
 }
+
+TEST_F(TorrentTest, AssignFileOffsetsPlacesFilesBackToBack) {
+  torrent.files.push_back(FileInfo{"a", 300, 0, 0});
+  torrent.files.push_back(FileInfo{"empty", 0, 0, 0});
+  torrent.files.push_back(FileInfo{"b", 200, 0, 0});
+  assign_file_offsets(torrent.files);
+
+  EXPECT_EQ(torrent.files[0].end_offset, 300);
+  EXPECT_EQ(torrent.files[1].start_offset, 300);
+  EXPECT_EQ(torrent.files[1].end_offset, 300);
+  EXPECT_EQ(torrent.files[2].start_offset, 300);
+  EXPECT_EQ(torrent.files[2].end_offset, 500);
+}
+
+TEST_F(TorrentTest, CopiesSharePieceHashes) {
+  std::string raw(40, 'x');
+  raw[20] = 'y';
+  torrent.pieces = PieceHashes(raw);
+  Torrent copy = torrent;
+
+  ASSERT_EQ(copy.total_pieces(), 2);
+  EXPECT_EQ(copy.pieces.data(), torrent.pieces.data());
+  EXPECT_EQ(copy.pieces[1][0], std::byte{'y'});
+  EXPECT_THROW(PieceHashes(std::string(21, 'x')), std::runtime_error);
+}
@@ -0,0 +1,184 @@
+#include "FakeUdpTracker.h"
+#include "TrackerClient/TrackerClient.h"
+#include <future>
+#include <gtest/gtest.h>
+#include <mutex>
+
+TEST(TrackerClientTest, ParsesCompactPeersAndInterval) {
+  // 10.0.0.1:6881 and 192.168.1.2:51413
+  std::string peers("\x0a\x00\x00\x01\x1a\xe1"
+                    "\xc0\xa8\x01\x02\xc8\xd5",
+                    12);
+  TrackerResponse response = parse_tracker_response(
+      "d8:intervali900e5:peers12:" + peers + "e");
+
+  EXPECT_TRUE(response.failure_reason.empty());
+  EXPECT_EQ(response.interval, 900u);
+  ASSERT_EQ(response.peers.size(), 2u);
+  EXPECT_EQ(response.peers[0].endpoint,
+            tcp::endpoint(boost::asio::ip::make_address("10.0.0.1"), 6881));
+  EXPECT_EQ(response.peers[1].endpoint,
+            tcp::endpoint(boost::asio::ip::make_address("192.168.1.2"),
+                          51413));
+}
+
+TEST(TrackerClientTest, ParsesCompactIpv6Peers) {
+  // [2001:db8::1]:6881
+  std::string peers6("\x20\x01\x0d\xb8\x00\x00\x00\x00"
+                     "\x00\x00\x00\x00\x00\x00\x00\x01\x1a\xe1",
+                     18);
+  TrackerResponse response =
+      parse_tracker_response("d5:peers0:6:peers618:" + peers6 + "e");
+
+  ASSERT_EQ(response.peers.size(), 1u);
+  EXPECT_EQ(response.peers[0].endpoint,
+            tcp::endpoint(boost::asio::ip::make_address("2001:db8::1"), 6881));
+  EXPECT_TRUE(response.peers[0].host.empty());
+}
+
+TEST(TrackerClientTest, KeepsHostNamesOfDictionaryPeers) {
+  TrackerResponse response = parse_tracker_response(
+      "d5:peersld2:ip8:10.0.0.74:porti1eed2:ip12:peer.example4:porti2eeee");
+
+  ASSERT_EQ(response.peers.size(), 2u);
+  EXPECT_EQ(response.peers[0].endpoint,
+            tcp::endpoint(boost::asio::ip::make_address("10.0.0.7"), 1));
+  EXPECT_TRUE(response.peers[0].host.empty());
+  EXPECT_EQ(response.peers[1].host, "peer.example");
+  EXPECT_EQ(response.peers[1].endpoint.port(), 2);
+}
+
+TEST(TrackerClientTest, ReportsFailureReason) {
+  TrackerResponse response =
+      parse_tracker_response("d14:failure reason12:unregisterede");
+  EXPECT_EQ(response.failure_reason, "unregistered");
+  EXPECT_EQ(response.interval, 0u);
+  EXPECT_TRUE(response.peers.empty());
+}
+
+TEST(TrackerClientTest, RejectsMalformedResponses) {
+  EXPECT_THROW(parse_tracker_response("<html>"), std::runtime_error);
+}
+
+class TrackerTiersTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    // A silent tracker gives up after 50 + 100 + 200 ms
+    udp_client = std::make_shared<UdpTrackerClient>(
+        io_context, std::chrono::milliseconds(50), 2);
+    http_client = std::make_shared<HttpClient>(io_context);
+    thread = std::thread([this]() { io_context.run(); });
+  }
+
+  void TearDown() override {
+    udp_client->close();
+    http_client->close();
+    work_guard.reset();
+    io_context.stop();
+    thread.join();
+  }
+
+  std::unique_ptr<TrackerClient>
+  make_client(std::vector<std::vector<std::string>> tiers) {
+    auto torrent = std::make_shared<Torrent>();
+    torrent->tracker_url = tiers.front().front();
+    torrent->tracker_tiers = std::move(tiers);
+    torrent->piece_length = 16384;
+    return std::make_unique<TrackerClient>(torrent, http_client, udp_client);
+  }
+
+  /**
+   * @brief Announces and collects what the callbacks receive.
+   */
+  TrackerResponse announce(TrackerClient &client) {
+    auto done = std::make_shared<std::promise<TrackerResponse>>();
+    std::future<TrackerResponse> response = done->get_future();
+    client.announce(
+        TrackerClient::Event::Started,
+        [this](TrackerResponse response) {
+          std::lock_guard<std::mutex> lock(mutex);
+          first_peers_at = std::min(first_peers_at, Clock::now());
+          peers_received += response.peers.size();
+        },
+        [this, done](TrackerResponse response) {
+          done_at = Clock::now();
+          done->set_value(std::move(response));
+        });
+    return response.get();
+  }
+
+  using Clock = std::chrono::steady_clock;
+
+  boost::asio::io_context io_context;
+  boost::asio::executor_work_guard<boost::asio::io_context::executor_type>
+      work_guard{io_context.get_executor()};
+  std::shared_ptr<UdpTrackerClient> udp_client;
+  std::shared_ptr<HttpClient> http_client;
+  std::thread thread;
+
+  std::mutex mutex;
+  Clock::time_point first_peers_at = Clock::time_point::max();
+  Clock::time_point done_at;
+  size_t peers_received = 0;
+};
+
+TEST_F(TrackerTiersTest, AnnouncesToTierInParallel) {
+  FakeUdpTracker dead(1000);
+  FakeUdpTracker live;
+  auto client = make_client({{dead.url(), live.url()}});
+
+  TrackerResponse response = announce(*client);
+  EXPECT_TRUE(response.failure_reason.empty()) << response.failure_reason;
+  EXPECT_EQ(response.peers.size(), 1u);
+
+  // Peers of the live tracker do not wait for the dead one to time out
+  std::lock_guard<std::mutex> lock(mutex);
+  EXPECT_EQ(peers_received, 1u);
+  EXPECT_LT(first_peers_at, done_at);
+  EXPECT_EQ(client->tracker_tiers()[0][0], live.url());
+}
+
+TEST_F(TrackerTiersTest, FailsOverToNextTier) {
+  FakeUdpTracker dead(1000);
+  FakeUdpTracker live;
+  auto client = make_client({{dead.url()}, {live.url()}});
+
+  TrackerResponse response = announce(*client);
+  EXPECT_TRUE(response.failure_reason.empty()) << response.failure_reason;
+  ASSERT_EQ(response.peers.size(), 1u);
+  EXPECT_EQ(response.peers[0].endpoint.address().to_string(), "10.0.0.1");
+}
+
+TEST_F(TrackerTiersTest, MergesAndDeduplicatesPeers) {
+  FakeUdpTracker a(0, {{0x0a000001, 1}, {0x0a000002, 2}});
+  FakeUdpTracker b(0, {{0x0a000002, 2}, {0x0a000003, 3}});
+  auto client = make_client({{a.url(), b.url()}});
+
+  TrackerResponse response = announce(*client);
+  EXPECT_TRUE(response.failure_reason.empty()) << response.failure_reason;
+  EXPECT_EQ(response.peers.size(), 3u);
+  std::lock_guard<std::mutex> lock(mutex);
+  EXPECT_EQ(peers_received, 3u);
+}
+
+TEST_F(TrackerTiersTest, ReportsFailureOfEveryTier) {
+  FakeUdpTracker first(1000);
+  FakeUdpTracker second(1000);
+  auto client = make_client({{first.url()}, {second.url()}});
+
+  TrackerResponse response = announce(*client);
+  EXPECT_NE(response.failure_reason.find(first.url()), std::string::npos);
+  EXPECT_NE(response.failure_reason.find(second.url()), std::string::npos);
+  EXPECT_TRUE(response.peers.empty());
+}
+
+TEST_F(TrackerTiersTest, ScrapesTheTrackerThatLastAnswered) {
+  FakeUdpTracker dead(1000);
+  FakeUdpTracker live;
+  auto client = make_client({{dead.url()}, {live.url()}});
+  EXPECT_EQ(client->scrape_url(), dead.url());
+
+  TrackerResponse response = announce(*client);
+  EXPECT_TRUE(response.failure_reason.empty()) << response.failure_reason;
+  EXPECT_EQ(client->scrape_url(), live.url());
+}
@@ -0,0 +1,125 @@
+#include "FakeUdpTracker.h"
+#include "UdpTrackerClient/UdpTrackerClient.h"
+#include <cstdlib>
+#include <future>
+#include <gtest/gtest.h>
+#include <thread>
+
+class UdpTrackerClientTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    client = std::make_shared<UdpTrackerClient>(
+        io_context, std::chrono::milliseconds(50), 2);
+    thread = std::thread([this]() { io_context.run(); });
+  }
+
+  void TearDown() override {
+    client->close();
+    work_guard.reset();
+    io_context.stop();
+    thread.join();
+  }
+
+  TrackerResponse announce(const std::string &url) {
+    auto done = std::make_shared<std::promise<TrackerResponse>>();
+    std::future<TrackerResponse> response = done->get_future();
+    UdpAnnounce params;
+    params.event = 2;
+    params.port = 6881;
+    client->announce(url, params, [done](TrackerResponse result) {
+      done->set_value(std::move(result));
+    });
+    return response.get();
+  }
+
+  ScrapeResponse scrape(const std::string &url,
+                        std::vector<InfoHash> info_hashes) {
+    auto done = std::make_shared<std::promise<ScrapeResponse>>();
+    std::future<ScrapeResponse> response = done->get_future();
+    client->scrape(url, std::move(info_hashes), [done](ScrapeResponse result) {
+      done->set_value(std::move(result));
+    });
+    return response.get();
+  }
+
+  boost::asio::io_context io_context;
+  boost::asio::executor_work_guard<boost::asio::io_context::executor_type>
+      work_guard{io_context.get_executor()};
+  std::shared_ptr<UdpTrackerClient> client;
+  std::thread thread;
+};
+
+TEST_F(UdpTrackerClientTest, AnnouncesAndCachesConnectionId) {
+  FakeUdpTracker tracker;
+  for (int i = 0; i < 3; ++i) {
+    TrackerResponse response = announce(tracker.url());
+    EXPECT_TRUE(response.failure_reason.empty()) << response.failure_reason;
+    EXPECT_EQ(response.interval, 1200u);
+    EXPECT_EQ(response.seeders, 7u);
+    EXPECT_EQ(response.leechers, 3u);
+    ASSERT_EQ(response.peers.size(), 1u);
+    EXPECT_EQ(response.peers[0].endpoint.address().to_string(), "10.0.0.1");
+    EXPECT_EQ(response.peers[0].endpoint.port(), 6881);
+  }
+  EXPECT_EQ(tracker.connects, 1);
+}
+
+TEST_F(UdpTrackerClientTest, RetransmitsLostPackets) {
+  FakeUdpTracker tracker(2); // Loses the connect and its first retransmission
+  TrackerResponse response = announce(tracker.url());
+  EXPECT_TRUE(response.failure_reason.empty()) << response.failure_reason;
+  EXPECT_EQ(response.peers.size(), 1u);
+}
+
+TEST_F(UdpTrackerClientTest, FailsWhenTrackerNeverAnswers) {
+  FakeUdpTracker tracker(100);
+  auto start = std::chrono::steady_clock::now();
+  TrackerResponse response = announce(tracker.url());
+  auto elapsed = std::chrono::steady_clock::now() - start;
+
+  EXPECT_FALSE(response.failure_reason.empty());
+  // 50 + 100 + 200 ms of backoff before giving up
+  EXPECT_GE(elapsed, std::chrono::milliseconds(350));
+}
+
+TEST_F(UdpTrackerClientTest, ScrapesInBatches) {
+  FakeUdpTracker tracker;
+  std::vector<InfoHash> info_hashes(UDP_SCRAPE_BATCH + 26);
+  for (size_t i = 0; i < info_hashes.size(); ++i) {
+    info_hashes[i][0] = static_cast<std::byte>(i);
+  }
+
+  ScrapeResponse response = scrape(tracker.url(), info_hashes);
+  EXPECT_TRUE(response.failure_reason.empty()) << response.failure_reason;
+  ASSERT_EQ(response.stats.size(), info_hashes.size());
+  for (size_t i = 0; i < info_hashes.size(); ++i) {
+    EXPECT_EQ(response.stats[i].seeders, i);
+    EXPECT_EQ(response.stats[i].completed, 2u);
+    EXPECT_EQ(response.stats[i].leechers, 1u);
+  }
+  EXPECT_EQ(tracker.scrapes, 2);
+  EXPECT_EQ(tracker.connects, 1);
+}
+
+TEST_F(UdpTrackerClientTest, RejectsInvalidUrls) {
+  EXPECT_FALSE(announce("udp://no-port/announce").failure_reason.empty());
+  EXPECT_FALSE(announce("http://127.0.0.1:80/").failure_reason.empty());
+}
+
+// Runs against a real tracker, such as the opentracker container from
+// local_test/docker-compose.yml:
+//   YATC_UDP_TRACKER=udp://127.0.0.1:6969/announce ./test_exec
+TEST_F(UdpTrackerClientTest, TalksToTrackerFromEnvironment) {
+  const char *url = std::getenv("YATC_UDP_TRACKER");
+  if (url == nullptr) {
+    GTEST_SKIP() << "YATC_UDP_TRACKER is not set";
+  }
+
+  TrackerResponse response = announce(url);
+  EXPECT_TRUE(response.failure_reason.empty()) << response.failure_reason;
+  EXPECT_GT(response.interval, 0u);
+
+  ScrapeResponse stats = scrape(url, {InfoHash{}, InfoHash{std::byte{1}}});
+  EXPECT_TRUE(stats.failure_reason.empty()) << stats.failure_reason;
+  EXPECT_EQ(stats.stats.size(), 2u);
+}